@@ -0,0 +1,346 @@
+#include "bound_matrix.h"
+#include "../../utils/global_defs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+/* largest code of the quantized encoding */
+#define QUANTIZED_MAX_CODE UINT16_C(65535)
+
+/* the quantized codes leave room for an accumulated drift of max_value / QUANTIZED_DRIFT_ROOM */
+#define QUANTIZED_DRIFT_ROOM 16
+
+/* round value down to the next float */
+static float encode_float(VALUE_TYPE value) {
+    float f;
+
+    if (value >= FLT_MAX) return FLT_MAX;
+    if (value <= -FLT_MAX) return -FLT_MAX;
+
+    f = (float) value;
+    if ((VALUE_TYPE) f > value) f = nextafterf(f, -FLT_MAX);
+    return f;
+}
+
+/* round value down to the next c * scale - drift */
+static uint16_t encode_quantized(struct bound_matrix* m, VALUE_TYPE drift, VALUE_TYPE value) {
+    VALUE_TYPE code;
+    uint16_t c;
+
+    if (value <= 0) return 0;
+    if (value > m->max_value) value = m->max_value;
+
+    code = (value + drift) / m->scale;
+    if (code >= QUANTIZED_MAX_CODE) return QUANTIZED_MAX_CODE;
+
+    c = (uint16_t) code;
+    if (c > 0 && c * m->scale - drift > value) c--;
+    return c;
+}
+
+static VALUE_TYPE decode_quantized(struct bound_matrix* m, VALUE_TYPE drift, uint16_t c) {
+    VALUE_TYPE value;
+
+    value = c * m->scale - drift;
+    return (value > 0) ? value : 0;
+}
+
+void initialize_bound_matrix(struct bound_matrix* m
+                             , uint64_t no_rows
+                             , uint64_t no_cols
+                             , uint32_t encoding
+                             , VALUE_TYPE max_value
+                             , uint64_t* row_starts
+                             , uint64_t no_ranges) {
+    uintptr_t start;
+    uint64_t r, row_size;
+
+    m->no_rows = no_rows;
+    m->no_cols = no_cols;
+    m->encoding = encoding;
+
+    /* float is the native type with FCL_SINGLE_PRECISION */
+    if (encoding == BOUND_ENCODING_FLOAT && sizeof(VALUE_TYPE) == sizeof(float)) {
+        m->encoding = BOUND_ENCODING_NATIVE;
+    }
+
+    m->max_value = (max_value > 0) ? max_value : 1;
+    m->scale = (m->max_value + m->max_value / QUANTIZED_DRIFT_ROOM) / QUANTIZED_MAX_CODE;
+    m->drift = NULL;
+    if (m->encoding == BOUND_ENCODING_QUANTIZED) {
+        m->drift = (VALUE_TYPE*) calloc(no_cols, sizeof(VALUE_TYPE));
+    }
+
+    m->raw = malloc(no_rows * no_cols * bound_matrix_entry_size(m) + BOUND_MATRIX_ALIGNMENT);
+    start = (uintptr_t) m->raw;
+    start = (start + BOUND_MATRIX_ALIGNMENT - 1) & ~((uintptr_t) BOUND_MATRIX_ALIGNMENT - 1);
+    m->data = (void*) start;
+
+    /* rows are placed on the node of the thread which processes them */
+    row_size = no_cols * bound_matrix_entry_size(m);
+    #pragma omp parallel for schedule(static, 1)
+    for (r = 0; r < no_ranges; r++) {
+        memset((char*) m->data + row_starts[r] * row_size, 0, (row_starts[r + 1] - row_starts[r]) * row_size);
+    }
+}
+
+size_t bound_matrix_entry_size(struct bound_matrix* m) {
+    switch (m->encoding) {
+        case BOUND_ENCODING_FLOAT:
+            return sizeof(float);
+        case BOUND_ENCODING_QUANTIZED:
+            return sizeof(uint16_t);
+        default:
+            return sizeof(VALUE_TYPE);
+    }
+}
+
+VALUE_TYPE bound_matrix_get(struct bound_matrix* m, uint64_t row, uint64_t col) {
+    uint64_t pos;
+
+    pos = row * m->no_cols + col;
+    switch (m->encoding) {
+        case BOUND_ENCODING_FLOAT:
+            return ((float*) m->data)[pos];
+        case BOUND_ENCODING_QUANTIZED:
+            return decode_quantized(m, m->drift[col], ((uint16_t*) m->data)[pos]);
+        default:
+            return ((VALUE_TYPE*) m->data)[pos];
+    }
+}
+
+void bound_matrix_set(struct bound_matrix* m, uint64_t row, uint64_t col, VALUE_TYPE value) {
+    uint64_t pos;
+
+    pos = row * m->no_cols + col;
+    switch (m->encoding) {
+        case BOUND_ENCODING_FLOAT:
+            ((float*) m->data)[pos] = encode_float(value);
+            break;
+        case BOUND_ENCODING_QUANTIZED:
+            ((uint16_t*) m->data)[pos] = encode_quantized(m, m->drift[col], value);
+            break;
+        default:
+            ((VALUE_TYPE*) m->data)[pos] = value;
+            break;
+    }
+}
+
+void bound_matrix_load_row(struct bound_matrix* m, uint64_t row, VALUE_TYPE* values) {
+    uint64_t j;
+
+    for (j = 0; j < m->no_cols; j++) {
+        values[j] = bound_matrix_get(m, row, j);
+    }
+}
+
+void bound_matrix_store_row(struct bound_matrix* m, uint64_t row, VALUE_TYPE* values) {
+    uint64_t j;
+
+    for (j = 0; j < m->no_cols; j++) {
+        bound_matrix_set(m, row, j, values[j]);
+    }
+}
+
+void bound_matrix_fill(struct bound_matrix* m, VALUE_TYPE value) {
+    uint64_t i;
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < m->no_rows; i++) {
+        uint64_t j;
+        for (j = 0; j < m->no_cols; j++) {
+            bound_matrix_set(m, i, j, value);
+        }
+    }
+}
+
+void bound_matrix_load_row_drift(struct bound_matrix* m
+                                 , uint64_t row
+                                 , VALUE_TYPE* drift
+                                 , VALUE_TYPE* before
+                                 , VALUE_TYPE* after) {
+    uint64_t j;
+    uint16_t* codes;
+
+    if (m->encoding == BOUND_ENCODING_QUANTIZED) {
+        /* the accumulated drift already contains drift */
+        codes = ((uint16_t*) m->data) + row * m->no_cols;
+        for (j = 0; j < m->no_cols; j++) {
+            before[j] = decode_quantized(m, m->drift[j] - drift[j], codes[j]);
+        }
+    } else {
+        bound_matrix_load_row(m, row, before);
+    }
+
+    for (j = 0; j < m->no_cols; j++) {
+        after[j] = before[j] - drift[j];
+    }
+}
+
+void bound_matrix_add_drift(struct bound_matrix* m, VALUE_TYPE* drift) {
+    uint64_t i, j;
+    VALUE_TYPE old_drift;
+
+    if (m->encoding != BOUND_ENCODING_QUANTIZED) return;
+
+    for (j = 0; j < m->no_cols; j++) {
+        old_drift = m->drift[j];
+        m->drift[j] += drift[j];
+        if (m->drift[j] <= m->max_value / QUANTIZED_DRIFT_ROOM || old_drift == 0) continue;
+
+        /* no room left for more drift: rounds down every bound of the column once
+         * to drop the old drift. the codes then represent the bounds before this drift
+         * like all other columns (see bound_matrix_load_row_drift).
+         */
+        m->drift[j] = drift[j];
+
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < m->no_rows; i++) {
+            uint16_t* code;
+            code = ((uint16_t*) m->data) + i * m->no_cols + j;
+            *code = encode_quantized(m, 0, decode_quantized(m, old_drift, *code));
+        }
+    }
+}
+
+/* row[j] = max(row[j] - drift[j], 0) for j in [start, end), returns the minimum of the new values */
+static VALUE_TYPE subtract_drift_range(VALUE_TYPE* row
+                                       , VALUE_TYPE* drift
+                                       , uint64_t start
+                                       , uint64_t end) {
+    uint64_t j;
+    VALUE_TYPE lb, min_lb;
+
+    min_lb = VALUE_TYPE_MAX;
+    #pragma omp simd reduction(min:min_lb) private(lb)
+    for (j = start; j < end; j++) {
+        lb = row[j] - drift[j];
+        lb = (lb > 0) ? lb : 0;
+        row[j] = lb;
+        min_lb = (lb < min_lb) ? lb : min_lb;
+    }
+
+    return min_lb;
+}
+
+/* same as subtract_drift_range without changing row */
+static VALUE_TYPE min_drift_range(VALUE_TYPE* row
+                                  , VALUE_TYPE* drift
+                                  , uint64_t start
+                                  , uint64_t end) {
+    uint64_t j;
+    VALUE_TYPE lb, min_lb;
+
+    min_lb = VALUE_TYPE_MAX;
+    #pragma omp simd reduction(min:min_lb) private(lb)
+    for (j = start; j < end; j++) {
+        lb = row[j] - drift[j];
+        lb = (lb > 0) ? lb : 0;
+        min_lb = (lb < min_lb) ? lb : min_lb;
+    }
+
+    return min_lb;
+}
+
+/* same as subtract_drift_range for float bounds, stores only if store is set */
+static VALUE_TYPE subtract_drift_range_float(float* row
+                                             , VALUE_TYPE* drift
+                                             , uint64_t start
+                                             , uint64_t end
+                                             , uint32_t store) {
+    uint64_t j;
+    VALUE_TYPE lb, min_lb;
+
+    min_lb = VALUE_TYPE_MAX;
+    for (j = start; j < end; j++) {
+        lb = row[j] - drift[j];
+        lb = (lb > 0) ? lb : 0;
+        if (store) row[j] = encode_float(lb);
+        min_lb = (lb < min_lb) ? lb : min_lb;
+    }
+
+    return min_lb;
+}
+
+/* minimum of the decoded bounds in [start, end), the drift is part of the decoding */
+static VALUE_TYPE min_quantized_range(struct bound_matrix* m
+                                      , uint16_t* row
+                                      , uint64_t start
+                                      , uint64_t end) {
+    uint64_t j;
+    VALUE_TYPE lb, min_lb, scale, *drift;
+
+    scale = m->scale;
+    drift = m->drift;
+    min_lb = VALUE_TYPE_MAX;
+    #pragma omp simd reduction(min:min_lb) private(lb)
+    for (j = start; j < end; j++) {
+        lb = row[j] * scale - drift[j];
+        lb = (lb > 0) ? lb : 0;
+        min_lb = (lb < min_lb) ? lb : min_lb;
+    }
+
+    return min_lb;
+}
+
+VALUE_TYPE bound_matrix_subtract_drift_row(struct bound_matrix* m
+                                           , uint64_t row
+                                           , VALUE_TYPE* drift
+                                           , uint64_t exclude_col
+                                           , uint32_t store) {
+    uint64_t split;
+    VALUE_TYPE min_lb, min_lb_after;
+
+    /* the excluded column is updated but not part of the minimum */
+    split = (exclude_col < m->no_cols) ? exclude_col : m->no_cols;
+
+    switch (m->encoding) {
+        case BOUND_ENCODING_FLOAT:
+        {
+            float* values;
+            values = ((float*) m->data) + row * m->no_cols;
+            min_lb = subtract_drift_range_float(values, drift, 0, split, store);
+            if (split == m->no_cols) return min_lb;
+            min_lb_after = subtract_drift_range_float(values, drift, split + 1, m->no_cols, store);
+            subtract_drift_range_float(values, drift, split, split + 1, store);
+            break;
+        }
+        case BOUND_ENCODING_QUANTIZED:
+        {
+            uint16_t* codes;
+            codes = ((uint16_t*) m->data) + row * m->no_cols;
+            min_lb = min_quantized_range(m, codes, 0, split);
+            if (split == m->no_cols) return min_lb;
+            min_lb_after = min_quantized_range(m, codes, split + 1, m->no_cols);
+            break;
+        }
+        default:
+        {
+            VALUE_TYPE* values;
+            values = ((VALUE_TYPE*) m->data) + row * m->no_cols;
+
+            if (!store) {
+                min_lb = min_drift_range(values, drift, 0, split);
+                if (split == m->no_cols) return min_lb;
+                min_lb_after = min_drift_range(values, drift, split + 1, m->no_cols);
+                break;
+            }
+
+            min_lb = subtract_drift_range(values, drift, 0, split);
+            if (split == m->no_cols) return min_lb;
+            min_lb_after = subtract_drift_range(values, drift, split + 1, m->no_cols);
+            subtract_drift_range(values, drift, split, split + 1);
+            break;
+        }
+    }
+
+    return (min_lb_after < min_lb) ? min_lb_after : min_lb;
+}
+
+void free_bound_matrix(struct bound_matrix* m) {
+    free_null(m->raw);
+    free_null(m->drift);
+    m->data = NULL;
+}
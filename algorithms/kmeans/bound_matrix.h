@@ -0,0 +1,183 @@
+#ifndef BOUND_MATRIX_H
+#define BOUND_MATRIX_H
+
+#include <stddef.h>
+#include "../../utils/types.h"
+
+/* lower bounds are stored as VALUE_TYPE */
+#define BOUND_ENCODING_NATIVE    UINT32_C(0)
+
+/* lower bounds are stored as float (same as native with FCL_SINGLE_PRECISION) */
+#define BOUND_ENCODING_FLOAT     UINT32_C(1)
+
+/* lower bounds are stored as 16 bit fixed point values code * scale */
+#define BOUND_ENCODING_QUANTIZED UINT32_C(2)
+
+#define NO_BOUND_ENCODINGS UINT32_C(3)
+
+/* alignment in bytes of the bound storage */
+#define BOUND_MATRIX_ALIGNMENT 64
+
+/**
+ * @brief Dense row major matrix of lower bounds (e.g. one row per sample and
+ *        one column per cluster or group) stored in one contiguous aligned block.
+ *
+ * Every value is rounded down when it gets encoded. A value read back is
+ * therefore never larger than the value that was written, so lower bounds stay
+ * valid with every encoding (they only get less tight).
+ *
+ * The quantized encoding does not re-encode the bounds when they are lowered by
+ * the drift of their column. The drift is accumulated per column instead and
+ * subtracted when a bound is decoded, so a bound is rounded down only once when
+ * it is written and not once per iteration.
+ */
+struct bound_matrix {
+    uint64_t no_rows;      /**< Number of rows */
+    uint64_t no_cols;      /**< Number of columns */
+    uint32_t encoding;     /**< One of BOUND_ENCODING_* */
+    VALUE_TYPE scale;      /**< Quantized encoding: a code c represents c * scale - drift[col] */
+    VALUE_TYPE max_value;  /**< Quantized encoding: larger values are stored as max_value */
+    VALUE_TYPE *drift;     /**< Quantized encoding: drift accumulated per column (else NULL) */
+    void *data;            /**< Start of the no_rows * no_cols entries (aligned) */
+    void *raw;             /**< Allocation data points into */
+};
+
+/**
+ * @brief Allocate a bound matrix with all bounds set to 0.
+ *
+ * @param[out] m The matrix to initialize.
+ * @param[in] no_rows Number of rows.
+ * @param[in] no_cols Number of columns.
+ * @param[in] encoding One of BOUND_ENCODING_*.
+ * @param[in] max_value Largest value which needs to be represented exactly enough.
+ *                      Only used by the quantized encoding, larger values
+ *                      are stored as max_value.
+ * @param[in] row_starts Array of no_ranges + 1 ascending rows (row_starts[no_ranges] = no_rows).
+ *                       The rows of range r are zeroed (and with the first touch
+ *                       policy placed) by the thread which gets iteration r of a
+ *                       "#pragma omp parallel for schedule(static, 1)" loop.
+ * @param[in] no_ranges Number of ranges.
+ */
+void initialize_bound_matrix(struct bound_matrix* m
+                             , uint64_t no_rows
+                             , uint64_t no_cols
+                             , uint32_t encoding
+                             , VALUE_TYPE max_value
+                             , uint64_t* row_starts
+                             , uint64_t no_ranges);
+
+/**
+ * @brief Number of bytes needed to store one bound.
+ *
+ * @param[in] m The bound matrix.
+ * @return Size of one entry in bytes.
+ */
+size_t bound_matrix_entry_size(struct bound_matrix* m);
+
+/**
+ * @brief Read one bound.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row of the bound.
+ * @param[in] col Column of the bound.
+ * @return The stored bound (<= the value that was written).
+ */
+VALUE_TYPE bound_matrix_get(struct bound_matrix* m, uint64_t row, uint64_t col);
+
+/**
+ * @brief Write one bound. The value is rounded down to the next value the
+ *        encoding can represent.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row of the bound.
+ * @param[in] col Column of the bound.
+ * @param[in] value The new bound.
+ */
+void bound_matrix_set(struct bound_matrix* m, uint64_t row, uint64_t col, VALUE_TYPE value);
+
+/**
+ * @brief Decode a complete row.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row to read.
+ * @param[out] values Array of no_cols values.
+ */
+void bound_matrix_load_row(struct bound_matrix* m, uint64_t row, VALUE_TYPE* values);
+
+/**
+ * @brief Encode a complete row.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row to write.
+ * @param[in] values Array of no_cols values.
+ */
+void bound_matrix_store_row(struct bound_matrix* m, uint64_t row, VALUE_TYPE* values);
+
+/**
+ * @brief Set every bound of the matrix to value.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] value The new value of all bounds.
+ */
+void bound_matrix_fill(struct bound_matrix* m, VALUE_TYPE value);
+
+/**
+ * @brief Decode a complete row as it was before the last bound_matrix_add_drift
+ *        and lowered by that drift.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row to read. Must not have been written since bound_matrix_add_drift.
+ * @param[in] drift Array of no_cols values which was passed to bound_matrix_add_drift.
+ * @param[out] before Array of no_cols values, receives the bounds before the drift.
+ * @param[out] after Array of no_cols values, receives before - drift (not limited to 0).
+ */
+void bound_matrix_load_row_drift(struct bound_matrix* m
+                                 , uint64_t row
+                                 , VALUE_TYPE* drift
+                                 , VALUE_TYPE* before
+                                 , VALUE_TYPE* after);
+
+/**
+ * @brief Account for the drift of every column before the rows are updated with
+ *        bound_matrix_subtract_drift_row.
+ *
+ * Only the quantized encoding does something here: it adds the drift to the
+ * accumulated drift of the columns (which lowers all bounds at once). A column
+ * whose accumulated drift gets too large for the codes is encoded again without it.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] drift Array of no_cols values (0 for columns which do not change).
+ */
+void bound_matrix_add_drift(struct bound_matrix* m, VALUE_TYPE* drift);
+
+/**
+ * @brief Lower every bound of a row by the drift of its column (bounds do not
+ *        drop below 0) and return the smallest lowered bound.
+ *
+ * Has to be called after bound_matrix_add_drift with the same drift. The native
+ * encoding works on the contiguous row with a vectorized min reduction, the
+ * other encodings with loops over their storage type. With the quantized
+ * encoding the row itself is never changed since the drift was already
+ * accounted for by bound_matrix_add_drift.
+ *
+ * @param[in] m The bound matrix.
+ * @param[in] row Row to update.
+ * @param[in] drift Array of no_cols values (0 for columns which do not change).
+ * @param[in] exclude_col Column which is ignored for the minimum (no_cols = none).
+ * @param[in] store If 0 the row is left unchanged and only the minimum is computed.
+ * @return Minimum of the lowered bounds (VALUE_TYPE_MAX if there is none).
+ */
+VALUE_TYPE bound_matrix_subtract_drift_row(struct bound_matrix* m
+                                           , uint64_t row
+                                           , VALUE_TYPE* drift
+                                           , uint64_t exclude_col
+                                           , uint32_t store);
+
+/**
+ * @brief Free the storage of a bound matrix.
+ *
+ * @param[in] m The bound matrix.
+ */
+void free_bound_matrix(struct bound_matrix* m);
+
+#endif
@@ -0,0 +1,205 @@
+#include "coreset.h"
+#include "../../utils/matrix/csr_matrix/csr_assign.h"
+#include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_time.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_sample_ids(const void *a, const void *b) {
+    uint64_t da = *((const uint64_t*) a);
+    uint64_t db = *((const uint64_t*) b);
+    return (da > db) - (da < db);
+}
+
+/* uniform random number in [0, 1) with a finer resolution than a single rand_r */
+static ACCUMULATOR_TYPE random_uniform(uint32_t* seed) {
+    ACCUMULATOR_TYPE rand_range;
+
+    rand_range = (ACCUMULATOR_TYPE) RAND_MAX + 1;
+    return ((ACCUMULATOR_TYPE) rand_r(seed)
+            + (ACCUMULATOR_TYPE) rand_r(seed) / rand_range) / rand_range;
+}
+
+uint64_t create_coreset(struct csr_matrix* samples
+                        , VALUE_TYPE* sample_weights
+                        , uint64_t no_draws
+                        , uint32_t* seed
+                        , uint64_t** coreset_samples
+                        , VALUE_TYPE** coreset_weights) {
+    uint64_t i, j, no_coreset_samples;
+    uint64_t* draws;
+    ACCUMULATOR_TYPE* mean;             /* weighted mean of all samples (dense) */
+    ACCUMULATOR_TYPE* costs;            /* w(x) * d(x, mean)² for every sample */
+    ACCUMULATOR_TYPE* cumulative;       /* prefix sums of the sampling probabilities */
+    ACCUMULATOR_TYPE total_weight, total_cost, mean_length, q, w;
+
+    mean = (ACCUMULATOR_TYPE*) calloc(samples->dim, sizeof(ACCUMULATOR_TYPE));
+    total_weight = 0;
+    for (i = 0; i < samples->sample_count; i++) {
+        w = (sample_weights == NULL) ? 1 : sample_weights[i];
+        total_weight += w;
+        for (j = samples->pointers[i]; j < samples->pointers[i + 1]; j++) {
+            mean[samples->keys[j]] += w * samples->values[j];
+        }
+    }
+
+    mean_length = 0;
+    for (j = 0; j < samples->dim; j++) {
+        mean[j] /= total_weight;
+        mean_length += mean[j] * mean[j];
+    }
+
+    /* d(x, mean)² = ||x||² - 2 <x, mean> + ||mean||² */
+    costs = (ACCUMULATOR_TYPE*) calloc(samples->sample_count, sizeof(ACCUMULATOR_TYPE));
+    total_cost = 0;
+    #pragma omp parallel for reduction(+:total_cost)
+    for (i = 0; i < samples->sample_count; i++) {
+        uint64_t k;
+        ACCUMULATOR_TYPE dot, length, dist;
+
+        dot = 0;
+        length = 0;
+        for (k = samples->pointers[i]; k < samples->pointers[i + 1]; k++) {
+            dot += samples->values[k] * mean[samples->keys[k]];
+            length += samples->values[k] * samples->values[k];
+        }
+
+        dist = length - 2 * dot + mean_length;
+        if (dist < 0) dist = 0;
+
+        costs[i] = ((sample_weights == NULL) ? 1 : sample_weights[i]) * dist;
+        total_cost += costs[i];
+    }
+
+    /* q(x) = 1/2 * w(x) / W + 1/2 * cost(x) / sum(cost). all samples equal
+     * the mean if sum(cost) is 0, then only the weights are used.
+     */
+    cumulative = (ACCUMULATOR_TYPE*) calloc(samples->sample_count, sizeof(ACCUMULATOR_TYPE));
+    for (i = 0; i < samples->sample_count; i++) {
+        w = (sample_weights == NULL) ? 1 : sample_weights[i];
+        if (total_cost > 0) {
+            q = 0.5 * w / total_weight + 0.5 * costs[i] / total_cost;
+        } else {
+            q = w / total_weight;
+        }
+        costs[i] = q;
+        cumulative[i] = ((i == 0) ? 0 : cumulative[i - 1]) + q;
+    }
+
+    /* draw with replacement: the first sample whose prefix sum exceeds a uniform number */
+    draws = (uint64_t*) calloc(no_draws, sizeof(uint64_t));
+    for (i = 0; i < no_draws; i++) {
+        uint64_t low, high, mid;
+        ACCUMULATOR_TYPE r;
+
+        r = random_uniform(seed) * cumulative[samples->sample_count - 1];
+        low = 0;
+        high = samples->sample_count - 1;
+        while (low < high) {
+            mid = low + (high - low) / 2;
+            if (cumulative[mid] > r) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        draws[i] = low;
+    }
+
+    /* merge samples which were drawn multiple times */
+    qsort(draws, no_draws, sizeof(uint64_t), compare_sample_ids);
+
+    *coreset_samples = (uint64_t*) calloc(no_draws, sizeof(uint64_t));
+    *coreset_weights = (VALUE_TYPE*) calloc(no_draws, sizeof(VALUE_TYPE));
+    no_coreset_samples = 0;
+    for (i = 0; i < no_draws; i = j) {
+        for (j = i; j < no_draws && draws[j] == draws[i]; j++);
+
+        w = (sample_weights == NULL) ? 1 : sample_weights[draws[i]];
+        (*coreset_samples)[no_coreset_samples] = draws[i];
+        (*coreset_weights)[no_coreset_samples] = (j - i) * w / (no_draws * costs[draws[i]]);
+        no_coreset_samples += 1;
+    }
+
+    free_null(draws);
+    free_null(cumulative);
+    free_null(costs);
+    free_null(mean);
+
+    return no_coreset_samples;
+}
+
+struct kmeans_result* coreset_kmeans(struct csr_matrix* samples, struct kmeans_params *prms) {
+    uint64_t i;
+    uint64_t no_coreset_samples;
+    uint64_t* coreset_samples;          /* sample ids of the coreset */
+    VALUE_TYPE* coreset_weights;        /* weight of every sample in the coreset */
+    VALUE_TYPE* input_weights;
+    VALUE_TYPE wcssd;
+    struct csr_matrix* coreset;
+    struct kmeans_result* res;
+    struct assign_result assign_res;
+    struct timeval tm_start;
+
+    if (prms->init_id == KMEANS_INIT_PARAMS) {
+        if (prms->verbose) LOG_ERROR("Unable to cluster a coreset since init_params refer to all samples. Clustering all samples instead!");
+        return KMEANS_ALGORITHM_FUNCTIONS[prms->kmeans_algorithm_id](samples, prms);
+    }
+
+    if (prms->coreset_size >= samples->sample_count) {
+        if (prms->verbose) LOG_INFO("coreset_size >= number of samples. Clustering all samples instead!");
+        return KMEANS_ALGORITHM_FUNCTIONS[prms->kmeans_algorithm_id](samples, prms);
+    }
+
+    gettimeofday(&tm_start, NULL);
+
+    no_coreset_samples = create_coreset(samples
+                                        , prms->sample_weights
+                                        , prms->coreset_size
+                                        , &(prms->seed)
+                                        , &coreset_samples
+                                        , &coreset_weights);
+    coreset = create_csr_matrix_from_rows(samples, coreset_samples, no_coreset_samples);
+
+    d_add_subint(&(prms->tr), "coreset", "size", prms->coreset_size);
+    d_add_subint(&(prms->tr), "coreset", "no_samples", no_coreset_samples);
+    d_add_subfloat(&(prms->tr), "coreset", "duration_create", (VALUE_TYPE) get_diff_in_microseconds(tm_start));
+    if (prms->verbose) LOG_INFO("Created coreset with %" PRINTF_INT64_MODIFIER "u samples out of %" PRINTF_INT64_MODIFIER "u"
+                                , no_coreset_samples
+                                , samples->sample_count);
+
+    /* cluster the coreset with the coreset weights */
+    input_weights = prms->sample_weights;
+    prms->sample_weights = coreset_weights;
+    res = KMEANS_ALGORITHM_FUNCTIONS[prms->kmeans_algorithm_id](coreset, prms);
+    prms->sample_weights = input_weights;
+
+    /* the initial clusters were samples of the coreset */
+    for (i = 0; i < res->initprms->len_initial_cluster_samples; i++) {
+        res->initprms->initial_cluster_samples[i] = coreset_samples[res->initprms->initial_cluster_samples[i]];
+    }
+
+    /* assign all samples to the clusters of the coreset */
+    gettimeofday(&tm_start, NULL);
+    assign_res = assign_weighted(samples, res->clusters, input_weights, &(prms->stop));
+    wcssd = assign_res.wcssd;
+
+    free_null(res->initprms->assignments);
+    res->initprms->assignments = assign_res.assignments;
+    res->initprms->len_assignments = assign_res.len_assignments;
+    assign_res.assignments = NULL;
+
+    d_add_subfloat(&(prms->tr), "coreset", "wcssd_input_samples", wcssd);
+    d_add_subfloat(&(prms->tr), "coreset", "duration_assign", (VALUE_TYPE) get_diff_in_microseconds(tm_start));
+    if (prms->verbose) LOG_INFO("wcssd of all samples with the clusters of the coreset = %f", wcssd);
+
+    free_assign_result(&assign_res);
+    free_csr_matrix(coreset);
+    free_null(coreset);
+    free_null(coreset_samples);
+    free_null(coreset_weights);
+
+    return res;
+}
@@ -0,0 +1,44 @@
+#ifndef CORESET_H
+#define CORESET_H
+
+#include "kmeans_control.h"
+
+/**
+ * @brief Sample a weighted coreset of a matrix with lightweight sensitivity sampling.
+ *
+ * Every sample x is drawn with probability
+ * q(x) = 1/2 * w(x) / W + 1/2 * w(x) * d(x, mean)² / sum(w(y) * d(y, mean)²)
+ * where w are the input weights and W their sum. Every draw gets the weight
+ * w(x) / (no_draws * q(x)). Samples which are drawn multiple times appear only
+ * once in the coreset with the sum of the weights of their draws.
+ *
+ * @param[in] samples Matrix to sample the coreset from.
+ * @param[in] sample_weights Weight of every sample (NULL = every sample has weight 1).
+ * @param[in] no_draws Number of draws (with replacement).
+ * @param[in] seed The seed used for the random number generator.
+ * @param[out] coreset_samples Sorted sample ids of the coreset (free it with free).
+ * @param[out] coreset_weights Weight of every sample in coreset_samples (free it with free).
+ * @return Number of samples in the coreset (<= no_draws).
+ */
+uint64_t create_coreset(struct csr_matrix* samples
+                        , VALUE_TYPE* sample_weights
+                        , uint64_t no_draws
+                        , uint32_t* seed
+                        , uint64_t** coreset_samples
+                        , VALUE_TYPE** coreset_weights);
+
+/**
+ * @brief Cluster a weighted coreset of prms->coreset_size samples with the
+ *        algorithm prms->kmeans_algorithm_id instead of all samples.
+ *
+ * The resulting clusters are assigned to all samples afterwards so the
+ * assignments of the result refer to samples. If the coreset would not be
+ * smaller than samples the algorithm runs on samples directly.
+ *
+ * @param samples which shall be clustered
+ * @param prms are the parameters to control the clustering
+ * @return
+ */
+struct kmeans_result* coreset_kmeans(struct csr_matrix* samples, struct kmeans_params *prms);
+
+#endif
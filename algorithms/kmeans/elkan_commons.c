@@ -10,15 +10,11 @@ void calculate_cluster_distance_matrix(struct general_kmeans_context* ctx
     uint64_t j;
     VALUE_TYPE dist_eval;
 
-    #pragma omp parallel for
-    for(i = 0; i < ctx->no_clusters; i++) {
-        /* reset min_dist_cluster_clusters */
-        min_dist_cluster_clusters[i] = VALUE_TYPE_MAX;
-    }
-
     /* evaluate block vector approximation. */
-    #pragma omp parallel for private(j)
+    #pragma omp parallel for schedule(dynamic, 1) private(j)
     for(i = 0; i < ctx->no_clusters; i++) {
+        struct kmeans_thread_stats* stats;
+        stats = get_thread_stats(ctx);
         if (*stop) continue;
 
         if (omp_get_thread_num() == 0) check_signals(stop);
@@ -27,7 +23,15 @@ void calculate_cluster_distance_matrix(struct general_kmeans_context* ctx
             if (i > j) {
                 if (!(ctx->clusters_not_changed[i] && ctx->clusters_not_changed[j])) {
                     /* if none of the two clusters moved, dont recalculate the distance */
-                    dist_clusters_clusters[i][j] = euclid_vector( ctx->cluster_vectors[i].keys
+                    if (ctx->dense_cluster_vectors) {
+                        dist_clusters_clusters[i][j] = euclid_vector_sparse_dense(ctx->cluster_vectors[i].keys
+                                                                , ctx->cluster_vectors[i].values
+                                                                , ctx->cluster_vectors[i].nnz
+                                                                , get_dense_cluster_vectors(ctx) + j * ctx->samples->dim
+                                                                , ctx->vector_lengths_clusters[i]
+                                                                , ctx->vector_lengths_clusters[j]);
+                    } else {
+                        dist_clusters_clusters[i][j] = euclid_vector( ctx->cluster_vectors[i].keys
                                                                 , ctx->cluster_vectors[i].values
                                                                 , ctx->cluster_vectors[i].nnz
                                                                 , ctx->cluster_vectors[j].keys
@@ -35,14 +39,153 @@ void calculate_cluster_distance_matrix(struct general_kmeans_context* ctx
                                                                 , ctx->cluster_vectors[j].nnz
                                                                 , ctx->vector_lengths_clusters[i]
                                                                 , ctx->vector_lengths_clusters[j]);
-                    ctx->done_calculations += 1;
+                    }
+                    stats->done_calculations += 1;
                 }
 
                 dist_clusters_clusters[j][i] = dist_clusters_clusters[i][j];
-                dist_eval = 0.5 * dist_clusters_clusters[i][j];
-                min_dist_cluster_clusters[i] = (dist_eval < min_dist_cluster_clusters[i]) ? dist_eval : min_dist_cluster_clusters[i];
-                min_dist_cluster_clusters[j] = (dist_eval < min_dist_cluster_clusters[j]) ? dist_eval : min_dist_cluster_clusters[j];
             }
         }
     }
+    merge_thread_stats(ctx);
+
+    /* every cluster only writes its own minimum */
+    #pragma omp parallel for private(j, dist_eval)
+    for(i = 0; i < ctx->no_clusters; i++) {
+        min_dist_cluster_clusters[i] = VALUE_TYPE_MAX;
+        for(j = 0; j < ctx->no_clusters; j++) {
+            if (i == j) continue;
+            dist_eval = 0.5 * dist_clusters_clusters[i][j];
+            min_dist_cluster_clusters[i] = (dist_eval < min_dist_cluster_clusters[i]) ? dist_eval : min_dist_cluster_clusters[i];
+        }
+    }
+}
+
+uint64_t update_hamerly_bounds(struct general_kmeans_context* ctx
+                               , VALUE_TYPE* distance_clustersold_to_clustersnew
+                               , VALUE_TYPE* lower_bounds
+                               , char* bound_needs_update
+                               , uint64_t* recheck_samples) {
+    uint64_t i, max_drift_cluster, no_chunks, chunk_size, no_recheck_samples;
+    uint64_t* chunk_counts;
+    VALUE_TYPE max_drift, second_max_drift;
+
+    /* the lower bound of a sample only needs to shrink by the largest drift
+     * of all clusters except the one it is assigned to.
+     */
+    max_drift = 0;
+    second_max_drift = 0;
+    max_drift_cluster = 0;
+    for (i = 0; i < ctx->no_clusters; i++) {
+        if (distance_clustersold_to_clustersnew[i] > max_drift) {
+            second_max_drift = max_drift;
+            max_drift = distance_clustersold_to_clustersnew[i];
+            max_drift_cluster = i;
+        } else if (distance_clustersold_to_clustersnew[i] > second_max_drift) {
+            second_max_drift = distance_clustersold_to_clustersnew[i];
+        }
+    }
+
+    chunk_size = get_sample_chunks(ctx, &no_chunks);
+    chunk_counts = (uint64_t*) calloc(no_chunks, sizeof(uint64_t));
+
+    #pragma omp parallel for schedule(static, 1)
+    for (i = 0; i < no_chunks; i++) {
+        uint64_t sample_id, start, end, cluster_id, no_selected;
+        VALUE_TYPE drift;
+
+        start = i * chunk_size;
+        end = start + chunk_size;
+        if (start > ctx->samples->sample_count) start = ctx->samples->sample_count;
+        if (end > ctx->samples->sample_count) end = ctx->samples->sample_count;
+
+        no_selected = 0;
+        for (sample_id = start; sample_id < end; sample_id++) {
+            cluster_id = ctx->cluster_assignments[sample_id];
+            drift = (cluster_id == max_drift_cluster) ? second_max_drift : max_drift;
+            lower_bounds[sample_id] = (lower_bounds[sample_id] - drift > 0) ? (lower_bounds[sample_id] - drift) : 0;
+
+            if (!ctx->clusters_not_changed[cluster_id]) {
+                ctx->cluster_distances[sample_id] = ctx->cluster_distances[sample_id] + distance_clustersold_to_clustersnew[cluster_id];
+                bound_needs_update[sample_id] = 1;
+            }
+
+            /* no other cluster can be closer if the upper bound does not exceed the lower bound */
+            if (ctx->cluster_distances[sample_id] > lower_bounds[sample_id]) {
+                recheck_samples[start + no_selected] = sample_id;
+                no_selected++;
+            }
+        }
+        chunk_counts[i] = no_selected;
+    }
+
+    no_recheck_samples = concatenate_sample_chunks(recheck_samples, chunk_size, chunk_counts, no_chunks);
+    free(chunk_counts);
+
+    return no_recheck_samples;
+}
+
+uint64_t update_bounds_collect_rechecks(struct general_kmeans_context* ctx
+                                        , VALUE_TYPE* distance_clustersold_to_clustersnew
+                                        , struct bound_matrix* lower_bounds
+                                        , VALUE_TYPE* lower_bound_drift
+                                        , uint32_t lower_bounds_per_cluster
+                                        , char* bound_needs_update
+                                        , uint64_t* recheck_samples) {
+    uint64_t i, no_chunks, chunk_size, no_recheck_samples;
+    uint64_t* chunk_counts;
+
+    chunk_size = get_sample_chunks(ctx, &no_chunks);
+    chunk_counts = (uint64_t*) calloc(no_chunks, sizeof(uint64_t));
+
+    bound_matrix_add_drift(lower_bounds, lower_bound_drift);
+
+    #pragma omp parallel for schedule(static, 1)
+    for (i = 0; i < no_chunks; i++) {
+        uint64_t sample_id, start, end, cluster_id, exclude_col, no_selected;
+        VALUE_TYPE min_lower_bound;
+
+        start = i * chunk_size;
+        end = start + chunk_size;
+        if (start > ctx->samples->sample_count) start = ctx->samples->sample_count;
+        if (end > ctx->samples->sample_count) end = ctx->samples->sample_count;
+
+        no_selected = 0;
+        for (sample_id = start; sample_id < end; sample_id++) {
+            cluster_id = ctx->cluster_assignments[sample_id];
+
+            /* the bound of the assigned cluster itself is no bound to any other cluster */
+            exclude_col = lower_bounds_per_cluster ? cluster_id : lower_bounds->no_cols;
+
+            if (!ctx->clusters_not_changed[cluster_id]) {
+                ctx->cluster_distances[sample_id] += distance_clustersold_to_clustersnew[cluster_id];
+                if (bound_needs_update) bound_needs_update[sample_id] = 1;
+            }
+
+            /* group bounds of samples which get examined are updated by the caller,
+             * it needs the bounds before the shift.
+             */
+            min_lower_bound = bound_matrix_subtract_drift_row(lower_bounds
+                                                              , sample_id
+                                                              , lower_bound_drift
+                                                              , exclude_col
+                                                              , lower_bounds_per_cluster);
+
+            if (ctx->cluster_distances[sample_id] > min_lower_bound) {
+                recheck_samples[start + no_selected] = sample_id;
+                no_selected++;
+            } else if (!lower_bounds_per_cluster) {
+                bound_matrix_subtract_drift_row(lower_bounds
+                                                , sample_id
+                                                , lower_bound_drift
+                                                , exclude_col
+                                                , 1);
+            }
+        }
+        chunk_counts[i] = no_selected;
+    }
+
+    no_recheck_samples = concatenate_sample_chunks(recheck_samples, chunk_size, chunk_counts, no_chunks);
+    free(chunk_counts);
+    return no_recheck_samples;
 }
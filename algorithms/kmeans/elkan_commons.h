@@ -8,5 +8,55 @@ void calculate_cluster_distance_matrix(struct general_kmeans_context* ctx
                                        , VALUE_TYPE** dist_clusters_clusters
                                        , VALUE_TYPE* min_dist_cluster_clusters
                                        , uint32_t* stop);
-                                       
+
+/**
+ * @brief Move the hamerly bounds of every sample after the clusters shifted.
+ *        The upper bound grows by the drift of the assigned cluster, the lower bound
+ *        shrinks by the largest drift of any other cluster. In the same pass the
+ *        samples whose upper bound exceeds their lower bound are collected
+ *        (in ascending order), all other samples keep their cluster.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] distance_clustersold_to_clustersnew Drift of every cluster (0 if it did not change).
+ * @param[in,out] lower_bounds Lower bound to the second closest cluster of every sample.
+ * @param[out] bound_needs_update Set for every sample whose upper bound is no longer tight.
+ * @param[out] recheck_samples Array of sample_count entries, receives the samples to examine.
+ * @return Number of samples written to recheck_samples.
+ */
+uint64_t update_hamerly_bounds(struct general_kmeans_context* ctx
+                               , VALUE_TYPE* distance_clustersold_to_clustersnew
+                               , VALUE_TYPE* lower_bounds
+                               , char* bound_needs_update
+                               , uint64_t* recheck_samples);
+
+/**
+ * @brief Fused bound update of elkan and yinyang after the clusters shifted.
+ *
+ * In one pass over the samples every lower bound shrinks by the drift of its
+ * column and the upper bound grows by the drift of the assigned cluster. A
+ * sample needs to be examined in the next iteration only if its upper bound
+ * is larger than the smallest of its lower bounds. These samples are collected
+ * in ascending order.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] distance_clustersold_to_clustersnew Drift of every cluster (0 if it did not change).
+ * @param[in,out] lower_bounds One row of lower bounds per sample. Group bounds of
+ *                          samples which need to be examined are left unchanged.
+ * @param[in] lower_bound_drift Drift of every column of lower_bounds.
+ * @param[in] lower_bounds_per_cluster 1 if there is one column per cluster (elkan). The
+ *                                     column of the assigned cluster is then not used
+ *                                     as a bound. 0 for group bounds (yinyang).
+ * @param[out] bound_needs_update If not NULL, set for every sample whose upper bound
+ *                                is no longer tight.
+ * @param[out] recheck_samples Array of sample_count entries, receives the samples to examine.
+ * @return Number of samples written to recheck_samples.
+ */
+uint64_t update_bounds_collect_rechecks(struct general_kmeans_context* ctx
+                                        , VALUE_TYPE* distance_clustersold_to_clustersnew
+                                        , struct bound_matrix* lower_bounds
+                                        , VALUE_TYPE* lower_bound_drift
+                                        , uint32_t lower_bounds_per_cluster
+                                        , char* bound_needs_update
+                                        , uint64_t* recheck_samples);
+
 #endif
\ No newline at end of file
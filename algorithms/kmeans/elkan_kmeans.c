@@ -7,6 +7,7 @@
 #include "../../utils/vector/common/common_vector_math.h"
 #include "../../utils/vector/sparse/sparse_vector_math.h"
 #include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -18,7 +19,7 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
 
     uint64_t i;
     uint64_t j;
-    uint64_t k;
+    uint64_t no_recheck_samples;
     uint64_t keys_per_block;
     uint64_t block_vectors_dim;         /* size of block vectors */
     VALUE_TYPE desired_bv_annz;         /* desired size of the block vectors */
@@ -30,13 +31,16 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
 
 
     char* bound_needs_update;                           /* bool per sample, 1 if a bound needs updating (rx)*/
-    VALUE_TYPE** lb_samples_clusters;                   /* lower bounds for every sample to every cluster (lxc) */
+    uint64_t* recheck_samples;                          /* samples which need to be examined in this iteration */
+    struct bound_matrix lb_samples_clusters;            /* lower bounds for every sample to every cluster (lxc) */
     VALUE_TYPE** dist_clusters_clusters;                /* distance from, to every cluster (dcc) */
     VALUE_TYPE*  min_dist_cluster_clusters;             /* minimum distance between a cluster and all other clusters (sc) */
     VALUE_TYPE*  distance_clustersold_to_clustersnew;   /* distance between clusters before/after a shift */
     /* upper bounds from samples to clusters are stored in ctx.cluster_distances */
 
     initialize_general_context(prms, &ctx, samples);
+    initialize_dense_cluster_vectors(prms, &ctx);
+    initialize_compressed_sample_keys(prms, &ctx);
 
     desired_bv_annz = d_get_subfloat_default(&(prms->tr)
                                             , "additional_params", "bv_annz", 0.3);
@@ -60,6 +64,7 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
 
             keys_per_block = ctx.samples->dim / block_vectors_dim;
             if (ctx.samples->dim % block_vectors_dim > 0) keys_per_block++;
+            initialize_thread_block_vectors(&ctx);
         }
 
         /* create block vectors for the clusters */
@@ -71,17 +76,18 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
     }
 
     /* initialization of the triangle inequality boundaries */
-    bound_needs_update = (char*) calloc(ctx.samples->sample_count, sizeof(char));
+    bound_needs_update = (char*) calloc_sample_array(&ctx, sizeof(char));
+    recheck_samples = create_sample_worklist(&ctx);
 
-    lb_samples_clusters = (VALUE_TYPE**) calloc(ctx.samples->sample_count, sizeof(VALUE_TYPE*));
+    initialize_lower_bound_matrix(prms, &ctx, ctx.no_clusters, &lb_samples_clusters);
     for (i = 0; i < ctx.samples->sample_count; i++) {
-        lb_samples_clusters[i] = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
         /* initialize the lower bounds to the distance of sample i to the
          * initial chosen cluster ctx.cluster_assignments[i]
          */
-        lb_samples_clusters[i][ctx.cluster_assignments[i]] = ctx.cluster_distances[i];
+        bound_matrix_set(&lb_samples_clusters, i, ctx.cluster_assignments[i], ctx.cluster_distances[i]);
         bound_needs_update[i] = 0;
     }
+    no_recheck_samples = ctx.samples->sample_count;
 
     dist_clusters_clusters = (VALUE_TYPE**) calloc(ctx.no_clusters, sizeof(VALUE_TYPE*));
     for (i = 0; i < ctx.no_clusters; i++) {
@@ -92,32 +98,24 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
     distance_clustersold_to_clustersnew = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many blockvector calculations were made / saved */
-        uint64_t saved_calculations_bv;
-        uint64_t done_blockvector_calcs, saved_calculations_cauchy;
-
-        /* reset all calculation counters */
-        done_blockvector_calcs = 0;
-        saved_calculations_cauchy = 0;
-        saved_calculations_bv = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
         calculate_cluster_distance_matrix(&ctx, dist_clusters_clusters, min_dist_cluster_clusters, &(prms->stop));
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
 
-            struct sparse_vector bv;
-            bv.nnz = 0;
-            bv.keys = NULL;
-            bv.values = NULL;
+            struct sparse_vector *bv;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
+            bv = NULL;
 
-            sample_id = j;
+            sample_id = recheck_samples[j];
 
             if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
@@ -135,17 +133,16 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                     /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
                     if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
                     if (cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
-                    if (ctx.cluster_distances[sample_id] <= lb_samples_clusters[sample_id][cluster_id]) continue;
+                    if (ctx.cluster_distances[sample_id] <= bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)) continue;
                     if (ctx.cluster_distances[sample_id] <= 0.5 * dist_clusters_clusters[ctx.cluster_assignments[sample_id]][cluster_id]) continue;
 
                     if (bound_needs_update[sample_id]) {
                         /* if we reached this point we need to calculate a full euclidean distance */
-                        dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, ctx.cluster_assignments[sample_id]
-                                , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
-                        ctx.done_calculations += 1;
+                        dist = euclid_sample_cluster(&ctx, sample_id, ctx.cluster_assignments[sample_id]);
+                        stats->done_calculations += 1;
 
                         /* update lower bound */
-                        lb_samples_clusters[sample_id][ctx.cluster_assignments[sample_id]] = dist;
+                        bound_matrix_set(&lb_samples_clusters, sample_id, ctx.cluster_assignments[sample_id], dist);
 
                         /* tighten upper bound */
                         ctx.cluster_distances[sample_id] = dist;
@@ -154,7 +151,7 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                         bound_needs_update[sample_id] = 0;
                     }
 
-                    if (ctx.cluster_distances[sample_id] > lb_samples_clusters[sample_id][cluster_id]
+                    if (ctx.cluster_distances[sample_id] > bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)
                         || ctx.cluster_distances[sample_id] > 0.5 * dist_clusters_clusters[ctx.cluster_assignments[sample_id]][cluster_id]) {
 
                         if (!disable_optimizations) {
@@ -164,10 +161,10 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
 
                             if (dist >= ctx.cluster_distances[sample_id]) {
                                 /* approximated distance is larger than current best distance. skip full distance calculation */
-                                if (dist > lb_samples_clusters[sample_id][cluster_id]) {
-                                    lb_samples_clusters[sample_id][cluster_id] = dist;
+                                if (dist > bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)) {
+                                    bound_matrix_set(&lb_samples_clusters, sample_id, cluster_id, dist);
                                 }
-                                saved_calculations_cauchy += 1;
+                                stats->saved_calculations_cauchy += 1;
                                 continue;
                             }
                             if (prms->kmeans_algorithm_id == ALGORITHM_BV_ELKAN_KMEANS) {
@@ -177,14 +174,15 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                                               , ctx.vector_lengths_samples
                                               , ctx.vector_lengths_clusters);
                             } else {
-                                if (bv.keys == NULL) {
-                                    create_block_vector_from_csr_matrix_vector(ctx.samples
-                                                                               , sample_id
-                                                                               , keys_per_block
-                                                                               , &bv);
+                                if (bv == NULL) {
+                                    bv = get_thread_block_vector(&ctx);
+                                    fill_block_vector_from_csr_matrix_vector(ctx.samples
+                                                                              , sample_id
+                                                                              , keys_per_block
+                                                                              , bv);
                                 }
 
-                                dist = euclid_vector(bv.keys, bv.values, bv.nnz
+                                dist = euclid_vector(bv->keys, bv->values, bv->nnz
                                                      , block_vectors_clusters[cluster_id].keys
                                                      , block_vectors_clusters[cluster_id].values
                                                      , block_vectors_clusters[cluster_id].nnz
@@ -192,24 +190,23 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                                                      , ctx.vector_lengths_clusters[cluster_id]);
                             }
 
-                            done_blockvector_calcs += 1;
+                            stats->done_blockvector_calcs += 1;
 
                             if (dist >= ctx.cluster_distances[sample_id]) {
                                 /* tighten lower bound (if possible) */
-                                if (dist > lb_samples_clusters[sample_id][cluster_id]) {
-                                    lb_samples_clusters[sample_id][cluster_id] = dist;
+                                if (dist > bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)) {
+                                    bound_matrix_set(&lb_samples_clusters, sample_id, cluster_id, dist);
                                 }
-                                saved_calculations_bv += 1;
+                                stats->saved_calculations_bv += 1;
                                 continue;
                             }
                         }
 
-                        dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
-                                                    , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
-                        ctx.done_calculations += 1;
+                        dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
+                        stats->done_calculations += 1;
 
                         /* tighten lower bound */
-                        lb_samples_clusters[sample_id][cluster_id] = dist;
+                        bound_matrix_set(&lb_samples_clusters, sample_id, cluster_id, dist);
 
                         if (dist < ctx.cluster_distances[sample_id]) {
                             /* replace current best distance with new distance */
@@ -219,12 +216,8 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                     }
                 }
             }
-
-            if (!disable_optimizations) {
-                free_null(bv.keys);
-                free_null(bv.values);
-            }
         }
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -251,33 +244,28 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
                                         , ctx.clusters_not_changed
                                         , block_vectors_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs", done_blockvector_calcs);
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", saved_calculations_bv + saved_calculations_cauchy);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs", ctx.iteration_stats.done_blockvector_calcs);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", ctx.iteration_stats.saved_calculations_bv + ctx.iteration_stats.saved_calculations_cauchy);
         }
 
-        #pragma omp parallel for private(j)
-        for(k = 0; k < ctx.samples->sample_count; k++) {
-            for(j = 0; j < ctx.no_clusters; j++) {
-                if (!ctx.clusters_not_changed[j]) {
-                    lb_samples_clusters[k][j] = ((lb_samples_clusters[k][j] - distance_clustersold_to_clustersnew[j] > 0) ?
-                                                (lb_samples_clusters[k][j] - distance_clustersold_to_clustersnew[j]) :
-                                                0);
-                }
-            }
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
 
-            if (!ctx.clusters_not_changed[ctx.cluster_assignments[k]]) {
-                ctx.cluster_distances[k] = ctx.cluster_distances[k] + distance_clustersold_to_clustersnew[ctx.cluster_assignments[k]];
-                bound_needs_update[k] = 1;
-            }
-        }
+        /* move all bounds and find the samples which need to be examined in the next iteration */
+        no_recheck_samples = update_bounds_collect_rechecks(&ctx
+                                                            , distance_clustersold_to_clustersnew
+                                                            , &lb_samples_clusters
+                                                            , distance_clustersold_to_clustersnew
+                                                            , 1
+                                                            , bound_needs_update
+                                                            , recheck_samples);
 
         print_iteration_summary(&ctx, prms, i);
 
         /* print block vector statistics */
         if (!disable_optimizations && prms->verbose) LOG_INFO("BV statistics c:%" PRINTF_INT64_MODIFIER "u/b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_cauchy
-                , saved_calculations_bv
-                , done_blockvector_calcs);
+                , ctx.iteration_stats.saved_calculations_cauchy
+                , ctx.iteration_stats.saved_calculations_bv
+                , ctx.iteration_stats.done_blockvector_calcs);
     }
 
     if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
@@ -294,11 +282,9 @@ struct kmeans_result* elkan_kmeans(struct csr_matrix* samples, struct kmeans_par
     /* cleanup all */
     free_general_context(&ctx, prms);
     free_null(bound_needs_update);
+    free_null(recheck_samples);
 
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        free_null(lb_samples_clusters[i]);
-    }
-    free_null(lb_samples_clusters);
+    free_bound_matrix(&lb_samples_clusters);
 
     for (i = 0; i < ctx.no_clusters; i++) {
         free_null(dist_clusters_clusters[i]);
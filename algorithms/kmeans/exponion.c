@@ -0,0 +1,267 @@
+#include "exponion.h"
+#include "kmeans_utils.h"
+
+#include "../../utils/matrix/csr_matrix/csr_to_vector_list.h"
+#include "../../utils/matrix/vector_list/vector_list_math.h"
+#include "../../utils/matrix/csr_matrix/csr_math.h"
+#include "../../utils/vector/common/common_vector_math.h"
+#include "../../utils/vector/sparse/sparse_vector_math.h"
+#include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
+
+#include <math.h>
+#include <unistd.h>
+#include <float.h>
+
+#include "elkan_commons.h"
+
+/**
+ * @brief A cluster together with its distance to another cluster.
+ */
+struct cluster_neighbor {
+    VALUE_TYPE distance;    /**< distance between the two clusters */
+    uint64_t cluster_id;    /**< id of the neighbor cluster */
+};
+
+static int cmp_cluster_neighbor(const void *a, const void *b) {
+    const struct cluster_neighbor *na = (const struct cluster_neighbor*) a;
+    const struct cluster_neighbor *nb = (const struct cluster_neighbor*) b;
+
+    if (na->distance < nb->distance) return -1;
+    if (na->distance > nb->distance) return 1;
+    if (na->cluster_id < nb->cluster_id) return -1;
+    if (na->cluster_id > nb->cluster_id) return 1;
+    return 0;
+}
+
+/*
+ * For every cluster sort all other clusters by their distance to it.
+ */
+static void sort_cluster_neighbors(struct general_kmeans_context* ctx
+                                   , VALUE_TYPE** dist_clusters_clusters
+                                   , struct cluster_neighbor** neighbors) {
+    uint64_t i;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (i = 0; i < ctx->no_clusters; i++) {
+        uint64_t j, no_neighbors;
+
+        no_neighbors = 0;
+        for (j = 0; j < ctx->no_clusters; j++) {
+            if (j == i) continue;
+            neighbors[i][no_neighbors].distance = dist_clusters_clusters[i][j];
+            neighbors[i][no_neighbors].cluster_id = j;
+            no_neighbors++;
+        }
+
+        qsort(neighbors[i], no_neighbors, sizeof(struct cluster_neighbor), cmp_cluster_neighbor);
+    }
+}
+
+struct kmeans_result* exponion_kmeans(struct csr_matrix* samples, struct kmeans_params *prms) {
+
+    uint64_t i;
+    uint64_t j;
+    struct kmeans_result* res;
+    struct general_kmeans_context ctx;
+
+    char* bound_needs_update;                           /* bool per sample, 1 if the upper bound needs updating */
+    VALUE_TYPE*  lower_bounds;                          /* lower bound for every sample to its second closest cluster */
+    uint64_t*    recheck_samples;                       /* samples which need to be examined in this iteration */
+    uint64_t     no_recheck_samples;
+    VALUE_TYPE** dist_clusters_clusters;                /* distance from, to every cluster (dcc) */
+    VALUE_TYPE*  min_dist_cluster_clusters;             /* half the minimum distance between a cluster and all other clusters (s) */
+    VALUE_TYPE*  distance_clustersold_to_clustersnew;   /* distance between clusters before/after a shift */
+    struct cluster_neighbor** neighbors;                /* for every cluster all other clusters sorted by distance */
+    /* upper bounds from samples to their assigned clusters are stored in ctx.cluster_distances */
+
+    initialize_general_context(prms, &ctx, samples);
+    initialize_dense_cluster_vectors(prms, &ctx);
+    initialize_compressed_sample_keys(prms, &ctx);
+
+    /* initialization of the triangle inequality boundaries. the upper bounds
+     * are exact after the initialization, the lower bounds are 0.
+     */
+    bound_needs_update = (char*) calloc_sample_array(&ctx, sizeof(char));
+    lower_bounds = (VALUE_TYPE*) calloc_sample_array(&ctx, sizeof(VALUE_TYPE));
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
+
+    dist_clusters_clusters = (VALUE_TYPE**) calloc(ctx.no_clusters, sizeof(VALUE_TYPE*));
+    neighbors = (struct cluster_neighbor**) calloc(ctx.no_clusters, sizeof(struct cluster_neighbor*));
+    for (i = 0; i < ctx.no_clusters; i++) {
+        dist_clusters_clusters[i] = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+        neighbors[i] = (struct cluster_neighbor*) calloc(ctx.no_clusters, sizeof(struct cluster_neighbor));
+    }
+
+    min_dist_cluster_clusters = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+    distance_clustersold_to_clustersnew = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+
+    for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
+        /* initialize data needed for the iteration */
+        pre_process_iteration(&ctx);
+
+        calculate_cluster_distance_matrix(&ctx, dist_clusters_clusters, min_dist_cluster_clusters, &(prms->stop));
+        sort_cluster_neighbors(&ctx, dist_clusters_clusters, neighbors);
+
+        /* samples which are not in the worklist passed the bound test */
+        ctx.iteration_stats.saved_calculations_global += (ctx.samples->sample_count - no_recheck_samples) * ctx.no_clusters;
+
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
+            /* iterate over all samples */
+            VALUE_TYPE dist, bound, radius, closest_dist, second_closest_dist;
+            uint64_t cluster_id, sample_id, assigned_cluster, closest_cluster, k;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
+
+            sample_id = recheck_samples[j];
+            assigned_cluster = ctx.cluster_assignments[sample_id];
+
+            if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
+            if (prms->stop) continue;
+
+            bound = (min_dist_cluster_clusters[assigned_cluster] > lower_bounds[sample_id])
+                    ? min_dist_cluster_clusters[assigned_cluster]
+                    : lower_bounds[sample_id];
+
+            if (ctx.cluster_distances[sample_id] <= bound) {
+                /* there cannot be any cluster closer than the current one */
+                stats->saved_calculations_global += ctx.no_clusters;
+                continue;
+            }
+
+            if (bound_needs_update[sample_id]) {
+                /* tighten upper bound and test again */
+                ctx.cluster_distances[sample_id] = euclid_sample_cluster(&ctx, sample_id, assigned_cluster);
+                stats->done_calculations += 1;
+                bound_needs_update[sample_id] = 0;
+
+                if (ctx.cluster_distances[sample_id] <= bound) {
+                    stats->saved_calculations_global += ctx.no_clusters - 1;
+                    continue;
+                }
+            }
+
+            /* every cluster c with d(a, c) > radius has d(s, c) > radius - u = u + 2 * s(a).
+             * The closest other cluster of a (which is inside the ball) is at most
+             * u + 2 * s(a) away from the sample. So clusters outside the ball can be
+             * neither the closest nor the second closest cluster.
+             */
+            radius = 2 * ctx.cluster_distances[sample_id] + 2 * min_dist_cluster_clusters[assigned_cluster];
+
+            closest_cluster = assigned_cluster;
+            closest_dist = ctx.cluster_distances[sample_id];
+
+            /* second closest distance of the clusters inside the ball */
+            second_closest_dist = VALUE_TYPE_MAX;
+
+            for (k = 0; k < ctx.no_clusters - 1; k++) {
+                /* iterate over the clusters inside the ball, closest to the assigned cluster first */
+                if (neighbors[assigned_cluster][k].distance > radius
+                    || neighbors[assigned_cluster][k].distance - ctx.cluster_distances[sample_id] > second_closest_dist) {
+                    /* d(s, c) >= d(a, c) - u for this and all following clusters. they are outside
+                     * the ball or farther away than the second closest cluster so far.
+                     */
+                    dist = neighbors[assigned_cluster][k].distance - ctx.cluster_distances[sample_id];
+                    if (dist < second_closest_dist) second_closest_dist = dist;
+                    stats->saved_calculations_local += ctx.no_clusters - 1 - k;
+                    break;
+                }
+
+                cluster_id = neighbors[assigned_cluster][k].cluster_id;
+
+                /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
+                if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
+
+                /* annulus: clusters whose norm differs too much from the sample norm can be
+                 * skipped. only if they are not closer than the second closest cluster so far,
+                 * otherwise the loose norm bound would become the lower bound of the sample.
+                 */
+                dist = lower_bound_euclid(ctx.vector_lengths_clusters[cluster_id]
+                                          , ctx.vector_lengths_samples[sample_id]);
+                if (dist >= closest_dist && dist >= second_closest_dist) {
+                    stats->saved_calculations_cauchy += 1;
+                    continue;
+                }
+
+                dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
+                stats->done_calculations += 1;
+
+                /* clusters are not visited in id order. on ties prefer the smaller
+                 * id to get the same assignments as a full scan.
+                 */
+                if (dist < closest_dist
+                    || (dist == closest_dist && closest_cluster != assigned_cluster && cluster_id < closest_cluster)) {
+                    second_closest_dist = closest_dist;
+                    closest_dist = dist;
+                    closest_cluster = cluster_id;
+                } else if (dist < second_closest_dist) {
+                    second_closest_dist = dist;
+                }
+            }
+
+            ctx.cluster_distances[sample_id] = closest_dist;
+            ctx.cluster_assignments[sample_id] = closest_cluster;
+            lower_bounds[sample_id] = second_closest_dist;
+        }
+        merge_thread_stats(&ctx);
+
+        post_process_iteration(&ctx, prms);
+
+        /* shift clusters to new position */
+        calculate_shifted_clusters(&ctx);
+
+        /* calculate distance between a cluster before and after the shift */
+        calculate_distance_clustersold_to_clustersnew(distance_clustersold_to_clustersnew
+                                                      , ctx.shifted_cluster_vectors
+                                                      , ctx.cluster_vectors
+                                                      , ctx.no_clusters
+                                                      , ctx.vector_lengths_shifted_clusters
+                                                      , ctx.vector_lengths_clusters
+                                                      , ctx.clusters_not_changed);
+
+        switch_to_shifted_clusters(&ctx);
+
+        d_add_ilist(&(prms->tr), "iteration_saved_calcs_global", ctx.iteration_stats.saved_calculations_global);
+        d_add_ilist(&(prms->tr), "iteration_saved_calcs_local", ctx.iteration_stats.saved_calculations_local);
+
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+
+        no_recheck_samples = update_hamerly_bounds(&ctx
+                                                   , distance_clustersold_to_clustersnew
+                                                   , lower_bounds
+                                                   , bound_needs_update
+                                                   , recheck_samples);
+
+        print_iteration_summary(&ctx, prms, i);
+
+        /* print exponion statistics */
+        if (prms->verbose) LOG_INFO("statistics [EX] g=%" PRINTF_INT64_MODIFIER "u/l=%" PRINTF_INT64_MODIFIER "u/c=%" PRINTF_INT64_MODIFIER "u"
+                , ctx.iteration_stats.saved_calculations_global
+                , ctx.iteration_stats.saved_calculations_local
+                , ctx.iteration_stats.saved_calculations_cauchy);
+    }
+
+    if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
+
+    res = create_kmeans_result(prms, &ctx);
+
+    /* cleanup all */
+    free_general_context(&ctx, prms);
+    free_null(bound_needs_update);
+    free_null(lower_bounds);
+    free_null(recheck_samples);
+
+    for (i = 0; i < ctx.no_clusters; i++) {
+        free_null(dist_clusters_clusters[i]);
+        free_null(neighbors[i]);
+    }
+    free_null(dist_clusters_clusters);
+    free_null(neighbors);
+    free_null(min_dist_cluster_clusters);
+    free_null(distance_clustersold_to_clustersnew);
+
+    return res;
+}
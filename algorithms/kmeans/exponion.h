@@ -0,0 +1,16 @@
+#ifndef EXPONION_H
+#define EXPONION_H
+
+#include "kmeans_control.h"
+
+/**
+ * @brief The exponion version of k-means. Uses the hamerly bounds and only scans
+ *        the clusters within a ball around the currently assigned cluster.
+ *
+ * @param samples which shall be clustered
+ * @param prms are the parameters to control the clustering
+ * @return
+ */
+struct kmeans_result* exponion_kmeans(struct csr_matrix* samples, struct kmeans_params *prms);
+
+#endif
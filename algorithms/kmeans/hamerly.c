@@ -0,0 +1,270 @@
+#include "hamerly.h"
+#include "kmeans_utils.h"
+
+#include "../../utils/matrix/csr_matrix/csr_to_vector_list.h"
+#include "../../utils/matrix/vector_list/vector_list_math.h"
+#include "../../utils/matrix/csr_matrix/csr_math.h"
+#include "../../utils/vector/common/common_vector_math.h"
+#include "../../utils/vector/sparse/sparse_vector_math.h"
+#include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
+
+#include <math.h>
+#include <unistd.h>
+#include <float.h>
+
+#include "elkan_commons.h"
+
+struct kmeans_result* hamerly_kmeans(struct csr_matrix* samples, struct kmeans_params *prms) {
+
+    uint64_t i;
+    uint64_t j;
+    uint64_t block_vectors_dim;         /* size of block vectors */
+    VALUE_TYPE desired_bv_annz;         /* desired size of the block vectors */
+    struct csr_matrix block_vectors_samples;  /* block vector matrix of samples */
+    struct sparse_vector* block_vectors_clusters; /* block vector matrix of clusters */
+    struct kmeans_result* res;
+    struct general_kmeans_context ctx;
+    uint32_t disable_optimizations;
+
+    char* bound_needs_update;                           /* bool per sample, 1 if the upper bound needs updating */
+    VALUE_TYPE*  lower_bounds;                          /* lower bound for every sample to its second closest cluster */
+    uint64_t*    recheck_samples;                       /* samples which need to be examined in this iteration */
+    uint64_t     no_recheck_samples;
+    VALUE_TYPE** dist_clusters_clusters;                /* distance from, to every cluster (dcc) */
+    VALUE_TYPE*  min_dist_cluster_clusters;             /* half the minimum distance between a cluster and all other clusters (s) */
+    VALUE_TYPE*  distance_clustersold_to_clustersnew;   /* distance between clusters before/after a shift */
+    /* upper bounds from samples to their assigned clusters are stored in ctx.cluster_distances */
+
+    initialize_general_context(prms, &ctx, samples);
+    initialize_dense_cluster_vectors(prms, &ctx);
+    initialize_compressed_sample_keys(prms, &ctx);
+
+    desired_bv_annz = d_get_subfloat_default(&(prms->tr)
+                                            , "additional_params", "bv_annz", 0.3);
+    block_vectors_dim = 0;
+
+    disable_optimizations = prms->kmeans_algorithm_id == ALGORITHM_HAMERLY;
+
+    if (!disable_optimizations) {
+        initialize_csr_matrix_zero(&block_vectors_samples);
+
+        /* search for a suitable size of the block vectors for the input samples and create them */
+        search_samples_block_vectors(prms, ctx.samples, desired_bv_annz
+                                     , &block_vectors_samples
+                                     , &block_vectors_dim);
+
+        /* create block vectors for the clusters */
+        create_block_vectors_list_from_vector_list(ctx.cluster_vectors
+                                                        , block_vectors_dim
+                                                        , ctx.no_clusters
+                                                        , ctx.samples->dim
+                                                        , &block_vectors_clusters);
+    }
+
+    /* initialization of the triangle inequality boundaries. the upper bounds
+     * are exact after the initialization, the lower bounds are 0.
+     */
+    bound_needs_update = (char*) calloc_sample_array(&ctx, sizeof(char));
+    lower_bounds = (VALUE_TYPE*) calloc_sample_array(&ctx, sizeof(VALUE_TYPE));
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
+
+    dist_clusters_clusters = (VALUE_TYPE**) calloc(ctx.no_clusters, sizeof(VALUE_TYPE*));
+    for (i = 0; i < ctx.no_clusters; i++) {
+        dist_clusters_clusters[i] = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+    }
+
+    min_dist_cluster_clusters = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+    distance_clustersold_to_clustersnew = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
+
+    for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
+        /* initialize data needed for the iteration */
+        pre_process_iteration(&ctx);
+
+        calculate_cluster_distance_matrix(&ctx, dist_clusters_clusters, min_dist_cluster_clusters, &(prms->stop));
+
+        /* samples which are not in the worklist passed the bound test */
+        ctx.iteration_stats.saved_calculations_global += (ctx.samples->sample_count - no_recheck_samples) * ctx.no_clusters;
+
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
+            /* iterate over all samples */
+            VALUE_TYPE dist, bound, closest_dist, second_closest_dist;
+            uint64_t cluster_id, sample_id, assigned_cluster, closest_cluster;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
+
+            sample_id = recheck_samples[j];
+            assigned_cluster = ctx.cluster_assignments[sample_id];
+
+            if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
+            if (prms->stop) continue;
+
+            bound = (min_dist_cluster_clusters[assigned_cluster] > lower_bounds[sample_id])
+                    ? min_dist_cluster_clusters[assigned_cluster]
+                    : lower_bounds[sample_id];
+
+            if (ctx.cluster_distances[sample_id] <= bound) {
+                /* there cannot be any cluster closer than the current one */
+                stats->saved_calculations_global += ctx.no_clusters;
+                continue;
+            }
+
+            if (bound_needs_update[sample_id]) {
+                /* tighten upper bound and test again */
+                ctx.cluster_distances[sample_id] = euclid_sample_cluster(&ctx, sample_id, assigned_cluster);
+                stats->done_calculations += 1;
+                bound_needs_update[sample_id] = 0;
+
+                if (ctx.cluster_distances[sample_id] <= bound) {
+                    stats->saved_calculations_global += ctx.no_clusters - 1;
+                    continue;
+                }
+            }
+
+            /* search the closest and second closest cluster. the upper bound
+             * is exact here and the tightening above replaced the calculation
+             * of the assigned cluster. clusters are only skipped with a lower
+             * bound if it cannot lower the second closest distance, so the new
+             * lower bound of the sample stays as tight as an exact scan.
+             */
+            closest_cluster = assigned_cluster;
+            closest_dist = ctx.cluster_distances[sample_id];
+            second_closest_dist = VALUE_TYPE_MAX;
+
+            for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
+                /* iterate over all cluster centers */
+
+                if (cluster_id == assigned_cluster) continue;
+
+                /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
+                if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
+
+                /* the distance between the centers bounds the distance to this cluster.
+                 * it only skips the cluster if it can neither become the closest
+                 * nor the second closest cluster.
+                 */
+                dist = dist_clusters_clusters[assigned_cluster][cluster_id] - ctx.cluster_distances[sample_id];
+                if (dist >= closest_dist && dist >= second_closest_dist) {
+                    stats->saved_calculations_local += 1;
+                    continue;
+                }
+
+                if (!disable_optimizations) {
+                    /* evaluate cauchy approximation. fast but not good */
+                    dist = lower_bound_euclid(ctx.vector_lengths_clusters[cluster_id]
+                                              , ctx.vector_lengths_samples[sample_id]);
+
+                    if (dist >= closest_dist && dist >= second_closest_dist) {
+                        stats->saved_calculations_cauchy += 1;
+                        continue;
+                    }
+
+                    /* evaluate block vector approximation. */
+                    dist = euclid_vector_list(&block_vectors_samples, sample_id
+                                  , block_vectors_clusters, cluster_id
+                                  , ctx.vector_lengths_samples
+                                  , ctx.vector_lengths_clusters);
+                    stats->done_blockvector_calcs += 1;
+
+                    if (dist >= closest_dist && dist >= second_closest_dist) {
+                        stats->saved_calculations_bv += 1;
+                        continue;
+                    }
+                }
+
+                dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
+                stats->done_calculations += 1;
+
+                if (dist < closest_dist) {
+                    second_closest_dist = closest_dist;
+                    closest_dist = dist;
+                    closest_cluster = cluster_id;
+                } else if (dist < second_closest_dist) {
+                    second_closest_dist = dist;
+                }
+            }
+
+            ctx.cluster_distances[sample_id] = closest_dist;
+            ctx.cluster_assignments[sample_id] = closest_cluster;
+            lower_bounds[sample_id] = second_closest_dist;
+        }
+        merge_thread_stats(&ctx);
+
+        post_process_iteration(&ctx, prms);
+
+        /* shift clusters to new position */
+        calculate_shifted_clusters(&ctx);
+
+        /* calculate distance between a cluster before and after the shift */
+        calculate_distance_clustersold_to_clustersnew(distance_clustersold_to_clustersnew
+                                                      , ctx.shifted_cluster_vectors
+                                                      , ctx.cluster_vectors
+                                                      , ctx.no_clusters
+                                                      , ctx.vector_lengths_shifted_clusters
+                                                      , ctx.vector_lengths_clusters
+                                                      , ctx.clusters_not_changed);
+
+        switch_to_shifted_clusters(&ctx);
+
+        if (!disable_optimizations) {
+            /* update only block vectors for cluster that shifted */
+            update_changed_blockvectors(ctx.cluster_vectors
+                                        , block_vectors_dim
+                                        , ctx.no_clusters
+                                        , ctx.samples->dim
+                                        , ctx.clusters_not_changed
+                                        , block_vectors_clusters);
+
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs", ctx.iteration_stats.done_blockvector_calcs);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", ctx.iteration_stats.saved_calculations_bv + ctx.iteration_stats.saved_calculations_cauchy);
+        }
+        d_add_ilist(&(prms->tr), "iteration_saved_calcs_global", ctx.iteration_stats.saved_calculations_global);
+        d_add_ilist(&(prms->tr), "iteration_saved_calcs_local", ctx.iteration_stats.saved_calculations_local);
+
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+
+        no_recheck_samples = update_hamerly_bounds(&ctx
+                                                   , distance_clustersold_to_clustersnew
+                                                   , lower_bounds
+                                                   , bound_needs_update
+                                                   , recheck_samples);
+
+        print_iteration_summary(&ctx, prms, i);
+
+        /* print block vector and hamerly statistics */
+        if (prms->verbose) LOG_INFO("statistics [BV] c:%" PRINTF_INT64_MODIFIER "u/b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u [HA] g=%" PRINTF_INT64_MODIFIER "u/l=%" PRINTF_INT64_MODIFIER "u"
+                , ctx.iteration_stats.saved_calculations_cauchy
+                , ctx.iteration_stats.saved_calculations_bv
+                , ctx.iteration_stats.done_blockvector_calcs
+                , ctx.iteration_stats.saved_calculations_global
+                , ctx.iteration_stats.saved_calculations_local);
+    }
+
+    if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
+
+    res = create_kmeans_result(prms, &ctx);
+
+    /* cleanup all */
+    if (!disable_optimizations) {
+        free_csr_matrix(&block_vectors_samples);
+        free_vector_list(block_vectors_clusters, ctx.no_clusters);
+        free(block_vectors_clusters);
+    }
+
+    free_general_context(&ctx, prms);
+    free_null(bound_needs_update);
+    free_null(lower_bounds);
+    free_null(recheck_samples);
+
+    for (i = 0; i < ctx.no_clusters; i++) {
+        free_null(dist_clusters_clusters[i]);
+    }
+    free_null(dist_clusters_clusters);
+    free_null(min_dist_cluster_clusters);
+    free_null(distance_clustersold_to_clustersnew);
+
+    return res;
+}
@@ -0,0 +1,16 @@
+#ifndef HAMERLY_H
+#define HAMERLY_H
+
+#include "kmeans_control.h"
+
+/**
+ * @brief The hamerly version of k-means. Keeps only one upper and one lower
+ *        bound per sample instead of one lower bound for every cluster (elkan).
+ *
+ * @param samples which shall be clustered
+ * @param prms are the parameters to control the clustering
+ * @return
+ */
+struct kmeans_result* hamerly_kmeans(struct csr_matrix* samples, struct kmeans_params *prms);
+
+#endif
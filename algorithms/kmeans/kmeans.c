@@ -6,6 +6,7 @@
 #include "../../utils/vector/common/common_vector_math.h"
 #include "../../utils/vector/sparse/sparse_vector_math.h"
 #include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -21,11 +22,16 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
     struct sparse_vector* block_vectors_clusters; /* block vector matrix of clusters */
     struct kmeans_result* res;
     uint32_t disable_optimizations;
+    uint32_t blocked_assignment;
 
     /* bv_kmeans: contains all samples which are eligible for the cluster
      * no change optimization.
      */
     uint32_t *eligible_for_cluster_no_change_optimization;
+
+    /* samples which need to be examined in this iteration */
+    uint64_t *recheck_samples;
+    uint64_t no_recheck_samples;
     struct general_kmeans_context ctx;
 
     initialize_general_context(prms, &ctx, samples);
@@ -35,6 +41,11 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
     block_vectors_dim = 0;
     keys_per_block = 0;
     disable_optimizations = prms->kmeans_algorithm_id == ALGORITHM_KMEANS;
+    blocked_assignment = disable_optimizations && use_blocked_assignment(prms, &ctx);
+    if (!blocked_assignment) {
+        initialize_dense_cluster_vectors(prms, &ctx);
+        initialize_compressed_sample_keys(prms, &ctx);
+    }
 
     if (!disable_optimizations) {
         initialize_csr_matrix_zero(&block_vectors_samples);
@@ -51,6 +62,7 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
 
             keys_per_block = ctx.samples->dim / block_vectors_dim;
             if (ctx.samples->dim % block_vectors_dim > 0) keys_per_block++;
+            initialize_thread_block_vectors(&ctx);
         }
 
         /* create block vectors for the clusters */
@@ -61,116 +73,114 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
                                                         , &block_vectors_clusters);
     }
 
-    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc(ctx.samples->sample_count, sizeof(uint32_t));
+    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc_sample_array(&ctx, sizeof(uint32_t));
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many blockvector calculations were made / saved */
-        uint64_t saved_calculations_bv, saved_calculations_prev_cluster;
-        uint64_t done_blockvector_calcs, saved_calculations_cauchy;
-
-        /* reset all calculation counters */
-        done_blockvector_calcs = 0;
-        saved_calculations_cauchy = 0;
-        saved_calculations_prev_cluster = 0;
-        saved_calculations_bv = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
-            /* iterate over all samples */
-
-            VALUE_TYPE dist;
-            uint64_t cluster_id, sample_id;
-            struct sparse_vector bv;
-            bv.nnz = 0;
-            bv.keys = NULL;
-            bv.values = NULL;
+        if (blocked_assignment) {
+            /* naive k-means: compute all distances tile-wise as sparse x dense product */
+            assign_samples_blocked(&ctx, i != 0, NULL, NULL, &(prms->stop));
+        } else {
+            /* samples which are not in the worklist skip every non empty cluster except their own */
+            ctx.iteration_stats.saved_calculations_prev_cluster += (ctx.samples->sample_count - no_recheck_samples)
+                                                                   * (get_nnz_uint64_array(ctx.cluster_counts, ctx.no_clusters) - 1);
 
-            if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
+            partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+            #pragma omp parallel private(j)
+            for (j = 0; next_sample_position(&ctx, &j); j++) {
+                /* iterate over all samples */
 
-            if (!prms->stop) {
-                sample_id = j;
+                VALUE_TYPE dist;
+                uint64_t cluster_id, sample_id;
+                struct sparse_vector *bv;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
+                bv = NULL;
 
-                for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
-                    /* iterate over all cluster centers */
+                if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
-                    /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
-                    if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
+                if (!prms->stop) {
+                    sample_id = recheck_samples[j];
 
-                    if (!disable_optimizations) {
-                        /* bv_kmeans */
+                    for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
+                        /* iterate over all cluster centers */
 
-                        /* we already know the distance to the cluster from last iteration */
-                        if (cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
+                        /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
+                        if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
 
-                        /* clusters which did not move in the last iteration can be skipped if the sample is eligible */
-                        if (eligible_for_cluster_no_change_optimization[sample_id] && ctx.clusters_not_changed[cluster_id]) {
-                            /* cluster did not move and sample was eligible for this check. distance to this cluster can not be less than to our best from last iteration */
-                            saved_calculations_prev_cluster += 1;
-                            goto end;
-                        }
+                        if (!disable_optimizations) {
+                            /* bv_kmeans */
 
-                        /* evaluate cauchy approximation. fast but not good */
-                        dist = lower_bound_euclid(ctx.vector_lengths_clusters[cluster_id]
-                                                  , ctx.vector_lengths_samples[sample_id]);
+                            /* we already know the distance to the cluster from last iteration */
+                            if (cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
 
-                        if (dist >= ctx.cluster_distances[sample_id]) {
-                            /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_cauchy += 1;
-                            goto end;
-                        }
-                        if (prms->kmeans_algorithm_id == ALGORITHM_BV_KMEANS) {
-                            /* evaluate block vector approximation. */
-                            dist = euclid_vector_list(&block_vectors_samples, sample_id
-                                          , block_vectors_clusters, cluster_id
-                                          , ctx.vector_lengths_samples
-                                          , ctx.vector_lengths_clusters);
-                        } else {
-                            if (bv.keys == NULL) {
-                                create_block_vector_from_csr_matrix_vector(ctx.samples
-                                                                           , sample_id
-                                                                           , keys_per_block
-                                                                           , &bv);
+                            /* clusters which did not move in the last iteration can be skipped if the sample is eligible */
+                            if (eligible_for_cluster_no_change_optimization[sample_id] && ctx.clusters_not_changed[cluster_id]) {
+                                /* cluster did not move and sample was eligible for this check. distance to this cluster can not be less than to our best from last iteration */
+                                stats->saved_calculations_prev_cluster += 1;
+                                goto end;
                             }
 
-                            dist = euclid_vector(bv.keys, bv.values, bv.nnz
-                                                 , block_vectors_clusters[cluster_id].keys
-                                                 , block_vectors_clusters[cluster_id].values
-                                                 , block_vectors_clusters[cluster_id].nnz
-                                                 , ctx.vector_lengths_samples[sample_id]
-                                                 , ctx.vector_lengths_clusters[cluster_id]);
-                        }
+                            /* evaluate cauchy approximation. fast but not good */
+                            dist = lower_bound_euclid(ctx.vector_lengths_clusters[cluster_id]
+                                                      , ctx.vector_lengths_samples[sample_id]);
 
-                        done_blockvector_calcs += 1;
+                            if (dist >= ctx.cluster_distances[sample_id]) {
+                                /* approximated distance is larger than current best distance. skip full distance calculation */
+                                stats->saved_calculations_cauchy += 1;
+                                goto end;
+                            }
+                            if (prms->kmeans_algorithm_id == ALGORITHM_BV_KMEANS) {
+                                /* evaluate block vector approximation. */
+                                dist = euclid_vector_list(&block_vectors_samples, sample_id
+                                              , block_vectors_clusters, cluster_id
+                                              , ctx.vector_lengths_samples
+                                              , ctx.vector_lengths_clusters);
+                            } else {
+                                if (bv == NULL) {
+                                    bv = get_thread_block_vector(&ctx);
+                                    fill_block_vector_from_csr_matrix_vector(ctx.samples
+                                                                              , sample_id
+                                                                              , keys_per_block
+                                                                              , bv);
+                                }
+
+                                dist = euclid_vector(bv->keys, bv->values, bv->nnz
+                                                     , block_vectors_clusters[cluster_id].keys
+                                                     , block_vectors_clusters[cluster_id].values
+                                                     , block_vectors_clusters[cluster_id].nnz
+                                                     , ctx.vector_lengths_samples[sample_id]
+                                                     , ctx.vector_lengths_clusters[cluster_id]);
+                            }
+
+                            stats->done_blockvector_calcs += 1;
 
-                        if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
-                            /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_bv += 1;
-                            goto end;
+                            if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
+                                /* approximated distance is larger than current best distance. skip full distance calculation */
+                                stats->saved_calculations_bv += 1;
+                                goto end;
+                            }
                         }
-                    }
 
-                    /* if we reached this point we need to calculate a full euclidean distance */
-                    dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
-                            , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
+                        /* if we reached this point we need to calculate a full euclidean distance */
+                        dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
 
-                    ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
-                    if (dist < ctx.cluster_distances[sample_id]) {
-                        /* replace current best distance with new distance */
-                        ctx.cluster_distances[sample_id] = dist;
-                        ctx.cluster_assignments[sample_id] = cluster_id;
+                        if (dist < ctx.cluster_distances[sample_id]) {
+                            /* replace current best distance with new distance */
+                            ctx.cluster_distances[sample_id] = dist;
+                            ctx.cluster_assignments[sample_id] = cluster_id;
+                        }
+                        end:;
                     }
-                    end:;
                 }
             }
-
-            if (!disable_optimizations) {
-                free_null(bv.keys);
-                free_null(bv.values);
-            }
+            merge_thread_stats(&ctx);
         }
 
         post_process_iteration(&ctx, prms);
@@ -188,27 +198,22 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
                                         , ctx.clusters_not_changed
                                         , block_vectors_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs", done_blockvector_calcs);
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", saved_calculations_bv + saved_calculations_cauchy);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs", ctx.iteration_stats.done_blockvector_calcs);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", ctx.iteration_stats.saved_calculations_bv + ctx.iteration_stats.saved_calculations_cauchy);
 
             #pragma omp parallel for
             for (j = 0; j < ctx.samples->sample_count; j++) {
                 /* iterate over all samples */
 
                 VALUE_TYPE previous_distance;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
                 previous_distance = ctx.cluster_distances[j];
 
                 /* if the cluster did move. calculate the new distance to this sample */
                 if (ctx.clusters_not_changed[ctx.cluster_assignments[j]] == 0) {
-                    ctx.cluster_distances[j]
-                      = euclid_vector_list(ctx.samples, j
-                              , ctx.cluster_vectors, ctx.cluster_assignments[j]
-                              , ctx.vector_lengths_samples
-                              , ctx.vector_lengths_clusters);
-
-                    /*#pragma omp critical*/
-                    ctx.done_calculations += 1;
-                    ctx.total_no_calcs += 1;
+                    ctx.cluster_distances[j] = euclid_sample_cluster(&ctx, j, ctx.cluster_assignments[j]);
+                    stats->done_calculations += 1;
                 }
 
                 /* if the cluster moved towards this sample,
@@ -221,12 +226,18 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
                     eligible_for_cluster_no_change_optimization[j] = 0;
                 }
             }
+            ctx.total_no_calcs += merge_thread_stats(&ctx);
+
+            d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+            no_recheck_samples = collect_no_change_worklist(&ctx
+                                                            , eligible_for_cluster_no_change_optimization
+                                                            , recheck_samples);
         } else {
             /* naive k-means without any optimization remembers nothing from
              * the previous iteration.
              */
             for (j = 0; j < ctx.samples->sample_count; j++) {
-                ctx.cluster_distances[j] = DBL_MAX;
+                ctx.cluster_distances[j] = VALUE_TYPE_MAX;
             }
         }
 
@@ -234,10 +245,10 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
 
         /* print block vector statistics */
         if (prms->verbose) LOG_INFO("BV statistics c:%" PRINTF_INT64_MODIFIER "u/b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u/pc:%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_cauchy
-                , saved_calculations_bv
-                , done_blockvector_calcs
-                , saved_calculations_prev_cluster);
+                , ctx.iteration_stats.saved_calculations_cauchy
+                , ctx.iteration_stats.saved_calculations_bv
+                , ctx.iteration_stats.done_blockvector_calcs
+                , ctx.iteration_stats.saved_calculations_prev_cluster);
     }
 
     if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
@@ -253,6 +264,7 @@ struct kmeans_result* bv_kmeans(struct csr_matrix* samples, struct kmeans_params
 
     free_general_context(&ctx, prms);
     free_null(eligible_for_cluster_no_change_optimization);
+    free_null(recheck_samples);
 
 
     return res;
@@ -9,143 +9,358 @@
 #include <ctype.h>
 #include "../../utils/fcl_logging.h"
 
-uint32_t add_sample_to_hashmap(struct keyvaluecount_hash** clusters_raw
+/* minimal number of slots of a hash table */
+#define CLUSTER_HASHMAP_MIN_CAPACITY 16
+
+/* home slot of a key within the hash table (fibonacci hashing) */
+static uint64_t get_home_slot(struct cluster_accumulator* acc, KEY_TYPE key) {
+    return (((uint64_t) key * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (acc->capacity - 1);
+}
+
+/* slot which contains key or the empty slot where key would be inserted */
+static uint64_t find_slot(struct cluster_accumulator* acc, KEY_TYPE key) {
+    uint64_t slot;
+
+    slot = get_home_slot(acc, key);
+    while (acc->counts[slot] != 0 && acc->keys[slot] != key) {
+        slot = (slot + 1) & (acc->capacity - 1);
+    }
+    return slot;
+}
+
+static void switch_to_dense(struct cluster_accumulator* acc) {
+    uint64_t i;
+    ACCUMULATOR_TYPE *values;
+    uint64_t *counts;
+
+    values = (ACCUMULATOR_TYPE*) calloc(acc->dim, sizeof(ACCUMULATOR_TYPE));
+    counts = (uint64_t*) calloc(acc->dim, sizeof(uint64_t));
+    acc->bitmap = (uint64_t*) calloc((acc->dim + 63) / 64, sizeof(uint64_t));
+
+    for (i = 0; i < acc->capacity; i++) {
+        if (acc->counts[i] != 0) {
+            values[acc->keys[i]] = acc->values[i];
+            counts[acc->keys[i]] = acc->counts[i];
+            acc->bitmap[acc->keys[i] / 64] |= UINT64_C(1) << (acc->keys[i] % 64);
+        }
+    }
+
+    free_null(acc->keys);
+    free_null(acc->values);
+    free_null(acc->counts);
+    acc->values = values;
+    acc->counts = counts;
+    acc->capacity = acc->dim;
+    acc->is_dense = 1;
+}
+
+/*
+ * Make sure that no_new_features more features can be added without exceeding a
+ * load factor of 0.5.
+ */
+static void reserve_features(struct cluster_accumulator* acc, uint64_t no_new_features) {
+    uint64_t i, new_capacity, old_capacity, slot;
+    KEY_TYPE *old_keys;
+    ACCUMULATOR_TYPE *old_values;
+    uint64_t *old_counts;
+
+    if (acc->is_dense || 2 * (acc->nnz + no_new_features) <= acc->capacity) return;
+
+    new_capacity = CLUSTER_HASHMAP_MIN_CAPACITY;
+    while (new_capacity < 2 * (acc->nnz + no_new_features)) new_capacity *= 2;
+
+    if (new_capacity >= acc->dim) {
+        /* the hash table would be larger than a dense vector */
+        switch_to_dense(acc);
+        return;
+    }
+
+    old_keys = acc->keys;
+    old_values = acc->values;
+    old_counts = acc->counts;
+    old_capacity = acc->capacity;
+
+    acc->capacity = new_capacity;
+    acc->keys = (KEY_TYPE*) calloc(new_capacity, sizeof(KEY_TYPE));
+    acc->values = (ACCUMULATOR_TYPE*) calloc(new_capacity, sizeof(ACCUMULATOR_TYPE));
+    acc->counts = (uint64_t*) calloc(new_capacity, sizeof(uint64_t));
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old_counts[i] != 0) {
+            slot = find_slot(acc, old_keys[i]);
+            acc->keys[slot] = old_keys[i];
+            acc->values[slot] = old_values[i];
+            acc->counts[slot] = old_counts[i];
+        }
+    }
+
+    free_null(old_keys);
+    free_null(old_values);
+    free_null(old_counts);
+}
+
+/*
+ * Position of key within values/counts. If key is not yet set, an empty
+ * entry is created and *added is set to 1. Needs reserve_features before.
+ */
+static uint64_t insert_feature(struct cluster_accumulator* acc, KEY_TYPE key, uint32_t* added) {
+    uint64_t slot;
+
+    if (acc->is_dense) {
+        slot = key;
+        if (acc->counts[slot] == 0) {
+            acc->bitmap[key / 64] |= UINT64_C(1) << (key % 64);
+        }
+    } else {
+        slot = find_slot(acc, key);
+        if (acc->counts[slot] == 0) {
+            acc->keys[slot] = key;
+            acc->values[slot] = 0;
+        }
+    }
+
+    if (acc->counts[slot] == 0) {
+        acc->nnz += 1;
+        *added = 1;
+    }
+    return slot;
+}
+
+/*
+ * Remove the entry at slot. Entries of the hash table behind slot are shifted
+ * back, so that no tombstones are needed.
+ */
+static void delete_feature(struct cluster_accumulator* acc, uint64_t slot) {
+    uint64_t next, home;
+
+    acc->nnz -= 1;
+    acc->values[slot] = 0;
+
+    if (acc->is_dense) {
+        acc->bitmap[slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+        return;
+    }
+
+    next = (slot + 1) & (acc->capacity - 1);
+    while (acc->counts[next] != 0) {
+        home = get_home_slot(acc, acc->keys[next]);
+
+        /* the entry at next may move into slot if its home is not within (slot, next] */
+        if ((slot < next && (home <= slot || home > next))
+            || (slot > next && (home <= slot && home > next))) {
+            acc->keys[slot] = acc->keys[next];
+            acc->values[slot] = acc->values[next];
+            acc->counts[slot] = acc->counts[next];
+            acc->counts[next] = 0;
+            acc->values[next] = 0;
+            slot = next;
+        }
+        next = (next + 1) & (acc->capacity - 1);
+    }
+}
+
+void initialize_cluster_hashmaps(struct cluster_accumulator* clusters_raw
+                                 , uint64_t no_clusters
+                                 , uint64_t dim) {
+    uint64_t i;
+
+    memset(clusters_raw, 0, no_clusters * sizeof(struct cluster_accumulator));
+    for (i = 0; i < no_clusters; i++) {
+        clusters_raw[i].dim = dim;
+    }
+}
+
+uint32_t add_sample_to_hashmap(struct cluster_accumulator* clusters_raw
                                       , KEY_TYPE* keys
                                       , VALUE_TYPE* values
                                       , uint64_t nnz
-                                      , uint64_t cluster_id) {
-    uint64_t sample_iter;
-    struct keyvaluecount_hash* cluster_entry;
+                                      , uint64_t cluster_id
+                                      , VALUE_TYPE weight) {
+    uint64_t sample_iter, slot;
+    struct cluster_accumulator* acc;
     uint32_t item_added;
 
+    acc = clusters_raw + cluster_id;
     item_added = 0;
+    reserve_features(acc, nnz);
+
     for (sample_iter = 0; sample_iter  < nnz; sample_iter++) {
-        cluster_entry = NULL;
-        HASH_FIND_INT(clusters_raw[cluster_id], keys + sample_iter, cluster_entry);
-        if (cluster_entry==NULL) {
-            cluster_entry = (struct keyvaluecount_hash*) malloc(sizeof(struct keyvaluecount_hash));
-            cluster_entry->id = *(keys + sample_iter);
-            cluster_entry->val = *(values + sample_iter);
-            cluster_entry->count = 1;
-            item_added = 1;
-            HASH_ADD_INT(clusters_raw[cluster_id], id, cluster_entry);
-        } else {
-            cluster_entry->val += *(values + sample_iter);
-            cluster_entry->count += 1;
-        }
+        slot = insert_feature(acc, keys[sample_iter], &item_added);
+        acc->values[slot] += weight * values[sample_iter];
+        acc->counts[slot] += 1;
     }
     return item_added;
 }
 
-uint32_t add_sample_to_hashmap_minibatch_kmeans(struct keyvaluecount_hash** clusters_raw
+uint32_t add_sample_to_hashmap_minibatch_kmeans(struct cluster_accumulator* clusters_raw
                                       , KEY_TYPE* keys
                                       , VALUE_TYPE* values
                                       , uint64_t nnz
                                       , uint64_t cluster_id
-                                      , uint64_t cluster_count) {
-    uint64_t sample_iter;
-    struct keyvaluecount_hash* cluster_entry;
+                                      , ACCUMULATOR_TYPE cluster_weight
+                                      , VALUE_TYPE weight) {
+    uint64_t sample_iter, slot;
+    struct cluster_accumulator* acc;
     uint32_t item_added;
 
-    struct keyvaluecount_hash *tmp;
+    acc = clusters_raw + cluster_id;
 
     /*
      * The operation done here is:
-     * learning_rate = 1 / (cluster_count + 1)
+     * learning_rate = weight / (cluster_weight + weight)
      * c = (1 - learning_rate) * c + leaning_rate * x
+     * (without sample weights: learning_rate = 1 / (cluster_count + 1))
      */
 
 
     /*
-     * This HASH_ITER does c = (1 - learning_rage) * c
+     * This loop does c = (1 - learning_rage) * c
      * which is the same as c = c - learning_rage * c
-     * which is the same as c = c - (c / (cluster_count + 1))
+     * which is the same as c = c - (c * weight / (cluster_weight + weight))
+     * (empty slots are 0 and stay 0)
      */
-    HASH_ITER(hh, clusters_raw[cluster_id], cluster_entry, tmp) {
-        cluster_entry->val -= cluster_entry->val / (cluster_count + 1);
+    for (slot = 0; slot < acc->capacity; slot++) {
+        acc->values[slot] -= acc->values[slot] * weight / (cluster_weight + weight);
     }
 
     /*
      * This for loop does c = c + learning_rate * x
-     * which is the same as c = c + x / (cluster_count + 1)
+     * which is the same as c = c + x * weight / (cluster_weight + weight)
      */
     item_added = 0;
+    reserve_features(acc, nnz);
+
     for (sample_iter = 0; sample_iter  < nnz; sample_iter++) {
-        cluster_entry = NULL;
-        HASH_FIND_INT(clusters_raw[cluster_id], keys + sample_iter, cluster_entry);
-        if (cluster_entry==NULL) {
-            cluster_entry = (struct keyvaluecount_hash*) malloc(sizeof(struct keyvaluecount_hash));
-            cluster_entry->id = *(keys + sample_iter);
-            cluster_entry->val = (*(values + sample_iter) / (cluster_count + 1));
-            item_added = 1;
-            HASH_ADD_INT(clusters_raw[cluster_id], id, cluster_entry);
-        } else {
-            cluster_entry->val += (*(values + sample_iter) / (cluster_count + 1));
-        }
+        slot = insert_feature(acc, keys[sample_iter], &item_added);
+        acc->values[slot] += (values[sample_iter] * weight / (cluster_weight + weight));
+        acc->counts[slot] += 1;
     }
     return item_added;
 }
 
-void remove_sample_from_hashmap(struct keyvaluecount_hash** clusters_raw
+void remove_sample_from_hashmap(struct cluster_accumulator* clusters_raw
                                        , KEY_TYPE* keys
                                        , VALUE_TYPE* values
                                        , uint64_t nnz
-                                       , uint64_t cluster_id) {
-    uint64_t sample_iter;
-    struct keyvaluecount_hash* cluster_entry;
+                                       , uint64_t cluster_id
+                                       , VALUE_TYPE weight) {
+    uint64_t sample_iter, slot;
+    struct cluster_accumulator* acc;
+
+    acc = clusters_raw + cluster_id;
 
     for (sample_iter = 0; sample_iter  < nnz; sample_iter++) {
-        cluster_entry = NULL;
-        HASH_FIND_INT(clusters_raw[cluster_id], keys + sample_iter, cluster_entry);
-        if (cluster_entry==NULL) {
+        if (acc->is_dense) {
+            slot = keys[sample_iter];
+        } else {
+            slot = (acc->capacity > 0) ? find_slot(acc, keys[sample_iter]) : 0;
+        }
+
+        if (acc->capacity == 0 || acc->counts[slot] == 0) {
             LOG_ERROR("expected element in hashmap but it is not available!");
         } else {
-            cluster_entry->val -= *(values + sample_iter);
-            cluster_entry->count -= 1;
+            acc->values[slot] -= weight * values[sample_iter];
+            acc->counts[slot] -= 1;
 
-            if (cluster_entry->count == 0) {
-                HASH_DEL(clusters_raw[cluster_id], cluster_entry);
-                free(cluster_entry);
-            }
+            if (acc->counts[slot] == 0) delete_feature(acc, slot);
         }
     }
 }
 
-int id_sort(struct keyvaluecount_hash *a, struct keyvaluecount_hash *b) {
-    if (a->id < b->id) return -1;
-    if (a->id > b->id) return 1;
-    return 0;
+uint64_t get_cluster_hashmap_memory_consumption(struct cluster_accumulator *acc) {
+    uint64_t memory_consumption;
 
+    memory_consumption = sizeof(struct cluster_accumulator)
+                         + acc->capacity * (sizeof(ACCUMULATOR_TYPE) + sizeof(uint64_t));
+    if (acc->is_dense) {
+        memory_consumption += ((acc->dim + 63) / 64) * sizeof(uint64_t);
+    } else {
+        memory_consumption += acc->capacity * sizeof(KEY_TYPE);
+    }
+    return memory_consumption;
 }
 
-void free_keyvaluecount_hashmap(struct keyvaluecount_hash *k) {
-    struct keyvaluecount_hash *current_item, *tmp;
+void free_cluster_hashmaps(struct cluster_accumulator* clusters
+                           , uint64_t no_clusters) {
+    uint64_t i;
 
-    HASH_ITER(hh, k, current_item, tmp) {
-      HASH_DEL(k,current_item);  /* delete; users advances to next */
-      free(current_item);            /* optional- if you want to free  */
+    for (i = 0; i < no_clusters; i++) {
+        free_null(clusters[i].keys);
+        free_null(clusters[i].values);
+        free_null(clusters[i].counts);
+        free_null(clusters[i].bitmap);
+        clusters[i].nnz = 0;
+        clusters[i].capacity = 0;
+        clusters[i].is_dense = 0;
     }
 }
 
-void free_cluster_hashmaps(struct keyvaluecount_hash ** clusters
-                           , uint64_t no_clusters) {
-    uint64_t i;
+static int compare_keys(const void *a, const void *b) {
+    KEY_TYPE key_a, key_b;
+
+    key_a = *((const KEY_TYPE*) a);
+    key_b = *((const KEY_TYPE*) b);
+    if (key_a < key_b) return -1;
+    if (key_a > key_b) return 1;
+    return 0;
+}
+
+void create_vector_from_hashmap(struct cluster_accumulator* acc
+                                , ACCUMULATOR_TYPE cluster_weight
+                                , struct sparse_vector *vector) {
+    uint64_t i, local_feature_count, word;
+    KEY_TYPE key;
+
+    vector->nnz = acc->nnz;
+    vector->keys = NULL;
+    vector->values = NULL;
+    if (acc->nnz == 0) return;
 
-  for (i = 0; i < no_clusters; i++) {
-      free_keyvaluecount_hashmap(clusters[i]);
-      clusters[i] = NULL;
-  }
+    vector->keys = (KEY_TYPE*) calloc(acc->nnz, sizeof(KEY_TYPE));
+    vector->values = (VALUE_TYPE*) calloc(acc->nnz, sizeof(VALUE_TYPE));
+
+    local_feature_count = 0;
+    if (acc->is_dense) {
+        /* the bitmap yields the features in ascending order */
+        for (i = 0; i < (acc->dim + 63) / 64; i++) {
+            word = acc->bitmap[i];
+            while (word != 0) {
+#ifdef __GNUC__
+                key = (KEY_TYPE) (i * 64 + __builtin_ctzll(word));
+#else
+                for (key = 0; !(word & (UINT64_C(1) << key)); key++);
+                key = (KEY_TYPE) (i * 64 + key);
+#endif
+                word &= word - 1;
+                vector->keys[local_feature_count] = key;
+                vector->values[local_feature_count] = acc->values[key] / cluster_weight;
+                local_feature_count += 1;
+            }
+        }
+    } else {
+        for (i = 0; i < acc->capacity; i++) {
+            if (acc->counts[i] != 0) {
+                vector->keys[local_feature_count] = acc->keys[i];
+                local_feature_count += 1;
+            }
+        }
+        qsort(vector->keys, acc->nnz, sizeof(KEY_TYPE), compare_keys);
+        for (i = 0; i < acc->nnz; i++) {
+            vector->values[i] = acc->values[find_slot(acc, vector->keys[i])] / cluster_weight;
+        }
+    }
 }
 
-void create_matrix_from_hashmap(struct keyvaluecount_hash** clusters_raw
-                                       , uint64_t* cluster_counts
+void create_matrix_from_hashmap(struct cluster_accumulator* clusters_raw
+                                       , ACCUMULATOR_TYPE* cluster_weights
                                        , struct csr_matrix *clusters) {
     uint64_t i, nnz;
+    struct sparse_vector vector;
     nnz = 0;
 
     /* calculate number of non zero values */
     for (i = 0; i < clusters->sample_count; i++) {
-        nnz += HASH_COUNT(clusters_raw[i]);
+        nnz += clusters_raw[i].nnz;
         clusters->pointers[i + 1] = nnz;
     }
 
@@ -155,44 +370,24 @@ void create_matrix_from_hashmap(struct keyvaluecount_hash** clusters_raw
 
     /* fill sparse cluster matrix */
     for (i = 0; i < clusters->sample_count; i++) {
-        uint64_t local_feature_count;
-        struct keyvaluecount_hash *current_item, *tmp;
-        current_item = NULL;
-        tmp = NULL;
-
-        local_feature_count = 0;
-        HASH_ITER(hh, clusters_raw[i], current_item, tmp) {
-          clusters->keys[clusters->pointers[i] + local_feature_count] = current_item->id;
-          clusters->values[clusters->pointers[i] + local_feature_count] = current_item->val / cluster_counts[i];
-          local_feature_count += 1;
+        create_vector_from_hashmap(clusters_raw + i, cluster_weights[i], &vector);
+        if (vector.nnz > 0) {
+            memcpy(clusters->keys + clusters->pointers[i], vector.keys, vector.nnz * sizeof(KEY_TYPE));
+            memcpy(clusters->values + clusters->pointers[i], vector.values, vector.nnz * sizeof(VALUE_TYPE));
         }
+        free_null(vector.keys);
+        free_null(vector.values);
     }
 }
 
-void create_vector_list_from_hashmap(struct keyvaluecount_hash** clusters_raw
-                                       , uint64_t* cluster_counts
+void create_vector_list_from_hashmap(struct cluster_accumulator* clusters_raw
+                                       , ACCUMULATOR_TYPE* cluster_weights
                                        , struct sparse_vector *clusters
                                        , uint64_t no_cluster) {
     uint64_t i;
 
     /* fill sparse cluster matrix */
     for (i = 0; i < no_cluster; i++) {
-        uint64_t local_feature_count;
-        struct keyvaluecount_hash *current_item, *tmp;
-        current_item = NULL;
-        tmp = NULL;
-
-        clusters[i].nnz = HASH_COUNT(clusters_raw[i]);
-        if (clusters[i].nnz > 0) {
-            clusters[i].keys = (KEY_TYPE*) calloc(clusters[i].nnz, sizeof(KEY_TYPE));
-            clusters[i].values = (VALUE_TYPE*) calloc(clusters[i].nnz, sizeof(VALUE_TYPE));
-        }
-
-        local_feature_count = 0;
-        HASH_ITER(hh, clusters_raw[i], current_item, tmp) {
-          clusters[i].keys[local_feature_count] = current_item->id;
-          clusters[i].values[local_feature_count] = current_item->val / cluster_counts[i];
-          local_feature_count += 1;
-        }
+        create_vector_from_hashmap(clusters_raw + i, cluster_weights[i], clusters + i);
     }
 }
@@ -5,7 +5,6 @@
 #include "../../utils/types.h"
 #include "../../utils/matrix/csr_matrix/csr_matrix.h"
 #include "../../utils/matrix/vector_list/vector_list.h"
-#include "../../utils/uthash.h"
 
 /**
  * @brief Structure is used to efficiently update sparse cluster centers.
@@ -18,113 +17,140 @@
  *
  * Basically the value for feature_0 is summed up over all samples in S which actually
  * have feature_0 set. And count equals the number of samples which had feature_0 set.
+ *
+ * Small clusters are stored in an open addressing hash table (linear probing).
+ * Once the table would need more slots than the cluster has dimensions, the cluster
+ * switches to dense arrays of length dim together with a bitmap of the set features.
+ * In both cases no memory is allocated per feature.
  */
-struct keyvaluecount_hash {
-    KEY_TYPE id;           /**< The id of a specific dimension of a cluster */
-    VALUE_TYPE val;        /**< The accumulated value of one dimension of the cluster center */
-    uint64_t count;        /**< The number of samples which had these feature set within this cluster */
-    UT_hash_handle hh;     /**< ut_hash element which makes this structure hashable */
+struct cluster_accumulator {
+    uint64_t dim;                 /**< Number of features of the samples */
+    uint64_t nnz;                 /**< Number of features with count > 0 */
+    uint64_t capacity;            /**< Number of slots (hash table) or dim (dense) */
+    uint32_t is_dense;            /**< True if the arrays are indexed by the feature */
+    KEY_TYPE *keys;               /**< Feature of every slot (only hash table) */
+    ACCUMULATOR_TYPE *values;     /**< Accumulated value of every slot */
+    uint64_t *counts;             /**< Number of samples in every slot, 0 = slot is empty */
+    uint64_t *bitmap;             /**< Bit i is set if count of feature i > 0 (only dense) */
 };
 
 /**
- * @brief Add one sample to a specific cluster dictionary in clusters_raw.
+ * @brief Initialize empty accumulators for no_clusters clusters.
+ *
+ * @param[out] clusters_raw Array of no_clusters accumulators.
+ * @param[in] no_clusters Length of clusters_raw.
+ * @param[in] dim Number of features of the samples.
+ */
+void initialize_cluster_hashmaps(struct cluster_accumulator* clusters_raw
+                                 , uint64_t no_clusters
+                                 , uint64_t dim);
+
+/**
+ * @brief Add one sample to a specific cluster accumulator in clusters_raw.
  *
- * @param[in] clusters_raw Dictionary of dictionarys (one for every cluster)
+ * @param[in] clusters_raw Accumulators (one for every cluster)
  * @param[in] keys of the sparse sample
  * @param[in] values of the sparse sample
  * @param[in] nnz Number of non zero values (=length of keys/values)
  * @param[in] cluster_id The cluster id to add this sample to.
- * @return True(1) if a new item was added to the dictionary else False(0)
+ * @param[in] weight The values of the sample are multiplied with this weight (1 for unweighted samples).
+ * @return True(1) if a new feature was added to the accumulator else False(0)
  */
-uint32_t add_sample_to_hashmap(struct keyvaluecount_hash** clusters_raw
+uint32_t add_sample_to_hashmap(struct cluster_accumulator* clusters_raw
                                       , KEY_TYPE* keys
                                       , VALUE_TYPE* values
                                       , uint64_t nnz
-                                      , uint64_t cluster_id);
+                                      , uint64_t cluster_id
+                                      , VALUE_TYPE weight);
 
 /**
- * @brief Add one sample to a specific cluster dictionary in clusters_raw.
+ * @brief Add one sample to a specific cluster accumulator in clusters_raw.
  *        for the minibatch kmeans case
  *
- * @param[in] clusters_raw Dictionary of dictionarys (one for every cluster)
+ * @param[in] clusters_raw Accumulators (one for every cluster)
  * @param[in] keys of the sparse sample
  * @param[in] values of the sparse sample
  * @param[in] nnz Number of non zero values (=length of keys/values)
  * @param[in] cluster_id The cluster id to add this sample to.
- * @param[in] cluster_count The number of samples that were already added to this cluster.
- * @return True(1) if a new item was added to the dictionary else False(0)
+ * @param[in] cluster_weight The summed weight of the samples that were already added to this cluster
+ *                           (the number of samples for unweighted samples).
+ * @param[in] weight The weight of the sample (1 for unweighted samples).
+ * @return True(1) if a new feature was added to the accumulator else False(0)
  */
-uint32_t add_sample_to_hashmap_minibatch_kmeans(struct keyvaluecount_hash** clusters_raw
+uint32_t add_sample_to_hashmap_minibatch_kmeans(struct cluster_accumulator* clusters_raw
                                       , KEY_TYPE* keys
                                       , VALUE_TYPE* values
                                       , uint64_t nnz
                                       , uint64_t cluster_id
-                                      , uint64_t cluster_count);
+                                      , ACCUMULATOR_TYPE cluster_weight
+                                      , VALUE_TYPE weight);
 
 /**
- * @brief Remove one sample from a specific cluster dictionary in clusters_raw.
+ * @brief Remove one sample from a specific cluster accumulator in clusters_raw.
  *
- * @param[in] clusters_raw Dictionary of dictionarys (one for every cluster)
+ * @param[in] clusters_raw Accumulators (one for every cluster)
  * @param[in] keys of the sparse sample
  * @param[in] values of the sparse sample
  * @param[in] nnz Number of non zero values (=length of keys/values)
  * @param[in] cluster_id The cluster id to remove this sample from.
+ * @param[in] weight The weight the sample was added with.
  */
-void remove_sample_from_hashmap(struct keyvaluecount_hash** clusters_raw
+void remove_sample_from_hashmap(struct cluster_accumulator* clusters_raw
                                        , KEY_TYPE* keys
                                        , VALUE_TYPE* values
                                        , uint64_t nnz
-                                       , uint64_t cluster_id);
+                                       , uint64_t cluster_id
+                                       , VALUE_TYPE weight);
 
 /**
- * @brief Comparator function used for sorting.
+ * @brief Number of bytes used by a cluster accumulator.
  *
- * @param[in] a First element which shall be compared.
- * @param[in] b Second element which shall be compared.
- * @return (-1) if a->id < b->id
- *         ( 0) if a->id == b->id
- *         ( 1) if a->id > b->id
+ * @param[in] acc Accumulator.
+ * @return Memory consumption in bytes.
  */
-int id_sort(struct keyvaluecount_hash *a, struct keyvaluecount_hash *b);
-
+uint64_t get_cluster_hashmap_memory_consumption(struct cluster_accumulator *acc);
 
 /**
- * @brief Cleanup a specific cluster dictionary/hashmap.
+ * Cleanup all cluster accumulators. They can be reused afterwards.
  *
- * @param[in] k Dictionary/Hashmap to cleanup.
+ * @param[in] clusters The accumulators to cleanup.
+ * @param[in] no_clusters Length of clusters
  */
-void free_keyvaluecount_hashmap(struct keyvaluecount_hash *k);
+void free_cluster_hashmaps(struct cluster_accumulator* clusters
+                           , uint64_t no_clusters);
 
 /**
- * Cleanup all cluster dictionaries/hashmaps.
+ * Create a sparse vector (sorted by key) from a cluster accumulator.
  *
- * @param[in] clusters The dictionaries to cleanup.
- * @param[in] no_clusters Length of clusters dictionary
+ * @param[in] acc Accumulator of the cluster.
+ * @param[in] cluster_weight Every value is divided by this number.
+ * @param[out] vector Resulting vector (keys/values are allocated if acc->nnz > 0).
  */
-void free_cluster_hashmaps(struct keyvaluecount_hash ** clusters
-                           , uint64_t no_clusters);
+void create_vector_from_hashmap(struct cluster_accumulator* acc
+                                , ACCUMULATOR_TYPE cluster_weight
+                                , struct sparse_vector *vector);
 
 /**
- * Create a csr matrix from a dictionary of cluster dictionaries.
+ * Create a csr matrix from cluster accumulators.
  *
- * @param[in] clusters_raw Dictionary of cluster dictionaries.
- * @param[in] cluster_counts For every cluster dict in clusters_raw the no_samples in that cluster.
+ * @param[in] clusters_raw Accumulators (one for every cluster).
+ * @param[in] cluster_weights For every accumulator in clusters_raw the summed weight of the samples in that cluster.
  * @param[out] clusters Resulting csr matrix.
  */
-void create_matrix_from_hashmap(struct keyvaluecount_hash** clusters_raw
-                                       , uint64_t* cluster_counts
+void create_matrix_from_hashmap(struct cluster_accumulator* clusters_raw
+                                       , ACCUMULATOR_TYPE* cluster_weights
                                        , struct csr_matrix *clusters);
 
 /**
- * Create a vector list from a dictionary of cluster dictionaries.
+ * Create a vector list from cluster accumulators.
  *
- * @param[in] clusters_raw Dictionary of cluster dictionaries.
- * @param[in] cluster_counts For every cluster dict in clusters_raw the no_samples in that cluster.
+ * @param[in] clusters_raw Accumulators (one for every cluster).
+ * @param[in] cluster_weights For every accumulator in clusters_raw the summed weight of the samples in that cluster.
  * @param[out] clusters Resulting array of vectors.
  * @param[in] no_cluster length of clusters array.
  */
-void create_vector_list_from_hashmap(struct keyvaluecount_hash** clusters_raw
-                                       , uint64_t* cluster_counts
+void create_vector_list_from_hashmap(struct cluster_accumulator* clusters_raw
+                                       , ACCUMULATOR_TYPE* cluster_weights
                                        , struct sparse_vector *clusters
                                        , uint64_t no_cluster);
 
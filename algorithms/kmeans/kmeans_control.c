@@ -9,6 +9,9 @@
 #include "pca_yinyang.h"
 #include "kmeanspp.h"
 #include "nc_kmeans.h"
+#include "hamerly.h"
+#include "pca_hamerly.h"
+#include "exponion.h"
 
 const char *KMEANS_ALGORITHM_NAMES[NO_KMEANS_ALGOS] = {"kmeans"
 										  , "bv_kmeans"
@@ -28,7 +31,11 @@ const char *KMEANS_ALGORITHM_NAMES[NO_KMEANS_ALGOS] = {"kmeans"
 										  , "kmeans++"
 										  , "bv_kmeans++"
 										  , "pca_kmeans++"
-										  , "nc_kmeans"};
+										  , "nc_kmeans"
+										  , "hamerly"
+										  , "bv_hamerly"
+										  , "pca_hamerly"
+										  , "exponion"};
 
 const char *KMEANS_ALGORITHM_DESCRIPTION[NO_KMEANS_ALGOS] = {"standard k-means"
 											  , "k-means optimized (no_change, with block vectors)"
@@ -48,7 +55,11 @@ const char *KMEANS_ALGORITHM_DESCRIPTION[NO_KMEANS_ALGOS] = {"standard k-means"
 											  , "kmeans++ as full clustering strategy (not just init)"
 											  , "kmeans++ (with block vectors)"
 											  , "kmeans++ (with pca lower bounds)"
-											  , "no_change kmeans: standard kmeans with optimization avoiding calculations if centers did not change"};
+											  , "no_change kmeans: standard kmeans with optimization avoiding calculations if centers did not change"
+											  , "triangle inequality optimized kmeans with one lower bound per sample (less memory than elkan)"
+											  , "triangle inequality optimized kmeans with one lower bound per sample (with block vectors)"
+											  , "triangle inequality optimized kmeans with one lower bound per sample and pca lower bounds"
+											  , "exponion k-means: hamerly bounds, only clusters in a ball around the assigned cluster are searched"};
 
 kmeans_algorithm_function KMEANS_ALGORITHM_FUNCTIONS[NO_KMEANS_ALGOS] = {bv_kmeans
 														  , bv_kmeans
@@ -68,13 +79,19 @@ kmeans_algorithm_function KMEANS_ALGORITHM_FUNCTIONS[NO_KMEANS_ALGOS] = {bv_kmea
                                                           , bv_kmeanspp
                                                           , bv_kmeanspp
                                                           , bv_kmeanspp
-														  , nc_kmeans};
+														  , nc_kmeans
+                                                          , hamerly_kmeans
+                                                          , hamerly_kmeans
+                                                          , pca_hamerly_kmeans
+                                                          , exponion_kmeans};
 
 const char *KMEANS_INIT_NAMES[NO_KMEANS_INITS] = {"random"
                                                   , "kmeans++"
-                                                  , "initialization_params"};
+                                                  , "initialization_params"
+                                                  , "kmeans||"};
 
 const char *KMEANS_INIT_DESCRIPTION[NO_KMEANS_INITS] = {"initial cluster centers are random samples from input matrix",
                                   	  	                "initial cluster centers are samples from input matrix chosen by kmeans++ strategy",
-                                                        "a list with len(list) = len(samples) is supplied which assigns each sample to a (subset of samples) = cluster centers"};
+                                                        "a list with len(list) = len(samples) is supplied which assigns each sample to a (subset of samples) = cluster centers",
+                                                        "scalable kmeans++: a few rounds choose many candidates at once, kmeans++ on the weighted candidates picks the cluster centers"};
 
@@ -5,7 +5,7 @@
 #ifndef KMEANS_CONTROL_H
 #define KMEANS_CONTROL_H
 
-#define NO_KMEANS_ALGOS                               UINT32_C(19)
+#define NO_KMEANS_ALGOS                               UINT32_C(23)
 #define ALGORITHM_KMEANS                              UINT32_C(0)
 #define ALGORITHM_BV_KMEANS                           UINT32_C(1)
 #define ALGORITHM_BV_KMEANS_ONDEMAND                  UINT32_C(2)
@@ -25,12 +25,17 @@
 #define ALGORITHM_BV_KMEANSPP                         UINT32_C(16)
 #define ALGORITHM_PCA_KMEANSPP                        UINT32_C(17)
 #define ALGORITHM_NC_KMEANS                           UINT32_C(18)
+#define ALGORITHM_HAMERLY                             UINT32_C(19)
+#define ALGORITHM_BV_HAMERLY                          UINT32_C(20)
+#define ALGORITHM_PCA_HAMERLY                         UINT32_C(21)
+#define ALGORITHM_EXPONION                            UINT32_C(22)
 
 
-#define NO_KMEANS_INITS                      UINT32_C(3)
+#define NO_KMEANS_INITS                      UINT32_C(4)
 #define KMEANS_INIT_RANDOM                   UINT32_C(0)
 #define KMEANS_INIT_KMPP                     UINT32_C(1)
 #define KMEANS_INIT_PARAMS                   UINT32_C(2)
+#define KMEANS_INIT_KMEANS_PARALLEL          UINT32_C(3)
 
 extern const char *KMEANS_ALGORITHM_NAMES[NO_KMEANS_ALGOS];
 extern const char *KMEANS_ALGORITHM_DESCRIPTION[NO_KMEANS_ALGOS];
@@ -62,6 +67,8 @@ struct kmeans_params {
     struct cdict* tr;                       /**< tracking data results. e.g. calculations per iteration */
     struct csr_matrix* ext_vects;           /**< externally supplied vectors */
     struct initialization_params* initprms; /**< parameters that control the initialization step of kmeans */
+    VALUE_TYPE* sample_weights;             /**< weight > 0 of every sample (NULL = every sample has weight 1) */
+    uint64_t coreset_size;                  /**< if > 0 cluster a weighted coreset of this many samples (see coreset_kmeans) */
 };
 
 typedef struct kmeans_result* (*kmeans_algorithm_function) (struct csr_matrix* samples, struct kmeans_params *prms);
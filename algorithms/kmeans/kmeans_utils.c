@@ -5,6 +5,7 @@
 
 #include "../../utils/fcl_logging.h"
 #include "../../utils/fcl_time.h"
+#include "../../utils/fcl_numa.h"
 #include "../../utils/matrix/csr_matrix/csr_to_vector_list.h"
 #include "../../utils/matrix/csr_matrix/csr_math.h"
 #include "../../utils/matrix/vector_list/vector_list_math.h"
@@ -16,6 +17,29 @@
 #define UPDATE_TYPE_KMEANS           UINT32_C(0)
 #define UPDATE_TYPE_MINIBATCH_KMEANS UINT32_C(1)
 
+/* values of the additional parameter sample_order */
+#define SAMPLE_ORDER_INPUT   UINT32_C(0)
+#define SAMPLE_ORDER_CLUSTER UINT32_C(1)
+#define SAMPLE_ORDER_FEATURE UINT32_C(2)
+
+/* tile sizes of assign_samples_blocked. A tile of dot products
+ * (BLOCKED_SAMPLES_TILE x BLOCKED_CLUSTERS_TILE) is kept per thread.
+ */
+#define BLOCKED_SAMPLES_TILE  UINT64_C(32)
+#define BLOCKED_CLUSTERS_TILE UINT64_C(128)
+
+/* number of worklist positions next_sample_position hands out at once */
+#define SAMPLE_CHUNK_SIZE UINT64_C(256)
+
+/* number of samples per leaf of the kmeans++ sum tree */
+#define KMPP_BLOCK_SIZE UINT64_C(4096)
+
+/* number of group positions a thread examines at once in a kmeans++ pass */
+#define KMPP_CHUNK_SIZE UINT64_C(1000)
+
+/* number of samples per block when kmeans|| collects the candidates of a round */
+#define KMPAR_BLOCK_SIZE UINT64_C(4096)
+
 typedef void (*kmeans_init_function) (struct general_kmeans_context* ctx
         											, struct kmeans_params *prms);
 
@@ -24,12 +48,52 @@ typedef void (*kmeans_preinit_function) (struct csr_matrix *mtrx, struct kmeans_
 kmeans_init_function KMEANS_INIT_FUNCTIONS[NO_KMEANS_INITS] \
                                       = {initialize_kmeans_random,
                                          initialize_kmeans_pp,
-                                         initialize_kmeans_init_params};
+                                         initialize_kmeans_init_params,
+                                         initialize_kmeans_parallel};
 
 kmeans_preinit_function KMEANS_PREINIT_FUNCTIONS[NO_KMEANS_INITS] \
                                                   = {NULL,
                                                      NULL,
-                                                     preinitialize_kmeans_init_params};
+                                                     preinitialize_kmeans_init_params,
+                                                     NULL};
+
+/* sums of the kmeans++ weights of blocks of KMPP_BLOCK_SIZE samples as complete
+ * binary tree: node i has the children 2i and 2i + 1, the leaves start at no_leaves
+ */
+struct kmpp_sum_tree {
+    ACCUMULATOR_TYPE *nodes;
+    uint64_t no_leaves;
+    uint64_t no_blocks;
+    uint32_t *block_changed;      /* blocks which contain samples whose weight changed */
+};
+
+/* data the kmeans++ inits use to skip distance calculations */
+struct kmpp_pruning {
+    uint64_t use_triangle_inequality;
+    struct csr_matrix block_vectors_samples;     /* sample_count == 0 if block vectors are disabled */
+    struct sparse_vector* pca_projection_samples; /* NULL if pca is disabled */
+    VALUE_TYPE* vector_lengths_pca_samples;
+};
+
+/* the samples grouped by their closest center. A kmeans++ pass for a new center
+ * only examines the groups which the triangle inequality cannot skip as a whole.
+ * Samples which move to the new center stay in their old group until most
+ * samples of the group moved.
+ */
+struct kmpp_center_groups {
+    uint64_t **samples;             /* sample ids of every group */
+    uint64_t *sizes;                /* including the samples which moved to another group */
+    uint64_t *no_moved;             /* samples of the group which moved to another group */
+    VALUE_TYPE *radius;             /* upper bound of the distance of a sample of the group to its center */
+    VALUE_TYPE *center_distances;   /* distance of every center to the new center */
+    uint64_t *examined;             /* groups examined in the current pass */
+    uint64_t *offsets;              /* start of every examined group in the current pass */
+    uint64_t no_threads;
+    uint64_t **thread_moved;        /* samples every thread moved to the new center */
+    uint64_t *thread_no_moved;
+    uint64_t *thread_capacities;
+    VALUE_TYPE *thread_radius;      /* largest distance of a moved sample to the new center */
+};
 
 void get_kmeanspp_assigns(struct csr_matrix *mtrx
                           , struct csr_matrix *blockvectors_mtrx
@@ -45,24 +109,60 @@ void get_kmeanspp_assigns(struct csr_matrix *mtrx
                           , uint64_t *initial_cluster_samples
                           , uint32_t verbose
                           , struct cdict* tr
-                          , uint32_t* stop);
+                          , uint32_t* stop
+                          , VALUE_TYPE *sample_weights);
 
 void free_general_context(struct general_kmeans_context* ctx
                           , struct kmeans_params *prms) {
+    uint64_t i;
 
     free_vector_list(ctx->cluster_vectors, ctx->no_clusters);
     free_null(ctx->cluster_vectors);
     free_cluster_hashmaps(ctx->clusters_raw, ctx->no_clusters);
     free_null(ctx->clusters_raw);
+    free_null(ctx->thread_stats);
+    free_null(ctx->partition_ranges);
+    free_null(ctx->sample_calcs);
+    if (ctx->thread_block_vectors) free_vector_list(ctx->thread_block_vectors, ctx->no_threads);
+    free_null(ctx->thread_block_vectors);
     free_null(ctx->cluster_distances);
     free_null(ctx->cluster_assignments);
     free_null(ctx->initial_cluster_samples);
     free_null(ctx->cluster_counts);
+    free_null(ctx->cluster_weights);
     free_null(ctx->vector_lengths_samples);
     free_null(ctx->vector_lengths_clusters);
     free_null(ctx->clusters_not_changed);
     free_null(ctx->was_assigned);
     free_null(ctx->previous_cluster_assignments);
+    free_null(ctx->dense_cluster_vectors);
+    free_null(ctx->dense_transposed_clusters);
+    if (ctx->dense_cluster_replicas != NULL) {
+        for (i = 0; i < ctx->no_dense_cluster_replicas; i++) {
+            free_null(ctx->dense_cluster_replicas[i]);
+        }
+        free_null(ctx->dense_cluster_replicas);
+    }
+    if (ctx->compressed_sample_keys != NULL) {
+        free_csr_compressed_keys(ctx->compressed_sample_keys);
+        free_null(ctx->compressed_sample_keys);
+    }
+    if (ctx->thread_sample_keys != NULL) {
+        for (i = 0; i < ctx->no_threads; i++) {
+            free_null(ctx->thread_sample_keys[i].keys);
+        }
+        free_null(ctx->thread_sample_keys);
+    }
+    if (ctx->input_samples != NULL) {
+        /* free the reordered copy of the samples */
+        free_csr_matrix(ctx->samples);
+        free_null(ctx->samples);
+        ctx->samples = ctx->input_samples;
+        ctx->input_samples = NULL;
+        if (ctx->sample_weights != prms->sample_weights) free_null(ctx->sample_weights);
+    }
+    free_null(ctx->sample_order);
+    free_null(ctx->sample_positions);
 }
 
 void free_kmeans_result(struct kmeans_result* res) {
@@ -167,16 +267,14 @@ void initialize_kmeans_init_params(struct general_kmeans_context* ctx,
         keys = ctx->samples->keys + ctx->samples->pointers[i];
         values = ctx->samples->values + ctx->samples->pointers[i];
         nnz = ctx->samples->pointers[i + 1] - ctx->samples->pointers[i];
-        add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->cluster_assignments[i]);
+        add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->cluster_assignments[i]
+                              , get_sample_weight(ctx, i));
+        ctx->cluster_weights[ctx->cluster_assignments[i]] += get_sample_weight(ctx, i);
         ctx->was_assigned[i] = 1;
     }
 
-    for (i = 0; i < prms->no_clusters; i++) {
-        HASH_SORT(ctx->clusters_raw[i], id_sort);
-    }
-
     create_vector_list_from_hashmap(ctx->clusters_raw
-                                        , ctx->cluster_counts
+                                        , ctx->cluster_weights
                                         , ctx->cluster_vectors
                                         , ctx->no_clusters);
 
@@ -186,32 +284,23 @@ void initialize_kmeans_init_params(struct general_kmeans_context* ctx,
 
 }
 
-void initialize_kmeans_pp(struct general_kmeans_context* ctx,
-                              struct kmeans_params *prms) {
-
-    uint64_t i;
-    KEY_TYPE *keys;
-    VALUE_TYPE *values;
-    uint64_t nnz;
-    uint64_t use_triangle_inequality;
-
-    /* Block vector variables */
+/* read the kmeans++ pruning options (kmpp_use_triangle_inequality, kmpp_bv_annz,
+ * kmpp_use_pca) and create the block vectors / pca projections of the samples
+ */
+static void initialize_kmpp_pruning(struct general_kmeans_context* ctx
+                                    , struct kmeans_params *prms
+                                    , struct kmpp_pruning* pruning) {
     uint64_t block_vectors_dim;         /* size of block vectors */
     VALUE_TYPE desired_bv_annz;         /* desired size of the block vectors */
-    struct csr_matrix block_vectors_samples;  /* block vector matrix of samples */
+    uint64_t use_pca;
 
-    /* PCA variables */
-    uint64_t use_pca;                 /* desired size of the block vectors */
-    VALUE_TYPE* vector_lengths_pca_samples;
-    struct sparse_vector* pca_projection_samples;
-
-    pca_projection_samples = NULL;
-    vector_lengths_pca_samples = NULL;
-    block_vectors_samples.sample_count = 0;
+    pruning->pca_projection_samples = NULL;
+    pruning->vector_lengths_pca_samples = NULL;
+    pruning->block_vectors_samples.sample_count = 0;
     desired_bv_annz = d_get_subfloat_default(&(prms->tr)
                                             , "additional_params", "kmpp_bv_annz", 0);
 
-    use_triangle_inequality = d_get_subint_default(&(prms->tr)
+    pruning->use_triangle_inequality = d_get_subint_default(&(prms->tr)
                             , "additional_params", "kmpp_use_triangle_inequality", 0);
 
     use_pca = d_get_subint_default(&(prms->tr)
@@ -219,59 +308,722 @@ void initialize_kmeans_pp(struct general_kmeans_context* ctx,
 
     if (use_pca && prms->ext_vects != NULL) {
         if (prms->verbose) LOG_INFO("kmeans++ pca activated");
-        pca_projection_samples = matrix_dot(ctx->samples, prms->ext_vects);
-        calculate_vector_list_lengths(pca_projection_samples, ctx->samples->sample_count, &vector_lengths_pca_samples);
+        pruning->pca_projection_samples = matrix_dot(ctx->samples, prms->ext_vects);
+        calculate_vector_list_lengths(pruning->pca_projection_samples, ctx->samples->sample_count, &(pruning->vector_lengths_pca_samples));
     }
 
     if (desired_bv_annz > 0) {
         if (prms->verbose) LOG_INFO("kmeans++ block vectors activated with annz: %.3f", desired_bv_annz);
         determine_block_vectors_for_matrix(ctx->samples
                                            , desired_bv_annz
-                                           , &block_vectors_samples
+                                           , &(pruning->block_vectors_samples)
                                            , &block_vectors_dim);
         if (prms->verbose) LOG_INFO("kmeans++ done getting block vector matrix");
     }
+}
+
+static void free_kmpp_pruning(struct general_kmeans_context* ctx
+                              , struct kmpp_pruning* pruning) {
+    if (pruning->block_vectors_samples.sample_count > 0) {
+        free_csr_matrix(&(pruning->block_vectors_samples));
+    }
+    if (pruning->pca_projection_samples != NULL) {
+        free_vector_list(pruning->pca_projection_samples, ctx->samples->sample_count);
+        free_null(pruning->vector_lengths_pca_samples);
+        free_null(pruning->pca_projection_samples);
+    }
+}
+
+/* create the cluster centers as means of the samples assigned to them */
+static void create_clusters_from_assignments(struct general_kmeans_context* ctx) {
+    uint64_t i;
+    KEY_TYPE *keys;
+    VALUE_TYPE *values;
+    uint64_t nnz;
+
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        keys = ctx->samples->keys + ctx->samples->pointers[i];
+        values = ctx->samples->values + ctx->samples->pointers[i];
+        nnz = ctx->samples->pointers[i + 1] - ctx->samples->pointers[i];
+        add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->cluster_assignments[i]
+                              , get_sample_weight(ctx, i));
+        ctx->cluster_weights[ctx->cluster_assignments[i]] += get_sample_weight(ctx, i);
+        ctx->was_assigned[i] = 1;
+    }
+
+    create_vector_list_from_hashmap(ctx->clusters_raw
+                                        , ctx->cluster_weights
+                                        , ctx->cluster_vectors
+                                        , ctx->no_clusters);
+}
+
+void initialize_kmeans_pp(struct general_kmeans_context* ctx,
+                              struct kmeans_params *prms) {
+    struct kmpp_pruning pruning;
+
+    initialize_kmpp_pruning(ctx, prms, &pruning);
 
     get_kmeanspp_assigns(ctx->samples
-                         , &block_vectors_samples
-                         , pca_projection_samples
+                         , &(pruning.block_vectors_samples)
+                         , pruning.pca_projection_samples
                          , ctx->vector_lengths_samples
-                         , vector_lengths_pca_samples
+                         , pruning.vector_lengths_pca_samples
                          , prms->no_clusters
                          , ctx->cluster_counts
                          , ctx->cluster_assignments
                          , ctx->cluster_distances
                          , &(prms->seed)
-                         , use_triangle_inequality
+                         , pruning.use_triangle_inequality
                          , ctx->initial_cluster_samples
                          , prms->verbose
                          , prms->tr
-                         , &(prms->stop));
+                         , &(prms->stop)
+                         , ctx->sample_weights);
 
-    if (desired_bv_annz > 0) {
-        free_csr_matrix(&block_vectors_samples);
+    free_kmpp_pruning(ctx, &pruning);
+    create_clusters_from_assignments(ctx);
+}
+
+/* uniform random number in [0, 1) for a sample. Only depends on the round seed
+ * and the sample, so the candidates do not depend on the number of threads.
+ */
+static VALUE_TYPE get_sample_random(uint32_t round_seed, uint64_t sample_id) {
+    uint64_t x;
+
+    /* splitmix64 finalizer */
+    x = ((((uint64_t) round_seed) << 32) ^ sample_id) + UINT64_C(0x9E3779B97F4A7C15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+    x = x ^ (x >> 31);
+
+    /* 24 bits are exact in single precision */
+    return ((VALUE_TYPE) (x >> 40)) / ((VALUE_TYPE) (UINT64_C(1) << 24));
+}
+
+/* kmeans|| chooses a sample which is not a candidate yet with probability
+ * factor * w(sample) * d(sample) / phi
+ */
+static uint32_t is_new_kmpar_candidate(struct general_kmeans_context* ctx
+                                       , uint64_t* candidate_index
+                                       , uint32_t round_seed
+                                       , VALUE_TYPE factor
+                                       , VALUE_TYPE phi
+                                       , uint64_t sample_id) {
+    if (candidate_index[sample_id]) return 0;
+    return get_sample_random(round_seed, sample_id) * phi
+           < factor * get_sample_weight(ctx, sample_id) * ctx->cluster_distances[sample_id];
+}
+
+/* distance of a sample to a center. If the block vectors (*skipped = 1) or the
+ * pca projections (*skipped = 2) show that it is not smaller than bound, no full
+ * distance is calculated and VALUE_TYPE_MAX is returned (*skipped = 0 otherwise).
+ */
+static VALUE_TYPE get_kmpp_distance(struct csr_matrix *mtrx
+                                    , struct kmpp_pruning* pruning
+                                    , VALUE_TYPE *vector_lengths
+                                    , uint64_t sample_id
+                                    , uint64_t center_id
+                                    , VALUE_TYPE bound
+                                    , uint32_t *skipped) {
+    VALUE_TYPE dist;
+    struct csr_matrix *bv;
+
+    bv = &(pruning->block_vectors_samples);
+    *skipped = 0;
+
+    if (bv->sample_count > 0) {
+        dist = euclid_vector(bv->keys + bv->pointers[center_id]
+                             , bv->values + bv->pointers[center_id]
+                             , bv->pointers[center_id + 1] - bv->pointers[center_id]
+                             , bv->keys + bv->pointers[sample_id]
+                             , bv->values + bv->pointers[sample_id]
+                             , bv->pointers[sample_id + 1] - bv->pointers[sample_id]
+                             , vector_lengths[center_id]
+                             , vector_lengths[sample_id]);
+        if (dist >= bound) {
+            *skipped = 1;
+            return VALUE_TYPE_MAX;
+        }
     }
-    if (use_pca && prms->ext_vects != NULL) {
-        free_vector_list(pca_projection_samples, ctx->samples->sample_count);
-        free(vector_lengths_pca_samples);
-        free(pca_projection_samples);
+
+    if (pruning->pca_projection_samples != NULL) {
+        dist = euclid_vector(pruning->pca_projection_samples[sample_id].keys
+                             , pruning->pca_projection_samples[sample_id].values
+                             , pruning->pca_projection_samples[sample_id].nnz
+                             , pruning->pca_projection_samples[center_id].keys
+                             , pruning->pca_projection_samples[center_id].values
+                             , pruning->pca_projection_samples[center_id].nnz
+                             , pruning->vector_lengths_pca_samples[sample_id]
+                             , pruning->vector_lengths_pca_samples[center_id]);
+        if (dist >= bound) {
+            *skipped = 2;
+            return VALUE_TYPE_MAX;
+        }
+    }
+
+    return euclid_vector(mtrx->keys + mtrx->pointers[center_id]
+                         , mtrx->values + mtrx->pointers[center_id]
+                         , mtrx->pointers[center_id + 1] - mtrx->pointers[center_id]
+                         , mtrx->keys + mtrx->pointers[sample_id]
+                         , mtrx->values + mtrx->pointers[sample_id]
+                         , mtrx->pointers[sample_id + 1] - mtrx->pointers[sample_id]
+                         , vector_lengths[center_id]
+                         , vector_lengths[sample_id]);
+}
+
+/* lower the distance of every sample to its closest candidate with the candidates
+ * [first_candidate, no_candidates). half_distances contains for every candidate
+ * half its distance to the closest candidate chosen before it. returns the number
+ * of full distance calculations
+ */
+static uint64_t update_candidate_distances(struct general_kmeans_context* ctx
+                                           , struct kmeans_params *prms
+                                           , struct kmpp_pruning* pruning
+                                           , uint64_t* candidates
+                                           , VALUE_TYPE* half_distances
+                                           , uint64_t first_candidate
+                                           , uint64_t no_candidates
+                                           , uint64_t* closest_candidate) {
+    uint64_t i, calcs_needed;
+    struct csr_matrix *mtrx;
+
+    mtrx = ctx->samples;
+    calcs_needed = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1000) reduction(+:calcs_needed)
+    for (i = 0; i < mtrx->sample_count; i++) {
+        uint64_t c, candidate_id;
+        uint32_t skipped;
+        VALUE_TYPE dist, old_dist;
+
+        if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
+        if (prms->stop) continue;
+
+        /* distance to the closest of the candidates chosen before first_candidate */
+        old_dist = ctx->cluster_distances[i];
+
+        for (c = first_candidate; c < no_candidates; c++) {
+            candidate_id = candidates[c];
+
+            if (pruning->use_triangle_inequality && old_dist <= half_distances[c]) {
+                /* d(closest candidate, c) >= 2 * d(sample, closest candidate)
+                 * --> d(sample, c) >= d(sample, closest candidate)
+                 */
+                continue;
+            }
+
+            dist = get_kmpp_distance(mtrx, pruning, ctx->vector_lengths_samples
+                                     , i, candidate_id, ctx->cluster_distances[i], &skipped);
+            if (skipped) continue;
+            calcs_needed += 1;
+
+            if (dist < ctx->cluster_distances[i]) {
+                ctx->cluster_distances[i] = dist;
+                closest_candidate[i] = candidate_id;
+            }
+        }
     }
+
+    return calcs_needed;
+}
+
+/* random sample chosen uniformly or, if sample_weights are given, proportional to its weight */
+static uint64_t choose_random_sample(uint64_t sample_count
+                                     , VALUE_TYPE *sample_weights
+                                     , uint32_t* seed) {
+    uint64_t i;
+    ACCUMULATOR_TYPE total_weight, target;
+
+    if (sample_weights == NULL) return rand_r(seed) % sample_count;
+
+    total_weight = 0;
+    for (i = 0; i < sample_count; i++) total_weight += sample_weights[i];
+
+    target = total_weight * ((ACCUMULATOR_TYPE) rand_r(seed) / ((ACCUMULATOR_TYPE) RAND_MAX + 1));
+    for (i = 0; i < sample_count - 1; i++) {
+        if (target < sample_weights[i]) break;
+        target -= sample_weights[i];
+    }
+
+    return i;
+}
+
+void initialize_kmeans_parallel(struct general_kmeans_context* ctx,
+                                struct kmeans_params *prms) {
+    uint64_t i, round, no_rounds, no_candidates, max_candidates, first_new_candidate, calcs_needed;
+    uint64_t b, no_blocks, no_new_candidates;
+    uint64_t *block_positions;         /* for every block of samples: position of its first new
+                                          candidate in candidates */
+    uint64_t *candidates;              /* sample ids of the candidates (first in the order they were
+                                          chosen, then ascending) */
+    uint64_t *candidate_index;         /* for every sample: 1 + index of the candidate or 0 */
+    uint64_t *closest_candidate;       /* for every sample: sample id of the closest candidate */
+    uint64_t *candidate_assignments, *candidate_counts, *initial_candidates;
+    uint32_t round_seed;
+    VALUE_TYPE oversampling, phi;
+    VALUE_TYPE *half_distances;        /* for every candidate: half the distance to the closest
+                                          candidate before it */
+    VALUE_TYPE *candidate_weights, *candidate_distances, *candidate_lengths, *candidate_pca_lengths;
+    struct kmpp_pruning pruning;
+    struct csr_matrix *candidate_mtrx, *candidate_bv_mtrx, candidate_block_vectors;
+    struct sparse_vector *candidate_pca;
+
+    /* expected number of candidates per round is oversampling * no_clusters */
+    oversampling = d_get_subfloat_default(&(prms->tr)
+                                         , "additional_params", "kmpar_oversampling", 2.0);
+    no_rounds = d_get_subint_default(&(prms->tr)
+                                    , "additional_params", "kmpar_rounds", 2);
+
+    initialize_kmpp_pruning(ctx, prms, &pruning);
+
+    max_candidates = ctx->no_clusters;
+    candidates = (uint64_t*) calloc(max_candidates, sizeof(uint64_t));
+    half_distances = (VALUE_TYPE*) calloc(max_candidates, sizeof(VALUE_TYPE));
+    candidate_index = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
+    closest_candidate = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
+    no_blocks = (ctx->samples->sample_count + KMPAR_BLOCK_SIZE - 1) / KMPAR_BLOCK_SIZE;
+    block_positions = (uint64_t*) calloc(no_blocks, sizeof(uint64_t));
+
+    /* the first candidate is chosen at random (proportional to the sample weights) */
+    candidates[0] = choose_random_sample(ctx->samples->sample_count, ctx->sample_weights, &(prms->seed));
+    candidate_index[candidates[0]] = 1;
+    half_distances[0] = 0;
+    no_candidates = 1;
+    first_new_candidate = 0;
+    calcs_needed = 0;
+
     for (i = 0; i < ctx->samples->sample_count; i++) {
-        keys = ctx->samples->keys + ctx->samples->pointers[i];
-        values = ctx->samples->values + ctx->samples->pointers[i];
-        nnz = ctx->samples->pointers[i + 1] - ctx->samples->pointers[i];
-        add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->cluster_assignments[i]);
-        ctx->was_assigned[i] = 1;
+        ctx->cluster_distances[i] = VALUE_TYPE_MAX;
+        closest_candidate[i] = candidates[0];
     }
 
-    for (i = 0; i < prms->no_clusters; i++) {
-        HASH_SORT(ctx->clusters_raw[i], id_sort);
+    /* every round chooses every sample independently with probability
+     * oversampling * no_clusters * w(sample) * d(sample) / sum of all w(sample) * d(sample),
+     * where d is the distance to the closest candidate and w the sample weight
+     * (weighted like kmeans++ in get_kmeanspp_assigns)
+     */
+    for (round = 0; !prms->stop; round++) {
+        calcs_needed += update_candidate_distances(ctx, prms, &pruning, candidates, half_distances
+                                                   , first_new_candidate, no_candidates
+                                                   , closest_candidate);
+        first_new_candidate = no_candidates;
+        if (round == no_rounds) break;
+
+        phi = 0;
+        #pragma omp parallel for reduction(+:phi)
+        for (i = 0; i < ctx->samples->sample_count; i++) {
+            phi += get_sample_weight(ctx, i) * ctx->cluster_distances[i];
+        }
+        if (phi <= 0) break;
+
+        round_seed = rand_r(&(prms->seed));
+
+        /* count the new candidates of every block */
+        #pragma omp parallel for schedule(dynamic, 1) private(i)
+        for (b = 0; b < no_blocks; b++) {
+            uint64_t block_end;
+
+            block_end = (b + 1) * KMPAR_BLOCK_SIZE;
+            if (block_end > ctx->samples->sample_count) block_end = ctx->samples->sample_count;
+
+            block_positions[b] = 0;
+            for (i = b * KMPAR_BLOCK_SIZE; i < block_end; i++) {
+                if (is_new_kmpar_candidate(ctx, candidate_index, round_seed
+                                           , oversampling * ctx->no_clusters, phi, i)) {
+                    block_positions[b] += 1;
+                }
+            }
+        }
+
+        /* the new candidates of a block follow the ones of the blocks before it */
+        no_new_candidates = 0;
+        for (b = 0; b < no_blocks; b++) {
+            i = block_positions[b];
+            block_positions[b] = no_candidates + no_new_candidates;
+            no_new_candidates += i;
+        }
+
+        if (no_candidates + no_new_candidates > max_candidates) {
+            while (no_candidates + no_new_candidates > max_candidates) max_candidates *= 2;
+            candidates = (uint64_t*) realloc(candidates, max_candidates * sizeof(uint64_t));
+            half_distances = (VALUE_TYPE*) realloc(half_distances, max_candidates * sizeof(VALUE_TYPE));
+        }
+
+        /* store the new candidates in ascending order */
+        #pragma omp parallel for schedule(dynamic, 1) private(i)
+        for (b = 0; b < no_blocks; b++) {
+            uint64_t block_end, position;
+
+            block_end = (b + 1) * KMPAR_BLOCK_SIZE;
+            if (block_end > ctx->samples->sample_count) block_end = ctx->samples->sample_count;
+
+            position = block_positions[b];
+            for (i = b * KMPAR_BLOCK_SIZE; i < block_end; i++) {
+                if (!is_new_kmpar_candidate(ctx, candidate_index, round_seed
+                                            , oversampling * ctx->no_clusters, phi, i)) continue;
+
+                candidates[position] = i;
+                half_distances[position] = ctx->cluster_distances[i] / 2;
+                position++;
+                candidate_index[i] = position;
+            }
+        }
+        no_candidates += no_new_candidates;
+
+        if (prms->verbose) LOG_INFO("kmeans|| round %" PRINTF_INT64_MODIFIER "u: %" PRINTF_INT64_MODIFIER "u candidates"
+                                    , round + 1, no_candidates);
     }
 
-    create_vector_list_from_hashmap(ctx->clusters_raw
-                                        , ctx->cluster_counts
-                                        , ctx->cluster_vectors
-                                        , ctx->no_clusters);
+    /* less candidates than clusters (e.g. many duplicate samples): add random samples */
+    if (no_candidates < ctx->no_clusters) {
+        candidates = (uint64_t*) realloc(candidates, ctx->no_clusters * sizeof(uint64_t));
+        half_distances = (VALUE_TYPE*) realloc(half_distances, ctx->no_clusters * sizeof(VALUE_TYPE));
+        i = rand_r(&(prms->seed)) % ctx->samples->sample_count;
+        while (no_candidates < ctx->no_clusters) {
+            if (!candidate_index[i]) {
+                candidates[no_candidates] = i;
+                half_distances[no_candidates] = ctx->cluster_distances[i] / 2;
+                no_candidates++;
+                candidate_index[i] = no_candidates;
+            }
+            i = (i + 1) % ctx->samples->sample_count;
+        }
+        calcs_needed += update_candidate_distances(ctx, prms, &pruning, candidates, half_distances
+                                                   , first_new_candidate, no_candidates
+                                                   , closest_candidate);
+    }
+
+    /* candidates in ascending order, the same order as in the candidate matrix */
+    no_candidates = 0;
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        if (candidate_index[i]) {
+            candidates[no_candidates] = i;
+            no_candidates++;
+            candidate_index[i] = no_candidates;
+        }
+    }
+
+    /* every candidate is weighted with the summed weights of the samples it is the closest candidate to */
+    candidate_weights = (VALUE_TYPE*) calloc(no_candidates, sizeof(VALUE_TYPE));
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        candidate_weights[candidate_index[closest_candidate[i]] - 1] += get_sample_weight(ctx, i);
+    }
+
+    candidate_mtrx = remove_vectors_not_in_mask(ctx->samples, candidate_index);
+    candidate_block_vectors.sample_count = 0;
+    if (pruning.block_vectors_samples.sample_count > 0) {
+        candidate_bv_mtrx = remove_vectors_not_in_mask(&(pruning.block_vectors_samples), candidate_index);
+        candidate_block_vectors = *candidate_bv_mtrx;
+        free(candidate_bv_mtrx);
+    }
+
+    candidate_lengths = (VALUE_TYPE*) calloc(no_candidates, sizeof(VALUE_TYPE));
+    candidate_pca = NULL;
+    candidate_pca_lengths = NULL;
+    if (pruning.pca_projection_samples != NULL) {
+        candidate_pca = (struct sparse_vector*) calloc(no_candidates, sizeof(struct sparse_vector));
+        candidate_pca_lengths = (VALUE_TYPE*) calloc(no_candidates, sizeof(VALUE_TYPE));
+    }
+    for (i = 0; i < no_candidates; i++) {
+        candidate_lengths[i] = ctx->vector_lengths_samples[candidates[i]];
+        if (candidate_pca != NULL) {
+            /* shares the projections of the samples */
+            candidate_pca[i] = pruning.pca_projection_samples[candidates[i]];
+            candidate_pca_lengths[i] = pruning.vector_lengths_pca_samples[candidates[i]];
+        }
+    }
+
+    d_add_subint(&(prms->tr), "kmeans||", "no_candidates", no_candidates);
+    d_add_subint(&(prms->tr), "kmeans||", "calculations_needed", calcs_needed);
+    if (prms->verbose) LOG_INFO("kmeans|| %" PRINTF_INT64_MODIFIER "u candidates, calcs_needed %" PRINTF_INT64_MODIFIER "u"
+                                , no_candidates, calcs_needed);
+
+    /* weighted kmeans++ on the candidates */
+    candidate_assignments = (uint64_t*) calloc(no_candidates, sizeof(uint64_t));
+    candidate_distances = (VALUE_TYPE*) calloc(no_candidates, sizeof(VALUE_TYPE));
+    candidate_counts = (uint64_t*) calloc(ctx->no_clusters, sizeof(uint64_t));
+    initial_candidates = (uint64_t*) calloc(ctx->no_clusters, sizeof(uint64_t));
+
+    get_kmeanspp_assigns(candidate_mtrx
+                         , &candidate_block_vectors
+                         , candidate_pca
+                         , candidate_lengths
+                         , candidate_pca_lengths
+                         , ctx->no_clusters
+                         , candidate_counts
+                         , candidate_assignments
+                         , candidate_distances
+                         , &(prms->seed)
+                         , pruning.use_triangle_inequality
+                         , initial_candidates
+                         , prms->verbose
+                         , prms->tr
+                         , &(prms->stop)
+                         , candidate_weights);
+
+    /* every sample gets the cluster of its closest candidate. the first
+     * iteration of the algorithm moves samples to their closest cluster.
+     */
+    for (i = 0; i < ctx->no_clusters; i++) {
+        ctx->initial_cluster_samples[i] = candidates[initial_candidates[i]];
+    }
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        ctx->cluster_assignments[i] = candidate_assignments[candidate_index[closest_candidate[i]] - 1];
+        ctx->cluster_counts[ctx->cluster_assignments[i]] += 1;
+    }
+
+    free_csr_matrix(candidate_mtrx);
+    free_null(candidate_mtrx);
+    if (candidate_block_vectors.sample_count > 0) {
+        free_csr_matrix(&candidate_block_vectors);
+    }
+    free_null(candidate_pca);
+    free_null(candidate_pca_lengths);
+    free_null(candidate_lengths);
+    free_null(candidate_weights);
+    free_null(candidate_assignments);
+    free_null(candidate_distances);
+    free_null(candidate_counts);
+    free_null(initial_candidates);
+    free_null(candidates);
+    free_null(half_distances);
+    free_null(candidate_index);
+    free_null(closest_candidate);
+    free_null(block_positions);
+    free_kmpp_pruning(ctx, &pruning);
+
+    create_clusters_from_assignments(ctx);
+}
+
+static void initialize_kmpp_sum_tree(struct kmpp_sum_tree* tree, uint64_t sample_count) {
+    uint64_t i;
+
+    tree->no_blocks = (sample_count + KMPP_BLOCK_SIZE - 1) / KMPP_BLOCK_SIZE;
+    tree->no_leaves = 1;
+    while (tree->no_leaves < tree->no_blocks) tree->no_leaves *= 2;
+
+    tree->nodes = (ACCUMULATOR_TYPE*) calloc(2 * tree->no_leaves, sizeof(ACCUMULATOR_TYPE));
+    tree->block_changed = (uint32_t*) calloc(tree->no_blocks, sizeof(uint32_t));
+    for (i = 0; i < tree->no_blocks; i++) {
+        tree->block_changed[i] = 1;
+    }
+}
+
+static void free_kmpp_sum_tree(struct kmpp_sum_tree* tree) {
+    free_null(tree->nodes);
+    free_null(tree->block_changed);
+}
+
+/* the kmeans++ weight of a sample */
+static VALUE_TYPE get_kmpp_weight(VALUE_TYPE *cluster_distances
+                                  , VALUE_TYPE *sample_weights
+                                  , uint64_t sample_id) {
+    return (sample_weights == NULL) ? cluster_distances[sample_id]
+                                    : sample_weights[sample_id] * cluster_distances[sample_id];
+}
+
+/* sum the changed blocks again and update the inner nodes */
+static void update_kmpp_sum_tree(struct kmpp_sum_tree* tree
+                                 , VALUE_TYPE *cluster_distances
+                                 , VALUE_TYPE *sample_weights
+                                 , uint64_t sample_count) {
+    uint64_t block_id, node;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (block_id = 0; block_id < tree->no_blocks; block_id++) {
+        uint64_t i, end;
+        ACCUMULATOR_TYPE sum;
+
+        if (!tree->block_changed[block_id]) continue;
+
+        end = (block_id + 1) * KMPP_BLOCK_SIZE;
+        if (end > sample_count) end = sample_count;
+
+        sum = 0;
+        for (i = block_id * KMPP_BLOCK_SIZE; i < end; i++) {
+            sum += get_kmpp_weight(cluster_distances, sample_weights, i);
+        }
+        tree->nodes[tree->no_leaves + block_id] = sum;
+        tree->block_changed[block_id] = 0;
+    }
+
+    for (node = tree->no_leaves - 1; node > 0; node--) {
+        tree->nodes[node] = tree->nodes[2 * node] + tree->nodes[2 * node + 1];
+    }
+}
+
+/* choose a sample with a probability proportional to its weight. r is uniform in [0, 1].
+ * The tree is descended to a block which is searched linearly. Returns sample_count
+ * if rounding errors left no sample.
+ */
+static uint64_t sample_kmpp_sum_tree(struct kmpp_sum_tree* tree
+                                     , VALUE_TYPE *cluster_distances
+                                     , VALUE_TYPE *sample_weights
+                                     , uint64_t sample_count
+                                     , VALUE_TYPE r) {
+    uint64_t node, i, end;
+    ACCUMULATOR_TYPE target;
+
+    target = r * tree->nodes[1];
+    node = 1;
+    while (node < tree->no_leaves) {
+        node *= 2;
+        if (target >= tree->nodes[node]) {
+            target -= tree->nodes[node];
+            node++;
+        }
+    }
+
+    i = (node - tree->no_leaves) * KMPP_BLOCK_SIZE;
+    if (i >= sample_count) return sample_count;
+    end = i + KMPP_BLOCK_SIZE;
+    if (end > sample_count) end = sample_count;
+
+    for (; i < end; i++) {
+        target -= get_kmpp_weight(cluster_distances, sample_weights, i);
+        if (target < 0) return i;
+    }
+
+    return sample_count;
+}
+
+static void initialize_kmpp_center_groups(struct kmpp_center_groups* groups, uint64_t no_clusters) {
+    groups->samples = (uint64_t**) calloc(no_clusters, sizeof(uint64_t*));
+    groups->sizes = (uint64_t*) calloc(no_clusters, sizeof(uint64_t));
+    groups->no_moved = (uint64_t*) calloc(no_clusters, sizeof(uint64_t));
+    groups->radius = (VALUE_TYPE*) calloc(no_clusters, sizeof(VALUE_TYPE));
+    groups->center_distances = (VALUE_TYPE*) calloc(no_clusters, sizeof(VALUE_TYPE));
+    groups->examined = (uint64_t*) calloc(no_clusters, sizeof(uint64_t));
+    groups->offsets = (uint64_t*) calloc(no_clusters + 1, sizeof(uint64_t));
+
+    groups->no_threads = omp_get_max_threads();
+    groups->thread_moved = (uint64_t**) calloc(groups->no_threads, sizeof(uint64_t*));
+    groups->thread_no_moved = (uint64_t*) calloc(groups->no_threads, sizeof(uint64_t));
+    groups->thread_capacities = (uint64_t*) calloc(groups->no_threads, sizeof(uint64_t));
+    groups->thread_radius = (VALUE_TYPE*) calloc(groups->no_threads, sizeof(VALUE_TYPE));
+}
+
+static void free_kmpp_center_groups(struct kmpp_center_groups* groups, uint64_t no_clusters) {
+    uint64_t i;
+
+    for (i = 0; i < no_clusters; i++) {
+        free_null(groups->samples[i]);
+    }
+    for (i = 0; i < groups->no_threads; i++) {
+        free_null(groups->thread_moved[i]);
+    }
+    free_null(groups->samples);
+    free_null(groups->sizes);
+    free_null(groups->no_moved);
+    free_null(groups->radius);
+    free_null(groups->center_distances);
+    free_null(groups->examined);
+    free_null(groups->offsets);
+    free_null(groups->thread_moved);
+    free_null(groups->thread_no_moved);
+    free_null(groups->thread_capacities);
+    free_null(groups->thread_radius);
+}
+
+/* remember that a thread moved a sample to the new center */
+static void add_kmpp_moved_sample(struct kmpp_center_groups* groups
+                                  , uint64_t thread_id
+                                  , uint64_t sample_id
+                                  , VALUE_TYPE dist) {
+    if (groups->thread_no_moved[thread_id] == groups->thread_capacities[thread_id]) {
+        groups->thread_capacities[thread_id] = 2 * groups->thread_capacities[thread_id] + 1024;
+        groups->thread_moved[thread_id] = (uint64_t*) realloc(groups->thread_moved[thread_id]
+                                                               , groups->thread_capacities[thread_id] * sizeof(uint64_t));
+    }
+    groups->thread_moved[thread_id][groups->thread_no_moved[thread_id]++] = sample_id;
+    if (dist > groups->thread_radius[thread_id]) groups->thread_radius[thread_id] = dist;
+}
+
+/* remove the samples from a group which moved to other groups and calculate
+ * the exact radius of the remaining samples
+ */
+static void compact_kmpp_center_group(struct kmpp_center_groups* groups
+                                      , uint64_t group_id
+                                      , uint64_t *cluster_assignments
+                                      , VALUE_TYPE *cluster_distances) {
+    uint64_t i, sample_id, no_kept;
+    uint64_t *samples;
+    VALUE_TYPE radius;
+
+    samples = groups->samples[group_id];
+    no_kept = 0;
+    radius = 0;
+
+    for (i = 0; i < groups->sizes[group_id]; i++) {
+        sample_id = samples[i];
+        if (cluster_assignments[sample_id] != group_id) continue;
+        samples[no_kept++] = sample_id;
+        if (cluster_distances[sample_id] > radius) radius = cluster_distances[sample_id];
+    }
+
+    groups->sizes[group_id] = no_kept;
+    groups->no_moved[group_id] = 0;
+    groups->radius[group_id] = radius;
+    groups->samples[group_id] = (uint64_t*) realloc(samples, ((no_kept > 0) ? no_kept : 1) * sizeof(uint64_t));
+}
+
+/* examine a sample for the new center cluster_id, which forms the group new_group.
+ * center_distance is the distance of the new center to the closest center of the
+ * sample (only used with the triangle inequality). returns 1 if the sample moved
+ * to the new group
+ */
+static uint32_t update_kmpp_sample(struct csr_matrix *mtrx
+                                   , struct kmpp_pruning* pruning
+                                   , VALUE_TYPE *sparse_vector_lengths
+                                   , uint64_t *is_cluster
+                                   , struct kmpp_sum_tree* sum_tree
+                                   , uint64_t *cluster_assignments
+                                   , VALUE_TYPE *cluster_distances
+                                   , uint64_t sample_id
+                                   , uint64_t cluster_id
+                                   , uint64_t new_group
+                                   , VALUE_TYPE center_distance
+                                   , uint64_t *calcs_skipped_is_cluster
+                                   , uint64_t *calcs_skipped_tr
+                                   , uint64_t *calcs_skipped_bv
+                                   , uint64_t *calcs_skipped_pca
+                                   , uint64_t *calcs_needed) {
+    uint32_t skipped;
+    VALUE_TYPE dist;
+
+    /* the new center is examined too, so that it is assigned to its own cluster */
+    if (is_cluster[sample_id] && sample_id != cluster_id) {
+        *calcs_skipped_is_cluster += 1;
+        return 0;
+    }
+
+    if (pruning->use_triangle_inequality && center_distance >= 2 * cluster_distances[sample_id]) {
+        /* triangle inequality d(closest_cluster, new_cluster) >= 2 * d(sample, closest_cluster)
+         * --> d(sample, new_cluster) >= d(sample, closest_cluster)
+         */
+        *calcs_skipped_tr += 1;
+        return 0;
+    }
+
+    dist = get_kmpp_distance(mtrx, pruning, sparse_vector_lengths
+                             , sample_id, cluster_id, cluster_distances[sample_id], &skipped);
+    if (skipped == 1) {
+        *calcs_skipped_bv += 1;
+        return 0;
+    }
+    if (skipped == 2) {
+        *calcs_skipped_pca += 1;
+        return 0;
+    }
+    *calcs_needed += 1;
+
+    if (dist >= cluster_distances[sample_id]) return 0;
+
+    cluster_distances[sample_id] = dist;
+    cluster_assignments[sample_id] = new_group;
+    #pragma omp atomic write
+    sum_tree->block_changed[sample_id / KMPP_BLOCK_SIZE] = 1;
+    return 1;
 }
 
 void get_kmeanspp_assigns(struct csr_matrix *mtrx
@@ -288,19 +1040,24 @@ void get_kmeanspp_assigns(struct csr_matrix *mtrx
                           , uint64_t *initial_cluster_samples
                           , uint32_t verbose
                           , struct cdict* tr
-                          , uint32_t* stop) {
+                          , uint32_t* stop
+                          , VALUE_TYPE *sample_weights) {
 
     uint64_t  no_clusters_so_far, i, j, calcs_skipped_tr, calcs_skipped_bv, calcs_skipped_pca, calcs_skipped_is_cluster;
+    uint64_t calcs_center_center, new_group, cluster_id, no_examined_groups, no_chunks, chunk;
+    struct kmpp_sum_tree sum_tree;
+    struct kmpp_center_groups groups;
+    struct kmpp_pruning pruning;
     VALUE_TYPE rand_max;
     VALUE_TYPE approximated_full_distance_calcs_bv;
     VALUE_TYPE approximated_full_distance_calcs_pca;
     uint64_t mtrx_annz;
     uint64_t calcs_needed;
     uint64_t *is_cluster;
-    VALUE_TYPE min_distances_cluster_new_cluster;
     time_t start;
     no_clusters_so_far = 0;
     calcs_needed = 0;
+    calcs_center_center = 0;
     rand_max = RAND_MAX;
     approximated_full_distance_calcs_bv = 0;
     approximated_full_distance_calcs_pca = 0;
@@ -310,135 +1067,223 @@ void get_kmeanspp_assigns(struct csr_matrix *mtrx
     calcs_skipped_is_cluster = 0;
     start = time(NULL);
 
+    pruning.use_triangle_inequality = use_triangle_inequality;
+    pruning.block_vectors_samples = *blockvectors_mtrx;
+    pruning.pca_projection_samples = pca_projection_samples;
+    pruning.vector_lengths_pca_samples = pca_sparse_vector_lengths;
+
     is_cluster = (uint64_t*) calloc(mtrx->sample_count, sizeof(uint64_t));
+    initialize_kmpp_sum_tree(&sum_tree, mtrx->sample_count);
+    initialize_kmpp_center_groups(&groups, no_clusters);
 
-    /* choose the first sample randomly from all samples */
-    initial_cluster_samples[no_clusters_so_far] = rand_r(seed) % mtrx->sample_count;
+    /* choose the first sample randomly from all samples (proportional to the sample weights) */
+    initial_cluster_samples[no_clusters_so_far] = choose_random_sample(mtrx->sample_count, sample_weights, seed);
+    cluster_id = initial_cluster_samples[no_clusters_so_far];
     no_clusters_so_far += 1;
 
     /* initialize all distances with infinity */
     for (i = 0; i < mtrx->sample_count; i++) {
-        cluster_distances[i] = DBL_MAX;
+        cluster_distances[i] = VALUE_TYPE_MAX;
     }
 
-    min_distances_cluster_new_cluster = 0;
+    /* the first cluster is the closest cluster of every sample */
+    #pragma omp parallel for schedule(dynamic, 1000) reduction(+:calcs_skipped_bv, calcs_skipped_pca, calcs_needed)
+    for (i = 0; i < mtrx->sample_count; i++) {
+        uint32_t skipped;
+
+        if (omp_get_thread_num() == 0) check_signals(stop);
+        if (*stop) continue;
+
+        cluster_distances[i] = get_kmpp_distance(mtrx, &pruning, sparse_vector_lengths
+                                                 , i, cluster_id, VALUE_TYPE_MAX, &skipped);
+        cluster_assignments[i] = 0;
+        if (skipped == 1) calcs_skipped_bv += 1;
+        if (skipped == 2) calcs_skipped_pca += 1;
+        if (!skipped) calcs_needed += 1;
+    }
+
+    if (use_triangle_inequality) {
+        groups.samples[0] = (uint64_t*) calloc(mtrx->sample_count, sizeof(uint64_t));
+        groups.sizes[0] = mtrx->sample_count;
+        for (i = 0; i < mtrx->sample_count; i++) {
+            groups.samples[0][i] = i;
+            if (cluster_distances[i] > groups.radius[0]) groups.radius[0] = cluster_distances[i];
+        }
+    }
+
+    while (no_clusters_so_far < no_clusters && !(*stop)) {
+        uint64_t no_moved;
+
+        /* find new cluster depending on the closest distances from every sample to the already chosen clusters */
+        update_kmpp_sum_tree(&sum_tree, cluster_distances, sample_weights, mtrx->sample_count);
+        j = sample_kmpp_sum_tree(&sum_tree, cluster_distances, sample_weights, mtrx->sample_count
+                                 , rand_r(seed) / rand_max);
+
+        if (j == mtrx->sample_count) {
+            initial_cluster_samples[no_clusters_so_far] = rand_r(seed) % mtrx->sample_count;
+        } else {
+            initial_cluster_samples[no_clusters_so_far] = j;
+        }
+
+        is_cluster[initial_cluster_samples[no_clusters_so_far]] = 1;
+        new_group = no_clusters_so_far;
+        cluster_id = initial_cluster_samples[new_group];
+        no_clusters_so_far++;
 
-    while (no_clusters_so_far <= no_clusters  && !(*stop)) {
-        uint64_t cluster_id;
-        VALUE_TYPE sum;
         if (no_clusters_so_far % 500 == 0) {
             if (verbose) LOG_INFO("kmeans++ chosen_clusters so far: %" PRINTF_INT64_MODIFIER "u (%d secs).. %" PRINTF_INT64_MODIFIER "u %" PRINTF_INT64_MODIFIER "u", no_clusters_so_far, (int) (time(NULL) - start), calcs_skipped_tr, calcs_skipped_bv);
             start = time(NULL);
         }
 
-        /* no need to iterate over all clusters, only the recently added cluster is new info */
-        cluster_id = initial_cluster_samples[no_clusters_so_far - 1];
-
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (i = 0; i < mtrx->sample_count; i++) {
-            uint64_t sample_id;
-            VALUE_TYPE dist;
-            sample_id = i;
+        if (!use_triangle_inequality) {
+            /* no group can be skipped without the triangle inequality. scanning the
+             * samples in their order is faster than scanning them group by group
+             */
+            #pragma omp parallel for schedule(dynamic, KMPP_CHUNK_SIZE) reduction(+:calcs_skipped_is_cluster, calcs_skipped_tr, calcs_skipped_bv, calcs_skipped_pca, calcs_needed)
+            for (i = 0; i < mtrx->sample_count; i++) {
+                if (omp_get_thread_num() == 0) check_signals(stop);
+                if (*stop) continue;
+
+                update_kmpp_sample(mtrx, &pruning, sparse_vector_lengths, is_cluster, &sum_tree
+                                   , cluster_assignments, cluster_distances, i, cluster_id, new_group, 0
+                                   , &calcs_skipped_is_cluster, &calcs_skipped_tr, &calcs_skipped_bv
+                                   , &calcs_skipped_pca, &calcs_needed);
+            }
+            continue;
+        }
 
-            if (omp_get_thread_num() == 0) check_signals(stop);
+        /* distances of the new cluster to the clusters which still have samples */
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:calcs_center_center)
+        for (j = 0; j < new_group; j++) {
+            uint64_t group_cluster_id;
+
+            if (groups.sizes[j] == 0) continue;
+            group_cluster_id = initial_cluster_samples[j];
+            groups.center_distances[j] = euclid_vector(mtrx->keys + mtrx->pointers[cluster_id]
+                                                       , mtrx->values + mtrx->pointers[cluster_id]
+                                                       , mtrx->pointers[cluster_id + 1] - mtrx->pointers[cluster_id]
+                                                       , mtrx->keys + mtrx->pointers[group_cluster_id]
+                                                       , mtrx->values + mtrx->pointers[group_cluster_id]
+                                                       , mtrx->pointers[group_cluster_id + 1] - mtrx->pointers[group_cluster_id]
+                                                       , sparse_vector_lengths[cluster_id]
+                                                       , sparse_vector_lengths[group_cluster_id]);
+            calcs_center_center += 1;
+        }
 
-            if (!(*stop)) {
+        /* collect the groups which need to be examined */
+        no_examined_groups = 0;
+        for (j = 0; j < new_group; j++) {
+            if (groups.sizes[j] == groups.no_moved[j]) continue;
+
+            if (groups.center_distances[j] >= 2 * groups.radius[j]) {
+                /* triangle inequality d(cluster, new_cluster) >= 2 * d(sample, cluster)
+                 * for every sample of the group --> no sample is closer to the new cluster
+                 */
+                calcs_skipped_tr += groups.sizes[j] - groups.no_moved[j];
+                continue;
+            }
 
-                if (is_cluster[sample_id]) {
-                    calcs_skipped_is_cluster += 1;
-                    continue;
-                }
+            groups.examined[no_examined_groups] = j;
+            groups.offsets[no_examined_groups + 1] = groups.offsets[no_examined_groups] + groups.sizes[j];
+            no_examined_groups++;
+        }
 
-                if (use_triangle_inequality
-                    && (min_distances_cluster_new_cluster >= cluster_distances[sample_id])) {
-                    /* triangle inequality d(closest_cluster, new_cluster) >= 2 * d(sample, closest_cluster)
-                     * --> d(sample, new_cluster) >= d(sample, closest_cluster)
-                     */
-                    calcs_skipped_tr += 1;
-                    continue;
-                }
+        for (j = 0; j < groups.no_threads; j++) {
+            groups.thread_no_moved[j] = 0;
+            groups.thread_radius[j] = 0;
+        }
 
-                if (blockvectors_mtrx->sample_count > 0) {
+        /* the samples of the examined groups are processed in chunks of consecutive positions */
+        no_chunks = (groups.offsets[no_examined_groups] + KMPP_CHUNK_SIZE - 1) / KMPP_CHUNK_SIZE;
 
-                    dist = euclid_vector(blockvectors_mtrx->keys + blockvectors_mtrx->pointers[cluster_id]
-                                         , blockvectors_mtrx->values + blockvectors_mtrx->pointers[cluster_id]
-                                         , blockvectors_mtrx->pointers[cluster_id + 1] - blockvectors_mtrx->pointers[cluster_id]
-                                         , blockvectors_mtrx->keys + blockvectors_mtrx->pointers[sample_id]
-                                         , blockvectors_mtrx->values + blockvectors_mtrx->pointers[sample_id]
-                                         , blockvectors_mtrx->pointers[sample_id + 1] - blockvectors_mtrx->pointers[sample_id]
-                                         , sparse_vector_lengths[cluster_id]
-                                         , sparse_vector_lengths[sample_id]);
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:calcs_skipped_is_cluster, calcs_skipped_tr, calcs_skipped_bv, calcs_skipped_pca, calcs_needed)
+        for (chunk = 0; chunk < no_chunks; chunk++) {
+            uint64_t pos, end, low, high, mid, group_id, sample_id, no_moved_group;
 
-                    if (dist >= cluster_distances[sample_id]) {
-                        calcs_skipped_bv += 1;
-                        continue;
-                    }
+            if (omp_get_thread_num() == 0) check_signals(stop);
+            if (*stop) continue;
+
+            pos = chunk * KMPP_CHUNK_SIZE;
+            end = pos + KMPP_CHUNK_SIZE;
+            if (end > groups.offsets[no_examined_groups]) end = groups.offsets[no_examined_groups];
+
+            /* binary search the examined group which contains pos */
+            low = 0;
+            high = no_examined_groups;
+            while (high - low > 1) {
+                mid = (low + high) / 2;
+                if (groups.offsets[mid] <= pos) {
+                    low = mid;
+                } else {
+                    high = mid;
                 }
+            }
 
-                if (pca_projection_samples != NULL) {
-                    dist = euclid_vector(pca_projection_samples[sample_id].keys
-                                         , pca_projection_samples[sample_id].values
-                                         , pca_projection_samples[sample_id].nnz
-                                         , pca_projection_samples[cluster_id].keys
-                                         , pca_projection_samples[cluster_id].values
-                                         , pca_projection_samples[cluster_id].nnz
-                                         , pca_sparse_vector_lengths[sample_id]
-                                         , pca_sparse_vector_lengths[cluster_id]);
-                    if (dist >= cluster_distances[sample_id]) {
-                        calcs_skipped_pca += 1;
-                        continue;
-                    }
+            no_moved_group = 0;
+            for (; pos < end; pos++) {
+                if (pos >= groups.offsets[low + 1]) {
+                    #pragma omp atomic
+                    groups.no_moved[groups.examined[low]] += no_moved_group;
+                    no_moved_group = 0;
+                    low++;
                 }
 
-                dist = euclid_vector(mtrx->keys + mtrx->pointers[cluster_id]
-                                            , mtrx->values + mtrx->pointers[cluster_id]
-                                            , mtrx->pointers[cluster_id + 1] - mtrx->pointers[cluster_id]
-                                            , mtrx->keys + mtrx->pointers[sample_id]
-                                            , mtrx->values + mtrx->pointers[sample_id]
-                                            , mtrx->pointers[sample_id + 1] - mtrx->pointers[sample_id]
-                                            , sparse_vector_lengths[cluster_id]
-                                            , sparse_vector_lengths[sample_id]);
-                calcs_needed += 1;
-                #pragma omp critical
-                if (dist < cluster_distances[sample_id]) {
-                    if (no_clusters_so_far != 1) {
-                        cluster_counts[cluster_assignments[sample_id]] -= 1;
+                group_id = groups.examined[low];
+                sample_id = groups.samples[group_id][pos - groups.offsets[low]];
 
-                    }
+                /* the sample moved to another group before */
+                if (cluster_assignments[sample_id] != group_id) continue;
 
-                    cluster_distances[sample_id] = dist;
-                    cluster_assignments[sample_id] = no_clusters_so_far - 1;
-                    cluster_counts[cluster_assignments[sample_id]] += 1;
+                if (update_kmpp_sample(mtrx, &pruning, sparse_vector_lengths, is_cluster, &sum_tree
+                                       , cluster_assignments, cluster_distances, sample_id, cluster_id
+                                       , new_group, groups.center_distances[group_id]
+                                       , &calcs_skipped_is_cluster, &calcs_skipped_tr, &calcs_skipped_bv
+                                       , &calcs_skipped_pca, &calcs_needed)) {
+                    add_kmpp_moved_sample(&groups, omp_get_thread_num(), sample_id, cluster_distances[sample_id]);
+                    no_moved_group += 1;
                 }
             }
-        }
-
-        if (no_clusters_so_far == no_clusters) break;
-        sum = 0;
 
-        #pragma omp parallel for reduction(+:sum)
-        for (j = 0; j < mtrx->sample_count; j++) {
-            sum += cluster_distances[j];
+            if (no_moved_group > 0) {
+                #pragma omp atomic
+                groups.no_moved[groups.examined[low]] += no_moved_group;
+            }
         }
 
-        /* find new cluster depending on the closest distances from every sample to the already chosen clusters */
-        sum = (rand_r(seed) / rand_max) * sum;
-
-        for (j = 0; j < mtrx->sample_count; j++) {
-            sum -= cluster_distances[j];
-            if (sum < 0) break;
+        /* the samples which moved form the group of the new cluster */
+        no_moved = 0;
+        groups.radius[new_group] = 0;
+        for (j = 0; j < groups.no_threads; j++) {
+            no_moved += groups.thread_no_moved[j];
+            if (groups.thread_radius[j] > groups.radius[new_group]) groups.radius[new_group] = groups.thread_radius[j];
         }
 
-        if (j == mtrx->sample_count) {
-            initial_cluster_samples[no_clusters_so_far] = rand_r(seed) % mtrx->sample_count;
-        } else {
-            initial_cluster_samples[no_clusters_so_far] = j;
+        groups.samples[new_group] = (uint64_t*) calloc((no_moved > 0) ? no_moved : 1, sizeof(uint64_t));
+        groups.sizes[new_group] = 0;
+        for (j = 0; j < groups.no_threads; j++) {
+            memcpy(groups.samples[new_group] + groups.sizes[new_group]
+                   , groups.thread_moved[j]
+                   , groups.thread_no_moved[j] * sizeof(uint64_t));
+            groups.sizes[new_group] += groups.thread_no_moved[j];
         }
 
-        is_cluster[initial_cluster_samples[no_clusters_so_far]] = 1;
-        min_distances_cluster_new_cluster = cluster_distances[initial_cluster_samples[no_clusters_so_far]] / 2;
+        /* remove the moved samples from groups where they are the majority */
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (j = 0; j < no_examined_groups; j++) {
+            uint64_t group_id;
 
-        no_clusters_so_far++;
+            group_id = groups.examined[j];
+            if (2 * groups.no_moved[group_id] > groups.sizes[group_id]) {
+                compact_kmpp_center_group(&groups, group_id, cluster_assignments, cluster_distances);
+            }
+        }
+    }
+
+    for (i = 0; i < no_clusters; i++) {
+        cluster_counts[i] = 0;
+    }
+    for (i = 0; i < mtrx->sample_count; i++) {
+        cluster_counts[cluster_assignments[i]] += 1;
     }
 
     if (verbose) LOG_INFO("kmeans++ finished with %" PRINTF_INT64_MODIFIER "u clusters", no_clusters_so_far);
@@ -478,43 +1323,363 @@ void get_kmeanspp_assigns(struct csr_matrix *mtrx
                 }
             }
         }
-        pca_dim += 1;
-        pca_annz = pca_annz / mtrx->sample_count;
+        pca_dim += 1;
+        pca_annz = pca_annz / mtrx->sample_count;
+
+        d_add_subint(&tr, "kmeans++", "pca_dim", pca_dim);
+        d_add_subint(&tr, "kmeans++", "pca_annz", pca_annz);
+        d_add_subfloat(&tr, "kmeans++", "pca_relative_annz", pca_annz / mtrx_annz);
+        approximated_full_distance_calcs_pca = (pca_annz / mtrx_annz) * (calcs_needed + calcs_skipped_pca);
+    }
+
+    if (pca_projection_samples != NULL || blockvectors_mtrx->sample_count > 0) {
+        d_add_subint(&tr, "kmeans++", "approximated_full_distance_calcs"
+                     , (approximated_full_distance_calcs_bv + approximated_full_distance_calcs_pca + calcs_needed));
+    }
+
+    d_add_subint(&tr, "kmeans++", "calculations_needed", calcs_needed);
+    d_add_subint(&tr, "kmeans++", "calculations_needed_naive", (mtrx->sample_count * no_clusters) - calcs_skipped_is_cluster);
+    if (use_triangle_inequality) {
+        d_add_subint(&tr, "kmeans++", "calculations_skipped_triangle_inequality", calcs_skipped_tr);
+        d_add_subint(&tr, "kmeans++", "calculations_cluster_cluster", calcs_center_center);
+    }
+
+    free(is_cluster);
+    free_kmpp_sum_tree(&sum_tree);
+    free_kmpp_center_groups(&groups, no_clusters);
+}
+
+void pre_process_iteration(struct general_kmeans_context* ctx) {
+    uint64_t i;
+
+    if (ctx->previous_cluster_assignments == NULL) {
+        ctx->previous_cluster_assignments = (uint64_t*) calloc_sample_array(ctx, sizeof(uint64_t));
+    }
+
+    /* copy cluster_assignments before iteration to previous_cluster_assignments */
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        ctx->previous_cluster_assignments[i] = ctx->cluster_assignments[i];
+    }
+
+    /* reset all calculation counters */
+    ctx->done_calculations = 0;
+    ctx->no_changes = 0;
+    memset(&(ctx->iteration_stats), 0, sizeof(struct kmeans_thread_stats));
+
+    if (ctx->track_time) ctx->duration_all_calcs = clock();
+
+    gettimeofday(&(ctx->tm_start_iteration), NULL);
+    gettimeofday(&(ctx->durations), NULL);
+}
+
+struct kmeans_thread_stats* get_thread_stats(struct general_kmeans_context* ctx) {
+    return ctx->thread_stats + omp_get_thread_num();
+}
+
+VALUE_TYPE get_sample_weight(struct general_kmeans_context* ctx, uint64_t sample_id) {
+    if (ctx->sample_weights == NULL) return 1;
+    return ctx->sample_weights[sample_id];
+}
+
+uint64_t merge_thread_stats(struct general_kmeans_context* ctx) {
+    uint64_t i, done_calculations;
+    struct kmeans_thread_stats *stats, *merged;
+
+    merged = &(ctx->iteration_stats);
+    done_calculations = 0;
+    for (i = 0; i < ctx->no_threads; i++) {
+        stats = ctx->thread_stats + i;
+        done_calculations += stats->done_calculations;
+        merged->done_blockvector_calcs += stats->done_blockvector_calcs;
+        merged->done_pca_calcs += stats->done_pca_calcs;
+        merged->saved_calculations_bv += stats->saved_calculations_bv;
+        merged->saved_calculations_pca += stats->saved_calculations_pca;
+        merged->saved_calculations_cauchy += stats->saved_calculations_cauchy;
+        merged->saved_calculations_prev_cluster += stats->saved_calculations_prev_cluster;
+        merged->saved_calculations_global += stats->saved_calculations_global;
+        merged->saved_calculations_local += stats->saved_calculations_local;
+        merged->groups_not_skipped += stats->groups_not_skipped;
+        memset(stats, 0, sizeof(struct kmeans_thread_stats));
+    }
+
+    merged->done_calculations += done_calculations;
+    ctx->done_calculations += done_calculations;
+    return done_calculations;
+}
+
+uint64_t* create_sample_worklist(struct general_kmeans_context* ctx) {
+    uint64_t i;
+    uint64_t* worklist;
+
+    worklist = (uint64_t*) calloc_sample_array(ctx, sizeof(uint64_t));
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        worklist[i] = i;
+    }
+
+    return worklist;
+}
+
+uint64_t get_sample_chunks(struct general_kmeans_context* ctx, uint64_t* no_chunks) {
+    *no_chunks = omp_get_max_threads();
+    return (ctx->samples->sample_count + *no_chunks - 1) / *no_chunks;
+}
+
+uint64_t concatenate_sample_chunks(uint64_t* worklist
+                                   , uint64_t chunk_size
+                                   , uint64_t* chunk_counts
+                                   , uint64_t no_chunks) {
+    uint64_t i, no_samples;
+
+    no_samples = 0;
+    for (i = 0; i < no_chunks; i++) {
+        memmove(worklist + no_samples
+                , worklist + i * chunk_size
+                , chunk_counts[i] * sizeof(uint64_t));
+        no_samples += chunk_counts[i];
+    }
+
+    return no_samples;
+}
+
+uint64_t collect_no_change_worklist(struct general_kmeans_context* ctx
+                                    , uint32_t* eligible_for_cluster_no_change_optimization
+                                    , uint64_t* worklist) {
+    uint64_t i, no_chunks, chunk_size, no_moved_clusters, no_samples;
+    uint64_t* chunk_counts;
+
+    /* number of non empty clusters which moved */
+    no_moved_clusters = 0;
+    for (i = 0; i < ctx->no_clusters; i++) {
+        if (!ctx->clusters_not_changed[i] && ctx->cluster_counts[i] > 0) no_moved_clusters++;
+    }
+
+    chunk_size = get_sample_chunks(ctx, &no_chunks);
+    chunk_counts = (uint64_t*) calloc(no_chunks, sizeof(uint64_t));
+
+    #pragma omp parallel for schedule(static, 1)
+    for (i = 0; i < no_chunks; i++) {
+        uint64_t sample_id, start, end, no_selected, no_moved_other;
+
+        start = i * chunk_size;
+        end = start + chunk_size;
+        if (start > ctx->samples->sample_count) start = ctx->samples->sample_count;
+        if (end > ctx->samples->sample_count) end = ctx->samples->sample_count;
+
+        no_selected = 0;
+        for (sample_id = start; sample_id < end; sample_id++) {
+            if (eligible_for_cluster_no_change_optimization[sample_id]) {
+                /* moved clusters except the assigned one */
+                no_moved_other = no_moved_clusters;
+                if (!ctx->clusters_not_changed[ctx->cluster_assignments[sample_id]]
+                    && ctx->cluster_counts[ctx->cluster_assignments[sample_id]] > 0) no_moved_other--;
+                if (no_moved_other == 0) continue;
+            }
+
+            worklist[start + no_selected] = sample_id;
+            no_selected++;
+        }
+        chunk_counts[i] = no_selected;
+    }
+
+    no_samples = concatenate_sample_chunks(worklist, chunk_size, chunk_counts, no_chunks);
+    free(chunk_counts);
+
+    return no_samples;
+}
+
+/* work needed for the sample at position i of the partitioned worklist */
+static uint64_t get_sample_cost(struct general_kmeans_context* ctx, uint64_t i) {
+    uint64_t sample_id, cost;
+
+    sample_id = (ctx->partition_worklist == NULL) ? i : ctx->partition_worklist[i];
+    cost = ctx->samples->pointers[sample_id + 1] - ctx->samples->pointers[sample_id] + 1;
+    if (ctx->sample_calcs != NULL) cost *= ctx->sample_calcs[sample_id] + 1;
+
+    return cost;
+}
+
+/* work which lies before the start of range r if total_cost is split into no_ranges equal parts */
+static uint64_t get_range_target(uint64_t total_cost, uint64_t r, uint64_t no_ranges) {
+    return (total_cost / no_ranges) * r + ((total_cost % no_ranges) * r) / no_ranges;
+}
+
+void partition_sample_worklist(struct general_kmeans_context* ctx
+                               , uint64_t* worklist
+                               , uint64_t no_samples) {
+    uint64_t i, no_ranges, block_size, total_cost;
+    uint64_t *block_costs, *range_starts;
+
+    ctx->partition_worklist = worklist;
+    no_ranges = ctx->no_threads;
+
+    /* the worklist is scanned in one block per thread. block_costs[i] is the
+     * work before block i
+     */
+    block_size = (no_samples + no_ranges - 1) / no_ranges;
+    block_costs = (uint64_t*) calloc(no_ranges + 1, sizeof(uint64_t));
+    range_starts = (uint64_t*) calloc(no_ranges + 1, sizeof(uint64_t));
+
+    #pragma omp parallel for schedule(static, 1)
+    for (i = 0; i < no_ranges; i++) {
+        uint64_t j, start, end;
+
+        start = i * block_size;
+        end = start + block_size;
+        if (start > no_samples) start = no_samples;
+        if (end > no_samples) end = no_samples;
+
+        for (j = start; j < end; j++) {
+            block_costs[i + 1] += get_sample_cost(ctx, j);
+        }
+    }
+
+    for (i = 0; i < no_ranges; i++) {
+        block_costs[i + 1] += block_costs[i];
+        range_starts[i + 1] = UINT64_MAX;
+    }
+    total_cost = block_costs[no_ranges];
+
+    /* range r starts after the first position where the work reaches its target.
+     * every block sets the starts of the targets it reaches.
+     */
+    #pragma omp parallel for schedule(static, 1)
+    for (i = 0; i < no_ranges; i++) {
+        uint64_t j, r, start, end, cost;
+
+        start = i * block_size;
+        end = start + block_size;
+        if (start > no_samples) start = no_samples;
+        if (end > no_samples) end = no_samples;
+
+        cost = block_costs[i];
+        r = 1;
+        while (r < no_ranges && get_range_target(total_cost, r, no_ranges) <= cost) r++;
+
+        for (j = start; j < end && r < no_ranges; j++) {
+            cost += get_sample_cost(ctx, j);
+            while (r < no_ranges && get_range_target(total_cost, r, no_ranges) <= cost) {
+                range_starts[r] = j + 1;
+                r++;
+            }
+        }
+    }
 
-        d_add_subint(&tr, "kmeans++", "pca_dim", pca_dim);
-        d_add_subint(&tr, "kmeans++", "pca_annz", pca_annz);
-        d_add_subfloat(&tr, "kmeans++", "pca_relative_annz", pca_annz / mtrx_annz);
-        approximated_full_distance_calcs_pca = (pca_annz / mtrx_annz) * (calcs_needed + calcs_skipped_pca);
+    /* targets which are reached before the first sample get empty ranges */
+    range_starts[no_ranges] = no_samples;
+    for (i = 1; i < no_ranges; i++) {
+        if (range_starts[i] == UINT64_MAX) range_starts[i] = range_starts[i - 1];
     }
 
-    if (pca_projection_samples != NULL || blockvectors_mtrx->sample_count > 0) {
-        d_add_subint(&tr, "kmeans++", "approximated_full_distance_calcs"
-                     , (approximated_full_distance_calcs_bv + approximated_full_distance_calcs_pca + calcs_needed));
+    for (i = 0; i < no_ranges; i++) {
+        ctx->partition_ranges[i].next = range_starts[i];
+        ctx->partition_ranges[i].end = range_starts[i + 1];
+        ctx->partition_ranges[i].chunk_start = 0;
+        ctx->partition_ranges[i].chunk_end = 0;
     }
 
-    d_add_subint(&tr, "kmeans++", "calculations_needed", calcs_needed);
-    d_add_subint(&tr, "kmeans++", "calculations_needed_naive", (mtrx->sample_count * no_clusters) - calcs_skipped_is_cluster);
+    free(block_costs);
+    free(range_starts);
+}
 
-    free(is_cluster);
+uint64_t* get_sample_range_starts(struct general_kmeans_context* ctx) {
+    uint64_t i;
+    uint64_t* range_starts;
+
+    partition_sample_worklist(ctx, NULL, ctx->samples->sample_count);
+
+    range_starts = (uint64_t*) calloc(ctx->no_threads + 1, sizeof(uint64_t));
+    for (i = 0; i < ctx->no_threads; i++) {
+        range_starts[i] = ctx->partition_ranges[i].next;
+    }
+    range_starts[ctx->no_threads] = ctx->samples->sample_count;
+
+    return range_starts;
 }
 
-void pre_process_iteration(struct general_kmeans_context* ctx) {
+void* calloc_sample_array(struct general_kmeans_context* ctx, size_t size) {
+    uint64_t* range_starts;
+    void* array;
 
-    /* free old previous_cluster_assignments */
-    free_null(ctx->previous_cluster_assignments);
+    range_starts = get_sample_range_starts(ctx);
+    array = calloc_first_touch_ranges(ctx->samples->sample_count, size, range_starts, ctx->no_threads);
+    free(range_starts);
 
-    /* copy cluster_assignments before iteration to previous_cluster_assignments */
-    ctx->previous_cluster_assignments = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
-    memcpy(ctx->previous_cluster_assignments, ctx->cluster_assignments, ctx->samples->sample_count * sizeof(uint64_t) );
+    return array;
+}
 
-    /* reset all calculation counters */
-    ctx->done_calculations = 0;
-    ctx->no_changes = 0;
+/* spread the calculations of the finished chunk of a thread over its samples */
+static void record_chunk_calcs(struct general_kmeans_context* ctx
+                               , struct sample_partition_range* own) {
+    uint64_t j, sample_id, calcs, chunk_length;
 
-    if (ctx->track_time) ctx->duration_all_calcs = clock();
+    chunk_length = own->chunk_end - own->chunk_start;
+    if (chunk_length == 0) return;
 
-    gettimeofday(&(ctx->tm_start_iteration), NULL);
-    gettimeofday(&(ctx->durations), NULL);
+    calcs = get_thread_stats(ctx)->done_calculations - own->chunk_calcs;
+    calcs = (calcs + chunk_length - 1) / chunk_length;
+    for (j = own->chunk_start; j < own->chunk_end; j++) {
+        sample_id = (ctx->partition_worklist == NULL) ? j : ctx->partition_worklist[j];
+        ctx->sample_calcs[sample_id] = (uint32_t) calcs;
+    }
+}
+
+uint32_t next_sample_position(struct general_kmeans_context* ctx
+                              , uint64_t* position) {
+    uint64_t i, thread_id, chunk_start;
+    struct sample_partition_range *own, *range;
+
+    thread_id = omp_get_thread_num();
+    own = ctx->partition_ranges + thread_id;
+
+    /* continue with the current chunk */
+    if (*position >= own->chunk_start && *position < own->chunk_end) return 1;
+
+    if (ctx->sample_calcs != NULL) record_chunk_calcs(ctx, own);
+    own->chunk_start = 0;
+    own->chunk_end = 0;
+
+    /* own range first, then steal from the other threads */
+    for (i = 0; i < ctx->no_threads; i++) {
+        range = ctx->partition_ranges + ((thread_id + i) % ctx->no_threads);
+
+        #pragma omp atomic capture
+        chunk_start = range->next += SAMPLE_CHUNK_SIZE;
+
+        chunk_start -= SAMPLE_CHUNK_SIZE;
+        if (chunk_start >= range->end) continue;
+
+        own->chunk_start = chunk_start;
+        own->chunk_end = (chunk_start + SAMPLE_CHUNK_SIZE < range->end) ? chunk_start + SAMPLE_CHUNK_SIZE : range->end;
+        own->chunk_calcs = get_thread_stats(ctx)->done_calculations;
+        *position = chunk_start;
+        return 1;
+    }
+
+    return 0;
+}
+
+void initialize_thread_block_vectors(struct general_kmeans_context* ctx) {
+    uint64_t i, nnz, max_nnz;
+
+    /* a block vector never has more nnz than the sample it was created from */
+    max_nnz = 1;
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        nnz = ctx->samples->pointers[i + 1] - ctx->samples->pointers[i];
+        if (nnz > max_nnz) max_nnz = nnz;
+    }
+
+    ctx->thread_block_vectors = (struct sparse_vector*) calloc(ctx->no_threads, sizeof(struct sparse_vector));
+    for (i = 0; i < ctx->no_threads; i++) {
+        ctx->thread_block_vectors[i].keys = (KEY_TYPE*) calloc(max_nnz, sizeof(KEY_TYPE));
+        ctx->thread_block_vectors[i].values = (VALUE_TYPE*) calloc(max_nnz, sizeof(VALUE_TYPE));
+    }
+}
+
+struct sparse_vector* get_thread_block_vector(struct general_kmeans_context* ctx) {
+    return ctx->thread_block_vectors + omp_get_thread_num();
 }
 
 uint32_t batch_convergence(uint64_t no_samples
@@ -563,18 +1728,28 @@ void post_process_iteration_minibatch(struct general_kmeans_context* ctx
                                       , uint32_t max_not_improved_counter
                                       , struct convergence_context* conv_ctx) {
     uint64_t sample_id, samples_in_this_batch;
+    ACCUMULATOR_TYPE batch_weight;
     ctx->wcssd = 0;
     samples_in_this_batch = 0;
+    batch_weight = 0;
 
     for (sample_id = 0; sample_id < ctx->samples->sample_count; sample_id++) {
         if (chosen_sample_map[sample_id]) {
             if (ctx->cluster_assignments[sample_id] != ctx->previous_cluster_assignments[sample_id]) ctx->no_changes += 1;
-            ctx->wcssd += ctx->cluster_distances[sample_id];
+            ctx->wcssd += get_sample_weight(ctx, sample_id) * ctx->cluster_distances[sample_id];
             samples_in_this_batch += 1;
+            batch_weight += get_sample_weight(ctx, sample_id);
         }
 
     }
 
+    /* batch_convergence averages over the samples, with weights the average is
+     * taken over the weight of the batch
+     */
+    if (ctx->sample_weights != NULL && batch_weight > 0) {
+        ctx->wcssd *= samples_in_this_batch / batch_weight;
+    }
+
     ctx->total_no_calcs += ctx->done_calculations;
     if (ctx->track_time) ctx->duration_all_calcs = clock() - ctx->duration_all_calcs;
 
@@ -588,6 +1763,24 @@ void post_process_iteration_minibatch(struct general_kmeans_context* ctx
     ctx->old_wcssd = ctx->wcssd;
 }
 
+/* sum of the distances of all samples to their clusters, every distance multiplied
+ * with the weight of its sample
+ */
+static VALUE_TYPE sum_weighted_distances(struct general_kmeans_context* ctx) {
+    uint64_t i;
+    VALUE_TYPE sum;
+
+    if (ctx->sample_weights == NULL) return sum_value_array(ctx->cluster_distances, ctx->samples->sample_count);
+
+    sum = 0;
+    #pragma omp parallel for reduction(+:sum)
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        sum += ctx->sample_weights[i] * ctx->cluster_distances[i];
+    }
+
+    return sum;
+}
+
 void post_process_iteration(struct general_kmeans_context* ctx, struct kmeans_params *prms) {
     uint64_t sample_id;
 
@@ -599,7 +1792,7 @@ void post_process_iteration(struct general_kmeans_context* ctx, struct kmeans_pa
     if (ctx->track_time) ctx->duration_all_calcs = (VALUE_TYPE) get_diff_in_microseconds(ctx->durations);
 
     /* calculate the objective. This is exact for kmeans/bv_kmeans */
-    ctx->wcssd = sum_value_array(ctx->cluster_distances, ctx->samples->sample_count);
+    ctx->wcssd = sum_weighted_distances(ctx);
 
     if (fabs(ctx->wcssd - ctx->old_wcssd) < prms->tol || ctx->no_changes == 0) {
         ctx->converged = 1;
@@ -631,9 +1824,8 @@ void print_iteration_summary(struct general_kmeans_context* ctx, struct kmeans_p
     hash_overhead = 0;
     clusters_nnz = 0;
     for (j = 0; j < ctx->no_clusters; j++) {
-        clusters_nnz += HASH_COUNT(ctx->clusters_raw[j]);
-        hash_overhead += ((HASH_COUNT(ctx->clusters_raw[j]) * sizeof(struct keyvaluecount_hash))
-                           +  HASH_OVERHEAD(hh, ctx->clusters_raw[j]));
+        clusters_nnz += ctx->clusters_raw[j].nnz;
+        hash_overhead += get_cluster_hashmap_memory_consumption(ctx->clusters_raw + j);
     }
 
     clusters_memory_consumption = hash_overhead
@@ -654,12 +1846,19 @@ void print_iteration_summary(struct general_kmeans_context* ctx, struct kmeans_p
     d_add_ilist(&(prms->tr), "iteration_clusters_nnz", clusters_nnz);
     d_add_ilist(&(prms->tr), "iteration_clusters_sparsity", (clusters_nnz * 100) / (ctx->samples->dim * ctx->no_clusters));
     d_add_ilist(&(prms->tr), "iteration_full_distance_calcs", ctx->done_calculations);
+    d_add_ilist(&(prms->tr), "iteration_saved_calcs_cauchy", ctx->iteration_stats.saved_calculations_cauchy);
+    d_add_ilist(&(prms->tr), "iteration_saved_calcs_prev_cluster", ctx->iteration_stats.saved_calculations_prev_cluster);
     d_add_flist(&(prms->tr), "iteration_durations_calcs", ((VALUE_TYPE) ctx->duration_all_calcs) / 1000.0);
     d_add_flist(&(prms->tr), "iteration_durations_update_clusters", ((VALUE_TYPE) ctx->duration_update_clusters) / 1000.0);
     d_add_flist(&(prms->tr), "iteration_durations", ((VALUE_TYPE) get_diff_in_microseconds(ctx->tm_start_iteration)));
     d_add_int(&(prms->tr), "no_iterations", iteration + 1);
 }
 
+/* sample id in the input matrix of sample i of ctx->samples */
+static uint64_t get_input_sample_id(struct general_kmeans_context* ctx, uint64_t i) {
+    return (ctx->sample_order != NULL) ? ctx->sample_order[i] : i;
+}
+
 struct kmeans_result* create_kmeans_result(struct kmeans_params *prms
                                           , struct general_kmeans_context* ctx) {
     struct kmeans_result* res;
@@ -693,8 +1892,12 @@ struct kmeans_result* create_kmeans_result(struct kmeans_params *prms
 
         if (prms->verbose) LOG_INFO("Assigning all samples to clusters to find empty ones");
 
-        /* assign all samples */
-        assign_res = assign(ctx->samples, res->clusters, &(prms->stop));
+        /* assign all samples. the keys of a reordered copy may be compressed and freed */
+        if (ctx->input_samples != NULL) {
+            assign_res = assign_weighted(ctx->input_samples, res->clusters, prms->sample_weights, &(prms->stop));
+        } else {
+            assign_res = assign_weighted(ctx->samples, res->clusters, ctx->sample_weights, &(prms->stop));
+        }
         map = (uint64_t*) calloc(ctx->no_clusters, sizeof(uint64_t));
 
         for (i = 0; i < ctx->no_clusters; i++) {
@@ -713,14 +1916,13 @@ struct kmeans_result* create_kmeans_result(struct kmeans_params *prms
                                                                  assign_res.counts);
 
             for (i = 0; i < res->initprms->len_assignments; i++) {
-                res->initprms->assignments[i] = map[ctx->cluster_assignments[i]];
+                res->initprms->assignments[get_input_sample_id(ctx, i)] = map[ctx->cluster_assignments[i]];
             }
 
             if (prms->verbose) LOG_INFO("Remaining clusters after deleting empty ones = %lu"
                                       , res->clusters->sample_count);
         }
-        d_add_float(&(prms->tr), "wcssd_kmeans_with_remove_empty"
-                    , sum_value_array(assign_res.distances, assign_res.len_assignments));
+        d_add_float(&(prms->tr), "wcssd_kmeans_with_remove_empty", assign_res.wcssd);
 
         free_assign_result(&assign_res);
         free_null(map);
@@ -728,7 +1930,7 @@ struct kmeans_result* create_kmeans_result(struct kmeans_params *prms
                     , (VALUE_TYPE) get_diff_in_microseconds(ctx->tm_start));
     } else {
         for (i = 0; i < res->initprms->len_assignments; i++) {
-            res->initprms->assignments[i] = ctx->cluster_assignments[i];
+            res->initprms->assignments[get_input_sample_id(ctx, i)] = ctx->cluster_assignments[i];
         }
     }
 
@@ -736,6 +1938,15 @@ struct kmeans_result* create_kmeans_result(struct kmeans_params *prms
     return res;
 }
 
+/* algorithms which read the sample keys only with get_sample_keys */
+static uint32_t compressed_keys_supported(uint32_t kmeans_algorithm_id) {
+    return kmeans_algorithm_id == ALGORITHM_KMEANS
+           || kmeans_algorithm_id == ALGORITHM_ELKAN_KMEANS
+           || kmeans_algorithm_id == ALGORITHM_YINYANG
+           || kmeans_algorithm_id == ALGORITHM_HAMERLY
+           || kmeans_algorithm_id == ALGORITHM_EXPONION;
+}
+
 void initialize_general_context(struct kmeans_params *prms
                                 , struct general_kmeans_context* ctx
                                 , struct csr_matrix* samples) {
@@ -744,6 +1955,9 @@ void initialize_general_context(struct kmeans_params *prms
     VALUE_TYPE old_wcssd_;
     memset(ctx, 0, sizeof(struct general_kmeans_context));
 
+    ctx->no_threads = omp_get_max_threads();
+    ctx->thread_stats = (struct kmeans_thread_stats*) calloc(ctx->no_threads, sizeof(struct kmeans_thread_stats));
+
     if (prms->verbose) LOG_INFO("----------------");
     if (prms->verbose) LOG_INFO("%s", KMEANS_ALGORITHM_NAMES[prms->kmeans_algorithm_id]);
     if (prms->verbose) LOG_INFO("----------------");
@@ -761,8 +1975,17 @@ void initialize_general_context(struct kmeans_params *prms
     d_add_substring(&(prms->tr), "general_params", "init", (char*) KMEANS_INIT_NAMES[prms->init_id]);
     d_add_subint(&(prms->tr), "general_params", "no_cores_used", omp_get_max_threads());
 
+    if (d_get_subfloat_default(&(prms->tr), "additional_params", "compressed_keys", 0) > 0
+        && !compressed_keys_supported(prms->kmeans_algorithm_id)) {
+        if (prms->verbose) LOG_ERROR("Unable to use compressed keys with %s. Using uncompressed keys instead!"
+                                     , KMEANS_ALGORITHM_NAMES[prms->kmeans_algorithm_id]);
+    }
+
     ctx->samples = samples;
 
+    /* the ranges of the sample loops, the per sample arrays are placed accordingly */
+    ctx->partition_ranges = (struct sample_partition_range*) calloc(ctx->no_threads, sizeof(struct sample_partition_range));
+
     gettimeofday(&(ctx->tm_start), NULL);
 
     /* enables time tracking of specific parts of the source code */
@@ -776,17 +1999,20 @@ void initialize_general_context(struct kmeans_params *prms
         prms->no_clusters = ctx->samples->sample_count;
     }
 
-    ctx->clusters_raw = (struct keyvaluecount_hash**) calloc(prms->no_clusters, sizeof(struct keyvaluecount_hash*));
+    ctx->clusters_raw = (struct cluster_accumulator*) calloc(prms->no_clusters, sizeof(struct cluster_accumulator));
+    initialize_cluster_hashmaps(ctx->clusters_raw, prms->no_clusters, ctx->samples->dim);
     ctx->cluster_vectors = (struct sparse_vector*) calloc(prms->no_clusters, sizeof(struct sparse_vector));
     ctx->no_clusters = prms->no_clusters;
 
     ctx->cluster_counts = (uint64_t*) calloc(prms->no_clusters, sizeof(uint64_t));
-    ctx->cluster_assignments = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
+    ctx->cluster_weights = (ACCUMULATOR_TYPE*) calloc(prms->no_clusters, sizeof(ACCUMULATOR_TYPE));
+    ctx->sample_weights = prms->sample_weights;
+    ctx->cluster_assignments = (uint64_t*) calloc_sample_array(ctx, sizeof(uint64_t));
     ctx->initial_cluster_samples = (uint64_t*) calloc(prms->no_clusters, sizeof(uint64_t));
 
-    ctx->cluster_distances = (VALUE_TYPE*) calloc(ctx->samples->sample_count, sizeof(VALUE_TYPE));
+    ctx->cluster_distances = (VALUE_TYPE*) calloc_sample_array(ctx, sizeof(VALUE_TYPE));
 
-    ctx->was_assigned = (uint32_t*) calloc(ctx->samples->sample_count, sizeof(uint32_t));
+    ctx->was_assigned = (uint32_t*) calloc_sample_array(ctx, sizeof(uint32_t));
 
     ctx->previous_cluster_assignments = NULL;
 
@@ -805,6 +2031,15 @@ void initialize_general_context(struct kmeans_params *prms
                                                , ctx->vector_lengths_samples
                                                , ctx->cluster_distances);
 
+    initialize_sample_order(prms, ctx);
+
+    /* weighting the ranges of the sample loops by the calculations of the last
+     * iteration helps if only few samples of a thread fail the bound tests
+     */
+    if (d_get_subint_default(&(prms->tr), "additional_params", "partition_by_calcs", 0)) {
+        ctx->sample_calcs = (uint32_t*) calloc_sample_array(ctx, sizeof(uint32_t));
+    }
+
     /* every cluster is assumed to not have changed in the beginning */
     ctx->clusters_not_changed = (uint32_t*) calloc(prms->no_clusters, sizeof(uint32_t));
     for (i = 0; i < prms->no_clusters; i++) {
@@ -815,7 +2050,7 @@ void initialize_general_context(struct kmeans_params *prms
     old_wcssd_ = 0;
     #pragma omp parallel for reduction(+:old_wcssd_)
     for (i = 0; i < ctx->samples->sample_count; i++) {
-        old_wcssd_ += ctx->cluster_distances[i];
+        old_wcssd_ += get_sample_weight(ctx, i) * ctx->cluster_distances[i];
     }
 
     ctx->old_wcssd = old_wcssd_;
@@ -838,6 +2073,445 @@ void initialize_general_context(struct kmeans_params *prms
 
 }
 
+/* stable counting sort of the samples by key. returns the resulting order */
+static uint64_t* create_sample_order_by_key(uint64_t* keys
+                                            , uint64_t no_keys
+                                            , uint64_t no_samples) {
+    uint64_t i, pos, count;
+    uint64_t *offsets, *order;
+
+    offsets = (uint64_t*) calloc(no_keys, sizeof(uint64_t));
+    order = (uint64_t*) calloc(no_samples, sizeof(uint64_t));
+
+    for (i = 0; i < no_samples; i++) {
+        offsets[keys[i]]++;
+    }
+
+    pos = 0;
+    for (i = 0; i < no_keys; i++) {
+        count = offsets[i];
+        offsets[i] = pos;
+        pos += count;
+    }
+
+    for (i = 0; i < no_samples; i++) {
+        order[offsets[keys[i]]++] = i;
+    }
+
+    free_null(offsets);
+    return order;
+}
+
+/* reorder array (no_samples elements of size bytes) so that element i becomes element order[i] */
+static void permute_sample_array(void* array
+                                 , size_t size
+                                 , uint64_t* order
+                                 , uint64_t no_samples) {
+    uint64_t i;
+    char* copy;
+
+    copy = (char*) malloc(no_samples * size);
+    memcpy(copy, array, no_samples * size);
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < no_samples; i++) {
+        memcpy(((char*) array) + i * size, copy + order[i] * size, size);
+    }
+
+    free_null(copy);
+}
+
+void initialize_sample_order(struct kmeans_params *prms
+                             , struct general_kmeans_context* ctx) {
+    uint32_t sample_order;
+    uint64_t i, no_keys;
+    uint64_t* keys;
+    VALUE_TYPE* weights;
+
+    sample_order = d_get_subint_default(&(prms->tr)
+                                        , "additional_params", "sample_order", SAMPLE_ORDER_INPUT);
+    if (sample_order == SAMPLE_ORDER_INPUT) return;
+
+    if (is_mapped_csr_matrix(ctx->samples)) {
+        /* the reordered copy would have to fit into the main memory */
+        if (prms->verbose) LOG_ERROR("Unable to reorder memory mapped samples without copying them. Keeping the input order instead!");
+        return;
+    }
+
+    gettimeofday(&(ctx->durations), NULL);
+    keys = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
+
+    if (sample_order == SAMPLE_ORDER_FEATURE) {
+        /* the feature with the largest absolute value. samples about the same
+         * topic share it and most likely end up in the same clusters.
+         */
+        no_keys = ctx->samples->dim + 1;
+
+        #pragma omp parallel for schedule(dynamic, 1000)
+        for (i = 0; i < ctx->samples->sample_count; i++) {
+            uint64_t j;
+            VALUE_TYPE max_value;
+
+            max_value = -1;
+            for (j = ctx->samples->pointers[i]; j < ctx->samples->pointers[i + 1]; j++) {
+                if (fabs(ctx->samples->values[j]) > max_value) {
+                    max_value = fabs(ctx->samples->values[j]);
+                    keys[i] = ctx->samples->keys[j];
+                }
+            }
+        }
+    } else {
+        no_keys = ctx->no_clusters;
+        memcpy(keys, ctx->cluster_assignments, ctx->samples->sample_count * sizeof(uint64_t));
+    }
+
+    ctx->sample_order = create_sample_order_by_key(keys, no_keys, ctx->samples->sample_count);
+    free_null(keys);
+
+    ctx->sample_positions = (uint64_t*) calloc(ctx->samples->sample_count, sizeof(uint64_t));
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        ctx->sample_positions[ctx->sample_order[i]] = i;
+    }
+
+    ctx->input_samples = ctx->samples;
+    ctx->samples = create_permuted_csr_matrix(ctx->input_samples, ctx->sample_order);
+
+    permute_sample_array(ctx->cluster_assignments, sizeof(uint64_t), ctx->sample_order, ctx->samples->sample_count);
+    permute_sample_array(ctx->cluster_distances, sizeof(VALUE_TYPE), ctx->sample_order, ctx->samples->sample_count);
+    permute_sample_array(ctx->vector_lengths_samples, sizeof(VALUE_TYPE), ctx->sample_order, ctx->samples->sample_count);
+    permute_sample_array(ctx->was_assigned, sizeof(uint32_t), ctx->sample_order, ctx->samples->sample_count);
+
+    /* the weights belong to the caller, permute a copy */
+    if (ctx->sample_weights != NULL) {
+        weights = (VALUE_TYPE*) calloc(ctx->samples->sample_count, sizeof(VALUE_TYPE));
+        memcpy(weights, ctx->sample_weights, ctx->samples->sample_count * sizeof(VALUE_TYPE));
+        permute_sample_array(weights, sizeof(VALUE_TYPE), ctx->sample_order, ctx->samples->sample_count);
+        ctx->sample_weights = weights;
+    }
+
+    d_add_float(&(prms->tr), "duration_sample_order", (VALUE_TYPE) get_diff_in_microseconds(ctx->durations));
+    if (prms->verbose) LOG_INFO("Reordered samples (sample_order = %" PRINTF_INT32_MODIFIER "u)", sample_order);
+}
+
+/* copy the moved clusters (all if clusters_not_changed is NULL) from
+ * dense_cluster_vectors to the replicas. every replica is written by the first
+ * thread of its socket.
+ */
+static void update_dense_cluster_replicas(struct general_kmeans_context* ctx
+                                          , uint32_t* clusters_not_changed) {
+    #pragma omp parallel
+    {
+        uint64_t i, thread_id, socket;
+        VALUE_TYPE* replica;
+
+        thread_id = omp_get_thread_num();
+        socket = get_thread_socket(thread_id);
+
+        /* only the thread with the smallest id of every socket copies */
+        for (i = 0; i < thread_id && get_thread_socket(i) != socket; i++);
+
+        if (i == thread_id && socket < ctx->no_dense_cluster_replicas) {
+            replica = ctx->dense_cluster_replicas[socket];
+            for (i = 0; i < ctx->no_clusters; i++) {
+                if (clusters_not_changed != NULL && clusters_not_changed[i]) continue;
+                memcpy(replica + i * ctx->samples->dim
+                       , ctx->dense_cluster_vectors + i * ctx->samples->dim
+                       , ctx->samples->dim * sizeof(VALUE_TYPE));
+            }
+        }
+    }
+}
+
+VALUE_TYPE* get_dense_cluster_vectors(struct general_kmeans_context* ctx) {
+    if (ctx->dense_cluster_replicas == NULL) return ctx->dense_cluster_vectors;
+    return ctx->dense_cluster_replicas[get_thread_socket(omp_get_thread_num())];
+}
+
+void initialize_dense_cluster_vectors(struct kmeans_params *prms
+                                      , struct general_kmeans_context* ctx) {
+    VALUE_TYPE dense_clusters, replicate_clusters;
+    uint32_t use_dense, use_replicas;
+    uint64_t i;
+
+    dense_clusters = d_get_subfloat_default(&(prms->tr)
+                                            , "additional_params", "dense_clusters", -1);
+
+    if (dense_clusters == 0) {
+        use_dense = 0;
+    } else if (dense_clusters > 0) {
+        use_dense = 1;
+    } else {
+        use_dense = dense_vectors_recommended(ctx->samples, ctx->no_clusters);
+    }
+
+    d_add_int(&(prms->tr), "dense_clusters", use_dense);
+    if (!use_dense) return;
+
+    ctx->dense_cluster_vectors = (VALUE_TYPE*) calloc(ctx->no_clusters * ctx->samples->dim, sizeof(VALUE_TYPE));
+    update_dense_vectors_from_vector_list(ctx->cluster_vectors
+                                          , ctx->no_clusters
+                                          , ctx->samples->dim
+                                          , NULL
+                                          , ctx->dense_cluster_vectors);
+
+    if (prms->verbose) LOG_INFO("Using dense cluster centers (dim = %" PRINTF_INT64_MODIFIER "u)", ctx->samples->dim);
+
+    replicate_clusters = d_get_subfloat_default(&(prms->tr)
+                                                , "additional_params", "replicate_clusters", -1);
+
+    if (replicate_clusters == 0) {
+        use_replicas = 0;
+    } else if (replicate_clusters > 0) {
+        use_replicas = 1;
+    } else {
+        use_replicas = (get_no_sockets() > 1);
+    }
+
+    d_add_int(&(prms->tr), "dense_cluster_replicas", use_replicas ? get_no_sockets() : 0);
+    if (!use_replicas) return;
+
+    ctx->no_dense_cluster_replicas = get_no_sockets();
+    ctx->dense_cluster_replicas = (VALUE_TYPE**) calloc(ctx->no_dense_cluster_replicas, sizeof(VALUE_TYPE*));
+    for (i = 0; i < ctx->no_dense_cluster_replicas; i++) {
+        /* not touched yet, the first copy places the pages */
+        ctx->dense_cluster_replicas[i] = (VALUE_TYPE*) malloc(ctx->no_clusters * ctx->samples->dim * sizeof(VALUE_TYPE));
+    }
+    update_dense_cluster_replicas(ctx, NULL);
+
+    if (prms->verbose) LOG_INFO("Using one copy of the dense cluster centers per socket (%" PRINTF_INT64_MODIFIER "u)"
+                                , ctx->no_dense_cluster_replicas);
+}
+
+void initialize_compressed_sample_keys(struct kmeans_params *prms
+                                       , struct general_kmeans_context* ctx) {
+    VALUE_TYPE compressed_keys;
+    uint64_t i, nnz, max_nnz;
+
+    compressed_keys = d_get_subfloat_default(&(prms->tr)
+                                             , "additional_params", "compressed_keys", 0);
+
+    if (compressed_keys > 0 && !compressed_keys_supported(prms->kmeans_algorithm_id)) {
+        compressed_keys = 0;
+    }
+
+    d_add_int(&(prms->tr), "compressed_keys", compressed_keys > 0);
+    if (compressed_keys <= 0) return;
+
+    ctx->compressed_sample_keys = (struct csr_compressed_keys*) calloc(1, sizeof(struct csr_compressed_keys));
+    compress_csr_matrix_keys(ctx->samples, ctx->compressed_sample_keys);
+
+    max_nnz = 1;
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        nnz = ctx->samples->pointers[i + 1] - ctx->samples->pointers[i];
+        if (nnz > max_nnz) max_nnz = nnz;
+    }
+
+    ctx->thread_sample_keys = (struct sample_keys_buffer*) calloc(ctx->no_threads, sizeof(struct sample_keys_buffer));
+    for (i = 0; i < ctx->no_threads; i++) {
+        ctx->thread_sample_keys[i].keys = (KEY_TYPE*) calloc(max_nnz, sizeof(KEY_TYPE));
+        ctx->thread_sample_keys[i].sample_id = UINT64_MAX;
+    }
+
+    if (ctx->input_samples != NULL) {
+        /* the reordered copy belongs to the context, its keys are not needed anymore */
+        free_null(ctx->samples->keys);
+    } else {
+        /* the keys belong to the caller. if they are memory mapped their pages can be released */
+        advise_csr_matrix_keys(ctx->samples, 0);
+    }
+
+    nnz = ctx->samples->pointers[ctx->samples->sample_count];
+    if (prms->verbose) LOG_INFO("Using compressed sample keys (%.2f bytes per key)"
+                                , nnz ? ctx->compressed_sample_keys->stream_pointers[ctx->samples->sample_count] / (double) nnz : 0.0);
+}
+
+KEY_TYPE* get_sample_keys(struct general_kmeans_context* ctx, uint64_t sample_id) {
+    struct sample_keys_buffer *buffer;
+
+    if (ctx->compressed_sample_keys == NULL) return ctx->samples->keys + ctx->samples->pointers[sample_id];
+
+    buffer = ctx->thread_sample_keys + omp_get_thread_num();
+    if (buffer->sample_id != sample_id) {
+        decompress_keys(ctx->compressed_sample_keys->key_stream
+                            + ctx->compressed_sample_keys->stream_pointers[sample_id]
+                        , ctx->samples->pointers[sample_id + 1] - ctx->samples->pointers[sample_id]
+                        , buffer->keys);
+        buffer->sample_id = sample_id;
+    }
+
+    return buffer->keys;
+}
+
+void initialize_lower_bound_matrix(struct kmeans_params *prms
+                                   , struct general_kmeans_context* ctx
+                                   , uint64_t no_cols
+                                   , struct bound_matrix* lower_bounds) {
+    VALUE_TYPE bound_encoding;
+    VALUE_TYPE max_length;
+    uint32_t encoding;
+    uint64_t i;
+    uint64_t* range_starts;
+
+    bound_encoding = d_get_subfloat_default(&(prms->tr)
+                                            , "additional_params", "bound_encoding", 0);
+
+    encoding = BOUND_ENCODING_NATIVE;
+    if (bound_encoding > 0 && bound_encoding < NO_BOUND_ENCODINGS) encoding = (uint32_t) bound_encoding;
+
+    /* vector_lengths_samples contains the squared lengths */
+    max_length = 0;
+    for (i = 0; i < ctx->samples->sample_count; i++) {
+        if (ctx->vector_lengths_samples[i] > max_length) max_length = ctx->vector_lengths_samples[i];
+    }
+
+    range_starts = get_sample_range_starts(ctx);
+    initialize_bound_matrix(lower_bounds
+                            , ctx->samples->sample_count
+                            , no_cols
+                            , encoding
+                            , 2 * sqrt(max_length)
+                            , range_starts
+                            , ctx->no_threads);
+    free(range_starts);
+
+    d_add_int(&(prms->tr), "bound_encoding", lower_bounds->encoding);
+    if (prms->verbose) LOG_INFO("Using %" PRINTF_INT64_MODIFIER "u byte lower bounds (%.2f MB)"
+                                , (uint64_t) bound_matrix_entry_size(lower_bounds)
+                                , (ctx->samples->sample_count * no_cols * bound_matrix_entry_size(lower_bounds)) / (1024.0 * 1024.0));
+}
+
+VALUE_TYPE euclid_sample_cluster(struct general_kmeans_context* ctx
+                                 , uint64_t sample_id
+                                 , uint64_t cluster_id) {
+
+    if (ctx->dense_cluster_vectors == NULL) {
+        return euclid_vector(get_sample_keys(ctx, sample_id)
+                             , ctx->samples->values + ctx->samples->pointers[sample_id]
+                             , ctx->samples->pointers[sample_id + 1] - ctx->samples->pointers[sample_id]
+                             , ctx->cluster_vectors[cluster_id].keys
+                             , ctx->cluster_vectors[cluster_id].values
+                             , ctx->cluster_vectors[cluster_id].nnz
+                             , ctx->vector_lengths_samples[sample_id]
+                             , ctx->vector_lengths_clusters[cluster_id]);
+    }
+
+    return euclid_vector_sparse_dense(get_sample_keys(ctx, sample_id)
+                                      , ctx->samples->values + ctx->samples->pointers[sample_id]
+                                      , ctx->samples->pointers[sample_id + 1] - ctx->samples->pointers[sample_id]
+                                      , get_dense_cluster_vectors(ctx) + cluster_id * ctx->samples->dim
+                                      , ctx->vector_lengths_samples[sample_id]
+                                      , ctx->vector_lengths_clusters[cluster_id]);
+}
+
+uint32_t use_blocked_assignment(struct kmeans_params *prms
+                                , struct general_kmeans_context* ctx) {
+    VALUE_TYPE blocked_assign;
+    uint32_t use_blocked;
+
+    blocked_assign = d_get_subfloat_default(&(prms->tr)
+                                            , "additional_params", "blocked_assign", -1);
+
+    if (blocked_assign == 0) {
+        use_blocked = 0;
+    } else if (blocked_assign > 0) {
+        use_blocked = 1;
+    } else {
+        use_blocked = dense_block_fits_memory(ctx->no_clusters, ctx->samples->dim);
+    }
+
+    d_add_int(&(prms->tr), "blocked_assign", use_blocked);
+    return use_blocked;
+}
+
+void assign_samples_blocked(struct general_kmeans_context* ctx
+                            , uint32_t skip_empty_clusters
+                            , uint64_t* cluster_to_group
+                            , struct bound_matrix* group_lower_bounds
+                            , uint32_t* stop) {
+    uint64_t no_sample_tiles, sample_tile, done_calculations;
+
+    if (ctx->dense_transposed_clusters == NULL) {
+        /* filled completely once, afterwards switch_to_shifted_clusters refreshes moved clusters */
+        ctx->dense_transposed_clusters = (VALUE_TYPE*) calloc(ctx->samples->dim * ctx->no_clusters, sizeof(VALUE_TYPE));
+        update_dense_transposed_from_vector_list(ctx->cluster_vectors
+                                                 , ctx->no_clusters
+                                                 , ctx->samples->dim
+                                                 , NULL
+                                                 , ctx->dense_transposed_clusters);
+    }
+
+    no_sample_tiles = (ctx->samples->sample_count + BLOCKED_SAMPLES_TILE - 1) / BLOCKED_SAMPLES_TILE;
+    done_calculations = 0;
+
+    #pragma omp parallel reduction(+:done_calculations)
+    {
+        VALUE_TYPE* tile;
+        tile = (VALUE_TYPE*) malloc(BLOCKED_SAMPLES_TILE * BLOCKED_CLUSTERS_TILE * sizeof(VALUE_TYPE));
+
+        #pragma omp for schedule(dynamic, 1)
+        for (sample_tile = 0; sample_tile < no_sample_tiles; sample_tile++) {
+            uint64_t sample_start, sample_end, cluster_start, cluster_end;
+            uint64_t sample_id, cluster_id;
+            VALUE_TYPE dist;
+            VALUE_TYPE* tile_row;
+
+            if (omp_get_thread_num() == 0) check_signals(stop);
+            if (*stop) continue;
+
+            sample_start = sample_tile * BLOCKED_SAMPLES_TILE;
+            sample_end = sample_start + BLOCKED_SAMPLES_TILE;
+            if (sample_end > ctx->samples->sample_count) sample_end = ctx->samples->sample_count;
+
+            for (cluster_start = 0; cluster_start < ctx->no_clusters; cluster_start += BLOCKED_CLUSTERS_TILE) {
+                cluster_end = cluster_start + BLOCKED_CLUSTERS_TILE;
+                if (cluster_end > ctx->no_clusters) cluster_end = ctx->no_clusters;
+
+                csr_dense_transposed_dot_tile(ctx->samples
+                                              , sample_start, sample_end
+                                              , ctx->dense_transposed_clusters
+                                              , ctx->no_clusters
+                                              , cluster_start, cluster_end
+                                              , tile);
+
+                for (sample_id = sample_start; sample_id < sample_end; sample_id++) {
+                    tile_row = tile + (sample_id - sample_start) * (cluster_end - cluster_start);
+
+                    for (cluster_id = cluster_start; cluster_id < cluster_end; cluster_id++) {
+                        if (skip_empty_clusters && ctx->cluster_counts[cluster_id] == 0) continue;
+
+                        dist = sqrt(value_type_max(ctx->vector_lengths_samples[sample_id]
+                                                   + ctx->vector_lengths_clusters[cluster_id]
+                                                   - 2 * tile_row[cluster_id - cluster_start]
+                                                   , 0.0));
+                        done_calculations += 1;
+
+                        if (dist < ctx->cluster_distances[sample_id]) {
+                            if (group_lower_bounds) {
+                                /* the previously closest cluster becomes a lower bound of its group */
+                                uint64_t group_id;
+                                group_id = cluster_to_group[ctx->cluster_assignments[sample_id]];
+                                if (ctx->cluster_distances[sample_id] < bound_matrix_get(group_lower_bounds, sample_id, group_id)) {
+                                    bound_matrix_set(group_lower_bounds, sample_id, group_id, ctx->cluster_distances[sample_id]);
+                                }
+                            }
+                            ctx->cluster_distances[sample_id] = dist;
+                            ctx->cluster_assignments[sample_id] = cluster_id;
+                        } else if (group_lower_bounds) {
+                            if (dist < bound_matrix_get(group_lower_bounds, sample_id, cluster_to_group[cluster_id])) {
+                                bound_matrix_set(group_lower_bounds, sample_id, cluster_to_group[cluster_id], dist);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        free(tile);
+    }
+
+    ctx->done_calculations += done_calculations;
+}
+
 void search_samples_block_vectors(struct kmeans_params *prms
                                    , struct csr_matrix* samples
                                    , VALUE_TYPE desired_annz
@@ -877,110 +2551,140 @@ void switch_to_shifted_clusters(struct general_kmeans_context* ctx) {
 
     free_null(ctx->vector_lengths_clusters);
     ctx->vector_lengths_clusters = ctx->vector_lengths_shifted_clusters;
+
+    if (ctx->dense_cluster_vectors) {
+        update_dense_vectors_from_vector_list(ctx->cluster_vectors
+                                              , ctx->no_clusters
+                                              , ctx->samples->dim
+                                              , ctx->clusters_not_changed
+                                              , ctx->dense_cluster_vectors);
+    }
+
+    if (ctx->dense_cluster_replicas) {
+        update_dense_cluster_replicas(ctx, ctx->clusters_not_changed);
+    }
+
+    if (ctx->dense_transposed_clusters) {
+        update_dense_transposed_from_vector_list(ctx->cluster_vectors
+                                                 , ctx->no_clusters
+                                                 , ctx->samples->dim
+                                                 , ctx->clusters_not_changed
+                                                 , ctx->dense_transposed_clusters);
+    }
 }
 
 void calculate_shifted_clusters_general(struct general_kmeans_context* ctx
                                         , uint32_t* active_sample_map
                                         , uint32_t update_type) {
-    uint64_t* was_cluster_hashmap_changed;
     uint64_t j;
+    uint64_t *operation_offsets;   /* operations of cluster c are in [offsets[c], offsets[c + 1]) */
+    uint64_t *operation_positions;
+    uint64_t *operations;          /* (sample_id << 1) | 1 if the sample is added to the cluster */
 
     if (ctx->track_time) gettimeofday(&(ctx->durations), NULL);
 
-    was_cluster_hashmap_changed = (uint64_t*) calloc(ctx->no_clusters, sizeof(uint64_t));
+    /* group the samples to add / remove by cluster. every cluster is then updated by
+     * a single thread which applies its operations in the order of the samples.
+     */
+    operation_offsets = (uint64_t*) calloc(ctx->no_clusters + 1, sizeof(uint64_t));
+    operation_positions = (uint64_t*) calloc(ctx->no_clusters, sizeof(uint64_t));
+
+    for (j = 0; j < ctx->samples->sample_count; j++) {
+        if (update_type == UPDATE_TYPE_KMEANS) {
+            if ((ctx->previous_cluster_assignments[j]
+                != ctx->cluster_assignments[j]) || !ctx->was_assigned[j]) {
+                if (ctx->was_assigned[j]) operation_offsets[ctx->previous_cluster_assignments[j] + 1] += 1;
+                operation_offsets[ctx->cluster_assignments[j] + 1] += 1;
+            }
+        } else if (update_type == UPDATE_TYPE_MINIBATCH_KMEANS) {
+            if (active_sample_map[j]) operation_offsets[ctx->cluster_assignments[j] + 1] += 1;
+        }
+    }
 
-    #pragma omp parallel for schedule(dynamic, 1000)
     for (j = 0; j < ctx->no_clusters; j++) {
-        ctx->clusters_not_changed[j] = 1;
+        operation_offsets[j + 1] += operation_offsets[j];
+        operation_positions[j] = operation_offsets[j];
     }
+    operations = (uint64_t*) malloc((operation_offsets[ctx->no_clusters] + 1) * sizeof(uint64_t));
 
-    /* update cluster_centers if needed */
     for (j = 0; j < ctx->samples->sample_count; j++) {
         if (update_type == UPDATE_TYPE_KMEANS) {
             if ((ctx->previous_cluster_assignments[j]
                 != ctx->cluster_assignments[j]) || !ctx->was_assigned[j]) {
-                    KEY_TYPE* keys;
-                    VALUE_TYPE* values;
-                    uint64_t nnz;
-                    keys = ctx->samples->keys + ctx->samples->pointers[j];
-                    values = ctx->samples->values + ctx->samples->pointers[j];
-                    nnz = ctx->samples->pointers[j + 1] - ctx->samples->pointers[j];
-
-                    if (ctx->was_assigned[j]) {
-                        remove_sample_from_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->previous_cluster_assignments[j]);
-                        ctx->cluster_counts[ctx->previous_cluster_assignments[j]] -= 1;
-                        ctx->clusters_not_changed[ctx->previous_cluster_assignments[j]] = 0;
-                    }
-
-                    was_cluster_hashmap_changed[ctx->cluster_assignments[j]] += add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, ctx->cluster_assignments[j]);
-                    ctx->cluster_counts[ctx->cluster_assignments[j]] += 1;
-                    ctx->clusters_not_changed[ctx->cluster_assignments[j]] = 0;
-                    ctx->was_assigned[j] = 1;
+                if (ctx->was_assigned[j]) {
+                    operations[operation_positions[ctx->previous_cluster_assignments[j]]++] = j << 1;
+                }
+                operations[operation_positions[ctx->cluster_assignments[j]]++] = (j << 1) | 1;
+                ctx->was_assigned[j] = 1;
             }
         } else if (update_type == UPDATE_TYPE_MINIBATCH_KMEANS) {
             if (active_sample_map[j]) {
-                    KEY_TYPE* keys;
-                    VALUE_TYPE* values;
-                    uint64_t nnz;
-                    keys = ctx->samples->keys + ctx->samples->pointers[j];
-                    values = ctx->samples->values + ctx->samples->pointers[j];
-                    nnz = ctx->samples->pointers[j + 1] - ctx->samples->pointers[j];
-                    was_cluster_hashmap_changed[ctx->cluster_assignments[j]]
-                       += add_sample_to_hashmap_minibatch_kmeans(ctx->clusters_raw
-                                                                 , keys
-                                                                 , values
-                                                                 , nnz
-                                                                 , ctx->cluster_assignments[j]
-                                                                 , ctx->cluster_counts[ctx->cluster_assignments[j]]);
-                    ctx->cluster_counts[ctx->cluster_assignments[j]] += 1;
-                    ctx->clusters_not_changed[ctx->cluster_assignments[j]] = 0;
-                    ctx->was_assigned[j] = 1;
+                operations[operation_positions[ctx->cluster_assignments[j]]++] = (j << 1) | 1;
+                ctx->was_assigned[j] = 1;
             }
         }
     }
 
     ctx->shifted_cluster_vectors = (struct sparse_vector*) calloc(ctx->no_clusters, sizeof(struct csr_matrix));
 
+    /* update cluster_centers if needed */
+    #pragma omp parallel for schedule(dynamic, 1)
     for (j = 0; j < ctx->no_clusters; j++) {
-
-        if (was_cluster_hashmap_changed[j]) {
-            HASH_SORT((ctx->clusters_raw)[j], id_sort);
+        uint64_t op, sample_id, nnz;
+        KEY_TYPE* keys;
+        VALUE_TYPE* values;
+        VALUE_TYPE weight;
+
+        for (op = operation_offsets[j]; op < operation_offsets[j + 1]; op++) {
+            sample_id = operations[op] >> 1;
+            keys = get_sample_keys(ctx, sample_id);
+            values = ctx->samples->values + ctx->samples->pointers[sample_id];
+            nnz = ctx->samples->pointers[sample_id + 1] - ctx->samples->pointers[sample_id];
+            weight = get_sample_weight(ctx, sample_id);
+
+            if (!(operations[op] & 1)) {
+                remove_sample_from_hashmap(ctx->clusters_raw, keys, values, nnz, j, weight);
+                ctx->cluster_counts[j] -= 1;
+                ctx->cluster_weights[j] -= weight;
+            } else if (update_type == UPDATE_TYPE_MINIBATCH_KMEANS) {
+                add_sample_to_hashmap_minibatch_kmeans(ctx->clusters_raw
+                                                       , keys
+                                                       , values
+                                                       , nnz
+                                                       , j
+                                                       , ctx->cluster_weights[j]
+                                                       , weight);
+                ctx->cluster_counts[j] += 1;
+                ctx->cluster_weights[j] += weight;
+            } else {
+                add_sample_to_hashmap(ctx->clusters_raw, keys, values, nnz, j, weight);
+                ctx->cluster_counts[j] += 1;
+                ctx->cluster_weights[j] += weight;
+            }
         }
 
+        /* do not let rounding errors of the weights survive an empty cluster */
+        if (ctx->cluster_counts[j] == 0) ctx->cluster_weights[j] = 0;
+
+        ctx->clusters_not_changed[j] = (operation_offsets[j] == operation_offsets[j + 1]);
+
         if (ctx->clusters_not_changed[j]) {
             /* cluster was not changed! use old cluster as shifted */
             ctx->shifted_cluster_vectors[j].nnz = ctx->cluster_vectors[j].nnz;
             ctx->shifted_cluster_vectors[j].keys = ctx->cluster_vectors[j].keys;
             ctx->shifted_cluster_vectors[j].values = ctx->cluster_vectors[j].values;
         } else {
-            /* cluster has changed! adapt it */
-
-            uint64_t local_feature_count;
-            struct keyvaluecount_hash *current_item, *tmp;
-            current_item = NULL;
-            tmp = NULL;
-
-            ctx->shifted_cluster_vectors[j].nnz = HASH_COUNT(ctx->clusters_raw[j]);
-            /* printf("adapt cluster %u %u", j, ctx->shifted_cluster_vectors[j].nnz); */
-            if (ctx->shifted_cluster_vectors[j].nnz > 0) {
-                ctx->shifted_cluster_vectors[j].keys = (KEY_TYPE*) calloc(ctx->shifted_cluster_vectors[j].nnz, sizeof(KEY_TYPE));
-                ctx->shifted_cluster_vectors[j].values = (VALUE_TYPE*) calloc(ctx->shifted_cluster_vectors[j].nnz, sizeof(VALUE_TYPE));
-            }
-
-            local_feature_count = 0;
-            HASH_ITER(hh, ctx->clusters_raw[j], current_item, tmp) {
-              ctx->shifted_cluster_vectors[j].keys[local_feature_count] = current_item->id;
-              if (update_type == UPDATE_TYPE_MINIBATCH_KMEANS) {
-                  ctx->shifted_cluster_vectors[j].values[local_feature_count] = current_item->val;
-              } else {
-                  ctx->shifted_cluster_vectors[j].values[local_feature_count] = current_item->val / ctx->cluster_counts[j];
-              }
-              local_feature_count += 1;
-            }
-
+            /* cluster has changed! adapt it. minibatch kmeans accumulates the mean directly */
+            create_vector_from_hashmap(ctx->clusters_raw + j
+                                       , (update_type == UPDATE_TYPE_MINIBATCH_KMEANS) ? 1 : ctx->cluster_weights[j]
+                                       , ctx->shifted_cluster_vectors + j);
         }
     }
 
+    free_null(operations);
+    free_null(operation_positions);
+    free_null(operation_offsets);
+
     /* only recalculate for clusters which have actually changed */
     ctx->vector_lengths_shifted_clusters = (VALUE_TYPE*) calloc(ctx->no_clusters, sizeof(VALUE_TYPE));
     memcpy(ctx->vector_lengths_shifted_clusters, ctx->vector_lengths_clusters, ctx->no_clusters * sizeof(VALUE_TYPE));
@@ -990,8 +2694,6 @@ void calculate_shifted_clusters_general(struct general_kmeans_context* ctx
                                , ctx->clusters_not_changed
                                , ctx->vector_lengths_shifted_clusters);
 
-    free_null(was_cluster_hashmap_changed);
-
     if (ctx->track_time) ctx->duration_update_clusters = (VALUE_TYPE) get_diff_in_microseconds(ctx->durations);
 }
 
@@ -1006,6 +2708,86 @@ void calculate_shifted_clusters_minibatch_kmeans(struct general_kmeans_context*
                                       , UPDATE_TYPE_MINIBATCH_KMEANS);
 }
 
+/**
+ * @brief A cluster together with the distance to its closest group.
+ */
+struct grouped_cluster {
+    VALUE_TYPE distance;    /**< distance of the cluster to its closest group */
+    uint64_t cluster_id;    /**< id of the cluster */
+};
+
+static int cmp_grouped_cluster(const void *a, const void *b) {
+    const struct grouped_cluster *ga = (const struct grouped_cluster*) a;
+    const struct grouped_cluster *gb = (const struct grouped_cluster*) b;
+
+    if (ga->distance < gb->distance) return -1;
+    if (ga->distance > gb->distance) return 1;
+    if (ga->cluster_id < gb->cluster_id) return -1;
+    if (ga->cluster_id > gb->cluster_id) return 1;
+    return 0;
+}
+
+/* kmeans on few cluster centers leaves outlying centers in groups of their own
+ * while most centers share one group, which makes the group bounds useless.
+ * every group takes at most ceil(no_clusters / no_groups) clusters: the clusters
+ * closest to a group choose first and take their closest group with room left.
+ */
+static void balance_cluster_groups(struct csr_matrix* clusters
+                                   , struct csr_matrix* group_centers
+                                   , struct assign_result* assign_res) {
+    uint64_t i, j, group_id, capacity;
+    VALUE_TYPE *vector_lengths_clusters, *vector_lengths_groups, *distances;
+    struct grouped_cluster *order;
+
+    capacity = (clusters->sample_count + group_centers->sample_count - 1) / group_centers->sample_count;
+
+    calculate_matrix_vector_lengths(clusters, &vector_lengths_clusters);
+    calculate_matrix_vector_lengths(group_centers, &vector_lengths_groups);
+    distances = (VALUE_TYPE*) calloc(clusters->sample_count * group_centers->sample_count, sizeof(VALUE_TYPE));
+    order = (struct grouped_cluster*) calloc(clusters->sample_count, sizeof(struct grouped_cluster));
+
+    #pragma omp parallel for schedule(dynamic, 1) private(j)
+    for (i = 0; i < clusters->sample_count; i++) {
+        for (j = 0; j < group_centers->sample_count; j++) {
+            distances[i * group_centers->sample_count + j]
+                = euclid_vector(clusters->keys + clusters->pointers[i]
+                                , clusters->values + clusters->pointers[i]
+                                , clusters->pointers[i + 1] - clusters->pointers[i]
+                                , group_centers->keys + group_centers->pointers[j]
+                                , group_centers->values + group_centers->pointers[j]
+                                , group_centers->pointers[j + 1] - group_centers->pointers[j]
+                                , vector_lengths_clusters[i]
+                                , vector_lengths_groups[j]);
+        }
+        order[i].distance = distances[i * group_centers->sample_count + assign_res->assignments[i]];
+        order[i].cluster_id = i;
+    }
+    qsort(order, clusters->sample_count, sizeof(struct grouped_cluster), cmp_grouped_cluster);
+
+    for (j = 0; j < group_centers->sample_count; j++) assign_res->counts[j] = 0;
+
+    for (i = 0; i < clusters->sample_count; i++) {
+        VALUE_TYPE *cluster_distances;
+
+        cluster_distances = distances + order[i].cluster_id * group_centers->sample_count;
+        group_id = group_centers->sample_count;
+        for (j = 0; j < group_centers->sample_count; j++) {
+            if (assign_res->counts[j] == capacity) continue;
+            if (group_id == group_centers->sample_count || cluster_distances[j] < cluster_distances[group_id]) {
+                group_id = j;
+            }
+        }
+        assign_res->assignments[order[i].cluster_id] = group_id;
+        assign_res->distances[order[i].cluster_id] = cluster_distances[group_id];
+        assign_res->counts[group_id] += 1;
+    }
+
+    free_null(order);
+    free_null(distances);
+    free_null(vector_lengths_groups);
+    free_null(vector_lengths_clusters);
+}
+
 void create_kmeans_cluster_groups(struct sparse_vector *clusters_list
                                   , uint64_t no_clusters
                                   , uint64_t dim
@@ -1029,6 +2811,8 @@ void create_kmeans_cluster_groups(struct sparse_vector *clusters_list
     prms.remove_empty = 0;
     prms.stop = 0;
     prms.tr = NULL;
+    prms.sample_weights = NULL;
+    prms.coreset_size = 0;
     stop = 0;
 
     sparse_vector_list_to_csr_matrix(clusters_list
@@ -1042,6 +2826,7 @@ void create_kmeans_cluster_groups(struct sparse_vector *clusters_list
 
     /* assign clusters to groups */
     assign_res = assign(&clusters, res->clusters, &stop);
+    balance_cluster_groups(&clusters, res->clusters, &assign_res);
 
     *groups = (struct group*) calloc(*no_groups, sizeof(struct group));
     cluster_counters = (uint64_t*) calloc(*no_groups, sizeof(uint64_t));
@@ -3,8 +3,55 @@
 
 #include "kmeans_control.h"
 #include "kmeans_cluster_hashmap.h"
+#include "bound_matrix.h"
 #include <unistd.h>
 
+/**
+ * @brief Calculation counters of a single thread.
+ *
+ * Inside parallel loops every thread only increments its own block (see get_thread_stats).
+ * The blocks are merged with merge_thread_stats after the loop. A block is padded to
+ * 128 bytes so that blocks of different threads never share a cache line, regardless
+ * of the alignment of the array.
+ */
+struct kmeans_thread_stats {
+    uint64_t done_calculations;               /**< full distance calculations */
+    uint64_t done_blockvector_calcs;          /**< block vector distance approximations */
+    uint64_t done_pca_calcs;                  /**< pca distance approximations */
+    uint64_t saved_calculations_bv;           /**< full calculations saved by block vectors */
+    uint64_t saved_calculations_pca;          /**< full calculations saved by pca */
+    uint64_t saved_calculations_cauchy;       /**< full calculations saved by cauchy schwarz */
+    uint64_t saved_calculations_prev_cluster; /**< full calculations saved since the cluster did not move */
+    uint64_t saved_calculations_global;       /**< full calculations saved by the global filter (yinyang) */
+    uint64_t saved_calculations_local;        /**< full calculations saved by the local filter (yinyang) */
+    uint64_t groups_not_skipped;              /**< groups which passed the group filter (yinyang) */
+    uint64_t padding[6];
+};
+
+/**
+ * @brief Scratch buffer of one thread for the keys of a sample decoded from the
+ *        compressed sample keys (see get_sample_keys). Padded to 128 bytes like
+ *        kmeans_thread_stats.
+ */
+struct sample_keys_buffer {
+    KEY_TYPE *keys;            /**< decoded keys, large enough for every sample */
+    uint64_t sample_id;        /**< sample whose keys are in keys (UINT64_MAX = none) */
+    uint64_t padding[14];
+};
+
+/**
+ * @brief Range of a sample worklist which is owned by one thread (see
+ *        partition_sample_worklist). Padded to 128 bytes like kmeans_thread_stats.
+ */
+struct sample_partition_range {
+    uint64_t next;             /**< first position of the range which was not handed out yet */
+    uint64_t end;              /**< end of the range (exclusive) */
+    uint64_t chunk_start;      /**< start of the chunk the owning thread currently processes */
+    uint64_t chunk_end;        /**< end of the chunk the owning thread currently processes */
+    uint64_t chunk_calcs;      /**< full distance calculations of the owning thread before the chunk */
+    uint64_t padding[11];
+};
+
 /**
  * @brief General context has information about the currently running kmeans algorithm
  *        like internal counters which are the same for all k-means algorithms.
@@ -19,6 +66,8 @@ struct general_kmeans_context {
 
     uint32_t *was_assigned;            /**< For every sample: Was it assigned to any cluster yet? */
     uint64_t *cluster_counts;          /**< Number of samples contained in every cluster */
+    ACCUMULATOR_TYPE *cluster_weights; /**< Sum of the weights of the samples in every cluster (= cluster_counts without sample weights) */
+    VALUE_TYPE *sample_weights;        /**< Weight of every sample in samples (NULL = every sample has weight 1) */
     uint64_t *cluster_assignments;     /**< For every sample contains the assigned cluster */
     uint64_t *initial_cluster_samples; /**< A list of sample_ids from ctx.samples that served as initial cluster centers */
 
@@ -32,13 +81,34 @@ struct general_kmeans_context {
     uint64_t no_changes;                    /**< #samples that switched clusters in the last iteration */
     uint64_t done_calculations;             /**< #full distance calculations done in last iteration */
 
+    uint64_t no_threads;                         /**< length of thread_stats */
+    struct kmeans_thread_stats *thread_stats;    /**< counters of every thread (see get_thread_stats) */
+    struct kmeans_thread_stats iteration_stats;  /**< counters of all threads merged in the current iteration */
+
+    /* if not NULL: one scratch block vector for every thread, large enough to
+     * hold the block vector of any sample (see get_thread_block_vector).
+     */
+    struct sparse_vector *thread_block_vectors;
+
+    /* the worklist of the current sample loop split into one range of about
+     * equal work per thread (see partition_sample_worklist). partition_worklist
+     * NULL means all samples.
+     */
+    uint64_t *partition_worklist;
+    struct sample_partition_range *partition_ranges;
+
+    /* if not NULL: full distance calculations of every sample the last time it
+     * was examined. Used to weight the samples when partitioning a worklist.
+     */
+    uint32_t *sample_calcs;
+
     VALUE_TYPE *cluster_distances;          /**< distance samples to cluster */
     VALUE_TYPE *vector_lengths_samples;     /**< ||s|| for every s in samples */
     VALUE_TYPE *vector_lengths_clusters;    /**< ||c|| for every c in clusters */
 
     struct csr_matrix *samples;               /**< samples as csr */
     /* struct csr_matrix *clusters; */             /**< cluster centers as csr */
-    struct keyvaluecount_hash **clusters_raw; /**< cluster centers as hashmap */
+    struct cluster_accumulator *clusters_raw; /**< accumulated sums of the samples of every cluster */
 
     uint64_t no_clusters;                            /**< length of cluster_vectors / shifted_cluster_vectors array */
     struct sparse_vector* cluster_vectors;           /**< cluster centers as a list of sparse vectors */
@@ -47,8 +117,38 @@ struct general_kmeans_context {
     uint64_t *previous_cluster_assignments; /**< remembering to which cluster a sample was assigned in the last iteration avoids calculating that distance again */
 
     VALUE_TYPE *vector_lengths_shifted_clusters; /**< ||c|| for every c in clusters after shifting */
+
+    /* if not NULL: cluster_vectors as dense row-major no_clusters x samples->dim block.
+     * Kept in sync with cluster_vectors by switch_to_shifted_clusters.
+     */
+    VALUE_TYPE *dense_cluster_vectors;
+
+    /* if not NULL: a read only copy of dense_cluster_vectors for every socket,
+     * placed in the memory of that socket (see get_dense_cluster_vectors).
+     */
+    VALUE_TYPE **dense_cluster_replicas;
+    uint64_t no_dense_cluster_replicas;
+
+    /* if not NULL: cluster_vectors as dense transposed samples->dim x no_clusters block
+     * used by assign_samples_blocked. Kept in sync by switch_to_shifted_clusters.
+     */
+    VALUE_TYPE *dense_transposed_clusters;
+
+    /* if not NULL: keys of ctx->samples compressed. Used instead of samples->keys
+     * in the iterations (see get_sample_keys), samples->keys may be NULL.
+     */
+    struct csr_compressed_keys *compressed_sample_keys;
+    struct sample_keys_buffer *thread_sample_keys;   /**< one buffer per thread if the keys are compressed */
     struct csr_matrix *shifted_clusters;         /**< csr matrix of shifted clusters */
 
+    /* if not NULL: samples is a reordered copy of input_samples (see
+     * initialize_sample_order). Sample i of samples is sample sample_order[i]
+     * of input_samples and sample i of input_samples is sample_positions[i].
+     */
+    uint64_t *sample_order;
+    uint64_t *sample_positions;
+    struct csr_matrix *input_samples;         /**< samples the algorithm was started with */
+
     /* time stuff*/
     struct timeval tm_start_iteration;   /**< used to keep track of duration of a complete iter */
     struct timeval tm_start;             /**< used to keep track of overall elapsed time */
@@ -138,6 +238,161 @@ void post_process_iteration_minibatch(struct general_kmeans_context* ctx
  */
 void pre_process_iteration(struct general_kmeans_context* ctx);
 
+/**
+ * @brief Get the calculation counters of the calling thread.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return Counters which may only be modified by the calling thread.
+ */
+struct kmeans_thread_stats* get_thread_stats(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Get the weight of a sample.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] sample_id Sample of ctx->samples.
+ * @return Weight of the sample (1 if the samples are not weighted).
+ */
+VALUE_TYPE get_sample_weight(struct general_kmeans_context* ctx, uint64_t sample_id);
+
+/**
+ * @brief Add the counters of all threads to ctx->iteration_stats (and their full distance
+ *        calculations to ctx->done_calculations). Afterwards the thread counters are zero.
+ *        Must be called outside of parallel regions.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return Number of full distance calculations which were merged.
+ */
+uint64_t merge_thread_stats(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Create a worklist which contains every sample once (ascending).
+ *
+ * A worklist holds the samples an iteration needs to examine. Samples which
+ * are known not to change their cluster are left out, so late iterations
+ * only distribute the few remaining candidates across the threads.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return Array of sample_count sample ids.
+ */
+uint64_t* create_sample_worklist(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Split the samples into one contiguous chunk per thread to build a
+ *        worklist in parallel. Chunk i covers the samples
+ *        [i * chunk_size, (i + 1) * chunk_size) and writes the samples it selects
+ *        to the start of the same range of the worklist.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[out] no_chunks Number of chunks.
+ * @return Number of samples per chunk.
+ */
+uint64_t get_sample_chunks(struct general_kmeans_context* ctx, uint64_t* no_chunks);
+
+/**
+ * @brief Move the chunks of a worklist built with get_sample_chunks together.
+ *        The samples stay in ascending order.
+ *
+ * @param[in,out] worklist The worklist.
+ * @param[in] chunk_size Number of samples per chunk.
+ * @param[in] chunk_counts Number of samples every chunk selected.
+ * @param[in] no_chunks Number of chunks.
+ * @return Number of samples in the worklist.
+ */
+uint64_t concatenate_sample_chunks(uint64_t* worklist
+                                   , uint64_t chunk_size
+                                   , uint64_t* chunk_counts
+                                   , uint64_t no_chunks);
+
+/**
+ * @brief Build the worklist of algorithms using the cluster no change optimization.
+ *
+ * A sample whose assigned cluster moved towards it (eligible) skips all clusters
+ * which did not move. If no other non empty cluster moved, the sample is left out.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] eligible_for_cluster_no_change_optimization Eligibility of every sample.
+ * @param[out] worklist Array of sample_count entries, receives the samples to examine.
+ * @return Number of samples in the worklist.
+ */
+uint64_t collect_no_change_worklist(struct general_kmeans_context* ctx
+                                    , uint32_t* eligible_for_cluster_no_change_optimization
+                                    , uint64_t* worklist);
+
+/**
+ * @brief Split a worklist into one contiguous range per thread before a sample
+ *        loop. All ranges need about the same work: a sample costs its number
+ *        of non zero values (times its full distance calculations in the last
+ *        iteration if requested with the additional parameter partition_by_calcs).
+ *
+ * The loop then processes the worklist positions returned by next_sample_position.
+ * Must be called outside of parallel regions.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] worklist The samples to process. NULL means all samples.
+ * @param[in] no_samples Number of samples in the worklist.
+ */
+void partition_sample_worklist(struct general_kmeans_context* ctx
+                               , uint64_t* worklist
+                               , uint64_t no_samples);
+
+/**
+ * @brief Get the start of the range of every thread if all samples are
+ *        partitioned with partition_sample_worklist(ctx, NULL, sample_count).
+ *
+ * Must be called outside of parallel regions.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return Array of no_threads + 1 sample ids, the last one is sample_count (free it with free).
+ */
+uint64_t* get_sample_range_starts(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Allocate a zeroed array with one element per sample. Every thread
+ *        zeroes the samples of its range (see get_sample_range_starts), so the
+ *        pages are placed on the NUMA node of the thread which processes these
+ *        samples in the sample loops.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] size Size of one element in bytes.
+ * @return The zeroed array (free it with free).
+ */
+void* calloc_sample_array(struct general_kmeans_context* ctx, size_t size);
+
+/**
+ * @brief Get the next position of the partitioned worklist for the calling thread.
+ *        Positions are handed out in chunks. A thread first processes its own
+ *        range, afterwards it steals chunks from the ranges of the other threads.
+ *
+ * Usage:
+ * #pragma omp parallel private(j)
+ * for (j = 0; next_sample_position(ctx, &j); j++) sample_id = worklist[j] ...
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in,out] position The position after the last processed one (0 at the
+ *                start of the loop). Set to the next position to process.
+ * @return 0 if no work is left, else 1.
+ */
+uint32_t next_sample_position(struct general_kmeans_context* ctx
+                              , uint64_t* position);
+
+/**
+ * @brief Allocate a scratch block vector for every thread. Afterwards block vectors of
+ *        single samples can be created with fill_block_vector_from_csr_matrix_vector
+ *        into get_thread_block_vector without any memory allocations.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ */
+void initialize_thread_block_vectors(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Get the scratch block vector of the calling thread.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return Block vector which may only be used by the calling thread.
+ */
+struct sparse_vector* get_thread_block_vector(struct general_kmeans_context* ctx);
+
 /**
  * @brief Used to do all post processing needed after an iteration of kmeans
  *        which is common in many k-means algorithms.
@@ -165,6 +420,24 @@ void initialize_kmeans_random(struct general_kmeans_context* ctx,
 void initialize_kmeans_pp(struct general_kmeans_context* ctx,
                               struct kmeans_params *prms);
                               
+/**
+ * @brief Scalable kmeans++ (kmeans||) initialization.
+ *
+ * Starting with a random sample, every round chooses every sample with a
+ * probability proportional to its distance to the closest candidate, about
+ * kmpar_oversampling * no_clusters samples per round (additional parameter,
+ * default 2) for kmpar_rounds rounds (default 2). Afterwards kmeans++ on the
+ * candidates, weighted by the number of samples closest to them, chooses the
+ * cluster centers. A sample is assigned to the cluster of its closest candidate.
+ * The kmeans++ options kmpp_bv_annz, kmpp_use_pca and kmpp_use_triangle_inequality
+ * are used to skip distance calculations.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] prms are the parameters, the algorithm was started with
+ */
+void initialize_kmeans_parallel(struct general_kmeans_context* ctx,
+                                struct kmeans_params *prms);
+
 void initialize_kmeans_init_params(struct general_kmeans_context* ctx,
                                        struct kmeans_params *prms);
                                        
@@ -178,6 +451,155 @@ void preinitialize_kmeans_init_params(struct csr_matrix *samples,
  */
 void switch_to_shifted_clusters(struct general_kmeans_context* ctx);
 
+/**
+ * @brief Create the dense representation of the cluster centers if this is
+ *        favourable for the input samples (see dense_vectors_recommended).
+ *
+ * Can be forced with the additional parameter dense_clusters (0 = never,
+ * 1 = always, default = decide automatically).
+ *
+ * The additional parameter replicate_clusters controls the copies per socket
+ * (0 = never, 1 = always, default = if the threads are pinned to more than
+ * one socket, see pin_threads).
+ *
+ * @param[in] prms are the parameters, the algorithm was started with
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ */
+void initialize_dense_cluster_vectors(struct kmeans_params *prms
+                                      , struct general_kmeans_context* ctx);
+
+/**
+ * @brief Dense cluster centers to read from the calling thread. If the threads
+ *        are pinned to more than one socket, this is the copy of the centers
+ *        in the memory of the socket the thread runs on.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return ctx->dense_cluster_vectors or a copy of it.
+ */
+VALUE_TYPE* get_dense_cluster_vectors(struct general_kmeans_context* ctx);
+
+/**
+ * @brief Reorder the samples if requested with the additional parameter
+ *        sample_order (0 = input order (default), 1 = group samples by their
+ *        initial cluster, 2 = group samples by their largest feature).
+ *
+ * Neighbouring samples then mostly need the same few clusters, which keeps the
+ * working set of every thread small. ctx->samples is replaced by a reordered
+ * copy and all per sample arrays of the context are reordered accordingly.
+ * The copy needs as much memory as the samples themselves, memory mapped
+ * samples (binary csr matrix files) are therefore never reordered.
+ * create_kmeans_result returns the assignments in the input order.
+ * The random init assigns samples round robin, use 2 with it.
+ *
+ * @param[in] prms are the parameters, the algorithm was started with
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ */
+void initialize_sample_order(struct kmeans_params *prms
+                             , struct general_kmeans_context* ctx);
+
+/**
+ * @brief Compress the keys of the samples if requested with the additional
+ *        parameter compressed_keys (0 = never (default), 1 = always).
+ *
+ * The compressed keys need about one byte per non zero value instead of
+ * sizeof(KEY_TYPE). Afterwards the iterations only read the sample keys with
+ * get_sample_keys. The uncompressed keys are freed if ctx->samples is a copy
+ * owned by the context (see initialize_sample_order), the pages of a memory
+ * mapped matrix are released. Only kmeans, elkan, yinyang, hamerly and exponion
+ * support compressed keys. They need to call this after everything else which
+ * reads the sample keys was initialized.
+ *
+ * @param[in] prms are the parameters, the algorithm was started with
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ */
+void initialize_compressed_sample_keys(struct kmeans_params *prms
+                                       , struct general_kmeans_context* ctx);
+
+/**
+ * @brief Get the keys of a sample of ctx->samples.
+ *
+ * If the keys are compressed they are decoded into the buffer of the calling
+ * thread, which stays valid until the thread asks for the keys of another sample.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] sample_id Id of the sample in ctx->samples.
+ * @return The keys of the sample.
+ */
+KEY_TYPE* get_sample_keys(struct general_kmeans_context* ctx, uint64_t sample_id);
+
+/**
+ * @brief Allocate the lower bounds of a bound based algorithm with one row per
+ *        sample and no_cols columns (e.g. clusters or groups).
+ *
+ * The encoding is chosen with the additional parameter bound_encoding
+ * (0 = VALUE_TYPE, default; 1 = float; 2 = 16 bit quantized). No sample can be
+ * further away from a cluster than twice the largest sample norm, this is used
+ * as range of the quantized encoding.
+ *
+ * @param[in] prms are the parameters, the algorithm was started with
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] no_cols Number of bounds per sample.
+ * @param[out] lower_bounds The bound matrix to initialize (all bounds are 0).
+ */
+void initialize_lower_bound_matrix(struct kmeans_params *prms
+                                   , struct general_kmeans_context* ctx
+                                   , uint64_t no_cols
+                                   , struct bound_matrix* lower_bounds);
+
+/**
+ * @brief Calculate the euclidean distance between a sample and a cluster center.
+ *
+ * Uses the dense cluster centers if available, else the sparse ones. The keys
+ * of the sample are read with get_sample_keys.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] sample_id Id of the sample in ctx->samples.
+ * @param[in] cluster_id Id of the cluster in ctx->cluster_vectors.
+ * @return || s - c ||
+ */
+VALUE_TYPE euclid_sample_cluster(struct general_kmeans_context* ctx
+                                 , uint64_t sample_id
+                                 , uint64_t cluster_id);
+
+/**
+ * @brief Decide if the full assignment step should be done with the blocked
+ *        sparse x dense product (see assign_samples_blocked).
+ *
+ * Can be forced with the additional parameter blocked_assign (0 = never,
+ * 1 = always, default = if the dense transposed centers fit into memory).
+ *
+ * @param[in] prms are the parameters, the algorithm was started with
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @return 1 if assign_samples_blocked should be used else 0.
+ */
+uint32_t use_blocked_assignment(struct kmeans_params *prms
+                                , struct general_kmeans_context* ctx);
+
+/**
+ * @brief Full assignment step without any pruning: For every sample compute the
+ *        distance to every cluster and assign the sample to the closest one.
+ *
+ * The distances are computed tile-wise as product of the csr samples with the
+ * transposed dense cluster matrix (tiles over samples and clusters, parallelized
+ * over sample tiles). A sample only changes its assignment if a cluster is strictly
+ * closer than ctx->cluster_distances[sample_id]. The transposed cluster matrix is
+ * created with the first call and kept in ctx->dense_transposed_clusters.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in] skip_empty_clusters If true, clusters with cluster_counts == 0 are ignored.
+ * @param[in] cluster_to_group If not NULL the group id of every cluster (yinyang).
+ * @param[inout] group_lower_bounds If not NULL, for every sample and group the minimum
+ *                                  distance to a cluster of this group which is not the
+ *                                  closest one is written here (needs to be
+ *                                  initialized with VALUE_TYPE_MAX).
+ * @param[in] stop If the pointer behind this variable gets set, the step stops.
+ */
+void assign_samples_blocked(struct general_kmeans_context* ctx
+                            , uint32_t skip_empty_clusters
+                            , uint64_t* cluster_to_group
+                            , struct bound_matrix* group_lower_bounds
+                            , uint32_t* stop);
+
 /**
  * @brief This function initializes the kmeans context.
  *
@@ -4,12 +4,26 @@
 void create_chosen_sample_map(uint32_t** chosen_sample_map
                              , uint64_t no_samples
                              , uint64_t batch_size
-                             , unsigned int* seed) {
-    uint64_t j;
+                             , unsigned int* seed
+                             , uint64_t* sample_positions) {
+    uint64_t j, sample_id;
 
     free_null(*chosen_sample_map);
     *chosen_sample_map = (uint32_t*) calloc(no_samples, sizeof(uint32_t));
     for (j = 0; j < batch_size; j++) {
-        (*chosen_sample_map)[rand_r(seed) % no_samples] = 1;
+        sample_id = rand_r(seed) % no_samples;
+        if (sample_positions != NULL) sample_id = sample_positions[sample_id];
+        (*chosen_sample_map)[sample_id] = 1;
     }
 }
+
+void load_next_minibatch(struct general_kmeans_context* ctx
+                         , uint32_t** chosen_sample_map
+                         , uint64_t batch_size
+                         , unsigned int* seed) {
+
+    advise_csr_matrix_rows(ctx->samples, *chosen_sample_map, 0);
+    create_chosen_sample_map(chosen_sample_map, ctx->samples->sample_count, batch_size, seed
+                             , ctx->sample_positions);
+    advise_csr_matrix_rows(ctx->samples, *chosen_sample_map, 1);
+}
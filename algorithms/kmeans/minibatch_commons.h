@@ -4,9 +4,39 @@
 #ifndef MINIBATCH_COMMONS_H
 #define MINIBATCH_COMMONS_H
 
+/**
+ * @brief Draw batch_size random samples (with replacement).
+ *
+ * @param[out] chosen_sample_map Replaced by an array with 1 for every chosen sample.
+ * @param[in] no_samples Number of samples to choose from.
+ * @param[in] batch_size Number of samples to draw.
+ * @param[in,out] seed Seed for the random number generator.
+ * @param[in] sample_positions If not NULL the samples are drawn as ids of the
+ *                             input matrix and mapped to their position in the
+ *                             reordered matrix (see initialize_sample_order).
+ */
 void create_chosen_sample_map(uint32_t** chosen_sample_map
                              , uint64_t no_samples
                              , uint64_t batch_size
-                             , unsigned int* seed);
+                             , unsigned int* seed
+                             , uint64_t* sample_positions);
+
+/**
+ * @brief Replace the current minibatch with a new one (see create_chosen_sample_map).
+ *
+ * If the samples are memory mapped, the rows of the previous batch are released
+ * and the rows of the new batch are read ahead. Before the first batch (*chosen_sample_map
+ * is NULL) all rows are released, since the initialization touched every sample.
+ * This keeps the resident memory bounded by the batch size.
+ *
+ * @param[in] ctx is the context of a currently running kmeans algorithm.
+ * @param[in,out] chosen_sample_map Previous batch, is replaced by the new batch.
+ * @param[in] batch_size Number of samples to draw.
+ * @param[in,out] seed Seed for the random number generator.
+ */
+void load_next_minibatch(struct general_kmeans_context* ctx
+                         , uint32_t** chosen_sample_map
+                         , uint64_t batch_size
+                         , unsigned int* seed);
                                        
 #endif
\ No newline at end of file
@@ -43,7 +43,10 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
     free_cluster_hashmaps(ctx.clusters_raw, ctx.no_clusters);
 
     /* reset cluster counts since minibatch kmeans handels them differently */
-    for (i = 0; i < ctx.no_clusters; i++) ctx.cluster_counts[i] = 0;
+    for (i = 0; i < ctx.no_clusters; i++) {
+        ctx.cluster_counts[i] = 0;
+        ctx.cluster_weights[i] = 0;
+    }
 
     desired_bv_annz = d_get_subfloat_default(&(prms->tr)
                                             , "additional_params", "bv_annz", 0.3);
@@ -63,6 +66,7 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
 
         keys_per_block = ctx.samples->dim / block_vectors_dim;
         if (ctx.samples->dim % block_vectors_dim > 0) keys_per_block++;
+        initialize_thread_block_vectors(&ctx);
 
         /* create block vectors for the clusters */
         create_block_vectors_list_from_vector_list(ctx.cluster_vectors
@@ -73,33 +77,23 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
 
     }
 
-    create_chosen_sample_map(&chosen_sample_map, ctx.samples->sample_count, samples_per_batch, &(prms->seed));
+    load_next_minibatch(&ctx, &chosen_sample_map, samples_per_batch, &(prms->seed));
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many blockvector calculations were made / saved */
-        uint64_t saved_calculations_bv, saved_calculations_prev_cluster;
-        uint64_t done_blockvector_calcs, saved_calculations_cauchy;
-		
-
-        /* reset all calculation counters */
-        done_blockvector_calcs = 0;
-        saved_calculations_cauchy = 0;
-        saved_calculations_prev_cluster = 0;
-        saved_calculations_bv = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        partition_sample_worklist(&ctx, NULL, ctx.samples->sample_count);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
 
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
-            struct sparse_vector bv;
-            bv.nnz = 0;
-            bv.keys = NULL;
-            bv.values = NULL;
+            struct sparse_vector *bv;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
+            bv = NULL;
 
             if (!prms->stop && chosen_sample_map[j]) {
                 sample_id = j;
@@ -121,30 +115,31 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
 
                         if (dist >= ctx.cluster_distances[sample_id]) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_cauchy += 1;
+                            stats->saved_calculations_cauchy += 1;
                             goto end;
                          }
 
-                        if (bv.keys == NULL) {
-                            create_block_vector_from_csr_matrix_vector(ctx.samples
-                                                                       , sample_id
-                                                                       , keys_per_block
-                                                                       , &bv);
+                        if (bv == NULL) {
+                            bv = get_thread_block_vector(&ctx);
+                            fill_block_vector_from_csr_matrix_vector(ctx.samples
+                                                                      , sample_id
+                                                                      , keys_per_block
+                                                                      , bv);
                         }
 
                         /* evaluate block vector approximation. */
-                        dist = euclid_vector(bv.keys, bv.values, bv.nnz
+                        dist = euclid_vector(bv->keys, bv->values, bv->nnz
                                              , block_vectors_clusters[cluster_id].keys
                                              , block_vectors_clusters[cluster_id].values
                                              , block_vectors_clusters[cluster_id].nnz
                                              , ctx.vector_lengths_samples[sample_id]
                                              , ctx.vector_lengths_clusters[cluster_id]);
 
-                        done_blockvector_calcs += 1;
+                        stats->done_blockvector_calcs += 1;
 
                         if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_bv += 1;
+                            stats->saved_calculations_bv += 1;
                             goto end;
                         }
                     }
@@ -153,7 +148,7 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
                     dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                             , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     if (dist < ctx.cluster_distances[sample_id]) {
                         /* replace current best distance with new distance */
@@ -163,13 +158,10 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
                     end:;
                 }
             }
-
-            if (!disable_optimizations) {
-                free_null(bv.keys);
-                free_null(bv.values);
-            }
         }
 
+        merge_thread_stats(&ctx);
+
         check_signals(&(prms->stop));
         post_process_iteration_minibatch(&ctx
                                         , chosen_sample_map
@@ -181,7 +173,7 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
         /* calculate_shifted_clusters(&ctx); */
         switch_to_shifted_clusters(&ctx);
 
-        create_chosen_sample_map(&chosen_sample_map, ctx.samples->sample_count, samples_per_batch, &(prms->seed));
+        load_next_minibatch(&ctx, &chosen_sample_map, samples_per_batch, &(prms->seed));
 
         if (!disable_optimizations) {
             /* update only block vectors for cluster that shifted */
@@ -192,8 +184,8 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
                                         , ctx.clusters_not_changed
                                         , block_vectors_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs", done_blockvector_calcs);
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", saved_calculations_bv + saved_calculations_cauchy);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs", ctx.iteration_stats.done_blockvector_calcs);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", ctx.iteration_stats.saved_calculations_bv + ctx.iteration_stats.saved_calculations_cauchy);
         }
 
         #pragma omp parallel for
@@ -203,6 +195,8 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
              */
 
             if (chosen_sample_map[j]) {
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
 
                 ctx.cluster_distances[j]
                   = euclid_vector_list(ctx.samples, j
@@ -210,20 +204,19 @@ struct kmeans_result* bv_minibatch_kmeans(struct csr_matrix* samples
                           , ctx.vector_lengths_samples
                           , ctx.vector_lengths_clusters);
 
-                /*#pragma omp critical*/
-                ctx.done_calculations += 1;
-                ctx.total_no_calcs += 1;
+                stats->done_calculations += 1;
             }
         }
+        ctx.total_no_calcs += merge_thread_stats(&ctx);
 
         print_iteration_summary(&ctx, prms, i);
 
         /* print block vector statistics */
         if (prms->verbose) LOG_INFO("BV statistics c:%" PRINTF_INT64_MODIFIER "u/b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u/pc:%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_cauchy
-                , saved_calculations_bv
-                , done_blockvector_calcs
-                , saved_calculations_prev_cluster);
+                , ctx.iteration_stats.saved_calculations_cauchy
+                , ctx.iteration_stats.saved_calculations_bv
+                , ctx.iteration_stats.done_blockvector_calcs
+                , ctx.iteration_stats.saved_calculations_prev_cluster);
     }
 
     if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
@@ -6,6 +6,7 @@
 #include "../../utils/vector/common/common_vector_math.h"
 #include "../../utils/vector/sparse/sparse_vector_math.h"
 #include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -20,33 +21,40 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
      * no change optimization.
      */
     uint32_t *eligible_for_cluster_no_change_optimization;
+
+    /* samples which need to be examined in this iteration */
+    uint64_t *recheck_samples;
+    uint64_t no_recheck_samples;
     struct general_kmeans_context ctx;
 
     initialize_general_context(prms, &ctx, samples);
 
-    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc(ctx.samples->sample_count, sizeof(uint32_t));
+    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc_sample_array(&ctx, sizeof(uint32_t));
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many blockvector calculations were made / saved */
-        uint64_t saved_calculations_prev_cluster;
-
-        /* reset all calculation counters */
-        saved_calculations_prev_cluster = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        /* samples which are not in the worklist skip every non empty cluster except their own */
+        ctx.iteration_stats.saved_calculations_prev_cluster += (ctx.samples->sample_count - no_recheck_samples)
+                                                               * (get_nnz_uint64_array(ctx.cluster_counts, ctx.no_clusters) - 1);
+
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
 
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
 
             if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
             if (!prms->stop) {
-                sample_id = j;
+                sample_id = recheck_samples[j];
 
                 for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
                     /* iterate over all cluster centers */
@@ -60,7 +68,7 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
                     /* clusters which did not move in the last iteration can be skipped if the sample is eligible */
                     if (eligible_for_cluster_no_change_optimization[sample_id] && ctx.clusters_not_changed[cluster_id]) {
                         /* cluster did not move and sample was eligible for this check. distance to this cluster can not be less than to our best from last iteration */
-                        saved_calculations_prev_cluster += 1;
+                        stats->saved_calculations_prev_cluster += 1;
                         goto end;
                     }
 
@@ -68,7 +76,7 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
                     dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                             , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     if (dist < ctx.cluster_distances[sample_id]) {
                         /* replace current best distance with new distance */
@@ -79,6 +87,7 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
                 }
             }
         }
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -86,13 +95,15 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
         calculate_shifted_clusters(&ctx);
         switch_to_shifted_clusters(&ctx);
 
-        d_add_ilist(&(prms->tr), "iteration_nc_calcs_saved", saved_calculations_prev_cluster);
+        d_add_ilist(&(prms->tr), "iteration_nc_calcs_saved", ctx.iteration_stats.saved_calculations_prev_cluster);
 
         #pragma omp parallel for
         for (j = 0; j < ctx.samples->sample_count; j++) {
             /* iterate over all samples */
 
             VALUE_TYPE previous_distance;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
             previous_distance = ctx.cluster_distances[j];
 
             /* if the cluster did move. calculate the new distance to this sample */
@@ -102,10 +113,7 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
                             , ctx.cluster_vectors, ctx.cluster_assignments[j]
                             , ctx.vector_lengths_samples
                             , ctx.vector_lengths_clusters);
-
-                /*#pragma omp critical*/
-                ctx.done_calculations += 1;
-                ctx.total_no_calcs += 1;
+                stats->done_calculations += 1;
             }
 
             /* if the cluster moved towards this sample,
@@ -118,11 +126,17 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
                 eligible_for_cluster_no_change_optimization[j] = 0;
             }
         }
+        ctx.total_no_calcs += merge_thread_stats(&ctx);
+
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+        no_recheck_samples = collect_no_change_worklist(&ctx
+                                                        , eligible_for_cluster_no_change_optimization
+                                                        , recheck_samples);
 
         print_iteration_summary(&ctx, prms, i);
 
         /* print block vector statistics */
-        if (prms->verbose) LOG_INFO("Saved calculations previous cluster pc:%" PRINTF_INT64_MODIFIER "u", saved_calculations_prev_cluster);
+        if (prms->verbose) LOG_INFO("Saved calculations previous cluster pc:%" PRINTF_INT64_MODIFIER "u", ctx.iteration_stats.saved_calculations_prev_cluster);
     }
 
     if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
@@ -131,6 +145,7 @@ struct kmeans_result* nc_kmeans(struct csr_matrix* samples, struct kmeans_params
 
     free_general_context(&ctx, prms);
     free_null(eligible_for_cluster_no_change_optimization);
+    free_null(recheck_samples);
 
 
     return res;
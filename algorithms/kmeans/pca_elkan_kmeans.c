@@ -7,6 +7,7 @@
 #include "../../utils/vector/common/common_vector_math.h"
 #include "../../utils/vector/sparse/sparse_vector_math.h"
 #include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -18,7 +19,7 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
 
     uint64_t i;
     uint64_t j;
-    uint64_t k;
+    uint64_t no_recheck_samples;
     struct sparse_vector* pca_projection_samples;  /* projection matrix of samples */
     struct sparse_vector* pca_projection_clusters; /* projection matrix of clusters */
     struct kmeans_result* res;
@@ -29,7 +30,8 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
     VALUE_TYPE* vector_lengths_pca_clusters;
 
     char* bound_needs_update;                           /* bool per sample, 1 if a bound needs updating (rx)*/
-    VALUE_TYPE** lb_samples_clusters;                   /* lower bounds for every sample to every cluster (lxc) */
+    uint64_t* recheck_samples;                          /* samples which need to be examined in this iteration */
+    struct bound_matrix lb_samples_clusters;            /* lower bounds for every sample to every cluster (lxc) */
     VALUE_TYPE** dist_clusters_clusters;                /* distance from, to every cluster (dcc) */
     VALUE_TYPE*  min_dist_cluster_clusters;             /* minimum distance between a cluster and all other clusters (sc) */
     VALUE_TYPE*  distance_clustersold_to_clustersnew;   /* distance between clusters before/after a shift */
@@ -48,7 +50,7 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
 	
 	if (!disable_optimizations) {
         /* create pca projections for the samples */
-        pca_projection_samples = matrix_dot(samples, prms->ext_vects);
+        pca_projection_samples = matrix_dot(ctx.samples, prms->ext_vects);
         calculate_vector_list_lengths(pca_projection_samples, samples->sample_count, &vector_lengths_pca_samples);
 
         /* create pca projections for the clusters */
@@ -60,17 +62,18 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
     }
 
     /* initialization of the triangle inequality boundaries */
-    bound_needs_update = (char*) calloc(ctx.samples->sample_count, sizeof(char));
+    bound_needs_update = (char*) calloc_sample_array(&ctx, sizeof(char));
+    recheck_samples = create_sample_worklist(&ctx);
 
-    lb_samples_clusters = (VALUE_TYPE**) calloc(ctx.samples->sample_count, sizeof(VALUE_TYPE*));
+    initialize_lower_bound_matrix(prms, &ctx, ctx.no_clusters, &lb_samples_clusters);
     for (i = 0; i < ctx.samples->sample_count; i++) {
-        lb_samples_clusters[i] = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
         /* initialize the lower bounds to the distance of sample i to the
          * initial chosen cluster ctx.cluster_assignments[i]
          */
-        lb_samples_clusters[i][ctx.cluster_assignments[i]] = ctx.cluster_distances[i];
+        bound_matrix_set(&lb_samples_clusters, i, ctx.cluster_assignments[i], ctx.cluster_distances[i]);
         bound_needs_update[i] = 0;
     }
+    no_recheck_samples = ctx.samples->sample_count;
 
     dist_clusters_clusters = (VALUE_TYPE**) calloc(ctx.no_clusters, sizeof(VALUE_TYPE*));
     for (i = 0; i < ctx.no_clusters; i++) {
@@ -81,31 +84,26 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
     distance_clustersold_to_clustersnew = (VALUE_TYPE*) calloc(ctx.no_clusters, sizeof(VALUE_TYPE));
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many projection calculations were made / saved */
-        uint64_t saved_calculations_pca;
-        uint64_t done_pca_calcs;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
 	    if (!disable_optimizations) {
-            /* reset all calculation counters */
-            done_pca_calcs = 0;
-            saved_calculations_pca = 0;
-
             free(vector_lengths_pca_clusters);
             calculate_vector_list_lengths(pca_projection_clusters, ctx.no_clusters, &vector_lengths_pca_clusters);
 		}
 		
         calculate_cluster_distance_matrix(&ctx, dist_clusters_clusters, min_dist_cluster_clusters, &(prms->stop));
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
 
-            sample_id = j;
+            sample_id = recheck_samples[j];
 
             if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
@@ -123,17 +121,17 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
                     /* if we are not in the first iteration and this cluster is empty, continue to next cluster */
                     if (i != 0 && ctx.cluster_counts[cluster_id] == 0) continue;
                     if (cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
-                    if (ctx.cluster_distances[sample_id] <= lb_samples_clusters[sample_id][cluster_id]) continue;
+                    if (ctx.cluster_distances[sample_id] <= bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)) continue;
                     if (ctx.cluster_distances[sample_id] <= 0.5 * dist_clusters_clusters[ctx.cluster_assignments[sample_id]][cluster_id]) continue;
 
                     if (bound_needs_update[sample_id]) {
                         /* if we reached this point we need to calculate a full euclidean distance */
                         dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, ctx.cluster_assignments[sample_id]
                                 , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         /* update lower bound */
-                        lb_samples_clusters[sample_id][ctx.cluster_assignments[sample_id]] = dist;
+                        bound_matrix_set(&lb_samples_clusters, sample_id, ctx.cluster_assignments[sample_id], dist);
 
                         /* tighten upper bound */
                         ctx.cluster_distances[sample_id] = dist;
@@ -142,7 +140,7 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
                         bound_needs_update[sample_id] = 0;
                     }
 
-                    if (ctx.cluster_distances[sample_id] > lb_samples_clusters[sample_id][cluster_id]
+                    if (ctx.cluster_distances[sample_id] > bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)
                         || ctx.cluster_distances[sample_id] > 0.5 * dist_clusters_clusters[ctx.cluster_assignments[sample_id]][cluster_id]) {
 
 						if (!disable_optimizations) {
@@ -154,23 +152,23 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
                                                  , pca_projection_clusters[cluster_id].nnz
                                                  , vector_lengths_pca_samples[sample_id]
                                                  , vector_lengths_pca_clusters[cluster_id]);
-                            done_pca_calcs += 1;
+                            stats->done_pca_calcs += 1;
 
                             if (dist >= ctx.cluster_distances[sample_id]) {
                                 /* tighten lower bound (if possible) */
-                                if (dist > lb_samples_clusters[sample_id][cluster_id]) {
-                                    lb_samples_clusters[sample_id][cluster_id] = dist;
+                                if (dist > bound_matrix_get(&lb_samples_clusters, sample_id, cluster_id)) {
+                                    bound_matrix_set(&lb_samples_clusters, sample_id, cluster_id, dist);
                                 }
-                                saved_calculations_pca += 1;
+                                stats->saved_calculations_pca += 1;
                                 continue;
                             }
 						}
                         dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                                                     , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         /* tighten lower bound */
-                        lb_samples_clusters[sample_id][cluster_id] = dist;
+                        bound_matrix_set(&lb_samples_clusters, sample_id, cluster_id, dist);
 
                         if (dist < ctx.cluster_distances[sample_id]) {
                             /* replace current best distance with new distance */
@@ -181,6 +179,7 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
                 }
             }
         }
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -206,33 +205,28 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
                                 ctx.clusters_not_changed,
                                 pca_projection_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs", done_pca_calcs);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs", ctx.iteration_stats.done_pca_calcs);
             d_add_ilist(&(prms->tr), "iteration_pca_calcs_success",
-                        saved_calculations_pca);
+                        ctx.iteration_stats.saved_calculations_pca);
 		}
-        #pragma omp parallel for private(j)
-        for(k = 0; k < ctx.samples->sample_count; k++) {
-            for(j = 0; j < ctx.no_clusters; j++) {
-                if (!ctx.clusters_not_changed[j]) {
-                    lb_samples_clusters[k][j] = ((lb_samples_clusters[k][j] - distance_clustersold_to_clustersnew[j] > 0) ?
-                                                (lb_samples_clusters[k][j] - distance_clustersold_to_clustersnew[j]) :
-                                                0);
-                }
-            }
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
 
-            if (!ctx.clusters_not_changed[ctx.cluster_assignments[k]]) {
-                ctx.cluster_distances[k] = ctx.cluster_distances[k] + distance_clustersold_to_clustersnew[ctx.cluster_assignments[k]];
-                bound_needs_update[k] = 1;
-            }
-        }
+        /* move all bounds and find the samples which need to be examined in the next iteration */
+        no_recheck_samples = update_bounds_collect_rechecks(&ctx
+                                                            , distance_clustersold_to_clustersnew
+                                                            , &lb_samples_clusters
+                                                            , distance_clustersold_to_clustersnew
+                                                            , 1
+                                                            , bound_needs_update
+                                                            , recheck_samples);
 
         print_iteration_summary(&ctx, prms, i);
 
         if (!disable_optimizations) {
             /* print projection statistics */
             if (prms->verbose) LOG_INFO("PCA statistics b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u"
-                    , saved_calculations_pca
-                    , done_pca_calcs);
+                    , ctx.iteration_stats.saved_calculations_pca
+                    , ctx.iteration_stats.done_pca_calcs);
         }
     }
 
@@ -252,11 +246,9 @@ struct kmeans_result* pca_elkan_kmeans(struct csr_matrix* samples, struct kmeans
         free(vector_lengths_pca_clusters);
 	}
     free_null(bound_needs_update);
+    free_null(recheck_samples);
 
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        free_null(lb_samples_clusters[i]);
-    }
-    free_null(lb_samples_clusters);
+    free_bound_matrix(&lb_samples_clusters);
 
     for (i = 0; i < ctx.no_clusters; i++) {
         free_null(dist_clusters_clusters[i]);
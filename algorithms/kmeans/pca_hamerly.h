@@ -0,0 +1,15 @@
+#ifndef PCA_HAMERLY_H
+#define PCA_HAMERLY_H
+
+#include "kmeans_control.h"
+
+/**
+ * @brief The pca hamerly version of k-means.
+ *
+ * @param samples which shall be clustered
+ * @param prms are the parameters to control the clustering
+ * @return
+ */
+struct kmeans_result* pca_hamerly_kmeans(struct csr_matrix* samples, struct kmeans_params *prms);
+
+#endif
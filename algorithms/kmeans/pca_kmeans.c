@@ -6,6 +6,7 @@
 #include "../../utils/vector/common/common_vector_math.h"
 #include "../../utils/vector/sparse/sparse_vector_math.h"
 #include "../../utils/fcl_logging.h"
+#include "../../utils/fcl_numa.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -27,6 +28,10 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
      * no change optimization.
      */
     uint32_t *eligible_for_cluster_no_change_optimization;
+
+    /* samples which need to be examined in this iteration */
+    uint64_t *recheck_samples;
+    uint64_t no_recheck_samples;
     struct general_kmeans_context ctx;
 
     pca_projection_clusters = NULL;
@@ -39,7 +44,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
     if (!disable_optimizations) {
         if (prms->kmeans_algorithm_id == ALGORITHM_PCA_KMEANS) {
             /* create pca projections for the samples */
-            pca_projection_samples = matrix_dot(samples, prms->ext_vects);
+            pca_projection_samples = matrix_dot(ctx.samples, prms->ext_vects);
             calculate_vector_list_lengths(pca_projection_samples, samples->sample_count, &vector_lengths_pca_samples);
         }
 
@@ -51,32 +56,33 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
         vector_lengths_pca_clusters = NULL;
     }
 
-    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc(ctx.samples->sample_count, sizeof(uint32_t));
+    eligible_for_cluster_no_change_optimization = (uint32_t*) calloc_sample_array(&ctx, sizeof(uint32_t));
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many projection calculations were made / saved */
-        uint64_t saved_calculations_pca, saved_calculations_prev_cluster;
-        uint64_t done_pca_calcs, saved_calculations_cauchy;
-
-        /* reset all calculation counters */
-        done_pca_calcs = 0;
-        saved_calculations_cauchy = 0;
-        saved_calculations_prev_cluster = 0;
-        saved_calculations_pca = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
-        free(vector_lengths_pca_clusters);
-        calculate_vector_list_lengths(pca_projection_clusters, ctx.no_clusters, &vector_lengths_pca_clusters);
+        if (!disable_optimizations) {
+            free(vector_lengths_pca_clusters);
+            calculate_vector_list_lengths(pca_projection_clusters, ctx.no_clusters, &vector_lengths_pca_clusters);
+        }
+
+        /* samples which are not in the worklist skip every non empty cluster except their own */
+        ctx.iteration_stats.saved_calculations_prev_cluster += (ctx.samples->sample_count - no_recheck_samples)
+                                                               * (get_nnz_uint64_array(ctx.cluster_counts, ctx.no_clusters) - 1);
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
 
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
             struct sparse_vector pca_projection;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
             pca_projection.nnz = 0;
             pca_projection.keys = NULL;
             pca_projection.values = NULL;
@@ -84,7 +90,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
             if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
             if (!prms->stop) {
-                sample_id = j;
+                sample_id = recheck_samples[j];
 
                 for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
                     /* iterate over all cluster centers */
@@ -101,7 +107,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                         /* clusters which did not move in the last iteration can be skipped if the sample is eligible */
                         if (eligible_for_cluster_no_change_optimization[sample_id] && ctx.clusters_not_changed[cluster_id]) {
                             /* cluster did not move and sample was eligible for this check. distance to this cluster can not be less than to our best from last iteration */
-                            saved_calculations_prev_cluster += 1;
+                            stats->saved_calculations_prev_cluster += 1;
                             goto end;
                         }
 
@@ -112,7 +118,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
 
                         if (dist >= ctx.cluster_distances[sample_id]) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_cauchy += 1;
+                            stats->saved_calculations_cauchy += 1;
                             goto end;
                         }
                         if (prms->kmeans_algorithm_id == ALGORITHM_PCA_KMEANS) {
@@ -145,11 +151,11 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                                                  , ctx.vector_lengths_clusters[cluster_id]);
                         }
 
-                        done_pca_calcs += 1;
+                        stats->done_pca_calcs += 1;
 
                         if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_pca += 1;
+                            stats->saved_calculations_pca += 1;
                             goto end;
                         }
                     }
@@ -158,7 +164,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                     dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                             , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
                     /* printf("actual dist = %.4f\n", dist); */
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     if (dist < ctx.cluster_distances[sample_id]) {
                         /* replace current best distance with new distance */
@@ -174,6 +180,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                 free_null(pca_projection.values);
             }
         }
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -189,14 +196,16 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                                 ctx.clusters_not_changed,
                                 pca_projection_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs", done_pca_calcs);
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs_success", saved_calculations_pca + saved_calculations_cauchy);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs", ctx.iteration_stats.done_pca_calcs);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs_success", ctx.iteration_stats.saved_calculations_pca + ctx.iteration_stats.saved_calculations_cauchy);
 
             #pragma omp parallel for
             for (j = 0; j < ctx.samples->sample_count; j++) {
                 /* iterate over all samples */
 
                 VALUE_TYPE previous_distance;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
                 previous_distance = ctx.cluster_distances[j];
 
                 /* if the cluster did move. calculate the new distance to this sample */
@@ -206,10 +215,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                               , ctx.cluster_vectors, ctx.cluster_assignments[j]
                               , ctx.vector_lengths_samples
                               , ctx.vector_lengths_clusters);
-
-                    /*#pragma omp critical*/
-                    ctx.done_calculations += 1;
-                    ctx.total_no_calcs += 1;
+                    stats->done_calculations += 1;
                 }
 
                 /* if the cluster moved towards this sample,
@@ -222,12 +228,18 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
                     eligible_for_cluster_no_change_optimization[j] = 0;
                 }
             }
+            ctx.total_no_calcs += merge_thread_stats(&ctx);
+
+            d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+            no_recheck_samples = collect_no_change_worklist(&ctx
+                                                            , eligible_for_cluster_no_change_optimization
+                                                            , recheck_samples);
         } else {
             /* naive k-means without any optimization remembers nothing from
              * the previous iteration.
              */
             for (j = 0; j < ctx.samples->sample_count; j++) {
-                ctx.cluster_distances[j] = DBL_MAX;
+                ctx.cluster_distances[j] = VALUE_TYPE_MAX;
             }
         }
 
@@ -235,10 +247,10 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
 
         /* print projection statistics */
         if (prms->verbose) LOG_INFO("PCA statistics c:%" PRINTF_INT64_MODIFIER "u/b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u/pc:%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_cauchy
-                , saved_calculations_pca
-                , done_pca_calcs
-                , saved_calculations_prev_cluster);
+                , ctx.iteration_stats.saved_calculations_cauchy
+                , ctx.iteration_stats.saved_calculations_pca
+                , ctx.iteration_stats.done_pca_calcs
+                , ctx.iteration_stats.saved_calculations_prev_cluster);
     }
 
     if (prms->verbose) LOG_INFO("total total_no_calcs = %" PRINTF_INT64_MODIFIER "u", ctx.total_no_calcs);
@@ -259,6 +271,7 @@ struct kmeans_result* pca_kmeans(struct csr_matrix* samples, struct kmeans_param
 
     free_general_context(&ctx, prms);
     free_null(eligible_for_cluster_no_change_optimization);
+    free_null(recheck_samples);
 
 
     return res;
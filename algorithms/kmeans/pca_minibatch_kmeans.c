@@ -46,7 +46,10 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
     free_cluster_hashmaps(ctx.clusters_raw, ctx.no_clusters);
 
     /* reset cluster counts since minibatch kmeans handels them differently */
-    for (i = 0; i < ctx.no_clusters; i++) ctx.cluster_counts[i] = 0;
+    for (i = 0; i < ctx.no_clusters; i++) {
+        ctx.cluster_counts[i] = 0;
+        ctx.cluster_weights[i] = 0;
+    }
 
     chosen_sample_map = NULL;
 	/* samples_per_batch = ctx.samples->sample_count; */
@@ -58,7 +61,7 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
 	
     if (!disable_optimizations) {
         /* create pca projections for the samples */
-        pca_projection_samples = matrix_dot(samples, prms->ext_vects);
+        pca_projection_samples = matrix_dot(ctx.samples, prms->ext_vects);
         calculate_vector_list_lengths(pca_projection_samples, samples->sample_count, &vector_lengths_pca_samples);
 
         /* create pca projections for the clusters */
@@ -69,18 +72,9 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
         vector_lengths_pca_clusters = NULL;
     }
 
-    create_chosen_sample_map(&chosen_sample_map, ctx.samples->sample_count, samples_per_batch, &(prms->seed));
+    load_next_minibatch(&ctx, &chosen_sample_map, samples_per_batch, &(prms->seed));
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        /* track how many blockvector calculations were made / saved */
-        uint64_t saved_calculations_pca;
-        uint64_t done_pca_calcs, saved_calculations_cauchy;
-		
-        /* reset all calculation counters */
-        done_pca_calcs = 0;
-        saved_calculations_cauchy = 0;
-        saved_calculations_pca = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
@@ -89,12 +83,15 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
             calculate_vector_list_lengths(pca_projection_clusters, ctx.no_clusters, &vector_lengths_pca_clusters);
         }
 
-        #pragma omp parallel for schedule(dynamic, 1000)
-        for (j = 0; j < ctx.samples->sample_count; j++) {
+        partition_sample_worklist(&ctx, NULL, ctx.samples->sample_count);
+        #pragma omp parallel private(j)
+        for (j = 0; next_sample_position(&ctx, &j); j++) {
             /* iterate over all samples */
 
             VALUE_TYPE dist;
             uint64_t cluster_id, sample_id;
+            struct kmeans_thread_stats* stats;
+            stats = get_thread_stats(&ctx);
 
             if (!prms->stop && chosen_sample_map[j]) {
                 sample_id = j;
@@ -116,7 +113,7 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
 
                         if (dist >= ctx.cluster_distances[sample_id]) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_cauchy += 1;
+                            stats->saved_calculations_cauchy += 1;
                             goto end;
                         }
 
@@ -129,11 +126,11 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
                                              , vector_lengths_pca_samples[sample_id]
                                              , vector_lengths_pca_clusters[cluster_id]);
 
-                        done_pca_calcs += 1;
+                        stats->done_pca_calcs += 1;
 
                         if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
                             /* approximated distance is larger than current best distance. skip full distance calculation */
-                            saved_calculations_pca += 1;
+                            stats->saved_calculations_pca += 1;
                             goto end;
                         }
                     }
@@ -142,7 +139,7 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
                     dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                             , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     if (dist < ctx.cluster_distances[sample_id]) {
                         /* replace current best distance with new distance */
@@ -154,6 +151,8 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
             }
         }
 
+        merge_thread_stats(&ctx);
+
         check_signals(&(prms->stop));
         post_process_iteration_minibatch(&ctx
                                         , chosen_sample_map
@@ -165,7 +164,7 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
         /* calculate_shifted_clusters(&ctx); */
         switch_to_shifted_clusters(&ctx);
 
-        create_chosen_sample_map(&chosen_sample_map, ctx.samples->sample_count, samples_per_batch, &(prms->seed));
+        load_next_minibatch(&ctx, &chosen_sample_map, samples_per_batch, &(prms->seed));
 
         if (!disable_optimizations) {
             /* update only projections for cluster that shifted */
@@ -175,8 +174,8 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
                                 ctx.clusters_not_changed,
                                 pca_projection_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs", done_pca_calcs);
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs_success", saved_calculations_pca + saved_calculations_cauchy);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs", ctx.iteration_stats.done_pca_calcs);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs_success", ctx.iteration_stats.saved_calculations_pca + ctx.iteration_stats.saved_calculations_cauchy);
         }
 
         #pragma omp parallel for
@@ -186,6 +185,8 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
              */
 
             if (chosen_sample_map[j]) {
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
 
                 ctx.cluster_distances[j]
                   = euclid_vector_list(ctx.samples, j
@@ -193,19 +194,18 @@ struct kmeans_result* pca_minibatch_kmeans(struct csr_matrix* samples
                           , ctx.vector_lengths_samples
                           , ctx.vector_lengths_clusters);
 
-                /*#pragma omp critical*/
-                ctx.done_calculations += 1;
-                ctx.total_no_calcs += 1;
+                stats->done_calculations += 1;
             }
         }
+        ctx.total_no_calcs += merge_thread_stats(&ctx);
 
         print_iteration_summary(&ctx, prms, i);
 
         if (!disable_optimizations) {
             /* print projection statistics */
             if (prms->verbose) LOG_INFO("PCA statistics b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u"
-                    , saved_calculations_pca
-                    , done_pca_calcs);
+                    , ctx.iteration_stats.saved_calculations_pca
+                    , ctx.iteration_stats.done_pca_calcs);
         }
     }
 
@@ -12,6 +12,8 @@
 #include <unistd.h>
 #include <float.h>
 
+#include "elkan_commons.h"
+
 struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmeans_params *prms) {
 
     uint32_t i;
@@ -34,7 +36,11 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
     struct group* groups;
 
     VALUE_TYPE *group_max_drift;
-    VALUE_TYPE **lower_bounds;
+    VALUE_TYPE *thread_group_bounds;    /* per thread: three arrays with one value per group */
+    uint64_t thread_group_bounds_size;
+    struct bound_matrix lower_bounds;
+    uint64_t *recheck_samples;          /* samples which need to be examined in this iteration */
+    uint64_t no_recheck_samples;
 
     pca_projection_clusters = NULL;
     pca_projection_samples = NULL;
@@ -49,7 +55,7 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
 
     if (!disable_optimizations) {
         /* create pca projections for the samples */
-        pca_projection_samples = matrix_dot(samples, prms->ext_vects);
+        pca_projection_samples = matrix_dot(ctx.samples, prms->ext_vects);
         calculate_vector_list_lengths(pca_projection_samples, samples->sample_count, &vector_lengths_pca_samples);
 
         /* create pca projections for the clusters */
@@ -69,16 +75,18 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
     /* create yinyang cluster groups by doing 5 k-means iterations on the clusters */
     create_kmeans_cluster_groups(ctx.cluster_vectors
                                 , ctx.no_clusters
-                                , ctx.samples->sample_count
+                                , ctx.samples->dim
                                 , &groups, &no_groups);
 
 
     group_max_drift = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-    lower_bounds = (VALUE_TYPE**) calloc(ctx.samples->sample_count, sizeof(VALUE_TYPE*));
 
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        lower_bounds[i] = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-    }
+    /* padded to 128 bytes so that threads do not share cache lines */
+    thread_group_bounds_size = (3 * no_groups * sizeof(VALUE_TYPE) + 127) / 128 * 128 / sizeof(VALUE_TYPE);
+    thread_group_bounds = (VALUE_TYPE*) calloc(ctx.no_threads * thread_group_bounds_size, sizeof(VALUE_TYPE));
+    initialize_lower_bound_matrix(prms, &ctx, no_groups, &lower_bounds);
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
 
     cluster_to_group = (uint64_t*) calloc(ctx.no_clusters, sizeof(uint64_t));
 
@@ -89,25 +97,10 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
     }
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        uint64_t saved_calculations_pca;
-        uint64_t done_pca_calcs;
-        uint64_t saved_calculations_prev_cluster;
-        uint64_t saved_calculations_global, saved_calculations_local;
-        uint64_t groups_not_skipped;
-
-        saved_calculations_global = 0;
-        saved_calculations_local = 0;
-        saved_calculations_prev_cluster = 0;
-        groups_not_skipped = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
 	    if (!disable_optimizations) {
-            /* reset all calculation counters */
-            done_pca_calcs = 0;
-            saved_calculations_pca = 0;
-
             free(vector_lengths_pca_clusters);
             calculate_vector_list_lengths(pca_projection_clusters, ctx.no_clusters, &vector_lengths_pca_clusters);
 		}
@@ -117,18 +110,21 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
             uint64_t sample_id, l;
 
             /* do one regular kmeans step to initialize bounds */
-            #pragma omp parallel for schedule(dynamic, 1000) private(l)
-            for (sample_id = 0; sample_id < ctx.samples->sample_count; sample_id++) {
+            partition_sample_worklist(&ctx, NULL, ctx.samples->sample_count);
+            #pragma omp parallel private(sample_id, l)
+            for (sample_id = 0; next_sample_position(&ctx, &sample_id); sample_id++) {
                 uint64_t cluster_id;
                 VALUE_TYPE dist;
                 uint32_t is_first_assignment;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
                 is_first_assignment = 0;
 
                 if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
                 if (!prms->stop) {
                     for (l = 0; l < no_groups; l++) {
-                        lower_bounds[sample_id][l] = DBL_MAX;
+                        bound_matrix_set(&lower_bounds, sample_id, l, VALUE_TYPE_MAX);
                     }
 
                     for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
@@ -141,105 +137,106 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
                                                   , pca_projection_clusters[cluster_id].nnz
                                                   , vector_lengths_pca_samples[sample_id]
                                                   , vector_lengths_pca_clusters[cluster_id]);
-                             done_pca_calcs += 1;
+                             stats->done_pca_calcs += 1;
 
                              /* we do this fabs to not run into numeric errors */
                              if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
-                                 saved_calculations_pca += 1;
+                                 stats->saved_calculations_pca += 1;
                                  goto end_cluster_init;
                              }
                         }
 
-                        dist = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, cluster_id
+                        dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                                 , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                        /*#pragma omp critical*/
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         if (dist < ctx.cluster_distances[sample_id]) {
                             if (is_first_assignment) {
                                 is_first_assignment = 0;
                             } else {
-                                lower_bounds[sample_id][cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
+                                bound_matrix_set(&lower_bounds, sample_id, cluster_to_group[ctx.cluster_assignments[sample_id]], ctx.cluster_distances[sample_id]);
                             }
 
                             ctx.cluster_distances[sample_id] = dist;
                             ctx.cluster_assignments[sample_id] = cluster_id;
                         } else {
                             end_cluster_init:;
-                            if (dist < lower_bounds[sample_id][cluster_to_group[cluster_id]]) {
-                                lower_bounds[sample_id][cluster_to_group[cluster_id]] = dist;
+                            if (dist < bound_matrix_get(&lower_bounds, sample_id, cluster_to_group[cluster_id])) {
+                                bound_matrix_set(&lower_bounds, sample_id, cluster_to_group[cluster_id], dist);
                             }
                         }
                     }
                 }
             }
         } else {
-
-            #pragma omp parallel for schedule(dynamic, 1000)
-            for (j = 0; j < ctx.samples->sample_count; j++) {
+            /* samples which were not selected by update_bounds_collect_rechecks
+             * passed the global test
+             */
+            ctx.iteration_stats.saved_calculations_global += (ctx.samples->sample_count - no_recheck_samples) * ctx.no_clusters;
+
+            partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+            #pragma omp parallel private(j)
+            for (j = 0; next_sample_position(&ctx, &j); j++) {
                 VALUE_TYPE dist;
                 uint64_t cluster_id, sample_id, l;
                 VALUE_TYPE *temp_lower_bounds;
+                VALUE_TYPE *sample_lower_bounds;
                 VALUE_TYPE global_lower_bound;
                 VALUE_TYPE *should_group_be_updated;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
 
-                sample_id = j;
+                sample_id = recheck_samples[j];
 
                 if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
                 if (!prms->stop) {
-                    /* update upper bound of this sample with drift of assigned cluster */
-                    ctx.cluster_distances[sample_id] = ctx.cluster_distances[sample_id] + distance_clustersold_to_clustersnew[ctx.cluster_assignments[sample_id]];
+                    temp_lower_bounds = thread_group_bounds + omp_get_thread_num() * thread_group_bounds_size;
+                    sample_lower_bounds = temp_lower_bounds + no_groups;
+                    should_group_be_updated = sample_lower_bounds + no_groups;
+                    memset(should_group_be_updated, 0, no_groups * sizeof(VALUE_TYPE));
 
-                    temp_lower_bounds = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-                    should_group_be_updated = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
+                    /* work on decoded bounds, they are encoded again when the sample is done */
+                    bound_matrix_load_row_drift(&lower_bounds, sample_id, group_max_drift
+                                                , temp_lower_bounds, sample_lower_bounds);
 
-                    global_lower_bound = DBL_MAX;
+                    global_lower_bound = VALUE_TYPE_MAX;
                     for (l = 0; l < no_groups; l++) {
-                        temp_lower_bounds[l] = lower_bounds[sample_id][l];
-                        lower_bounds[sample_id][l] = lower_bounds[sample_id][l] - group_max_drift[l];
-                        if (global_lower_bound > lower_bounds[sample_id][l]) global_lower_bound = lower_bounds[sample_id][l];
-                    }
-
-                    /* check if the global lower bound is already bigger than the current upper bound */
-                    if (global_lower_bound >= ctx.cluster_distances[sample_id]) {
-                        saved_calculations_global += ctx.no_clusters;
-                        goto end;
+                        if (global_lower_bound > sample_lower_bounds[l]) global_lower_bound = sample_lower_bounds[l];
                     }
 
                     /* tighten the upper bound by calculating the actual distance to the current closest cluster */
                     ctx.cluster_distances[sample_id]
-                       = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, ctx.cluster_assignments[sample_id]
+                       = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, ctx.cluster_assignments[sample_id]
                                 , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                    /*#pragma omp critical*/
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     /* recheck if the global lower bound is now bigger than the current upper bound */
                     if (global_lower_bound >= ctx.cluster_distances[sample_id]) {
-                        saved_calculations_global += ctx.no_clusters - 1;
+                        stats->saved_calculations_global += ctx.no_clusters - 1;
                         goto end;
                     }
 
                     for (l = 0; l < no_groups; l++) {
-                        if (lower_bounds[sample_id][l] < ctx.cluster_distances[sample_id]) {
+                        if (sample_lower_bounds[l] < ctx.cluster_distances[sample_id]) {
                             should_group_be_updated[l] = 1;
-                            groups_not_skipped += 1;
-                            lower_bounds[sample_id][l] = DBL_MAX;
+                            stats->groups_not_skipped += 1;
+                            sample_lower_bounds[l] = VALUE_TYPE_MAX;
                         }
                     }
 
                     for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
                         if (!should_group_be_updated[cluster_to_group[cluster_id]]) {
-                            saved_calculations_prev_cluster++;
+                            stats->saved_calculations_prev_cluster += 1;
                             continue;
                         }
                         if (ctx.cluster_counts[cluster_id] == 0 || cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
 
-                        if (lower_bounds[sample_id][cluster_to_group[cluster_id]] < temp_lower_bounds[cluster_to_group[cluster_id]] - distance_clustersold_to_clustersnew[cluster_id]) {
-                            dist = lower_bounds[sample_id][cluster_to_group[cluster_id]];
-                            saved_calculations_local += 1;
+                        if (sample_lower_bounds[cluster_to_group[cluster_id]] < temp_lower_bounds[cluster_to_group[cluster_id]] - distance_clustersold_to_clustersnew[cluster_id]) {
+                            dist = sample_lower_bounds[cluster_to_group[cluster_id]];
+                            stats->saved_calculations_local += 1;
                             goto end_cluster;
                         }
 
@@ -254,40 +251,39 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
                                                      , pca_projection_clusters[cluster_id].nnz
                                                      , vector_lengths_pca_samples[sample_id]
                                                      , vector_lengths_pca_clusters[cluster_id]);
-                                done_pca_calcs += 1;
+                                stats->done_pca_calcs += 1;
 
                                 /* we do this fabs to not run into numeric errors */
                                 if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
-                                    saved_calculations_pca += 1;
+                                    stats->saved_calculations_pca += 1;
                                     goto end_cluster;
                                 }
                             }
                         }
 
-                        dist = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, cluster_id
+                        dist = euclid_vector_list(ctx.samples, sample_id, ctx.cluster_vectors, cluster_id
                                 , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
 
-                        /*#pragma omp critical*/
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         if (dist < ctx.cluster_distances[sample_id]) {
-                            lower_bounds[sample_id][cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
+                            sample_lower_bounds[cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
                             ctx.cluster_distances[sample_id] = dist;
                             ctx.cluster_assignments[sample_id] = cluster_id;
                         } else {
                             end_cluster:;
-                            if (dist < lower_bounds[sample_id][cluster_to_group[cluster_id]]) {
-                                lower_bounds[sample_id][cluster_to_group[cluster_id]] = dist;
+                            if (dist < sample_lower_bounds[cluster_to_group[cluster_id]]) {
+                                sample_lower_bounds[cluster_to_group[cluster_id]] = dist;
                             }
                         }
                     }
 
                     end:;
-                    free(should_group_be_updated);
-                    free(temp_lower_bounds);
+                    bound_matrix_store_row(&lower_bounds, sample_id, sample_lower_bounds);
                 }
             } /* block iterate over samples */
         } /* block is first iteration */
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -313,9 +309,9 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
                                 ctx.clusters_not_changed,
                                 pca_projection_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_pca_calcs", done_pca_calcs);
+            d_add_ilist(&(prms->tr), "iteration_pca_calcs", ctx.iteration_stats.done_pca_calcs);
             d_add_ilist(&(prms->tr), "iteration_pca_calcs_success",
-                        saved_calculations_pca);
+                        ctx.iteration_stats.saved_calculations_pca);
         }
 
         /* ------------ calculate maximum drift for every group ------------- */
@@ -335,16 +331,27 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
             }
         }
 
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+
+        /* move all bounds and find the samples which do not pass the global test */
+        no_recheck_samples = update_bounds_collect_rechecks(&ctx
+                                                            , distance_clustersold_to_clustersnew
+                                                            , &lower_bounds
+                                                            , group_max_drift
+                                                            , 0
+                                                            , NULL
+                                                            , recheck_samples);
+
         print_iteration_summary(&ctx, prms, i);
 
         /* print pca and yinyang statistics */
         if (prms->verbose) LOG_INFO("PCA statistics b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u [YY] grp_not_skip=%" PRINTF_INT64_MODIFIER "u/pc:%" PRINTF_INT64_MODIFIER "u/g=%" PRINTF_INT64_MODIFIER "u/l=%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_pca
-                , done_pca_calcs
-                , groups_not_skipped
-                , saved_calculations_prev_cluster
-                , saved_calculations_global
-                , saved_calculations_local);
+                , ctx.iteration_stats.saved_calculations_pca
+                , ctx.iteration_stats.done_pca_calcs
+                , ctx.iteration_stats.groups_not_skipped
+                , ctx.iteration_stats.saved_calculations_prev_cluster
+                , ctx.iteration_stats.saved_calculations_global
+                , ctx.iteration_stats.saved_calculations_local);
 
     }
 
@@ -366,17 +373,15 @@ struct kmeans_result* pca_yinyang_kmeans(struct csr_matrix* samples, struct kmea
 
     free_null(distance_clustersold_to_clustersnew);
     free_null(group_max_drift);
-
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        free_null(lower_bounds[i]);
-    }
+    free_null(thread_group_bounds);
 
     for (i = 0; i < no_groups; i++) {
         free_null(groups[i].clusters);
     }
 
     free_null(groups);
-    free_null(lower_bounds);
+    free_bound_matrix(&lower_bounds);
+    free_null(recheck_samples);
     free_null(cluster_to_group);
 
     return res;
@@ -12,6 +12,8 @@
 #include <unistd.h>
 #include <float.h>
 
+#include "elkan_commons.h"
+
 struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_params *prms) {
 
     uint32_t i;
@@ -19,6 +21,7 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
     uint64_t block_vectors_dim;
     uint64_t no_groups;
     uint32_t disable_optimizations;
+    uint32_t blocked_assignment;
     uint64_t keys_per_block;
     VALUE_TYPE desired_bv_annz;         /* desired size of the block vectors */
 
@@ -34,10 +37,21 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
     struct group* groups;
 
     VALUE_TYPE *group_max_drift;
-    VALUE_TYPE **lower_bounds;
+    VALUE_TYPE *thread_group_bounds;    /* per thread: three arrays with one value per group */
+    uint64_t thread_group_bounds_size;
+    struct bound_matrix lower_bounds;
+    uint64_t *recheck_samples;          /* samples which need to be examined in this iteration */
+    uint64_t no_recheck_samples;
 
     disable_optimizations = prms->kmeans_algorithm_id == ALGORITHM_YINYANG;
     initialize_general_context(prms, &ctx, samples);
+    initialize_dense_cluster_vectors(prms, &ctx);
+
+    /* without block vectors there is no pruning in the first iteration */
+    blocked_assignment = disable_optimizations && use_blocked_assignment(prms, &ctx);
+
+    /* the blocked assignment reads the uncompressed keys */
+    if (!blocked_assignment) initialize_compressed_sample_keys(prms, &ctx);
 
     desired_bv_annz = d_get_subfloat_default(&(prms->tr)
                                             , "additional_params", "bv_annz", 0.3);
@@ -59,6 +73,7 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
 
             keys_per_block = ctx.samples->dim / block_vectors_dim;
             if (ctx.samples->dim % block_vectors_dim > 0) keys_per_block++;
+            initialize_thread_block_vectors(&ctx);
         }
 
         /* create block vectors for the clusters */
@@ -78,16 +93,18 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
     /* create yinyang cluster groups by doing 5 k-means iterations on the clusters */
     create_kmeans_cluster_groups(ctx.cluster_vectors
                                 , ctx.no_clusters
-                                , ctx.samples->sample_count
+                                , ctx.samples->dim
                                 , &groups, &no_groups);
 
 
     group_max_drift = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-    lower_bounds = (VALUE_TYPE**) calloc(ctx.samples->sample_count, sizeof(VALUE_TYPE*));
 
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        lower_bounds[i] = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-    }
+    /* padded to 128 bytes so that threads do not share cache lines */
+    thread_group_bounds_size = (3 * no_groups * sizeof(VALUE_TYPE) + 127) / 128 * 128 / sizeof(VALUE_TYPE);
+    thread_group_bounds = (VALUE_TYPE*) calloc(ctx.no_threads * thread_group_bounds_size, sizeof(VALUE_TYPE));
+    initialize_lower_bound_matrix(prms, &ctx, no_groups, &lower_bounds);
+    recheck_samples = create_sample_worklist(&ctx);
+    no_recheck_samples = ctx.samples->sample_count;
 
     cluster_to_group = (uint64_t*) calloc(ctx.no_clusters, sizeof(uint64_t));
 
@@ -98,42 +115,48 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
     }
 
     for (i = 0; i < prms->iteration_limit && !ctx.converged && !prms->stop; i++) {
-        uint64_t saved_calculations_prev_cluster, saved_calculations_bv;
-        uint64_t saved_calculations_global, saved_calculations_local;
-        uint64_t done_blockvector_calcs;
-        uint64_t groups_not_skipped;
-
-        done_blockvector_calcs = 0;
-        saved_calculations_bv = 0;
-        saved_calculations_global = 0;
-        saved_calculations_local = 0;
-        saved_calculations_prev_cluster = 0;
-        groups_not_skipped = 0;
-
         /* initialize data needed for the iteration */
         pre_process_iteration(&ctx);
 
-        if (i == 0) {
+        if (i == 0 && blocked_assignment) {
+            /* first iteration is a full assignment step without pruning. do it
+             * tile-wise as sparse x dense product and derive the group bounds from it.
+             */
+            uint64_t sample_id, l;
+
+            #pragma omp parallel for private(l)
+            for (sample_id = 0; sample_id < ctx.samples->sample_count; sample_id++) {
+                for (l = 0; l < no_groups; l++) {
+                    bound_matrix_set(&lower_bounds, sample_id, l, VALUE_TYPE_MAX);
+                }
+            }
+
+            assign_samples_blocked(&ctx, 0, cluster_to_group, &lower_bounds, &(prms->stop));
+
+            /* only the first iteration is blocked, no need to keep the transposed clusters up to date */
+            free_null(ctx.dense_transposed_clusters);
+        } else if (i == 0) {
             /* first iteration is done with regular kmeans to find the upper and lower bounds */
             uint64_t sample_id, l;
 
             /* do one regular kmeans step to initialize bounds */
-            #pragma omp parallel for schedule(dynamic, 1000) private(l)
-            for (sample_id = 0; sample_id < ctx.samples->sample_count; sample_id++) {
+            partition_sample_worklist(&ctx, NULL, ctx.samples->sample_count);
+            #pragma omp parallel private(sample_id, l)
+            for (sample_id = 0; next_sample_position(&ctx, &sample_id); sample_id++) {
                 uint64_t cluster_id;
                 VALUE_TYPE dist;
                 uint32_t is_first_assignment;
-                struct sparse_vector bv;
-                bv.nnz = 0;
-                bv.keys = NULL;
-                bv.values = NULL;
+                struct sparse_vector *bv;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
+                bv = NULL;
                 is_first_assignment = 0;
 
                 if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
                 if (!prms->stop) {
                     for (l = 0; l < no_groups; l++) {
-                        lower_bounds[sample_id][l] = DBL_MAX;
+                        bound_matrix_set(&lower_bounds, sample_id, l, VALUE_TYPE_MAX);
                     }
 
                     for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
@@ -149,14 +172,15 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
                                               , ctx.vector_lengths_clusters);
                             } else {
                                 /* kmeans_algorithm_id == ALGORITHM_BV_YINYANG_ONDEMAND */
-                                if (bv.keys == NULL) {
-                                    create_block_vector_from_csr_matrix_vector(ctx.samples
-                                                                               , sample_id
-                                                                               , keys_per_block
-                                                                               , &bv);
+                                if (bv == NULL) {
+                                    bv = get_thread_block_vector(&ctx);
+                                    fill_block_vector_from_csr_matrix_vector(ctx.samples
+                                                                              , sample_id
+                                                                              , keys_per_block
+                                                                              , bv);
                                 }
 
-                                dist = euclid_vector(bv.keys, bv.values, bv.nnz
+                                dist = euclid_vector(bv->keys, bv->values, bv->nnz
                                                      , block_vectors_clusters[cluster_id].keys
                                                      , block_vectors_clusters[cluster_id].values
                                                      , block_vectors_clusters[cluster_id].nnz
@@ -164,114 +188,107 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
                                                      , ctx.vector_lengths_clusters[cluster_id]);
                             }
 
-                            done_blockvector_calcs += 1;
+                            stats->done_blockvector_calcs += 1;
 
                             /* we do this fabs to not run into numeric errors */
                             if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
-                                saved_calculations_bv += 1;
+                                stats->saved_calculations_bv += 1;
                                 goto end_cluster_init;
                             }
 
                         }
 
-                        dist = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, cluster_id
-                                , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
+                        dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
 
-                        /*#pragma omp critical*/
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         if (dist < ctx.cluster_distances[sample_id]) {
                             if (is_first_assignment) {
                                 is_first_assignment = 0;
                             } else {
-                                lower_bounds[sample_id][cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
+                                bound_matrix_set(&lower_bounds, sample_id, cluster_to_group[ctx.cluster_assignments[sample_id]], ctx.cluster_distances[sample_id]);
                             }
 
                             ctx.cluster_distances[sample_id] = dist;
                             ctx.cluster_assignments[sample_id] = cluster_id;
                         } else {
                             end_cluster_init:;
-                            if (dist < lower_bounds[sample_id][cluster_to_group[cluster_id]]) {
-                                lower_bounds[sample_id][cluster_to_group[cluster_id]] = dist;
+                            if (dist < bound_matrix_get(&lower_bounds, sample_id, cluster_to_group[cluster_id])) {
+                                bound_matrix_set(&lower_bounds, sample_id, cluster_to_group[cluster_id], dist);
                             }
                         }
                     }
                 }
-                if (!disable_optimizations) {
-                    free_null(bv.keys);
-                    free_null(bv.values);
-                }
             }
         } else {
-
-            #pragma omp parallel for schedule(dynamic, 1000)
-            for (j = 0; j < ctx.samples->sample_count; j++) {
+            /* samples which were not selected by update_bounds_collect_rechecks
+             * passed the global test
+             */
+            ctx.iteration_stats.saved_calculations_global += (ctx.samples->sample_count - no_recheck_samples) * ctx.no_clusters;
+
+            partition_sample_worklist(&ctx, recheck_samples, no_recheck_samples);
+            #pragma omp parallel private(j)
+            for (j = 0; next_sample_position(&ctx, &j); j++) {
                 VALUE_TYPE dist;
                 uint64_t cluster_id, sample_id, l;
                 VALUE_TYPE *temp_lower_bounds;
+                VALUE_TYPE *sample_lower_bounds;
                 VALUE_TYPE global_lower_bound;
                 VALUE_TYPE *should_group_be_updated;
-                struct sparse_vector bv;
-                bv.nnz = 0;
-                bv.keys = NULL;
-                bv.values = NULL;
+                struct sparse_vector *bv;
+                struct kmeans_thread_stats* stats;
+                stats = get_thread_stats(&ctx);
+                bv = NULL;
 
-                sample_id = j;
+                sample_id = recheck_samples[j];
 
                 if (omp_get_thread_num() == 0) check_signals(&(prms->stop));
 
                 if (!prms->stop) {
-                    /* update upper bound of this sample with drift of assigned cluster */
-                    ctx.cluster_distances[sample_id] = ctx.cluster_distances[sample_id] + distance_clustersold_to_clustersnew[ctx.cluster_assignments[sample_id]];
+                    temp_lower_bounds = thread_group_bounds + omp_get_thread_num() * thread_group_bounds_size;
+                    sample_lower_bounds = temp_lower_bounds + no_groups;
+                    should_group_be_updated = sample_lower_bounds + no_groups;
+                    memset(should_group_be_updated, 0, no_groups * sizeof(VALUE_TYPE));
 
-                    temp_lower_bounds = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
-                    should_group_be_updated = (VALUE_TYPE*) calloc(no_groups, sizeof(VALUE_TYPE));
+                    /* work on decoded bounds, they are encoded again when the sample is done */
+                    bound_matrix_load_row_drift(&lower_bounds, sample_id, group_max_drift
+                                                , temp_lower_bounds, sample_lower_bounds);
 
-                    global_lower_bound = DBL_MAX;
+                    global_lower_bound = VALUE_TYPE_MAX;
                     for (l = 0; l < no_groups; l++) {
-                        temp_lower_bounds[l] = lower_bounds[sample_id][l];
-                        lower_bounds[sample_id][l] = lower_bounds[sample_id][l] - group_max_drift[l];
-                        if (global_lower_bound > lower_bounds[sample_id][l]) global_lower_bound = lower_bounds[sample_id][l];
-                    }
-
-                    /* check if the global lower bound is already bigger than the current upper bound */
-                    if (global_lower_bound >= ctx.cluster_distances[sample_id]) {
-                        saved_calculations_global += ctx.no_clusters;
-                        goto end;
+                        if (global_lower_bound > sample_lower_bounds[l]) global_lower_bound = sample_lower_bounds[l];
                     }
 
                     /* tighten the upper bound by calculating the actual distance to the current closest cluster */
                     ctx.cluster_distances[sample_id]
-                       = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, ctx.cluster_assignments[sample_id]
-                                , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
+                       = euclid_sample_cluster(&ctx, sample_id, ctx.cluster_assignments[sample_id]);
 
-                    /*#pragma omp critical*/
-                    ctx.done_calculations += 1;
+                    stats->done_calculations += 1;
 
                     /* recheck if the global lower bound is now bigger than the current upper bound */
                     if (global_lower_bound >= ctx.cluster_distances[sample_id]) {
-                        saved_calculations_global += ctx.no_clusters - 1;
+                        stats->saved_calculations_global += ctx.no_clusters - 1;
                         goto end;
                     }
 
                     for (l = 0; l < no_groups; l++) {
-                        if (lower_bounds[sample_id][l] < ctx.cluster_distances[sample_id]) {
+                        if (sample_lower_bounds[l] < ctx.cluster_distances[sample_id]) {
                             should_group_be_updated[l] = 1;
-                            groups_not_skipped += 1;
-                            lower_bounds[sample_id][l] = DBL_MAX;
+                            stats->groups_not_skipped += 1;
+                            sample_lower_bounds[l] = VALUE_TYPE_MAX;
                         }
                     }
 
                     for (cluster_id = 0; cluster_id < ctx.no_clusters; cluster_id++) {
                         if (!should_group_be_updated[cluster_to_group[cluster_id]]) {
-                            saved_calculations_prev_cluster++;
+                            stats->saved_calculations_prev_cluster += 1;
                             continue;
                         }
                         if (ctx.cluster_counts[cluster_id] == 0 || cluster_id == ctx.previous_cluster_assignments[sample_id]) continue;
 
-                        if (lower_bounds[sample_id][cluster_to_group[cluster_id]] < temp_lower_bounds[cluster_to_group[cluster_id]] - distance_clustersold_to_clustersnew[cluster_id]) {
-                            dist = lower_bounds[sample_id][cluster_to_group[cluster_id]];
-                            saved_calculations_local += 1;
+                        if (sample_lower_bounds[cluster_to_group[cluster_id]] < temp_lower_bounds[cluster_to_group[cluster_id]] - distance_clustersold_to_clustersnew[cluster_id]) {
+                            dist = sample_lower_bounds[cluster_to_group[cluster_id]];
+                            stats->saved_calculations_local += 1;
                             goto end_cluster;
                         }
 
@@ -287,14 +304,15 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
                                                   , ctx.vector_lengths_clusters);
                                 } else {
                                     /* kmeans_algorithm_id == ALGORITHM_BV_YINYANG_ONDEMAND */
-                                    if (bv.keys == NULL) {
-                                        create_block_vector_from_csr_matrix_vector(ctx.samples
-                                                                                   , sample_id
-                                                                                   , keys_per_block
-                                                                                   , &bv);
+                                    if (bv == NULL) {
+                                        bv = get_thread_block_vector(&ctx);
+                                        fill_block_vector_from_csr_matrix_vector(ctx.samples
+                                                                                  , sample_id
+                                                                                  , keys_per_block
+                                                                                  , bv);
                                     }
 
-                                    dist = euclid_vector(bv.keys, bv.values, bv.nnz
+                                    dist = euclid_vector(bv->keys, bv->values, bv->nnz
                                                          , block_vectors_clusters[cluster_id].keys
                                                          , block_vectors_clusters[cluster_id].values
                                                          , block_vectors_clusters[cluster_id].nnz
@@ -302,43 +320,37 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
                                                          , ctx.vector_lengths_clusters[cluster_id]);
                                 }
 
-                                done_blockvector_calcs += 1;
+                                stats->done_blockvector_calcs += 1;
 
                                 if (dist >= ctx.cluster_distances[sample_id] && fabs(dist - ctx.cluster_distances[sample_id]) >= 1e-6) {
-                                    saved_calculations_bv += 1;
+                                    stats->saved_calculations_bv += 1;
                                     goto end_cluster;
                                 }
                             }
                         }
 
-                        dist = euclid_vector_list(samples, sample_id, ctx.cluster_vectors, cluster_id
-                                , ctx.vector_lengths_samples, ctx.vector_lengths_clusters);
+                        dist = euclid_sample_cluster(&ctx, sample_id, cluster_id);
 
-                        /*#pragma omp critical*/
-                        ctx.done_calculations += 1;
+                        stats->done_calculations += 1;
 
                         if (dist < ctx.cluster_distances[sample_id]) {
-                            lower_bounds[sample_id][cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
+                            sample_lower_bounds[cluster_to_group[ctx.cluster_assignments[sample_id]]] = ctx.cluster_distances[sample_id];
                             ctx.cluster_distances[sample_id] = dist;
                             ctx.cluster_assignments[sample_id] = cluster_id;
                         } else {
                             end_cluster:;
-                            if (dist < lower_bounds[sample_id][cluster_to_group[cluster_id]]) {
-                                lower_bounds[sample_id][cluster_to_group[cluster_id]] = dist;
+                            if (dist < sample_lower_bounds[cluster_to_group[cluster_id]]) {
+                                sample_lower_bounds[cluster_to_group[cluster_id]] = dist;
                             }
                         }
                     }
 
                     end:;
-                    free(should_group_be_updated);
-                    free(temp_lower_bounds);
-                }
-                if (!disable_optimizations) {
-                    free_null(bv.keys);
-                    free_null(bv.values);
+                    bound_matrix_store_row(&lower_bounds, sample_id, sample_lower_bounds);
                 }
             } /* block iterate over samples */
         } /* block is first iteration */
+        merge_thread_stats(&ctx);
 
         post_process_iteration(&ctx, prms);
 
@@ -383,20 +395,31 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
                                         , ctx.clusters_not_changed
                                         , block_vectors_clusters);
 
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs", done_blockvector_calcs);
-            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", saved_calculations_bv);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs", ctx.iteration_stats.done_blockvector_calcs);
+            d_add_ilist(&(prms->tr), "iteration_bv_calcs_success", ctx.iteration_stats.saved_calculations_bv);
         }
 
+        d_add_ilist(&(prms->tr), "iteration_examined_samples", no_recheck_samples);
+
+        /* move all bounds and find the samples which do not pass the global test */
+        no_recheck_samples = update_bounds_collect_rechecks(&ctx
+                                                            , distance_clustersold_to_clustersnew
+                                                            , &lower_bounds
+                                                            , group_max_drift
+                                                            , 0
+                                                            , NULL
+                                                            , recheck_samples);
+
         print_iteration_summary(&ctx, prms, i);
 
         /* print block vector and yinyang statistics */
         if (prms->verbose) LOG_INFO("statistics [BV] b:%" PRINTF_INT64_MODIFIER "u/db:%" PRINTF_INT64_MODIFIER "u [YY] grp_not_skip=%" PRINTF_INT64_MODIFIER "u/pc:%" PRINTF_INT64_MODIFIER "u/g=%" PRINTF_INT64_MODIFIER "u/l=%" PRINTF_INT64_MODIFIER "u"
-                , saved_calculations_bv
-                , done_blockvector_calcs
-                , groups_not_skipped
-                , saved_calculations_prev_cluster
-                , saved_calculations_global
-                , saved_calculations_local);
+                , ctx.iteration_stats.saved_calculations_bv
+                , ctx.iteration_stats.done_blockvector_calcs
+                , ctx.iteration_stats.groups_not_skipped
+                , ctx.iteration_stats.saved_calculations_prev_cluster
+                , ctx.iteration_stats.saved_calculations_global
+                , ctx.iteration_stats.saved_calculations_local);
 
     }
 
@@ -414,17 +437,15 @@ struct kmeans_result* yinyang_kmeans(struct csr_matrix* samples, struct kmeans_p
     free_general_context(&ctx, prms);
     free_null(distance_clustersold_to_clustersnew);
     free_null(group_max_drift);
-
-    for (i = 0; i < ctx.samples->sample_count; i++) {
-        free_null(lower_bounds[i]);
-    }
+    free_null(thread_group_bounds);
 
     for (i = 0; i < no_groups; i++) {
         free_null(groups[i].clusters);
     }
 
     free_null(groups);
-    free_null(lower_bounds);
+    free_bound_matrix(&lower_bounds);
+    free_null(recheck_samples);
     free_null(cluster_to_group);
 
     return res;
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../utils/matrix/csr_matrix/csr_load_matrix.h"
+#include "../utils/matrix/csr_matrix/csr_store_matrix.h"
+#include "../utils/fcl_time.h"
+#include "../utils/fcl_file.h"
+#include "../utils/fcl_logging.h"
+#include "../utils/argtable3.h"
+
+#include "convert_task.h"
+
+void convert_task(int argc, char *argv[]) {
+    struct arg_lit *help = arg_lit0(NULL,"help", "print this help and exit");
+    struct arg_file *input_dataset_file = arg_file1(NULL, NULL, "file_input_dataset", "Input dataset in libsvm or binary format");
+    struct arg_file *output_dataset_file = arg_file1(NULL, NULL, "file_output_dataset", "Path the converted dataset is written to");
+    struct arg_lit *to_libsvm = arg_lit0(NULL, "libsvm", "write the output in libsvm format (default = binary format)");
+    struct arg_lit *silent = arg_lit0(NULL, "silent", "turn off verbosity (default=false)");
+    struct arg_end *end = arg_end(20);
+
+    void *argtable[6];
+    int nerrors;
+    char *progname;
+    uint32_t verbose, status;
+    struct csr_matrix *input_dataset;
+    int32_t* labels;
+    struct timeval tm_start;
+
+    argtable[0] = input_dataset_file;
+    argtable[1] = output_dataset_file;
+    argtable[2] = to_libsvm;
+    argtable[3] = silent;
+    argtable[4] = help;
+    argtable[5] = end;
+
+    progname = "fcl.exe";
+
+    if (arg_nullcheck(argtable) != 0) {
+        /* NULL entries were detected, some allocations must have failed */
+        printf("%s: insufficient memory\n",progname);
+        exit(1);
+    }
+
+    nerrors = arg_parse(argc,argv,argtable);
+
+    /* special case: '--help' takes precedence over error reporting */
+    if (help->count > 0) {
+usage_convert_params:
+        printf("Usage: %s convert", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Convert a dataset into the binary csr matrix format which is memory mapped\n");
+        printf("when loading (or back to libsvm). Binary datasets can be used everywhere\n");
+        printf("instead of libsvm files.\n\n");
+        printf("e.g. ./fcl convert <input_dataset.libsvm> <output_dataset.bin>\n\n");
+
+        printf("Parsing options:\n");
+        arg_print_glossary(stdout, argtable, "  %-29s %s\n");
+        exit(0);
+    }
+
+    /* If the parser returned any errors then display them and exit */
+    if (nerrors > 0) {
+        /* Display the error details contained in the arg_end struct.*/
+        arg_print_errors(stdout, end, progname);
+        printf("\n");
+        goto usage_convert_params;
+    }
+
+    if (!exists(input_dataset_file->filename[0])) {
+        printf("Unable to open input_dataset_file: %s\n\n", input_dataset_file->filename[0]);
+        goto usage_convert_params;
+    }
+
+    verbose = silent->count == 0;
+
+    gettimeofday(&tm_start, NULL);
+
+    if (to_libsvm->count == 0 && !is_binary_csr_matrix_file(input_dataset_file->filename[0])) {
+        /* libsvm to binary is done chunk by chunk to support datasets larger than memory */
+        if (verbose) LOG_INFO("converting data %s", input_dataset_file->filename[0]);
+        status = convert_libsvm_file_to_binary_csr_matrix(input_dataset_file->filename[0]
+                                                          , output_dataset_file->filename[0]);
+        if (status) {
+            LOG_ERROR("Unable to convert %s to %s", input_dataset_file->filename[0]
+                      , output_dataset_file->filename[0]);
+        } else {
+            if (verbose) LOG_INFO("Output file successfully written to: %s in %.2f ms"
+                                  , output_dataset_file->filename[0]
+                                  , get_diff_in_microseconds(tm_start));
+        }
+        goto cleanup;
+    }
+
+    if (verbose) LOG_INFO("loading data %s", input_dataset_file->filename[0]);
+    if (convert_libsvm_file_to_csr_matrix(input_dataset_file->filename[0], &input_dataset, &labels)) {
+        printf("unable to load input data / invalid libsvm or file does not exist!\n\n");
+        goto usage_convert_params;
+    }
+    if (verbose) LOG_INFO("data loaded (samples = %" PRINTF_INT64_MODIFIER "u, dim = %" PRINTF_INT64_MODIFIER "u) in %.2f ms"
+                          , input_dataset->sample_count, input_dataset->dim
+                          , get_diff_in_microseconds(tm_start));
+
+    if (to_libsvm->count > 0) {
+        status = store_matrix_with_label(input_dataset, labels, 0, (char*) output_dataset_file->filename[0]);
+    } else {
+        status = store_matrix_binary(input_dataset, labels, (char*) output_dataset_file->filename[0]);
+    }
+
+    if (status) {
+        LOG_ERROR("Unable to write output file: %s", output_dataset_file->filename[0]);
+    } else {
+        if (verbose) LOG_INFO("Output file successfully written to: %s", output_dataset_file->filename[0]);
+    }
+
+    free_csr_matrix(input_dataset);
+    free_null(input_dataset);
+    free_null(labels);
+
+cleanup:
+    /* deallocate each non-null entry in argtable[] */
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+}
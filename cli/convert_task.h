@@ -0,0 +1,11 @@
+#ifndef CONVERT_TASK_H
+#define CONVERT_TASK_H
+
+/**
+ * @brief The command line task to convert a dataset between the libsvm and the
+ *        binary csr matrix format.
+ *
+ */
+void convert_task(int argc, char *argv[]);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "../algorithms/kmeans/kmeans_utils.h"
 #include "../algorithms/kmeans/kmeans_control.h"
+#include "../algorithms/kmeans/coreset.h"
 #include "../utils/matrix/csr_matrix/csr_load_matrix.h"
 #include "../utils/matrix/csr_matrix/csr_store_matrix.h"
 #include "../utils/matrix/csr_matrix/csr_assign.h"
@@ -13,6 +14,7 @@
 #include "../utils/fcl_string.h"
 #include "../utils/fcl_random.h"
 #include "../utils/fcl_logging.h"
+#include "../utils/fcl_numa.h"
 #include "../utils/argtable3.h"
 
 #include "kmeans_task.h"
@@ -29,9 +31,11 @@ struct kmeans_params parse_kmeans_fit_params(int argc, char *argv[],
     struct arg_int *cluster_count = arg_int0(NULL,"no_clusters","<k>", "number of clusters to generate (default=10)");
     struct arg_int *random_seed = arg_int0(NULL,"seed","<random_seed>", "the random seed to generate different starting positions (default=1)");
     struct arg_int *no_cores = arg_int0(NULL,"no_cores","<no_cores>", "the number of cores to use if compiled with openmp (uses all cores with -1 = default)");
+    struct arg_lit *pin_threads_flag = arg_lit0(NULL, "pin_threads", "pin every thread to one cpu (keeps the samples of a thread in the memory of its NUMA node)");
     struct arg_int *iterations = arg_int0(NULL,"iterations","<iterations>", "the mamimum number of iterations (default=1000)");
     struct arg_dbl *tol = arg_dbl0(NULL, "tolerance","<tolerance>" , "if objective is less than this, the algorithm converges");
     struct arg_lit *silent = arg_lit0(NULL, "silent", "turn off verbosity (default=false)");
+    struct arg_int *coreset_size = arg_int0(NULL,"coreset_size","<m>", "cluster a weighted coreset of m samples instead of all samples (default=0 = no coreset)");
     struct arg_lit *remove_empty = arg_lit0(NULL, "remove_empty", "remove empty clusters from result (resulting no_clusters will most likely be less than requested no_clusters)");
     struct arg_file *input_dataset_file = arg_file1(NULL, NULL, "file_input_dataset", "Input dataset in libsvm format");
     struct arg_file *model_file = arg_file0(NULL, "file_model", "<path>", "Path, the model should be saved to when fitting / loaded from when predicting. (mandatory if predicting)");
@@ -45,6 +49,8 @@ struct kmeans_params parse_kmeans_fit_params(int argc, char *argv[],
     struct arg_rem *add_info3 = arg_rem(NULL,                                            "e.g. --info \"comment: Dataset was sampled for this Experiment\"");
     struct arg_file *tracking_param_file = arg_file0(NULL, "file_tracking_params", "<path>", "Output tracked params from algorithm to file in json format.");
     struct arg_file *input_vectors_file = arg_file0(NULL, "file_input_vectors", "<path>", "Input vectors in libsvm format, e.g. for PCA vectors");
+    struct arg_file *sample_weights_file = arg_file0(NULL, "file_sample_weights", "<path>", "Weight > 0 of every sample, one weight per line (default = every sample has weight 1)");
+    struct arg_lit *sample_weights_from_labels = arg_lit0(NULL, "sample_weights_from_labels", "use the integer labels > 0 of the input dataset as weights of the samples (e.g. number of duplicates of a row). use --file_sample_weights for non integer weights");
 
     struct arg_end *end = arg_end(20);
     struct kmeans_params prms;
@@ -87,15 +93,19 @@ struct kmeans_params parse_kmeans_fit_params(int argc, char *argv[],
 
     argtable[args_set] = init_params_file; args_set++;
     argtable[args_set] = no_cores; args_set++;
+    argtable[args_set] = pin_threads_flag; args_set++;
     argtable[args_set] = cluster_count; args_set++;
     argtable[args_set] = random_seed; args_set++;
     argtable[args_set] = iterations; args_set++;
     argtable[args_set] = tol; args_set++;
     argtable[args_set] = silent; args_set++;
     argtable[args_set] = remove_empty; args_set++;
+    argtable[args_set] = coreset_size; args_set++;
     argtable[args_set] = model_file; args_set++;
     argtable[args_set] = init_params_result_file; args_set++;
     argtable[args_set] = input_vectors_file; args_set++;
+    argtable[args_set] = sample_weights_file; args_set++;
+    argtable[args_set] = sample_weights_from_labels; args_set++;
     argtable[args_set] = add_params1; args_set++;
     argtable[args_set] = add_params2; args_set++;
     argtable[args_set] = add_info1; args_set++;
@@ -113,8 +123,10 @@ struct kmeans_params parse_kmeans_fit_params(int argc, char *argv[],
     no_cores->ival[0] = -1;
     iterations->ival[0] = 1000;
     tol->dval[0] = 1e-6;
+    coreset_size->ival[0] = 0;
     model_file->filename[0] = NULL;
     input_vectors_file->filename[0] = NULL;
+    sample_weights_file->filename[0] = NULL;
     init_params_file->filename[0] = NULL;
     init_params_result_file->filename[0] = NULL;
 
@@ -274,6 +286,8 @@ usage_kmeans_params:
     prms.stop = 0;
     prms.ext_vects = NULL;
     prms.initprms = NULL;
+    prms.sample_weights = NULL;
+    prms.coreset_size = (coreset_size->ival[0] > 0) ? coreset_size->ival[0] : 0;
 
     if (prms.init_id == KMEANS_INIT_PARAMS) {
         read_initialization_params_file(init_params_file->filename[0], &(prms.initprms));
@@ -320,11 +334,43 @@ usage_kmeans_params:
                             , KMEANS_INIT_NAMES[prms.init_id]
                             , no_cores->ival[0]);
 
+    /* threads are set up before loading, so the samples are first touched by
+     * the threads which process them later on
+     */
+    if (no_cores->ival[0] > 0) {
+        omp_set_num_threads(no_cores->ival[0]);
+    }
+
+    if (pin_threads_flag->count > 0) {
+        if (pin_threads()) {
+            if (prms.verbose) LOG_INFO("pinned threads to %" PRINTF_INT32_MODIFIER "u socket(s)", get_no_sockets());
+        } else {
+            if (prms.verbose) LOG_ERROR("pinning threads is not supported on this platform");
+        }
+    }
+
     labels = NULL;
     if (convert_libsvm_file_to_csr_matrix(input_dataset_file->filename[0], input_dataset, &labels)) {
         printf("unable to load input data / invalid libsvm or file does not exist!\n\n");
+        if (sample_weights_from_labels->count > 0) {
+            printf("labels must be integers to be used as sample weights. use --file_sample_weights for non integer weights!\n\n");
+        }
         goto usage_kmeans_params;
     }
+
+    if (sample_weights_from_labels->count > 0) {
+        if (convert_labels_to_sample_weights(labels, (*input_dataset)->sample_count, &(prms.sample_weights))) {
+            printf("unable to use labels as sample weights. every label must be an integer > 0!\n\n");
+            free(labels);
+            goto usage_kmeans_params;
+        }
+    } else if (sample_weights_file->filename[0] != NULL) {
+        if (read_sample_weights_file(sample_weights_file->filename[0], (*input_dataset)->sample_count, &(prms.sample_weights))) {
+            printf("unable to load sample weights. the file needs one weight > 0 per sample!\n\n");
+            free(labels);
+            goto usage_kmeans_params;
+        }
+    }
     free(labels);
 
     if (input_vectors_file->filename[0] != NULL) {
@@ -338,11 +384,6 @@ usage_kmeans_params:
 
     if (prms.verbose) LOG_INFO("data loaded");
 
-
-    if (no_cores->ival[0] > 0) {
-        omp_set_num_threads(no_cores->ival[0]);
-    }
-
     /* deallocate each non-null entry in argtable[] */
     arg_freetable(argtable, args_set);
 
@@ -469,7 +510,11 @@ void kmeans_task(int argc, char *argv[]) {
                                        &path_tracking_params);
 
         /* fit */
-        res = KMEANS_ALGORITHM_FUNCTIONS[prms.kmeans_algorithm_id](input_dataset, &prms);
+        if (prms.coreset_size > 0) {
+            res = coreset_kmeans(input_dataset, &prms);
+        } else {
+            res = KMEANS_ALGORITHM_FUNCTIONS[prms.kmeans_algorithm_id](input_dataset, &prms);
+        }
 
         if (path_model_file != NULL) {
             if (store_matrix_with_label(res->clusters, NULL, 1, path_model_file)) {
@@ -511,6 +556,7 @@ void kmeans_task(int argc, char *argv[]) {
             free_init_params(prms.initprms);
             free_null(prms.initprms);
         }
+        free_null(prms.sample_weights);
 
     }
     if (subtask == SUBTASK_PREDICT) {
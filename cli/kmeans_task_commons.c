@@ -46,3 +46,46 @@ void add_additional_info_param(struct kmeans_params* prms, char* key_str_pair) {
                  , key_str_pair
                  , str_value_as_str);
 }
+
+uint32_t read_sample_weights_file(const char* fname
+                                  , uint64_t no_samples
+                                  , VALUE_TYPE** sample_weights) {
+    FILE* file;
+    uint64_t i;
+    double weight;
+
+    *sample_weights = NULL;
+    file = fopen(fname, "r");
+    if (file == NULL) return 1;
+
+    *sample_weights = (VALUE_TYPE*) calloc(no_samples, sizeof(VALUE_TYPE));
+    for (i = 0; i < no_samples; i++) {
+        if (fscanf(file, "%lf", &weight) != 1 || !(weight > 0)) break;
+        (*sample_weights)[i] = weight;
+    }
+
+    /* exactly no_samples weights are expected */
+    if (i < no_samples || fscanf(file, "%lf", &weight) == 1) {
+        free_null(*sample_weights);
+    }
+
+    fclose(file);
+    return *sample_weights == NULL;
+}
+
+uint32_t convert_labels_to_sample_weights(int32_t* labels
+                                          , uint64_t no_samples
+                                          , VALUE_TYPE** sample_weights) {
+    uint64_t i;
+
+    *sample_weights = (VALUE_TYPE*) calloc(no_samples, sizeof(VALUE_TYPE));
+    for (i = 0; i < no_samples; i++) {
+        if (labels[i] <= 0) {
+            free_null(*sample_weights);
+            return 1;
+        }
+        (*sample_weights)[i] = labels[i];
+    }
+
+    return 0;
+}
@@ -10,4 +10,31 @@
 void add_additional_param_float(struct kmeans_params* prms, char* key_float_pair);
 void add_additional_info_param(struct kmeans_params* prms, char* key_str_pair);
 
+/**
+ * @brief Read the weights of the samples from a file with one weight per line.
+ *
+ * @param[in] fname Path of the file.
+ * @param[in] no_samples Number of weights the file must contain.
+ * @param[out] sample_weights The weights (free it with free).
+ * @return 0 if the file contained no_samples weights > 0 else 1.
+ */
+uint32_t read_sample_weights_file(const char* fname
+                                  , uint64_t no_samples
+                                  , VALUE_TYPE** sample_weights);
+
+/**
+ * @brief Use the labels of the samples as their weights.
+ *
+ * The labels are integers (a libsvm file with non integer labels can not be
+ * loaded), fractional weights need a weights file (see read_sample_weights_file).
+ *
+ * @param[in] labels Labels of the samples.
+ * @param[in] no_samples Length of labels.
+ * @param[out] sample_weights The weights (free it with free).
+ * @return 0 if every label is > 0 else 1.
+ */
+uint32_t convert_labels_to_sample_weights(int32_t* labels
+                                          , uint64_t no_samples
+                                          , VALUE_TYPE** sample_weights);
+
 #endif
\ No newline at end of file
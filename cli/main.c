@@ -8,7 +8,7 @@
 
 unsigned int parse_command_line_task(int argc, char *argv[]) {
     struct arg_lit *help = arg_lit0(NULL,"help", "print this help and exit");
-    struct arg_str *task = arg_str1(NULL,NULL,"task", "choose the clustering task: [kmeans]");
+    struct arg_str *task = arg_str1(NULL,NULL,"task", "choose the clustering task: [kmeans | convert]");
     struct arg_end *end = arg_end(20);
     unsigned int no_cli_algorithms;
     unsigned int i;
@@ -44,6 +44,7 @@ usage_task_params:
         printf("Choose a task e.g.:\n");
         printf("./fcl kmeans\n\n");
         printf("./fcl kmeanspp\n\n");
+        printf("./fcl convert\n\n");
 
         printf("Parsing options:\n");
         arg_print_glossary(stdout, argtable, "  %-25s %s\n");
@@ -85,5 +86,9 @@ int main (int argc, char *argv[]) {
         kmeans_task(argc - 1, argv + 1);
     }
 
+    if (clustering_task == CLUSTERING_TASK_CONVERT) {
+        convert_task(argc - 1, argv + 1);
+    }
+
     return 0;
 }
@@ -35,6 +35,11 @@ function fcl_make_kmeans(input_args)
         cflags_string = {'CFLAGS="\$CFLAGS -std=c99 -g -Wall -Wno-unknown-pragmas -DEXTENSION -DMATLAB_EXTENSION -fopenmp"'};
     end
     
+    % setenv('FCL_SINGLE_PRECISION', '1') before calling this script stores values as float
+    if ~isempty(getenv('FCL_SINGLE_PRECISION')) && ~strcmp(getenv('FCL_SINGLE_PRECISION'), '0')
+        additional_options = {strcat(additional_options{1}, ' -DFCL_SINGLE_PRECISION')};
+    end
+    
     addpath(alg_folder)
     items_to_compile = {'fcl_kmeans', 'fcl_kmeans_fit', 'fcl_kmeans_predict'};
     for k=1:length(items_to_compile)
@@ -37,6 +37,8 @@ uint32_t fcl_kmeans_fit(const mxArray* input_data
     (*prms)->stop=0;
     (*prms)->tr=NULL;
     (*prms)->initprms=NULL;
+    (*prms)->sample_weights=NULL;
+    (*prms)->coreset_size=0;
 
     // read optional input parameters if available
     if (opts == NULL) {
@@ -3,4 +3,5 @@ from libc.stdint cimport uint32_t, uint64_t, int32_t
 cdef extern from "<utils/types.h>":
     ctypedef uint32_t KEY_TYPE
     ctypedef uint64_t POINTER_TYPE
+    # double or float (when built with -DFCL_SINGLE_PRECISION), see utils/types.h
     ctypedef double VALUE_TYPE
\ No newline at end of file
@@ -2,6 +2,7 @@ from __future__ import print_function
 import cython
 import array
 from libc.stdlib cimport malloc, free, calloc
+from libc.string cimport memcpy
 from libc.stdint cimport uint32_t, uint64_t, int32_t, UINT32_MAX
 from cpython cimport Py_INCREF
 from fcl.cython.utils.types cimport KEY_TYPE, POINTER_TYPE, VALUE_TYPE
@@ -58,6 +59,11 @@ cdef extern from "algorithms/kmeans/kmeans_control.h":
       cdict* tr
       csr_matrix* ext_vects
       initialization_params* initprms
+      VALUE_TYPE* sample_weights
+      uint64_t coreset_size
+
+cdef extern from "algorithms/kmeans/coreset.h":
+    kmeans_result* coreset_kmeans(csr_matrix* samples, kmeans_params *prms) nogil
 
 cdef get_kmeans_algo_info():
     info = {}
@@ -110,7 +116,8 @@ cdef class _kmeans_c:
                   , uint32_t init_id
                   , uint32_t remove_empty
                   , initprms
-                  , uint32_t verbose):
+                  , uint32_t verbose
+                  , uint64_t coreset_size = 0):
         
         if (n_jobs > 0):
           omp_set_num_threads(n_jobs)
@@ -132,6 +139,8 @@ cdef class _kmeans_c:
         self.params.tr = NULL
         self.params.ext_vects = NULL
         self.params.initprms = NULL
+        self.params.sample_weights = NULL
+        self.params.coreset_size = coreset_size
         
         if initprms is not None:
           if type(initprms) != dict:
@@ -174,7 +183,10 @@ cdef class _kmeans_c:
       clusters = NULL
 
       with nogil:         
-        kmeans_result = KMEANS_ALGORITHM_FUNCTIONS[self.params.kmeans_algorithm_id](input_data.mtrx, self.params)
+        if self.params.coreset_size > 0:
+          kmeans_result = coreset_kmeans(input_data.mtrx, self.params)
+        else:
+          kmeans_result = KMEANS_ALGORITHM_FUNCTIONS[self.params.kmeans_algorithm_id](input_data.mtrx, self.params)
       
       wrapped_clusters = _csr_matrix()
       wrapped_clusters.mtrx = kmeans_result.clusters
@@ -232,7 +244,33 @@ cdef class _kmeans_c:
           
           return external_vectors
 
-    def fit(self, X, additional_params, additional_info, external_vectors=None):
+    cdef set_sample_weights(self, _csr_matrix X, sample_weight):
+        cdef VALUE_TYPE[::1] weights
+        
+        if sample_weight is None:
+          return
+        
+        try:
+          import numpy as np
+        except:
+          raise Exception("sample_weight was given but unable to import numpy!")
+        
+        weights_array = np.ascontiguousarray(sample_weight, dtype=np.float32 if cython.sizeof(VALUE_TYPE) == 4 else np.float64)
+        if weights_array.ndim != 1 or weights_array.shape[0] != X.mtrx.sample_count:
+          raise Exception("sample_weight needs one weight for every sample!")
+        
+        if not (weights_array > 0).all():
+          raise Exception("every weight in sample_weight must be > 0!")
+        
+        self.params.sample_weights = <VALUE_TYPE *>malloc(cython.sizeof(VALUE_TYPE) * X.mtrx.sample_count)
+        if self.params.sample_weights is NULL:
+            raise MemoryError()
+        
+        if X.mtrx.sample_count > 0:
+          weights = weights_array
+          memcpy(self.params.sample_weights, &weights[0], cython.sizeof(VALUE_TYPE) * X.mtrx.sample_count)
+
+    def fit(self, X, additional_params, additional_info, external_vectors=None, sample_weight=None):
         cdef uint32_t is_numpy       
         
         if external_vectors is not None:
@@ -240,7 +278,12 @@ cdef class _kmeans_c:
           
         self.reset_params(additional_params, additional_info, external_vectors)
         _X = convert_matrix_to_csr_matrix(X, &is_numpy)
-        python_res = self._fit_csr_matrix(_X)
+        self.set_sample_weights(_X, sample_weight)
+        try:
+          python_res = self._fit_csr_matrix(_X)
+        finally:
+          free(self.params.sample_weights)
+          self.params.sample_weights = NULL
         
         if self.params.stop:
           raise StopException("Stop was requested!")
@@ -22,7 +22,8 @@ class KMeans():
                  , seed = random.randint(0, 2**31), iteration_limit = 1000, tol = 1e-6, n_jobs = -1
                  , remove_empty_clusters = False, verbose = False, result_type = 'auto', init="random"
                  , additional_params = {}, additional_info = {}
-                 , create_signal_handler = True, external_vectors = None, initialization_params = None):
+                 , create_signal_handler = True, external_vectors = None, initialization_params = None
+                 , coreset_size = 0):
         
         if n_jobs <= 0:
           n_jobs = -1
@@ -80,6 +81,9 @@ class KMeans():
         if iteration_limit < 1:
             raise Exception("iteration_limit must at least be 1")
         
+        if coreset_size < 0:
+            raise Exception("coreset_size must be >= 0")
+        
         if not algorithm in KMEANS_ALGO_INFO:
             raise Exception("unknown algorithm %s"%algorithm)
         
@@ -100,7 +104,8 @@ class KMeans():
         init_id, _ = KMEANS_INIT_INFO[init]
                
         self.kmeans_c_obj = _kmeans_c(kmeans_algorithm_id, no_clusters, seed, iteration_limit, tol,
-                                      n_jobs, init_id, self.remove_empty_clusters, initialization_params, verbose)
+                                      n_jobs, init_id, self.remove_empty_clusters, initialization_params, verbose,
+                                      coreset_size)
         self.cluster_centers_ = None
         self.assign_c_obj = None
         
@@ -121,14 +126,14 @@ class KMeans():
     def get_tracked_params(self):
       return self.kmeans_c_obj.get_tracked_params()
     
-    def fit(self, X, external_vectors = None):
+    def fit(self, X, external_vectors = None, sample_weight = None):
         self.assign_c_obj = None
-        python_res = self.kmeans_c_obj.fit(X, self.additional_params, self.additional_info, external_vectors)
+        python_res = self.kmeans_c_obj.fit(X, self.additional_params, self.additional_info, external_vectors, sample_weight)
         self.cluster_centers_ = python_res['clusters']
         self.initialization_params_ = python_res['initialization_params']
     
-    def fit_predict(self, X, output_distance=False, output_numpy=None):
-        self.fit(X)
+    def fit_predict(self, X, output_distance=False, output_numpy=None, sample_weight=None):
+        self.fit(X, sample_weight=sample_weight)
         return self.predict(X, output_distance, output_numpy)
     
     def _retrieve_numpy(self, output_numpy):
@@ -19,7 +19,7 @@ cdef class _csr_matrix:
     
     number_keys = self.mtrx.pointers[self.mtrx.sample_count]
     keys = np.zeros(number_keys, dtype=np.int64)
-    values = np.zeros(number_keys, dtype=np.float64)
+    values = np.zeros(number_keys, dtype=np.float32 if cython.sizeof(VALUE_TYPE) == 4 else np.float64)
     pointers = np.zeros(self.mtrx.sample_count + 1, dtype=np.int64)
     
     for i in xrange(number_keys):
@@ -39,7 +39,7 @@ cdef class _csr_matrix:
       raise IndexError("Index is out of range. Index was %d, matrix size is %d"%(i, self.mtrx.sample_count))
     
     keys = array.array('I')
-    values = array.array('d')
+    values = array.array('f' if cython.sizeof(VALUE_TYPE) == 4 else 'd')
     
     nnz = self.mtrx.pointers[i + 1] - self.mtrx.pointers[i]
     
@@ -75,6 +75,11 @@ for algo in os.listdir(algorithms_path):
                 )
         algorithm_c_files[algo] = algorithm_c_files_specific
 
+extra_compile_args = ["-fopenmp", "-DEXTENSION"]
+# FCL_SINGLE_PRECISION=1 python setup.py ... builds the extension with float values
+if os.environ.get("FCL_SINGLE_PRECISION", "0") not in ("", "0"):
+    extra_compile_args.append("-DFCL_SINGLE_PRECISION")
+
 ext_modules = [
     Extension(
         "fcl.kmeans._kmeans",
@@ -88,6 +93,7 @@ ext_modules = [
             os.path.join(utils_path, "fcl_random.c"),
             os.path.join(utils_path, "fcl_string.c"),
             os.path.join(utils_path, "fcl_time.c"),
+            os.path.join(utils_path, "fcl_numa.c"),
             os.path.join(csr_matrix_folder, "csr_assign.c"),
             os.path.join(csr_matrix_folder, "csr_load_matrix.c"),
             os.path.join(csr_matrix_folder, "csr_math.c"),
@@ -101,7 +107,7 @@ ext_modules = [
             os.path.join(sparse_vector_folder, "sparse_vector_math.c"),
         ]
         + algorithm_c_files["kmeans"],
-        extra_compile_args=["-fopenmp", "-DEXTENSION"],
+        extra_compile_args=extra_compile_args,
         include_dirs=[".", "python"],
         extra_link_args=["-fopenmp"],
     ),
@@ -116,7 +122,7 @@ ext_modules = [
             os.path.join(csr_matrix_folder, "csr_matrix.c"),
             os.path.join(csr_matrix_folder, "csr_store_matrix.c"),
         ],
-        extra_compile_args=["-fopenmp", "-DEXTENSION"],
+        extra_compile_args=extra_compile_args,
         include_dirs=[".", "python"],
         extra_link_args=["-fopenmp"],
     ),
@@ -135,6 +141,7 @@ ext_modules = [
             os.path.join(utils_path, "fcl_file.c"),
             os.path.join(utils_path, "fcl_logging.c"),
             os.path.join(utils_path, "clogging.c"),
+            os.path.join(utils_path, "fcl_numa.c"),
             os.path.join(csr_matrix_folder, "csr_load_matrix.c"),
             os.path.join(csr_matrix_folder, "csr_math.c"),
             os.path.join(csr_matrix_folder, "csr_matrix.c"),
@@ -143,7 +150,7 @@ ext_modules = [
             os.path.join(common_vector_folder, "common_vector_math.c"),
             os.path.join(sparse_vector_folder, "sparse_vector_math.c"),
         ],
-        extra_compile_args=["-fopenmp", "-DEXTENSION"],
+        extra_compile_args=extra_compile_args,
         include_dirs=[".", "python"],
         extra_link_args=["-fopenmp"],
     ),
@@ -155,7 +162,7 @@ ext_modules = [
             os.path.join(utils_path, "cdict.c"),
             os.path.join(utils_path, "fcl_logging.c"),
         ],
-        extra_compile_args=["-fopenmp", "-DEXTENSION"],
+        extra_compile_args=extra_compile_args,
         include_dirs=[".", "python"],
         extra_link_args=["-fopenmp"],
     ),
@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+#include "fcl_numa.h"
+#include "global_defs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(_OPENMP)
+#include <sched.h>
+#define FCL_PIN_THREADS
+#endif
+
+static uint32_t no_pinned_threads = 0;
+static uint32_t no_sockets = 1;
+static uint32_t *thread_sockets = NULL;    /* socket index of every pinned thread */
+
+void* calloc_first_touch(uint64_t count, size_t size) {
+    char* array;
+
+    array = (char*) malloc(count * size + 1);
+
+    #pragma omp parallel
+    {
+        uint64_t thread_id, no_threads, block, remainder, start, end;
+
+        thread_id = omp_get_thread_num();
+        no_threads = omp_get_num_threads();
+
+        /* same split as schedule(static): the first count % no_threads threads get one more element */
+        block = count / no_threads;
+        remainder = count % no_threads;
+        if (thread_id < remainder) {
+            start = thread_id * (block + 1);
+            end = start + block + 1;
+        } else {
+            start = thread_id * block + remainder;
+            end = start + block;
+        }
+
+        memset(array + start * size, 0, (end - start) * size);
+    }
+
+    return array;
+}
+
+void* calloc_first_touch_ranges(uint64_t count, size_t size, uint64_t* range_starts, uint64_t no_ranges) {
+    char* array;
+    uint64_t r;
+
+    array = (char*) malloc(count * size + 1);
+
+    #pragma omp parallel for schedule(static, 1)
+    for (r = 0; r < no_ranges; r++) {
+        memset(array + range_starts[r] * size, 0, (range_starts[r + 1] - range_starts[r]) * size);
+    }
+
+    return array;
+}
+
+#ifdef FCL_PIN_THREADS
+/* socket (physical package) of a cpu. 0 if unknown */
+static uint32_t read_cpu_socket(int cpu) {
+    char path[128];
+    FILE* f;
+    unsigned int socket;
+
+    socket = 0;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%u", &socket) != 1) socket = 0;
+        fclose(f);
+    }
+
+    return socket;
+}
+#endif
+
+uint32_t pin_threads(void) {
+#ifdef FCL_PIN_THREADS
+    cpu_set_t allowed;
+    int *cpus;
+    uint32_t *cpu_sockets, *socket_ids;
+    uint32_t i, j, no_cpus, no_threads;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) return 0;
+
+    no_cpus = 0;
+    cpus = (int*) calloc(CPU_SETSIZE, sizeof(int));
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &allowed)) cpus[no_cpus++] = i;
+    }
+
+    if (no_cpus == 0) {
+        free(cpus);
+        return 0;
+    }
+
+    /* sockets of the cpus, numbered in the order they appear */
+    cpu_sockets = (uint32_t*) calloc(no_cpus, sizeof(uint32_t));
+    socket_ids = (uint32_t*) calloc(no_cpus, sizeof(uint32_t));
+    no_sockets = 0;
+    for (i = 0; i < no_cpus; i++) {
+        uint32_t socket_id;
+        socket_id = read_cpu_socket(cpus[i]);
+        for (j = 0; j < no_sockets && socket_ids[j] != socket_id; j++);
+        if (j == no_sockets) socket_ids[no_sockets++] = socket_id;
+        cpu_sockets[i] = j;
+    }
+
+    no_threads = omp_get_max_threads();
+    free_null(thread_sockets);
+    thread_sockets = (uint32_t*) calloc(no_threads, sizeof(uint32_t));
+
+    #pragma omp parallel
+    {
+        cpu_set_t cpu;
+        uint32_t thread_id;
+
+        thread_id = omp_get_thread_num();
+        CPU_ZERO(&cpu);
+        CPU_SET(cpus[thread_id % no_cpus], &cpu);
+        sched_setaffinity(0, sizeof(cpu_set_t), &cpu);
+        thread_sockets[thread_id] = cpu_sockets[thread_id % no_cpus];
+    }
+
+    /* only count the sockets which got threads */
+    no_sockets = 1;
+    for (i = 0; i < no_threads; i++) {
+        if (thread_sockets[i] + 1 > no_sockets) no_sockets = thread_sockets[i] + 1;
+    }
+
+    no_pinned_threads = no_threads;
+
+    free(cpus);
+    free(cpu_sockets);
+    free(socket_ids);
+    return no_pinned_threads;
+#else
+    return 0;
+#endif
+}
+
+uint32_t get_no_sockets(void) {
+    return no_sockets;
+}
+
+uint32_t get_thread_socket(uint32_t thread_id) {
+    if (thread_id >= no_pinned_threads) return 0;
+    return thread_sockets[thread_id];
+}
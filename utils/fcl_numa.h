@@ -0,0 +1,63 @@
+#ifndef FCL_NUMA_H
+#define FCL_NUMA_H
+
+#include <stddef.h>
+#include "types.h"
+
+/**
+ * @brief Allocate a zeroed array of count elements. The array is split like the
+ *        iterations of a "#pragma omp parallel for schedule(static)" loop over
+ *        its elements and every thread zeroes its own part.
+ *
+ * With the first touch policy of the kernel, the pages of every part are placed
+ * on the NUMA node of the thread that processes this part of the samples in
+ * static loops (instead of all pages ending up on the node of the main thread).
+ *
+ * @param[in] count Number of elements.
+ * @param[in] size Size of one element in bytes.
+ * @return The zeroed array (free it with free).
+ */
+void* calloc_first_touch(uint64_t count, size_t size);
+
+/**
+ * @brief Like calloc_first_touch, but split into given ranges of elements: range
+ *        r = [range_starts[r], range_starts[r + 1]) is zeroed by the thread which
+ *        gets iteration r of a "#pragma omp parallel for schedule(static, 1)" loop.
+ *
+ * @param[in] count Number of elements.
+ * @param[in] size Size of one element in bytes.
+ * @param[in] range_starts Array of no_ranges + 1 ascending element positions
+ *                         (range_starts[no_ranges] = count).
+ * @param[in] no_ranges Number of ranges.
+ * @return The zeroed array (free it with free).
+ */
+void* calloc_first_touch_ranges(uint64_t count, size_t size, uint64_t* range_starts, uint64_t no_ranges);
+
+/**
+ * @brief Pin every OpenMP thread to one cpu: thread i runs on the i-th cpu the
+ *        process is allowed to run on. Threads keep their cpu (and their memory
+ *        stays local) over all parallel regions.
+ *
+ * Only supported on linux with OpenMP, does nothing otherwise.
+ *
+ * @return Number of pinned threads (0 if pinning is not supported).
+ */
+uint32_t pin_threads(void);
+
+/**
+ * @brief Number of different sockets the threads were pinned to (1 if the
+ *        threads were not pinned).
+ *
+ * @return Number of sockets.
+ */
+uint32_t get_no_sockets(void);
+
+/**
+ * @brief Socket of a pinned thread.
+ *
+ * @param[in] thread_id OpenMP thread number.
+ * @return Socket index in [0, get_no_sockets()) (0 if the threads were not pinned).
+ */
+uint32_t get_thread_socket(uint32_t thread_id);
+
+#endif /* FCL_NUMA_H */
@@ -13,10 +13,11 @@ typedef int omp_lock_t;
 #define omp_set_num_threads(x)
 #define omp_get_max_threads() 1
 #define omp_get_thread_num() 0
+#define omp_get_num_threads() 1
 #endif
 
 #ifndef EXTENSION
-#define check_signals(X)
+#define check_signals(X) ((void) 0)
 #else
 extern void check_signals(uint32_t* stop);
 #endif
@@ -8,11 +8,20 @@
 struct assign_result assign(struct csr_matrix* samples
                            , struct csr_matrix* clusters
                            , uint32_t* stop) {
+    return assign_weighted(samples, clusters, NULL, stop);
+}
+
+struct assign_result assign_weighted(struct csr_matrix* samples
+                                    , struct csr_matrix* clusters
+                                    , VALUE_TYPE* sample_weights
+                                    , uint32_t* stop) {
 
     struct assign_result res;
-    uint64_t sample_id;
+    uint64_t sample_id, cluster_id, j, dense_dim;
+    ACCUMULATOR_TYPE wcssd;
 
     VALUE_TYPE *vector_lengths_clusters;    /* ||c|| for every c in clusters */
+    VALUE_TYPE *dense_clusters;             /* clusters as dense row-major block (or NULL) */
 
     /* calculate ||c|| for every c in clusters */
     calculate_matrix_vector_lengths(clusters, &vector_lengths_clusters);
@@ -20,12 +29,29 @@ struct assign_result assign(struct csr_matrix* samples
     res.assignments = (uint64_t*) calloc(samples->sample_count, sizeof(uint64_t));
     res.distances = (VALUE_TYPE*) calloc(samples->sample_count, sizeof(VALUE_TYPE));
     res.counts = (uint64_t*) calloc(clusters->sample_count, sizeof(uint64_t));
+    res.weights = (ACCUMULATOR_TYPE*) calloc(clusters->sample_count, sizeof(ACCUMULATOR_TYPE));
     res.len_counts = clusters->sample_count;
     res.len_assignments = samples->sample_count;
 
-    #pragma omp parallel for
+    /* samples may have keys which are not present in any cluster */
+    dense_dim = (samples->dim > clusters->dim) ? samples->dim : clusters->dim;
+    dense_clusters = NULL;
+    if (dense_vectors_recommended(samples, clusters->sample_count)) {
+        dense_clusters = (VALUE_TYPE*) calloc(clusters->sample_count * dense_dim, sizeof(VALUE_TYPE));
+        for (cluster_id = 0; cluster_id < clusters->sample_count; cluster_id++) {
+            for (j = clusters->pointers[cluster_id]; j < clusters->pointers[cluster_id + 1]; j++) {
+                dense_clusters[cluster_id * dense_dim + clusters->keys[j]] = clusters->values[j];
+            }
+        }
+    }
+
+    wcssd = 0;
+    #pragma omp parallel for reduction(+:wcssd)
     for (sample_id = 0; sample_id < samples->sample_count; sample_id++) {
+        VALUE_TYPE weight;
+
         res.distances[sample_id] = VALUE_TYPE_MAX;
+        weight = (sample_weights == NULL) ? 1 : sample_weights[sample_id];
 
         if (omp_get_thread_num() == 0) {
             check_signals(stop);
@@ -33,27 +59,75 @@ struct assign_result assign(struct csr_matrix* samples
 
         if (!(*stop)) {
             /* assign every sample to its closest cluster center */
-            /* assign samples to cluster centers with given vector lengths */
-            assign_vector(samples->keys + samples->pointers[sample_id]
-                         , samples->values + samples->pointers[sample_id]
-                         , samples->pointers[sample_id + 1] - samples->pointers[sample_id]
-                         , clusters
-                         , vector_lengths_clusters
-                         , res.assignments + sample_id
-                         , res.distances + sample_id);
+            if (dense_clusters) {
+                assign_vector_dense(samples->keys + samples->pointers[sample_id]
+                                   , samples->values + samples->pointers[sample_id]
+                                   , samples->pointers[sample_id + 1] - samples->pointers[sample_id]
+                                   , dense_clusters
+                                   , clusters->sample_count
+                                   , dense_dim
+                                   , vector_lengths_clusters
+                                   , res.assignments + sample_id
+                                   , res.distances + sample_id);
+            } else {
+                /* assign samples to cluster centers with given vector lengths */
+                assign_vector(samples->keys + samples->pointers[sample_id]
+                             , samples->values + samples->pointers[sample_id]
+                             , samples->pointers[sample_id + 1] - samples->pointers[sample_id]
+                             , clusters
+                             , vector_lengths_clusters
+                             , res.assignments + sample_id
+                             , res.distances + sample_id);
+            }
 
             /* increment the count of the closest cluster */
             #pragma omp critical
             {
                 res.counts[res.assignments[sample_id]] += 1;
+                res.weights[res.assignments[sample_id]] += weight;
             }
+            wcssd += weight * res.distances[sample_id];
         }
     }
+    res.wcssd = wcssd;
 
+    free_null(dense_clusters);
     free_null(vector_lengths_clusters);
     return res;
 }
 
+void assign_vector_dense(KEY_TYPE *input_keys
+                         , VALUE_TYPE *input_values
+                         , uint64_t input_non_zero_count_vector
+                         , VALUE_TYPE *dense_clusters
+                         , uint64_t no_clusters
+                         , uint64_t dim
+                         , VALUE_TYPE *vector_lengths_clusters
+                         , uint64_t* closest_cluster
+                         , VALUE_TYPE* closest_cluster_distance) {
+
+    uint64_t cluster_id;
+    VALUE_TYPE input_vector_length;
+    input_vector_length = calculate_squared_vector_length(input_values
+                                                        , input_non_zero_count_vector);
+
+    *closest_cluster_distance = VALUE_TYPE_MAX;
+
+    for (cluster_id = 0; cluster_id < no_clusters; cluster_id++) {
+        VALUE_TYPE dist;
+
+        dist = euclid_vector_sparse_dense(input_keys, input_values, input_non_zero_count_vector
+                                          , dense_clusters + cluster_id * dim
+                                          , input_vector_length
+                                          , vector_lengths_clusters[cluster_id]);
+
+        if (dist < *closest_cluster_distance) {
+            *closest_cluster = cluster_id;
+            *closest_cluster_distance = dist;
+        }
+    }
+}
+
 void assign_vector(KEY_TYPE *input_keys
                    , VALUE_TYPE *input_values
                    , uint64_t input_non_zero_count_vector
@@ -67,7 +141,7 @@ void assign_vector(KEY_TYPE *input_keys
     input_vector_length = calculate_squared_vector_length(input_values
                                                         , input_non_zero_count_vector);
 
-    *closest_cluster_distance = DBL_MAX;
+    *closest_cluster_distance = VALUE_TYPE_MAX;
 
     for (cluster_id = 0; cluster_id < clusters->sample_count; cluster_id++) {
         VALUE_TYPE dist;
@@ -90,6 +164,7 @@ void free_assign_result(struct assign_result* res) {
     free_null(res->assignments);
     free_null(res->distances);
     free_null(res->counts);
+    free_null(res->weights);
 }
 
 uint32_t store_assign_result(struct assign_result *res, char* output_path) {
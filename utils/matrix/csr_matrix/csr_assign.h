@@ -8,10 +8,12 @@
  */
 struct assign_result {
     uint64_t *counts;               /**< number of samples assigned to each cluster */
+    ACCUMULATOR_TYPE *weights;      /**< sum of the weights of the samples assigned to each cluster */
     uint64_t *assignments;          /**< The closest cluster id for every s in samples */
     VALUE_TYPE *distances;          /**< Distance to the closest cluster id for every s in samples */
     uint64_t len_counts;            /**< Length of the counts array */
     uint64_t len_assignments;       /**< Length of the assignments & distances array */
+    ACCUMULATOR_TYPE wcssd;         /**< Sum of the weighted distances of all samples to their closest cluster */
 };
 
 /**
@@ -28,6 +30,21 @@ struct assign_result assign(struct csr_matrix* samples
                            , struct csr_matrix* clusters
                            , uint32_t* stop);
 
+/**
+ * @brief Like assign but every sample has a weight. The weights are used for
+ *        the cluster weights and the wcssd of the result.
+ *
+ * @param[in] samples
+ * @param[in] clusters
+ * @param[in] sample_weights Weight of every sample (NULL = every sample has weight 1).
+ * @param[in] stop If the pointer behind this variable gets set, assign will stop immediately.
+ * @return The assignment result.
+ */
+struct assign_result assign_weighted(struct csr_matrix* samples
+                                    , struct csr_matrix* clusters
+                                    , VALUE_TYPE* sample_weights
+                                    , uint32_t* stop);
+
 /**
  * @brief Support function to cleanup the assignment result data structure.
  *
@@ -55,6 +72,29 @@ void assign_vector(KEY_TYPE *input_keys
                    , uint64_t* closest_cluster
                    , VALUE_TYPE* closest_cluster_distance);
 
+/**
+ * @brief Like assign_vector but the clusters are given as a dense row-major block.
+ *
+ * @param[in] input_keys of the sparse vectors
+ * @param[in] input_values corresponding to the keys
+ * @param[in] input_non_zero_count_vector
+ * @param[in] dense_clusters no_clusters x dim block of cluster centers
+ * @param[in] no_clusters number of rows in dense_clusters
+ * @param[in] dim number of columns in dense_clusters (must be > max(input_keys))
+ * @param[in] vector_lengths_clusters contains ||c||² for every c in clusters
+ * @param[out] closest_cluster is the output id of closest cluster to the input vector
+ * @param[out] closest_cluster_distance the distance to the closest cluster
+ */
+void assign_vector_dense(KEY_TYPE *input_keys
+                         , VALUE_TYPE *input_values
+                         , uint64_t input_non_zero_count_vector
+                         , VALUE_TYPE *dense_clusters
+                         , uint64_t no_clusters
+                         , uint64_t dim
+                         , VALUE_TYPE *vector_lengths_clusters
+                         , uint64_t* closest_cluster
+                         , VALUE_TYPE* closest_cluster_distance);
+
 /**
  * Write the assign result to a csv file.
  *
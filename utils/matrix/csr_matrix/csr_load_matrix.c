@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
 #include "csr_load_matrix.h"
 #include "../../fcl_file.h"
 #include "../../fcl_logging.h"
@@ -5,75 +7,528 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-/**
- * @brief Read line from input.
- *
- * @param[in] input
- * @param[out] line
- * @param[out] max_line_len
- * @return
+uint32_t is_binary_csr_matrix_file(const char *filename) {
+    FILE *fp;
+    char magic[8];
+    uint32_t is_binary;
+
+    fp = fopen(filename, "rb");
+    if (fp == NULL) return 0;
+
+    is_binary = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+                && memcmp(magic, CSR_BINARY_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return is_binary;
+}
+
+/*
+ * Check that an array of a binary csr matrix file lies within the file.
+ */
+static uint32_t binary_array_valid(uint64_t offset, uint64_t no_elements
+                                   , uint64_t element_size, uint64_t file_size) {
+    return offset % CSR_BINARY_ALIGNMENT == 0
+           && offset <= file_size
+           && no_elements <= (file_size - offset) / element_size;
+}
+
+/*
+ * Check the structure of a binary csr matrix file: pointers start at 0, never
+ * decrease and end at nnz and every key is smaller than dim. Returns 0 if valid.
  */
-char* readline(FILE *input, char** line, size_t* max_line_len);
+static uint32_t binary_structure_invalid(struct csr_binary_header *header, char *mapping) {
+    POINTER_TYPE *pointers;
+    KEY_TYPE *keys;
+    uint64_t i, j;
+    uint32_t pointers_invalid, keys_invalid;
+
+    pointers = (POINTER_TYPE*) (mapping + header->offset_pointers);
+    keys = (KEY_TYPE*) (mapping + header->offset_keys);
+
+    if (pointers[0] != 0 || pointers[header->sample_count] != header->nnz) return 1;
+
+    pointers_invalid = 0;
+    #pragma omp parallel for schedule(static) reduction(|:pointers_invalid)
+    for (i = 0; i < header->sample_count; i++) {
+        pointers_invalid |= pointers[i] > pointers[i + 1];
+    }
+    if (pointers_invalid) return 1;
+
+    keys_invalid = 0;
+    #pragma omp parallel for schedule(static) reduction(|:keys_invalid) private(j)
+    for (i = 0; i < header->sample_count; i++) {
+        for (j = pointers[i]; j < pointers[i + 1]; j++) {
+            keys_invalid |= keys[j] >= header->dim;
+        }
+    }
+    return keys_invalid ? 2 : 0;
+}
+
+uint32_t load_binary_csr_matrix(const char *filename, struct csr_matrix **mtrx, int32_t** labels) {
+    int fd;
+    struct stat file_stat;
+    struct csr_binary_header header;
+    char* mapping;
+    uint64_t i, file_size;
+    float* float_values;
+    double* double_values;
+
+    *mtrx = NULL;
+    *labels = NULL;
+    mapping = MAP_FAILED;
+    file_size = 0;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1 || fstat(fd, &file_stat) != 0) {
+        LOG_ERROR("can't open input file %s", filename);
+        goto error;
+    }
+
+    file_size = (uint64_t) file_stat.st_size;
+    if (file_size < sizeof(struct csr_binary_header)) {
+        LOG_ERROR("invalid binary csr matrix file %s: file too short", filename);
+        goto error;
+    }
+
+    /* private mapping: writes to the matrix never change the file */
+    mapping = (char*) mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("can't map input file %s into memory (errno=%d)", filename, errno);
+        goto error;
+    }
+    close(fd);
+    fd = -1;
+
+    memcpy(&header, mapping, sizeof(struct csr_binary_header));
+
+    if (memcmp(header.magic, CSR_BINARY_MAGIC, sizeof(header.magic)) != 0
+        || header.byte_order != CSR_BINARY_BYTE_ORDER) {
+        LOG_ERROR("invalid binary csr matrix file %s: wrong magic or byte order", filename);
+        goto error;
+    }
+
+    if (header.version != CSR_BINARY_VERSION) {
+        LOG_ERROR("binary csr matrix file %s has unsupported version %u", filename, header.version);
+        goto error;
+    }
+
+    if (header.pointer_size != sizeof(POINTER_TYPE)
+        || header.key_size != sizeof(KEY_TYPE)
+        || (header.value_size != sizeof(float) && header.value_size != sizeof(double))) {
+        LOG_ERROR("binary csr matrix file %s was written with incompatible types", filename);
+        goto error;
+    }
+
+    if (!binary_array_valid(header.offset_pointers, header.sample_count + 1, header.pointer_size, file_size)
+        || !binary_array_valid(header.offset_keys, header.nnz, header.key_size, file_size)
+        || !binary_array_valid(header.offset_values, header.nnz, header.value_size, file_size)
+        || (header.has_labels
+            && !binary_array_valid(header.offset_labels, header.sample_count, sizeof(int32_t), file_size))) {
+        LOG_ERROR("invalid binary csr matrix file %s: file truncated", filename);
+        goto error;
+    }
+
+    switch (binary_structure_invalid(&header, mapping)) {
+        case 1:
+            LOG_ERROR("invalid binary csr matrix file %s: pointers do not describe %" PRINTF_INT64_MODIFIER "u non zero values"
+                      , filename, header.nnz);
+            goto error;
+        case 2:
+            LOG_ERROR("invalid binary csr matrix file %s: key out of range (dim = %" PRINTF_INT64_MODIFIER "u)"
+                      , filename, header.dim);
+            goto error;
+    }
+
+    *mtrx = (struct csr_matrix*) malloc(sizeof(struct csr_matrix));
+    (*mtrx)->sample_count = header.sample_count;
+    (*mtrx)->dim = header.dim;
+    (*mtrx)->pointers = (POINTER_TYPE*) (mapping + header.offset_pointers);
+    (*mtrx)->keys = (KEY_TYPE*) (mapping + header.offset_keys);
+
+    if (header.value_size == sizeof(VALUE_TYPE)) {
+        (*mtrx)->values = (VALUE_TYPE*) (mapping + header.offset_values);
+    } else {
+        /* file was written by a build with a different VALUE_TYPE */
+        (*mtrx)->values = (VALUE_TYPE*) malloc(header.nnz * sizeof(VALUE_TYPE));
+        float_values = (float*) (mapping + header.offset_values);
+        double_values = (double*) (mapping + header.offset_values);
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < header.nnz; i++) {
+            (*mtrx)->values[i] = (header.value_size == sizeof(float))
+                                 ? (VALUE_TYPE) float_values[i]
+                                 : (VALUE_TYPE) double_values[i];
+        }
+    }
+
+    register_mapped_csr_matrix(*mtrx, mapping, file_size);
+
+    *labels = (int32_t*) calloc(header.sample_count, sizeof(int32_t));
+    if (header.has_labels) {
+        memcpy(*labels, mapping + header.offset_labels, header.sample_count * sizeof(int32_t));
+    }
+
+    return 0;
+
+error:
+    if (fd != -1) close(fd);
+    if (mapping != MAP_FAILED) munmap(mapping, file_size);
+    return 1;
+}
+
+/* size of the input in bytes which is parsed as one chunk */
+#define LIBSVM_CHUNK_BYTES (UINT64_C(1) << 20)
+
+/* max length of a value which can not be parsed by parse_libsvm_value directly */
+#define LIBSVM_MAX_VALUE_LENGTH 128
+
+#define LIBSVM_ERROR_NONE UINT32_C(0)
+#define LIBSVM_ERROR_LABEL_MISSING UINT32_C(1)
+#define LIBSVM_ERROR_LABEL_INVALID UINT32_C(2)
+#define LIBSVM_ERROR_KEY_INVALID UINT32_C(3)
+#define LIBSVM_ERROR_VALUE_INVALID UINT32_C(4)
 
 /**
- * @brief Read line from input.
- *
- * @param[in] input_str String which shall be read line by line
- * @param[in/out] offset Starting position of the next line
- * @param[out] line Buffer which contains the read string.
- * @param[in/out] max_line_len Maximum number of bytes line can hold.
- * @return
+ * @brief Part of a libsvm input which consists of complete lines.
  */
-size_t readline_string(const char* input_str, uint64_t *offset, char** line, size_t* max_line_len);
+struct libsvm_chunk {
+    const char *begin;            /**< First character of the chunk */
+    const char *end;              /**< Character after the last character of the chunk */
+    uint64_t no_samples;          /**< Number of lines in this chunk */
+    uint64_t nnz;                 /**< Number of non zero values (tokens after the labels) in this chunk */
+    uint64_t sample_offset;       /**< Number of samples in all previous chunks */
+    uint64_t nnz_offset;          /**< Position of the first key of this chunk in the matrix */
+    uint64_t dim;                 /**< max(key) + 1 of all keys in this chunk */
+    uint32_t error;               /**< One of LIBSVM_ERROR_* for the first error in this chunk */
+    uint64_t error_line;          /**< Line number of the error within this chunk (starting at 0) */
+    const char *error_position;   /**< Position of the error */
+    const char *error_line_end;   /**< End of the line which contains the error */
+};
+
+/* 10^i for i in [0, 22] are exactly representable as double */
+static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+                                      , 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19
+                                      , 1e20, 1e21, 1e22};
+
+static uint32_t is_libsvm_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
 
-char* readline(FILE *input, char** line, size_t* max_line_len) {
-    size_t len;
+static uint32_t is_libsvm_digit(char c) {
+    return c >= '0' && c <= '9';
+}
 
-    if(fgets(*line, *max_line_len, input) == NULL)
-        return NULL;
+/*
+ * Parse a floating point number which ends at whitespace or at end.
+ * Numbers with at most 19 significant digits and a decimal exponent within
+ * [-22, 22] are converted exactly (one rounding of an exact mantissa by an exact
+ * power of ten). Everything else is handed to strtod.
+ * Returns 0 on success.
+ */
+static uint32_t parse_libsvm_value(const char **position, const char *end, VALUE_TYPE *value) {
+    const char *p;
+    uint64_t mantissa;
+    int64_t exponent, explicit_exponent;
+    uint32_t negative, digits, exact, explicit_exponent_negative, exponent_digits;
+    double result;
+    char buffer[LIBSVM_MAX_VALUE_LENGTH + 1];
+    char *endptr;
+    uint64_t length;
+
+    p = *position;
+    negative = 0;
+    mantissa = 0;
+    exponent = 0;
+    digits = 0;
+    exact = 1;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
 
-    while(strrchr(*line, '\n') == NULL)
-    {
-        *max_line_len *= 2;
-        *line = (char *) realloc(*line,*max_line_len);
-        len = (int) strlen(*line);
-        if(fgets(*line + len,*max_line_len - len,input) == NULL)
-            break;
+    for (; p < end && is_libsvm_digit(*p); p++) {
+        if (mantissa < UINT64_C(1000000000000000000)) {
+            mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+        } else {
+            exponent++;
+            exact = 0;
+        }
+        digits++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && is_libsvm_digit(*p); p++) {
+            if (mantissa < UINT64_C(1000000000000000000)) {
+                mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                exponent--;
+            } else {
+                exact = 0;
+            }
+            digits++;
+        }
+    }
+
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        explicit_exponent = 0;
+        explicit_exponent_negative = 0;
+        exponent_digits = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            explicit_exponent_negative = (*p == '-');
+            p++;
+        }
+        for (; p < end && is_libsvm_digit(*p); p++) {
+            if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*p - '0');
+            exponent_digits++;
+        }
+        if (exponent_digits == 0) exact = 0;
+        exponent += explicit_exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (digits > 0 && exact
+        && (p == end || is_libsvm_space(*p))
+        && mantissa <= (UINT64_C(1) << 53)
+        && exponent >= -22 && exponent <= 22) {
+
+        result = (double) mantissa;
+        if (exponent < 0) {
+            result /= POWERS_OF_TEN[-exponent];
+        } else {
+            result *= POWERS_OF_TEN[exponent];
+        }
+        *value = (VALUE_TYPE) (negative ? -result : result);
+        *position = p;
+        return 0;
+    }
+
+    /* slow path: the value token is terminated and converted with strtod */
+    p = *position;
+    for (length = 0; p + length < end && !is_libsvm_space(p[length]); length++) {
+        if (length == LIBSVM_MAX_VALUE_LENGTH) return 1;
+    }
+    memcpy(buffer, p, length);
+    buffer[length] = '\0';
+
+    errno = 0;
+    result = strtod(buffer, &endptr);
+    if (endptr == buffer || errno != 0 || *endptr != '\0') return 1;
+
+    *value = (VALUE_TYPE) result;
+    *position = p + length;
+    return 0;
+}
+
+/*
+ * Parse a non negative integer which consists of at most max_digits digits
+ * without leading zeros. Returns 0 on success.
+ */
+static uint32_t parse_libsvm_integer(const char **position, const char *end
+                                     , uint32_t max_digits, uint64_t *value) {
+    const char *p;
+    uint32_t digits;
+
+    p = *position;
+    *value = 0;
+    for (digits = 0; p < end && is_libsvm_digit(*p); p++) {
+        *value = *value * 10 + (uint64_t) (*p - '0');
+        if (*value != 0) digits++;
+        if (digits > max_digits) return 1;
+    }
+    if (p == *position) return 1;
+
+    *position = p;
+    return 0;
+}
+
+static void set_libsvm_chunk_error(struct libsvm_chunk *chunk, uint32_t error, uint64_t line
+                                   , const char *position, const char *line_end) {
+    chunk->error = error;
+    chunk->error_line = line;
+    chunk->error_position = position;
+    chunk->error_line_end = line_end;
+}
+
+/*
+ * First pass over a chunk: count lines and non zero values (every ':' in the
+ * chunk). Trailing tokens without ':' are ignored by the parser, so this count
+ * is exact for every line which parses without error.
+ */
+static void count_libsvm_chunk(struct libsvm_chunk *chunk) {
+    const char *p;
+
+    chunk->no_samples = 0;
+    chunk->nnz = 0;
+
+    for (p = chunk->begin; p < chunk->end; p++) {
+        if (*p == '\n') {
+            chunk->no_samples++;
+        } else if (*p == ':') {
+            chunk->nnz++;
+        }
+    }
+
+    /* last line without line feed */
+    if (chunk->begin < chunk->end && *(chunk->end - 1) != '\n') {
+        chunk->no_samples++;
     }
-    return *line;
 }
 
-size_t readline_string(const char* input_str, uint64_t *offset, char** line, size_t* max_line_len) {
-    size_t len;
-    uint32_t line_feed_found;
-    len = 0;
-    line_feed_found = 0;
+/*
+ * Second pass over a chunk: parse all lines into the matrix starting at
+ * chunk->sample_offset / chunk->nnz_offset. Stops at the first error.
+ */
+static void parse_libsvm_chunk(struct libsvm_chunk *chunk, struct csr_matrix *mtrx, int32_t *labels) {
+    const char *p, *line_end;
+    uint64_t line, key_id, key, label;
+    int64_t inst_max_index;
+    uint32_t negative_label;
+    VALUE_TYPE value;
 
-    while (1) {
-        while (len < *max_line_len) {
-            if ((input_str[*offset + len] == '\0')
-                || (input_str[*offset + len] == '\n')) {
+    chunk->dim = 0;
+    chunk->error = LIBSVM_ERROR_NONE;
+    key_id = chunk->nnz_offset;
+    p = chunk->begin;
 
-                (*line)[len] = '\0';
+    for (line = 0; line < chunk->no_samples; line++) {
+        line_end = memchr(p, '\n', chunk->end - p);
+        if (line_end == NULL) line_end = chunk->end;
+
+        inst_max_index = -1;
+        while (p < line_end && is_libsvm_space(*p)) p++;
+        if (p == line_end) {
+            set_libsvm_chunk_error(chunk, LIBSVM_ERROR_LABEL_MISSING, line, p, line_end);
+            return;
+        }
+
+        /* labels beyond the int32 range are rejected instead of wrapping around */
+        negative_label = 0;
+        if (*p == '-' || *p == '+') {
+            negative_label = (*p == '-');
+            p++;
+        }
+        if (parse_libsvm_integer(&p, line_end, 10, &label) != 0
+            || label > INT32_MAX || (p < line_end && !is_libsvm_space(*p))) {
+            set_libsvm_chunk_error(chunk, LIBSVM_ERROR_LABEL_INVALID, line, p, line_end);
+            return;
+        }
+        labels[chunk->sample_offset + line] = negative_label ? -((int32_t) label) : (int32_t) label;
+
+        while (1) {
+            while (p < line_end && is_libsvm_space(*p)) p++;
+            if (p == line_end) break;
+
+            /* like the former strtok loop, the rest of a line without any
+             * further ':' (e.g. a trailing comment) is ignored.
+             */
+            if (memchr(p, ':', line_end - p) == NULL) break;
+
+            /* key 0 and keys beyond the KEY_TYPE range are rejected instead of wrapping around */
+            if (parse_libsvm_integer(&p, line_end, 10, &key) != 0
+                || key == 0 || key - 1 > KEY_TYPE_MAX
+                || p == line_end || *p != ':'
+                || (int64_t) (key - 1) <= inst_max_index) {
+                set_libsvm_chunk_error(chunk, LIBSVM_ERROR_KEY_INVALID, line, p, line_end);
+                return;
+            }
+            p++;
 
-                if (input_str[*offset + len] == '\n') line_feed_found = 1;
-                goto readline_end;
+            if (parse_libsvm_value(&p, line_end, &value) != 0) {
+                set_libsvm_chunk_error(chunk, LIBSVM_ERROR_VALUE_INVALID, line, p, line_end);
+                return;
             }
-            (*line)[len] = input_str[*offset + len];
-            len += 1;
+
+            inst_max_index = (int64_t) (key - 1);
+            mtrx->keys[key_id] = (KEY_TYPE) (key - 1);
+            mtrx->values[key_id] = value;
+            if (key > chunk->dim) chunk->dim = key;
+            key_id++;
         }
 
-        *max_line_len *= 2;
-        *line = (char *) realloc(*line,*max_line_len);
+        mtrx->pointers[chunk->sample_offset + line + 1] = key_id;
+        p = line_end + 1;
+    }
+}
+
+/*
+ * Split the input into chunks of complete lines with about LIBSVM_CHUNK_BYTES each.
+ * Returns the number of chunks (at least one).
+ */
+static uint64_t split_libsvm_input(const char *input, uint64_t input_size, struct libsvm_chunk **chunks) {
+    uint64_t i, no_chunks, gap_begin, gap_end;
+
+    no_chunks = (input_size + LIBSVM_CHUNK_BYTES - 1) / LIBSVM_CHUNK_BYTES;
+    if (no_chunks == 0) no_chunks = 1;
+    *chunks = (struct libsvm_chunk*) calloc(no_chunks, sizeof(struct libsvm_chunk));
+
+    gap_begin = 0;
+    for (i = 0; i < no_chunks; i++) {
+        gap_end = (i + 1 == no_chunks) ? input_size : (i + 1) * LIBSVM_CHUNK_BYTES;
+        if (gap_end < gap_begin) gap_end = gap_begin;
+        while (gap_end < input_size && input[gap_end - 1] != '\n') gap_end++;
+        (*chunks)[i].begin = input + gap_begin;
+        (*chunks)[i].end = input + gap_end;
+        gap_begin = gap_end;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (i = 0; i < no_chunks; i++) {
+        count_libsvm_chunk(*chunks + i);
+    }
+
+    return no_chunks;
+}
+
+static void log_libsvm_chunk_error(struct libsvm_chunk *failed_chunk) {
+    switch (failed_chunk->error) {
+        case LIBSVM_ERROR_LABEL_MISSING:
+            LOG_ERROR("invalid libsvm data. label missing in line %" PRINTF_INT64_MODIFIER "u"
+                      , failed_chunk->sample_offset + failed_chunk->error_line + 1);
+            break;
+        case LIBSVM_ERROR_LABEL_INVALID:
+            LOG_ERROR("invalid libsvm data. invalid label in line %" PRINTF_INT64_MODIFIER "u"
+                      , failed_chunk->sample_offset + failed_chunk->error_line + 1);
+            break;
+        case LIBSVM_ERROR_KEY_INVALID:
+            LOG_ERROR("invalid libsvm data. keys invalid or not sorted in line %" PRINTF_INT64_MODIFIER "u"
+                      , failed_chunk->sample_offset + failed_chunk->error_line + 1);
+            break;
+        default:
+            LOG_ERROR("invalid libsvm data. error while reading values! line: %" PRINTF_INT64_MODIFIER "u\n %.*s"
+                      , failed_chunk->sample_offset + failed_chunk->error_line + 1
+                      , (int) (failed_chunk->error_line_end - failed_chunk->error_position)
+                      , failed_chunk->error_position);
+            break;
     }
+}
+
+/*
+ * Map a libsvm file read-only into memory. Empty files result in *mapping == MAP_FAILED.
+ */
+static uint32_t map_libsvm_file(const char *filename, int *fd, char **mapping, uint64_t *input_size) {
+    struct stat file_stat;
+
+    *mapping = MAP_FAILED;
+    *input_size = 0;
 
-readline_end:
-    *offset += len;
-    /* continue after the linefeed when calling again */
-    if (line_feed_found) (*offset)++;
-    return len;
+    *fd = open(filename, O_RDONLY);
+    if (*fd == -1 || fstat(*fd, &file_stat) != 0) {
+        LOG_ERROR("can't open input file %s", filename);
+        return 1;
+    }
+    *input_size = (uint64_t) file_stat.st_size;
+    if (*input_size > 0) {
+        *mapping = (char*) mmap(NULL, *input_size, PROT_READ, MAP_PRIVATE, *fd, 0);
+        if (*mapping == MAP_FAILED) {
+            LOG_ERROR("can't map input file %s into memory (errno=%d)", filename, errno);
+            return 1;
+        }
+    }
+    return 0;
 }
 
 uint32_t convert_libsvm_file_to_csr_matrix_wo_labels(const char *input_string, struct csr_matrix **mtrx) {
@@ -87,160 +542,285 @@ uint32_t convert_libsvm_file_to_csr_matrix_wo_labels(const char *input_string, s
 }
 
 uint32_t convert_libsvm_file_to_csr_matrix(const char *input_string, struct csr_matrix **mtrx, int32_t** labels) {
-    uint64_t nnz, i, no_samples;
-    KEY_TYPE key_id;
-    int64_t inst_max_index;
-    FILE *fp;
-    char *endptr;
-    char *idx, *val, *label;
-    char *line = NULL;
-    size_t max_line_len;
+    uint64_t i, no_chunks, no_samples, nnz, input_size;
+    int fd;
+    const char *input;
+    char *mapping;
+    struct libsvm_chunk *chunks, *failed_chunk;
     uint32_t status;
     uint32_t is_file;
-    uint64_t offset;
 
     *labels = NULL;
     *mtrx = NULL;
-    fp = NULL;
+    chunks = NULL;
+    mapping = MAP_FAILED;
+    fd = -1;
+    input_size = 0;
 
     status = 0;
-    offset = 0;
     is_file = exists(input_string);
 
-    if (is_file) {
+    if (is_file && is_binary_csr_matrix_file(input_string)) {
+        return load_binary_csr_matrix(input_string, mtrx, labels);
+    }
 
-        fp = fopen(input_string,"r");
-        if(fp == NULL) {
-            LOG_ERROR("can't open input file %s",input_string);
+    if (is_file) {
+        if (map_libsvm_file(input_string, &fd, &mapping, &input_size)) {
             status = 1;
             goto error;
         }
+        input = mapping;
+    } else {
+        input = input_string;
+        input_size = strlen(input_string);
     }
 
+    no_chunks = split_libsvm_input(input, input_size, &chunks);
+
     no_samples = 0;
     nnz = 0;
-
-    max_line_len = 1024;
-    line = (char*) malloc(sizeof(char) * max_line_len);
-    while(1){
-        char *p;
-        if (is_file) {
-            if (readline(fp, &line, &max_line_len) == NULL) break;
-        } else {
-            /* check if end of string reached */
-            if (input_string[offset] == '\0') break;
-            readline_string(input_string, &offset, &line, &max_line_len);
-        }
-
-        p = strtok(line," \t");
-
-        while(1) {
-            p = strtok(NULL," \t");
-            if(p == NULL || *p == '\n')
-                break;
-            ++nnz;
-        }
-        ++no_samples;
-    }
-
-    if (is_file) {
-        /* rewind to the beginning of the file */
-        rewind(fp);
-    } else {
-        /* set offset to the beginning of the string */
-        offset = 0;
+    for (i = 0; i < no_chunks; i++) {
+        chunks[i].sample_offset = no_samples;
+        chunks[i].nnz_offset = nnz;
+        no_samples += chunks[i].no_samples;
+        nnz += chunks[i].nnz;
     }
 
     *mtrx = (struct csr_matrix*) malloc(sizeof(struct csr_matrix));
-    (*mtrx)->pointers = NULL;
-    (*mtrx)->values = NULL;
-    (*mtrx)->keys = NULL;
-    (*mtrx)->sample_count = 0;
-    (*mtrx)->dim = 0;
-
     (*mtrx)->keys = (KEY_TYPE *) malloc(nnz * sizeof(KEY_TYPE));
     (*mtrx)->values = (VALUE_TYPE *) malloc(nnz * sizeof(VALUE_TYPE));
     (*mtrx)->sample_count = no_samples;
+    (*mtrx)->dim = 0;
     (*mtrx)->pointers = (POINTER_TYPE *) malloc(((*mtrx)->sample_count + 1) * sizeof(POINTER_TYPE));
     (*mtrx)->pointers[0] = 0;
 
     *labels = (int32_t *) malloc((*mtrx)->sample_count * sizeof(int32_t));
 
-    key_id = 0;
-    for(i=0;i < no_samples;i++) {
-        inst_max_index = -1;
+    /* static: the chunks (and with them the samples) are split into one contiguous
+     * range per thread. every thread first touches the rows it later processes in
+     * static loops, so they get placed on the NUMA node of this thread.
+     */
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < no_chunks; i++) {
+        parse_libsvm_chunk(chunks + i, *mtrx, *labels);
+    }
 
-        if (is_file) {
-            readline(fp, &line, &max_line_len);
-        } else {
-            readline_string(input_string, &offset, &line, &max_line_len);
+    /* report the first error within the input */
+    failed_chunk = NULL;
+    for (i = 0; i < no_chunks; i++) {
+        if (chunks[i].error != LIBSVM_ERROR_NONE) {
+            failed_chunk = chunks + i;
+            break;
         }
+        if (chunks[i].dim > (*mtrx)->dim) (*mtrx)->dim = chunks[i].dim;
+    }
 
-        label = strtok(line," \t\n");
-        if(label == NULL) {
-            LOG_ERROR("invalid libsvm data. label missing in line %ld", i + 1);
-            status = 1;
-            goto error;
+    if (failed_chunk != NULL) {
+        status = 1;
+        log_libsvm_chunk_error(failed_chunk);
+        goto error;
+    }
+
+error:
+    free_null(chunks);
+    if (mapping != MAP_FAILED) munmap(mapping, input_size);
+    if (fd != -1) close(fd);
+    if (status != 0) {
+        /* some error occured */
+        if (*mtrx != NULL) {
+            free_csr_matrix(*mtrx);
+            free_null(*mtrx);
+        }
+        if (*labels != NULL) {
+            free_null(*labels);
         }
+    }
 
-        errno = 0;
-        (*labels)[i] = (int32_t) strtol(label, &endptr, 10);
+    return status;
+}
 
-        /* Check for various possible errors */
-        if (errno != 0 || endptr == label || *endptr != '\0') {
-            LOG_ERROR("invalid libsvm data. invalid label (errno=%d) in line %ld\n", errno, i + 1);
-            status = 1;
-            goto error;
-        }
+/*
+ * Write size bytes of data to fd at offset.
+ */
+static uint32_t write_at_offset(int fd, const void *data, uint64_t size, uint64_t offset) {
+    const char *p;
+    ssize_t written;
+
+    p = (const char*) data;
+    while (size > 0) {
+        written = pwrite(fd, p, size, (off_t) offset);
+        if (written <= 0) return 1;
+        p += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
 
-        while(1) {
-            idx = strtok(NULL,":");
-            val = strtok(NULL," \t");
+uint32_t convert_libsvm_file_to_binary_csr_matrix(const char *input_filename
+                                                  , const char *output_filename) {
+    uint64_t i, no_chunks, no_samples, nnz, input_size, file_size;
+    uint64_t group_begin, group_end, group_size, group_samples, group_nnz;
+    uint64_t max_group_samples, max_group_nnz, dim, page_size, released;
+    int fd, output_fd;
+    char *mapping;
+    struct libsvm_chunk *chunks, *failed_chunk;
+    struct csr_matrix buffer;
+    struct csr_binary_header header;
+    int32_t *buffer_labels;
+    uint32_t status;
 
-            if(val == NULL)
-                break;
+    chunks = NULL;
+    failed_chunk = NULL;
+    buffer_labels = NULL;
+    initialize_csr_matrix_zero(&buffer);
+    output_fd = -1;
+    status = 0;
 
-            errno = 0;
-            (*mtrx)->keys[key_id] = (KEY_TYPE) (strtoul(idx, &endptr, 10) - 1);
-            if(endptr == idx || errno != 0 || *endptr != '\0' || (*mtrx)->keys[key_id] <= inst_max_index){
-                LOG_ERROR("invalid libsvm data. keys invalid or not sorted (errno=%d) in line %ld\n!",errno , i + 1);
-                status = 1;
-                goto error;
-            } else {
-                inst_max_index = (*mtrx)->keys[key_id];
-            }
+    if (map_libsvm_file(input_filename, &fd, &mapping, &input_size)) {
+        status = 1;
+        goto error;
+    }
 
-            if ((*mtrx)->keys[key_id] + 1 > (*mtrx)->dim) {
-                (*mtrx)->dim = (*mtrx)->keys[key_id] + 1;
-            }
+    /* first pass: count samples and nnz of every chunk */
+    no_chunks = split_libsvm_input(mapping, input_size, &chunks);
+
+    no_samples = 0;
+    nnz = 0;
+    for (i = 0; i < no_chunks; i++) {
+        chunks[i].sample_offset = no_samples;
+        chunks[i].nnz_offset = nnz;
+        no_samples += chunks[i].no_samples;
+        nnz += chunks[i].nnz;
+    }
+
+    /* the dimension is only known at the end, the header is rewritten then */
+    file_size = initialize_csr_binary_header(&header, no_samples, 0, nnz, 1);
+
+    output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (output_fd == -1 || ftruncate(output_fd, (off_t) file_size) != 0) {
+        LOG_ERROR("can't create output file %s", output_filename);
+        status = 1;
+        goto error;
+    }
+
+    /* second pass: parse as many chunks in parallel as there are threads. only the
+     * chunks of the current group are held in memory.
+     */
+    group_size = omp_get_max_threads();
+    max_group_samples = 0;
+    max_group_nnz = 0;
+    for (group_begin = 0; group_begin < no_chunks; group_begin += group_size) {
+        group_end = group_begin + group_size < no_chunks ? group_begin + group_size : no_chunks;
+        group_samples = chunks[group_end - 1].sample_offset + chunks[group_end - 1].no_samples
+                        - chunks[group_begin].sample_offset;
+        group_nnz = chunks[group_end - 1].nnz_offset + chunks[group_end - 1].nnz
+                    - chunks[group_begin].nnz_offset;
+        if (group_samples > max_group_samples) max_group_samples = group_samples;
+        if (group_nnz > max_group_nnz) max_group_nnz = group_nnz;
+    }
+
+    buffer.pointers = (POINTER_TYPE*) calloc(max_group_samples + 1, sizeof(POINTER_TYPE));
+    buffer.keys = (KEY_TYPE*) calloc(max_group_nnz + 1, sizeof(KEY_TYPE));
+    buffer.values = (VALUE_TYPE*) calloc(max_group_nnz + 1, sizeof(VALUE_TYPE));
+    buffer_labels = (int32_t*) calloc(max_group_samples + 1, sizeof(int32_t));
+
+    page_size = sysconf(_SC_PAGESIZE);
+    released = 0;
+    dim = 0;
 
-            errno = 0;
-            (*mtrx)->values[key_id] = (VALUE_TYPE) strtod(val,&endptr);
-            if(endptr == val || errno != 0 || (*endptr != '\0' && !isspace((unsigned char) *endptr))){
-                LOG_ERROR("invalid libsvm data. error while reading values! line: %ld\n %s Key:%" KEY_TYPE_PRINTF_MODIFIER "u", i + 1, endptr, key_id);
-                status = 1;
-                goto error;
+    if (write_at_offset(output_fd, buffer.pointers, sizeof(POINTER_TYPE), header.offset_pointers)) {
+        status = 1;
+    }
+
+    for (group_begin = 0; group_begin < no_chunks && status == 0; group_begin += group_size) {
+        group_end = group_begin + group_size < no_chunks ? group_begin + group_size : no_chunks;
+        group_samples = chunks[group_end - 1].sample_offset + chunks[group_end - 1].no_samples
+                        - chunks[group_begin].sample_offset;
+        group_nnz = chunks[group_end - 1].nnz_offset + chunks[group_end - 1].nnz
+                    - chunks[group_begin].nnz_offset;
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (i = group_begin; i < group_end; i++) {
+            struct libsvm_chunk local_chunk;
+
+            /* parse into the buffer relative to the first chunk of the group */
+            local_chunk = chunks[i];
+            local_chunk.sample_offset -= chunks[group_begin].sample_offset;
+            local_chunk.nnz_offset -= chunks[group_begin].nnz_offset;
+            parse_libsvm_chunk(&local_chunk, &buffer, buffer_labels);
+
+            chunks[i].dim = local_chunk.dim;
+            chunks[i].error = local_chunk.error;
+            chunks[i].error_line = local_chunk.error_line;
+            chunks[i].error_position = local_chunk.error_position;
+            chunks[i].error_line_end = local_chunk.error_line_end;
+        }
+
+        for (i = group_begin; i < group_end; i++) {
+            if (chunks[i].error != LIBSVM_ERROR_NONE) {
+                failed_chunk = chunks + i;
+                break;
             }
+            if (chunks[i].dim > dim) dim = chunks[i].dim;
+        }
+        if (failed_chunk != NULL) {
+            log_libsvm_chunk_error(failed_chunk);
+            status = 1;
+            break;
+        }
 
-            ++key_id;
+        for (i = 1; i <= group_samples; i++) {
+            buffer.pointers[i] += chunks[group_begin].nnz_offset;
         }
 
-        (*mtrx)->pointers[i + 1] = key_id;
-    }
+        if (write_at_offset(output_fd, buffer.pointers + 1, group_samples * sizeof(POINTER_TYPE)
+                            , header.offset_pointers
+                              + (chunks[group_begin].sample_offset + 1) * sizeof(POINTER_TYPE))
+            || write_at_offset(output_fd, buffer.keys, group_nnz * sizeof(KEY_TYPE)
+                               , header.offset_keys
+                                 + chunks[group_begin].nnz_offset * sizeof(KEY_TYPE))
+            || write_at_offset(output_fd, buffer.values, group_nnz * sizeof(VALUE_TYPE)
+                               , header.offset_values
+                                 + chunks[group_begin].nnz_offset * sizeof(VALUE_TYPE))
+            || write_at_offset(output_fd, buffer_labels, group_samples * sizeof(int32_t)
+                               , header.offset_labels
+                                 + chunks[group_begin].sample_offset * sizeof(int32_t))) {
+            LOG_ERROR("can't write output file %s", output_filename);
+            status = 1;
+            break;
+        }
 
-error:
-    free_null(line);
-    if (is_file && fp) fclose(fp);
-    if (status != 0) {
-        /* some error occured */
-        if (*mtrx != NULL) {
-            free_csr_matrix(*mtrx);
-            free_null(*mtrx);
+        /* the text of this group is not needed anymore */
+        if (mapping != MAP_FAILED) {
+            i = (chunks[group_end - 1].end - mapping) / page_size * page_size;
+            if (i > released) {
+#ifdef MADV_DONTNEED
+                madvise(mapping + released, i - released, MADV_DONTNEED);
+#endif
+                released = i;
+            }
         }
-        if (*labels != NULL) {
-            free_null(*labels);
+    }
+
+    if (status == 0) {
+        header.dim = dim;
+        if (write_at_offset(output_fd, &header, sizeof(struct csr_binary_header), 0)) {
+            LOG_ERROR("can't write output file %s", output_filename);
+            status = 1;
         }
     }
 
+error:
+    free_null(chunks);
+    free_csr_matrix(&buffer);
+    free_null(buffer_labels);
+    if (mapping != MAP_FAILED) munmap(mapping, input_size);
+    if (fd != -1) close(fd);
+    if (output_fd != -1) {
+        if (close(output_fd) != 0) status = 1;
+        if (status != 0) unlink(output_filename);
+    }
+
     return status;
 }
@@ -1,8 +1,37 @@
 #include "csr_matrix.h"
 
+/**
+ * @brief Check if a file is a binary csr matrix file (see struct csr_binary_header).
+ *
+ * @param[in] filename Path to the file.
+ * @return 1 if the file starts with CSR_BINARY_MAGIC else 0.
+ */
+uint32_t is_binary_csr_matrix_file(const char *filename);
+
+/**
+ * @brief Map a binary csr matrix file into memory.
+ *
+ * The arrays of the resulting matrix point directly into the mapped file
+ * (read-only). Only if the file was written with a different VALUE_TYPE the
+ * values are converted into a new array. free_csr_matrix unmaps the file.
+ * Files whose pointers or keys do not form a valid matrix are rejected, this
+ * reads the pointers and keys once.
+ *
+ * @param[in] filename Path to a binary csr matrix file.
+ * @param[out] mtrx Resulting csr matrix
+ * @param[out] labels Labels of the csr matrix (0 for every sample if the file has no labels).
+ * @return 0 if loading succeeded else 1.
+ */
+uint32_t load_binary_csr_matrix(const char *filename
+                                , struct csr_matrix **mtrx
+                                , int32_t** labels);
+
 /**
  * @brief Convert a file in libsvm format into a csr matrix and a labels array.
  *
+ * Binary csr matrix files are detected automatically and loaded with
+ * load_binary_csr_matrix.
+ *
  * @param[in] filename Path to file in libsvm format.
  * @param[out] mtrx Resulting csr matrix
  * @param[out] labels Labels of the csr matrix.
@@ -21,3 +50,19 @@ uint32_t convert_libsvm_file_to_csr_matrix(const char *filename
  */
 uint32_t convert_libsvm_file_to_csr_matrix_wo_labels(const char *input_string
                                                      , struct csr_matrix **mtrx);
+
+/**
+ * @brief Convert a file in libsvm format into a binary csr matrix file without
+ *        loading the whole matrix into memory.
+ *
+ * The input is parsed in chunks (as many in parallel as there are threads) which
+ * are written to their final position in the output file right away. This allows
+ * to convert datasets which are larger than the main memory. The result is the
+ * same as loading the file and writing it with store_matrix_binary.
+ *
+ * @param[in] input_filename Path to file in libsvm format.
+ * @param[in] output_filename Path the binary csr matrix file is written to.
+ * @return 0 if conversion succeeded else 1.
+ */
+uint32_t convert_libsvm_file_to_binary_csr_matrix(const char *input_filename
+                                                  , const char *output_filename);
@@ -2,14 +2,30 @@
 #include "../../vector/common/common_vector_math.h"
 #include "../../vector/sparse/sparse_vector_math.h"
 #include "../../fcl_logging.h"
+#include "../../fcl_numa.h"
 
 #include <stdlib.h>
 #include <math.h>
 
+/* a dense row needs to fit into a (conservatively sized) L2 cache */
+#define DENSE_VECTORS_MAX_ROW_BYTES (256 * 1024)
+
+/* upper limit for the memory used by a dense block of vectors */
+#define DENSE_VECTORS_MAX_BYTES (UINT64_C(512) * 1024 * 1024)
+
+/* a dense row which fits into L1 is always used */
+#define DENSE_VECTORS_L1_ROW_BYTES (32 * 1024)
+
+/* larger dense rows are only used if the samples are not much sparser than this.
+ * every key of a very sparse sample hits another cache line of the dense row
+ * while a merge streams through the (then also sparse) cluster.
+ */
+#define DENSE_VECTORS_MAX_DIM_PER_ANNZ 64
+
 void calculate_matrix_vector_lengths(struct csr_matrix *mtrx, VALUE_TYPE** vector_lengths) {
     uint64_t i;
 
-    *vector_lengths = (VALUE_TYPE*) calloc(mtrx->sample_count, sizeof(VALUE_TYPE));
+    *vector_lengths = (VALUE_TYPE*) calloc_first_touch(mtrx->sample_count, sizeof(VALUE_TYPE));
 
     #pragma omp parallel for schedule(dynamic, 1000)
     for (i = 0; i < mtrx->sample_count; i++) {
@@ -169,3 +185,84 @@ void determine_block_vectors_for_matrix(struct csr_matrix* mtrx
     }
 }
 
+uint32_t dense_block_fits_memory(uint64_t no_vectors, uint64_t dim) {
+    uint64_t row_bytes;
+
+    if (dim == 0 || no_vectors == 0) return 0;
+
+    row_bytes = dim * sizeof(VALUE_TYPE);
+    return no_vectors <= DENSE_VECTORS_MAX_BYTES / row_bytes;
+}
+
+uint32_t dense_vectors_recommended(struct csr_matrix* samples, uint64_t no_vectors) {
+    uint64_t row_bytes, annz;
+
+    row_bytes = samples->dim * sizeof(VALUE_TYPE);
+    if (row_bytes > DENSE_VECTORS_MAX_ROW_BYTES) return 0;
+
+    if (row_bytes > DENSE_VECTORS_L1_ROW_BYTES && samples->sample_count > 0) {
+        annz = samples->pointers[samples->sample_count] / samples->sample_count;
+        if (samples->dim > annz * DENSE_VECTORS_MAX_DIM_PER_ANNZ) return 0;
+    }
+
+    return dense_block_fits_memory(no_vectors, samples->dim);
+}
+
+void csr_dense_transposed_dot_tile(struct csr_matrix *mtrx
+                                   , uint64_t sample_start
+                                   , uint64_t sample_end
+                                   , VALUE_TYPE *dense_transposed
+                                   , uint64_t no_vectors
+                                   , uint64_t vector_start
+                                   , uint64_t vector_end
+                                   , VALUE_TYPE *tile) {
+    uint64_t sample_id, j, c, tile_width;
+    VALUE_TYPE *tile_row;
+    VALUE_TYPE *dense_row;
+    VALUE_TYPE value;
+
+    tile_width = vector_end - vector_start;
+
+    for (sample_id = sample_start; sample_id < sample_end; sample_id++) {
+        tile_row = tile + (sample_id - sample_start) * tile_width;
+        for (c = 0; c < tile_width; c++) tile_row[c] = 0;
+
+        /* every nonzero of the sample scales one contiguous slice of the
+         * transposed dense matrix. This inner loop vectorizes.
+         */
+        for (j = mtrx->pointers[sample_id]; j < mtrx->pointers[sample_id + 1]; j++) {
+            value = mtrx->values[j];
+            dense_row = dense_transposed + ((uint64_t) mtrx->keys[j]) * no_vectors + vector_start;
+            for (c = 0; c < tile_width; c++) {
+                tile_row[c] += value * dense_row[c];
+            }
+        }
+    }
+}
+
+void compress_csr_matrix_keys(struct csr_matrix *mtrx
+                              , struct csr_compressed_keys *compressed_keys) {
+    uint64_t i;
+
+    compressed_keys->stream_pointers = (POINTER_TYPE*) calloc(mtrx->sample_count + 1, sizeof(POINTER_TYPE));
+
+    #pragma omp parallel for schedule(dynamic, 1000)
+    for (i = 0; i < mtrx->sample_count; i++) {
+        compressed_keys->stream_pointers[i + 1] = get_compressed_keys_size(mtrx->keys + mtrx->pointers[i]
+                                                                           , mtrx->pointers[i + 1] - mtrx->pointers[i]);
+    }
+
+    for (i = 0; i < mtrx->sample_count; i++) {
+        compressed_keys->stream_pointers[i + 1] += compressed_keys->stream_pointers[i];
+    }
+
+    compressed_keys->key_stream = (uint8_t*) calloc(compressed_keys->stream_pointers[mtrx->sample_count] + 1
+                                                    , sizeof(uint8_t));
+
+    #pragma omp parallel for schedule(dynamic, 1000)
+    for (i = 0; i < mtrx->sample_count; i++) {
+        compress_keys(mtrx->keys + mtrx->pointers[i]
+                      , mtrx->pointers[i + 1] - mtrx->pointers[i]
+                      , compressed_keys->key_stream + compressed_keys->stream_pointers[i]);
+    }
+}
@@ -69,4 +69,66 @@ VALUE_TYPE euclid(struct csr_matrix *mtrx1, uint64_t sample_id_1
                          , VALUE_TYPE *vector_lengths_mtrx1
                          , VALUE_TYPE *vector_lengths_mtrx2);
 
+/**
+ * @brief Check if a dense no_vectors x dim block stays within the memory limit
+ *        for dense representations.
+ *
+ * @param[in] no_vectors Number of dense vectors.
+ * @param[in] dim Dimensionality of the dense vectors.
+ * @return 1 if the block may be allocated else 0.
+ */
+uint32_t dense_block_fits_memory(uint64_t no_vectors, uint64_t dim);
+
+/**
+ * @brief Decide if no_vectors vectors with the dimensionality of samples should be
+ *        stored as a dense row-major block instead of sparse vectors.
+ *
+ * This is the case if one dense row fits into the L2 cache and the complete block
+ * does not use up too much memory. Rows larger than L1 additionally require that
+ * dim / annz of the samples is at most 64, since the keys of very sparse samples
+ * gather from scattered cache lines of the dense row. Distances between a sample and a dense vector
+ * are then calculated by gathering the values at the keys of the sample
+ * instead of merging the keys of two sparse vectors.
+ *
+ * @param[in] samples which are compared against the vectors.
+ * @param[in] no_vectors Number of vectors which would be stored dense.
+ * @return 1 if the dense representation should be used else 0.
+ */
+uint32_t dense_vectors_recommended(struct csr_matrix* samples, uint64_t no_vectors);
+
+/**
+ * @brief Compute a tile of dot products between rows of a csr matrix and
+ *        dense vectors which are stored transposed (dim x no_vectors).
+ *
+ * tile[(s - sample_start) * (vector_end - vector_start) + (c - vector_start)] = < mtrx[s], v_c >
+ * for all s in [sample_start, sample_end) and c in [vector_start, vector_end).
+ *
+ * @param[in] mtrx is the input matrix
+ * @param[in] sample_start First row of mtrx in the tile.
+ * @param[in] sample_end Row after the last row of mtrx in the tile.
+ * @param[in] dense_transposed Dense vectors as column-major block: entry (c, key) is
+ *                             stored at dense_transposed[key * no_vectors + c].
+ * @param[in] no_vectors Number of dense vectors.
+ * @param[in] vector_start First dense vector in the tile.
+ * @param[in] vector_end Dense vector after the last one in the tile.
+ * @param[out] tile Resulting dot products.
+ */
+void csr_dense_transposed_dot_tile(struct csr_matrix *mtrx
+                                   , uint64_t sample_start
+                                   , uint64_t sample_end
+                                   , VALUE_TYPE *dense_transposed
+                                   , uint64_t no_vectors
+                                   , uint64_t vector_start
+                                   , uint64_t vector_end
+                                   , VALUE_TYPE *tile);
+
+/**
+ * @brief Compress the keys of every row of a csr matrix (see compress_keys).
+ *
+ * @param[in] mtrx is the input matrix
+ * @param[out] compressed_keys Resulting compressed keys. Free with free_csr_compressed_keys.
+ */
+void compress_csr_matrix_keys(struct csr_matrix *mtrx
+                              , struct csr_compressed_keys *compressed_keys);
+
 #endif /* CSR_MATH_H */
@@ -1,6 +1,202 @@
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
 #include "csr_matrix.h"
 #include "stdlib.h"
 #include "string.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * @brief Memory mapped file which contains the arrays of a csr matrix.
+ */
+struct mapped_csr_matrix {
+    POINTER_TYPE *pointers;             /**< Identifies the matrix which uses this mapping */
+    char *mapping;                      /**< Start of the mapping */
+    uint64_t mapping_size;              /**< Length of the mapping in bytes */
+    struct mapped_csr_matrix *next;     /**< Next mapping in the list */
+};
+
+static struct mapped_csr_matrix *mapped_csr_matrices = NULL;
+
+void register_mapped_csr_matrix(struct csr_matrix *mtrx, void* mapping, uint64_t mapping_size) {
+    struct mapped_csr_matrix *entry;
+
+    entry = (struct mapped_csr_matrix*) malloc(sizeof(struct mapped_csr_matrix));
+    entry->pointers = mtrx->pointers;
+    entry->mapping = (char*) mapping;
+    entry->mapping_size = mapping_size;
+
+    #pragma omp critical (mapped_csr_matrices)
+    {
+        entry->next = mapped_csr_matrices;
+        mapped_csr_matrices = entry;
+    }
+}
+
+/*
+ * Remove the mapping of mtrx from the list. Returns NULL if mtrx is not
+ * memory mapped.
+ */
+static struct mapped_csr_matrix* unregister_mapped_csr_matrix(struct csr_matrix *mtrx) {
+    struct mapped_csr_matrix **entry;
+    struct mapped_csr_matrix *found;
+
+    found = NULL;
+    if (mtrx->pointers == NULL) return NULL;
+
+    #pragma omp critical (mapped_csr_matrices)
+    {
+        for (entry = &mapped_csr_matrices; *entry != NULL; entry = &((*entry)->next)) {
+            if ((*entry)->pointers == mtrx->pointers) {
+                found = *entry;
+                *entry = found->next;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static uint32_t is_within_mapping(struct mapped_csr_matrix *entry, void* array) {
+    return (char*) array >= entry->mapping
+           && (char*) array < entry->mapping + entry->mapping_size;
+}
+
+static struct mapped_csr_matrix* find_mapped_csr_matrix(struct csr_matrix *mtrx) {
+    struct mapped_csr_matrix *entry;
+
+    entry = NULL;
+    if (mtrx->pointers == NULL) return NULL;
+
+    #pragma omp critical (mapped_csr_matrices)
+    {
+        for (entry = mapped_csr_matrices; entry != NULL; entry = entry->next) {
+            if (entry->pointers == mtrx->pointers) break;
+        }
+    }
+    return entry;
+}
+
+static void advise_mapped_range(char *start, char *end, uint32_t needed) {
+    if (start >= end) return;
+#ifdef MADV_WILLNEED
+    madvise(start, end - start, needed ? MADV_WILLNEED : MADV_DONTNEED);
+#else
+    posix_madvise(start, end - start, needed ? POSIX_MADV_WILLNEED : POSIX_MADV_DONTNEED);
+#endif
+}
+
+/*
+ * Advise the pages of the rows in row_mask of one array (keys or values) of a
+ * mapped matrix. Adjacent rows are combined into one range.
+ */
+static void advise_mapped_array(struct mapped_csr_matrix *entry
+                                , struct csr_matrix *mtrx
+                                , char *array
+                                , uint64_t element_size
+                                , uint32_t *row_mask
+                                , uint32_t needed
+                                , uint64_t page_size) {
+    uint64_t i;
+    char *range_start, *range_end, *row_start, *row_end;
+
+    if (!is_within_mapping(entry, array)) return;
+
+    range_start = NULL;
+    range_end = NULL;
+    for (i = 0; i < mtrx->sample_count; i++) {
+        if (row_mask != NULL && !row_mask[i]) continue;
+        if (mtrx->pointers[i] == mtrx->pointers[i + 1]) continue;
+
+        row_start = array + mtrx->pointers[i] * element_size;
+        row_end = array + mtrx->pointers[i + 1] * element_size;
+
+        /* extend to whole pages */
+        row_start = entry->mapping + (row_start - entry->mapping) / page_size * page_size;
+        row_end = entry->mapping
+                  + ((row_end - entry->mapping) + page_size - 1) / page_size * page_size;
+        if (row_end > entry->mapping + entry->mapping_size) {
+            row_end = entry->mapping + entry->mapping_size;
+        }
+
+        if (range_start != NULL && row_start <= range_end) {
+            if (row_end > range_end) range_end = row_end;
+        } else {
+            advise_mapped_range(range_start, range_end, needed);
+            range_start = row_start;
+            range_end = row_end;
+        }
+    }
+    advise_mapped_range(range_start, range_end, needed);
+}
+
+uint32_t is_mapped_csr_matrix(struct csr_matrix *mtrx) {
+    return find_mapped_csr_matrix(mtrx) != NULL;
+}
+
+void advise_csr_matrix_rows(struct csr_matrix *mtrx, uint32_t *row_mask, uint32_t needed) {
+    struct mapped_csr_matrix *entry;
+    uint64_t page_size;
+
+    entry = find_mapped_csr_matrix(mtrx);
+    if (entry == NULL) return;
+
+    page_size = sysconf(_SC_PAGESIZE);
+    advise_mapped_array(entry, mtrx, (char*) mtrx->keys, sizeof(KEY_TYPE)
+                        , row_mask, needed, page_size);
+    advise_mapped_array(entry, mtrx, (char*) mtrx->values, sizeof(VALUE_TYPE)
+                        , row_mask, needed, page_size);
+}
+
+void advise_csr_matrix_keys(struct csr_matrix *mtrx, uint32_t needed) {
+    struct mapped_csr_matrix *entry;
+
+    entry = find_mapped_csr_matrix(mtrx);
+    if (entry == NULL) return;
+
+    advise_mapped_array(entry, mtrx, (char*) mtrx->keys, sizeof(KEY_TYPE)
+                        , NULL, needed, sysconf(_SC_PAGESIZE));
+}
+
+/* round size up to the next multiple of CSR_BINARY_ALIGNMENT */
+static uint64_t csr_binary_aligned_size(uint64_t size) {
+    return (size + CSR_BINARY_ALIGNMENT - 1) / CSR_BINARY_ALIGNMENT * CSR_BINARY_ALIGNMENT;
+}
+
+uint64_t initialize_csr_binary_header(struct csr_binary_header *header
+                                      , uint64_t sample_count
+                                      , uint64_t dim
+                                      , uint64_t nnz
+                                      , uint32_t has_labels) {
+    uint64_t offset;
+
+    memset(header, 0, sizeof(struct csr_binary_header));
+    memcpy(header->magic, CSR_BINARY_MAGIC, sizeof(header->magic));
+    header->version = CSR_BINARY_VERSION;
+    header->byte_order = CSR_BINARY_BYTE_ORDER;
+    header->pointer_size = sizeof(POINTER_TYPE);
+    header->key_size = sizeof(KEY_TYPE);
+    header->value_size = sizeof(VALUE_TYPE);
+    header->has_labels = has_labels;
+    header->sample_count = sample_count;
+    header->dim = dim;
+    header->nnz = nnz;
+
+    /* every array starts aligned */
+    offset = csr_binary_aligned_size(sizeof(struct csr_binary_header));
+    header->offset_pointers = offset;
+    offset += csr_binary_aligned_size((sample_count + 1) * sizeof(POINTER_TYPE));
+    header->offset_keys = offset;
+    offset += csr_binary_aligned_size(nnz * sizeof(KEY_TYPE));
+    header->offset_values = offset;
+    offset += csr_binary_aligned_size(nnz * sizeof(VALUE_TYPE));
+    if (has_labels) {
+        header->offset_labels = offset;
+        offset += csr_binary_aligned_size(sample_count * sizeof(int32_t));
+    }
+
+    return offset;
+}
 
 void initialize_csr_matrix_zero(struct csr_matrix *mtrx) {
     mtrx->pointers = NULL;
@@ -11,11 +207,31 @@ void initialize_csr_matrix_zero(struct csr_matrix *mtrx) {
 }
 
 void free_csr_matrix(struct csr_matrix *mtrx) {
+    struct mapped_csr_matrix *entry;
+
+    entry = unregister_mapped_csr_matrix(mtrx);
+    if (entry != NULL) {
+        /* arrays which were converted while loading are not part of the mapping */
+        if (!is_within_mapping(entry, mtrx->keys)) free(mtrx->keys);
+        if (!is_within_mapping(entry, mtrx->values)) free(mtrx->values);
+        munmap(entry->mapping, entry->mapping_size);
+        free(entry);
+        mtrx->pointers = NULL;
+        mtrx->keys = NULL;
+        mtrx->values = NULL;
+        return;
+    }
+
     free_null(mtrx->pointers);
     free_null(mtrx->keys);
     free_null(mtrx->values);
 }
 
+void free_csr_compressed_keys(struct csr_compressed_keys *compressed_keys) {
+    free_null(compressed_keys->key_stream);
+    free_null(compressed_keys->stream_pointers);
+}
+
 struct csr_matrix* remove_vectors_not_in_mask(struct csr_matrix* clusters
                                                    , uint64_t* mask) {
     uint64_t i, no_vectors_in_mask, nnz;
@@ -51,6 +267,43 @@ struct csr_matrix* remove_vectors_not_in_mask(struct csr_matrix* clusters
     return cluster_without_empty;
 }
 
+struct csr_matrix* create_csr_matrix_from_rows(struct csr_matrix* mtrx
+                                               , uint64_t* rows
+                                               , uint64_t no_rows) {
+    uint64_t i, nnz;
+    struct csr_matrix* subset;
+
+    subset = (struct csr_matrix*) malloc(sizeof(struct csr_matrix));
+    subset->dim = mtrx->dim;
+    subset->sample_count = no_rows;
+    subset->pointers = (POINTER_TYPE*) calloc(no_rows + 1
+                                              , sizeof(POINTER_TYPE));
+
+    for (i = 0; i < no_rows; i++) {
+        nnz = mtrx->pointers[rows[i] + 1] - mtrx->pointers[rows[i]];
+        subset->pointers[i + 1] = subset->pointers[i] + nnz;
+    }
+
+    subset->keys = (KEY_TYPE*) malloc(subset->pointers[no_rows] * sizeof(KEY_TYPE) + 1);
+    subset->values = (VALUE_TYPE*) malloc(subset->pointers[no_rows] * sizeof(VALUE_TYPE) + 1);
+
+    /* the rows are first touched by the thread which processes them in static loops */
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < no_rows; i++) {
+        uint64_t row_nnz;
+        row_nnz = subset->pointers[i + 1] - subset->pointers[i];
+        memcpy(subset->keys + subset->pointers[i], mtrx->keys + mtrx->pointers[rows[i]], row_nnz * sizeof(KEY_TYPE));
+        memcpy(subset->values + subset->pointers[i], mtrx->values + mtrx->pointers[rows[i]], row_nnz * sizeof(VALUE_TYPE));
+    }
+
+    return subset;
+}
+
+struct csr_matrix* create_permuted_csr_matrix(struct csr_matrix* mtrx
+                                              , uint64_t* order) {
+    return create_csr_matrix_from_rows(mtrx, order, mtrx->sample_count);
+}
+
 void create_matrix_random(struct csr_matrix *mtrx
                                  , struct csr_matrix *mtrx2
                                  , uint32_t *seed) {
@@ -17,6 +17,64 @@ struct csr_matrix {
     uint64_t dim;                  /**< Number of features of the matrix */
 };
 
+#define CSR_BINARY_MAGIC "FCLCSR\0\0"   /**< First 8 bytes of a binary csr matrix file */
+#define CSR_BINARY_VERSION UINT32_C(1)    /**< Current version of the binary csr matrix file format */
+#define CSR_BINARY_BYTE_ORDER UINT32_C(0x01020304) /**< Written in native byte order to detect foreign files */
+#define CSR_BINARY_ALIGNMENT UINT64_C(64) /**< Every array in a binary csr matrix file starts at a multiple of this */
+
+/**
+ * @brief Header of a binary csr matrix file.
+ *
+ * The header is followed by the arrays pointers (sample_count + 1 elements),
+ * keys (nnz), values (nnz) and optionally labels (sample_count int32) each starting
+ * at the given offset from the beginning of the file. This way the file can be
+ * mapped into memory and used as csr_matrix without copying.
+ */
+struct csr_binary_header {
+    char magic[8];                 /**< CSR_BINARY_MAGIC */
+    uint32_t version;              /**< CSR_BINARY_VERSION */
+    uint32_t byte_order;           /**< CSR_BINARY_BYTE_ORDER */
+    uint32_t pointer_size;         /**< sizeof(POINTER_TYPE) */
+    uint32_t key_size;             /**< sizeof(KEY_TYPE) */
+    uint32_t value_size;           /**< sizeof(VALUE_TYPE) (4 = float, 8 = double) */
+    uint32_t has_labels;           /**< True if the file contains labels. */
+    uint64_t sample_count;         /**< Number of samples in the matrix */
+    uint64_t dim;                  /**< Number of features of the matrix */
+    uint64_t nnz;                  /**< Number of non zero values of the matrix */
+    uint64_t offset_pointers;      /**< Offset of the pointers array */
+    uint64_t offset_keys;          /**< Offset of the keys array */
+    uint64_t offset_values;        /**< Offset of the values array */
+    uint64_t offset_labels;        /**< Offset of the labels array (0 if has_labels is false) */
+};
+
+/**
+ * @brief Fill the header of a binary csr matrix file for a matrix with the
+ *        given shape (arrays are laid out in the order of the header fields).
+ *
+ * @param[out] header Header to fill.
+ * @param[in] sample_count Number of samples in the matrix.
+ * @param[in] dim Number of features of the matrix.
+ * @param[in] nnz Number of non zero values of the matrix.
+ * @param[in] has_labels True if labels are stored in the file.
+ * @return Size of the resulting file in bytes.
+ */
+uint64_t initialize_csr_binary_header(struct csr_binary_header *header
+                                      , uint64_t sample_count
+                                      , uint64_t dim
+                                      , uint64_t nnz
+                                      , uint32_t has_labels);
+
+/**
+ * @brief Keys of a csr matrix in compressed form (see compress_keys).
+ *
+ * The keys of row i start at key_stream + stream_pointers[i]. The values and the
+ * number of non zero values per row are taken from the uncompressed matrix.
+ */
+struct csr_compressed_keys {
+    uint8_t *key_stream;               /**< Compressed keys of all rows. */
+    POINTER_TYPE *stream_pointers;     /**< Start of every row in key_stream (length sample_count + 1). */
+};
+
 /**
  * @brief Cleanup csr matrix.
  *
@@ -24,6 +82,56 @@ struct csr_matrix {
  */
 void free_csr_matrix(struct csr_matrix *mtrx);
 
+/**
+ * @brief Remember that the arrays of mtrx point into a memory mapped file.
+ *
+ * free_csr_matrix unmaps the file instead of freeing the arrays which lie within
+ * the mapping.
+ *
+ * @param mtrx[in] Matrix whose pointers array lies within the mapping.
+ * @param mapping[in] Start of the mapping.
+ * @param mapping_size[in] Length of the mapping in bytes.
+ */
+void register_mapped_csr_matrix(struct csr_matrix *mtrx, void* mapping, uint64_t mapping_size);
+
+/**
+ * @brief Check if mtrx was registered with register_mapped_csr_matrix.
+ *
+ * @param mtrx[in] Matrix to check.
+ * @return 1 if the arrays of mtrx lie within a memory mapped file else 0.
+ */
+uint32_t is_mapped_csr_matrix(struct csr_matrix *mtrx);
+
+/**
+ * @brief Tell the kernel which rows of a memory mapped matrix are needed soon
+ *        (they are read ahead) or not needed anymore (their pages are released).
+ *
+ * This allows to work on matrices which are larger than the main memory as long
+ * as only a subset of the rows is used at a time. Does nothing if mtrx is not
+ * memory mapped.
+ *
+ * @param mtrx[in] Matrix to advise.
+ * @param row_mask[in] Rows to advise (row_mask[i] != 0). NULL advises all rows.
+ * @param needed[in] 1 to prefetch the rows, 0 to release them.
+ */
+void advise_csr_matrix_rows(struct csr_matrix *mtrx, uint32_t *row_mask, uint32_t needed);
+
+/**
+ * @brief Like advise_csr_matrix_rows but only for the keys of all rows, e.g.
+ *        when they are used in compressed form only.
+ *
+ * @param mtrx[in] Matrix to advise.
+ * @param needed[in] 1 to prefetch the keys, 0 to release them.
+ */
+void advise_csr_matrix_keys(struct csr_matrix *mtrx, uint32_t needed);
+
+/**
+ * @brief Cleanup compressed keys of a csr matrix.
+ *
+ * @param compressed_keys[in] Compressed keys to cleanup.
+ */
+void free_csr_compressed_keys(struct csr_compressed_keys *compressed_keys);
+
 /**
  * @brief Initialize all fields of a csr matrix with zero.
  *
@@ -41,6 +149,28 @@ void initialize_csr_matrix_zero(struct csr_matrix *mtrx);
 struct csr_matrix* remove_vectors_not_in_mask(struct csr_matrix* clusters
                                                    , uint64_t* mask);
 
+/**
+ * @brief Create a copy of a matrix with its rows in a different order.
+ *
+ * @param[in] mtrx The matrix to copy.
+ * @param[in] order Permutation of the rows: row i of the new matrix is row order[i] of mtrx.
+ * @return New matrix with the permuted rows.
+ */
+struct csr_matrix* create_permuted_csr_matrix(struct csr_matrix* mtrx
+                                              , uint64_t* order);
+
+/**
+ * @brief Create a matrix from a selection of the rows of a matrix.
+ *
+ * @param[in] mtrx The matrix to copy the rows from.
+ * @param[in] rows Rows to copy: row i of the new matrix is row rows[i] of mtrx.
+ * @param[in] no_rows Length of rows.
+ * @return New matrix with no_rows rows.
+ */
+struct csr_matrix* create_csr_matrix_from_rows(struct csr_matrix* mtrx
+                                               , uint64_t* rows
+                                               , uint64_t no_rows);
+
 /**
  * @brief Choose random samples from mtrx to generate mtrx2.
  *
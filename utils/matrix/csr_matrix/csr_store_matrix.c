@@ -1,4 +1,46 @@
 #include "csr_store_matrix.h"
+#include <string.h>
+
+/*
+ * Write a block of data and pad it with zeros up to the next multiple of
+ * CSR_BINARY_ALIGNMENT. Sets error if writing fails.
+ */
+static void write_aligned_block(FILE *file, void* data, uint64_t size, uint32_t* error) {
+    char padding[CSR_BINARY_ALIGNMENT];
+    uint64_t padding_size;
+
+    if (size > 0 && fwrite(data, 1, size, file) != size) *error = 1;
+
+    padding_size = (CSR_BINARY_ALIGNMENT - (size % CSR_BINARY_ALIGNMENT)) % CSR_BINARY_ALIGNMENT;
+    memset(padding, 0, CSR_BINARY_ALIGNMENT);
+    if (padding_size > 0 && fwrite(padding, 1, padding_size, file) != padding_size) *error = 1;
+}
+
+uint32_t store_matrix_binary(struct csr_matrix *mtrx, int32_t* labels, char* output_path) {
+    FILE *file;
+    struct csr_binary_header header;
+    uint32_t error;
+
+    file = fopen(output_path, "wb");
+    if (!file) {
+        return 1;
+    }
+
+    initialize_csr_binary_header(&header, mtrx->sample_count, mtrx->dim
+                                 , mtrx->pointers[mtrx->sample_count], labels != NULL);
+
+    error = 0;
+    write_aligned_block(file, &header, sizeof(struct csr_binary_header), &error);
+    write_aligned_block(file, mtrx->pointers, (header.sample_count + 1) * sizeof(POINTER_TYPE), &error);
+    write_aligned_block(file, mtrx->keys, header.nnz * sizeof(KEY_TYPE), &error);
+    write_aligned_block(file, mtrx->values, header.nnz * sizeof(VALUE_TYPE), &error);
+    if (header.has_labels) {
+        write_aligned_block(file, labels, header.sample_count * sizeof(int32_t), &error);
+    }
+
+    if (fclose(file) != 0) error = 1;
+    return error;
+}
 
 uint32_t store_matrix_with_label(struct csr_matrix *mtrx, int32_t* labels, int32_t static_label, char* output_path) {
     FILE *file;
@@ -16,6 +16,17 @@
 uint32_t store_matrix_with_label(struct csr_matrix *mtrx, int32_t* labels
                                 , int32_t static_label, char* output_path);
 
+/**
+ * @brief Store csr_matrix as binary file (see struct csr_binary_header).
+ *
+ * @param[in] mtrx Matrix to store.
+ * @param[in] labels Vector of labels. If this is null no labels are stored.
+ * @param[in] output_path Path of the result file.
+ * @return 0 if storing succeeded else 1.
+ */
+uint32_t store_matrix_binary(struct csr_matrix *mtrx, int32_t* labels
+                             , char* output_path);
+
 /**
  * @brief Convert csr_matrix into a libsvm string.
  *
@@ -141,6 +141,13 @@ void create_block_vector_from_csr_matrix_vector(struct csr_matrix* mtrx
     block_vector->keys = (KEY_TYPE*) calloc(mtrx->pointers[vector_id + 1] - mtrx->pointers[vector_id], sizeof(KEY_TYPE));
     block_vector->values = (VALUE_TYPE*) calloc(mtrx->pointers[vector_id + 1] - mtrx->pointers[vector_id], sizeof(VALUE_TYPE));
 
+    fill_block_vector_from_csr_matrix_vector(mtrx, vector_id, keys_per_block, block_vector);
+}
+
+void fill_block_vector_from_csr_matrix_vector(struct csr_matrix* mtrx
+                                              , uint64_t vector_id
+                                              , uint64_t keys_per_block
+                                              , struct sparse_vector* block_vector) {
     fill_blockvector(mtrx->keys + mtrx->pointers[vector_id]
                           , mtrx->values + mtrx->pointers[vector_id]
                           , mtrx->pointers[vector_id + 1] - mtrx->pointers[vector_id]
@@ -32,6 +32,20 @@ void create_block_vector_from_csr_matrix_vector(struct csr_matrix* mtrx
                                                , uint64_t keys_per_block
                                                , struct sparse_vector* block_vector);
 
+/**
+ * @brief Transform from matrix mtrx the vector vector_id to a block vector
+ *        without allocating memory.
+ *
+ * @param[in] mtrx
+ * @param[in] vector_id
+ * @param[in] keys_per_block
+ * @param[out] block_vector keys/values must have space for the nnz of vector_id.
+ */
+void fill_block_vector_from_csr_matrix_vector(struct csr_matrix* mtrx
+                                              , uint64_t vector_id
+                                              , uint64_t keys_per_block
+                                              , struct sparse_vector* block_vector);
+
 /**
  * @brief Create the dot product of a sparse vector to a csr matrix.
  *
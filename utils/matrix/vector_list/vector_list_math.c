@@ -3,6 +3,7 @@
 #include "../../vector/sparse/sparse_vector_math.h"
 #include "../../global_defs.h"
 #include <stdlib.h>
+#include <string.h>
 
 void update_vector_list_lengths(struct sparse_vector* vector_array
                                    , uint64_t no_clusters
@@ -104,3 +105,49 @@ void update_changed_blockvectors(struct sparse_vector *mtrx
     }
 }
 
+void update_dense_vectors_from_vector_list(struct sparse_vector *mtrx
+                                           , uint64_t no_vectors
+                                           , uint64_t dim
+                                           , uint32_t* vector_not_changed
+                                           , VALUE_TYPE *dense_vectors) {
+    uint64_t i, j;
+
+    #pragma omp parallel for schedule(dynamic, 10) private(j)
+    for (i = 0; i < no_vectors; i++) {
+        VALUE_TYPE *row;
+        if (vector_not_changed != NULL && vector_not_changed[i]) continue;
+
+        row = dense_vectors + i * dim;
+        memset(row, 0, dim * sizeof(VALUE_TYPE));
+        for (j = 0; j < mtrx[i].nnz; j++) {
+            row[mtrx[i].keys[j]] = mtrx[i].values[j];
+        }
+    }
+}
+
+void update_dense_transposed_from_vector_list(struct sparse_vector *mtrx
+                                              , uint64_t no_vectors
+                                              , uint64_t dim
+                                              , uint32_t* vector_not_changed
+                                              , VALUE_TYPE *dense_transposed) {
+    uint64_t i, j;
+
+    if (vector_not_changed == NULL) {
+        memset(dense_transposed, 0, no_vectors * dim * sizeof(VALUE_TYPE));
+    }
+
+    for (i = 0; i < no_vectors; i++) {
+        if (vector_not_changed != NULL) {
+            if (vector_not_changed[i]) continue;
+
+            /* clear the column of the vector */
+            for (j = 0; j < dim; j++) {
+                dense_transposed[j * no_vectors + i] = 0;
+            }
+        }
+
+        for (j = 0; j < mtrx[i].nnz; j++) {
+            dense_transposed[((uint64_t) mtrx[i].keys[j]) * no_vectors + i] = mtrx[i].values[j];
+        }
+    }
+}
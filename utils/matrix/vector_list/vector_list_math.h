@@ -61,4 +61,39 @@ void create_block_vectors_list_from_vector_list(struct sparse_vector *mtrx
                                                 , uint64_t dim
                                                 , struct sparse_vector **block_vectors);
 
+/**
+ * Write a list of sparse vectors into a dense row-major no_vectors x dim block.
+ * Only the rows of vectors which were changed are rewritten.
+ *
+ * @param[in] mtrx list of sparse vectors
+ * @param[in] no_vectors length of mtrx
+ * @param[in] dim dimensionality of mtrx (length of one dense row)
+ * @param[in] vector_not_changed List of True/False for every vector in mtrx. True if vector did not change.
+ *                               If NULL, all rows are written.
+ * @param[inout] dense_vectors no_vectors x dim block which is updated.
+ */
+void update_dense_vectors_from_vector_list(struct sparse_vector *mtrx
+                                           , uint64_t no_vectors
+                                           , uint64_t dim
+                                           , uint32_t* vector_not_changed
+                                           , VALUE_TYPE *dense_vectors);
+
+/**
+ * Write a list of sparse vectors transposed into a dense dim x no_vectors block
+ * (entry (i, key) is stored at dense_transposed[key * no_vectors + i]).
+ * Only the columns of vectors which were changed are rewritten.
+ *
+ * @param[in] mtrx list of sparse vectors
+ * @param[in] no_vectors length of mtrx
+ * @param[in] dim dimensionality of mtrx
+ * @param[in] vector_not_changed List of True/False for every vector in mtrx. True if vector did not change.
+ *                               If NULL, all columns are written.
+ * @param[inout] dense_transposed dim x no_vectors block which is updated.
+ */
+void update_dense_transposed_from_vector_list(struct sparse_vector *mtrx
+                                              , uint64_t no_vectors
+                                              , uint64_t dim
+                                              , uint32_t* vector_not_changed
+                                              , VALUE_TYPE *dense_transposed);
+
 #endif /* VECTOR_LIST_MATH_H */
@@ -6,10 +6,23 @@
 
 typedef uint32_t KEY_TYPE;
 typedef uint64_t POINTER_TYPE;
+
+/*
+ * Compile with -DFCL_SINGLE_PRECISION to store all values (samples, clusters,
+ * bounds and distances) as float. Sums which run over many elements (dot products,
+ * vector lengths, objective) are always accumulated in ACCUMULATOR_TYPE.
+ */
+#ifdef FCL_SINGLE_PRECISION
+typedef float VALUE_TYPE;
+#define VALUE_TYPE_MAX FLT_MAX
+#else
 typedef double VALUE_TYPE;
+#define VALUE_TYPE_MAX DBL_MAX
+#endif
+
+typedef double ACCUMULATOR_TYPE;
 
 #define KEY_TYPE_MAX UINT32_MAX
-#define VALUE_TYPE_MAX DBL_MAX
 
 #define KEY_TYPE_PRINTF_MODIFIER PRINTF_INT32_MODIFIER
 #define POINTER_TYPE_PRINTF_MODIFIER PRINTF_INT64_MODIFIER
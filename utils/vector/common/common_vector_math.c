@@ -13,7 +13,7 @@ uint64_t get_nnz_uint64_array(uint64_t* array, uint64_t no_elements) {
 }
 
 VALUE_TYPE calculate_squared_vector_length(VALUE_TYPE *vector, uint64_t dim) {
-    VALUE_TYPE squared_vector_length;
+    ACCUMULATOR_TYPE squared_vector_length;
     uint64_t iter;
     squared_vector_length = 0;
 
@@ -24,7 +24,7 @@ VALUE_TYPE calculate_squared_vector_length(VALUE_TYPE *vector, uint64_t dim) {
 }
 
 VALUE_TYPE sum_value_array(VALUE_TYPE* array, uint64_t no_elements) {
-    VALUE_TYPE sum;
+    ACCUMULATOR_TYPE sum;
     uint64_t j;
 
     sum = 0;
@@ -1,7 +1,292 @@
 #include "sparse_vector_math.h"
 #include <math.h>
+#include <string.h>
 #include "../../fcl_logging.h"
 
+#if !defined(FCL_NO_SIMD) && defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define FCL_DOT_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * If one vector has more than DOT_GALLOPING_RATIO times the nnz of the other
+ * (e.g. sparse sample vs. dense-ish cluster), the keys of the short vector are
+ * searched in the long vector with an exponential search instead of merging.
+ */
+#define DOT_GALLOPING_RATIO 32
+
+typedef ACCUMULATOR_TYPE (*dot_kernel_function) (KEY_TYPE *keys_vector_one
+                                           , VALUE_TYPE *values_vector_one
+                                           , uint64_t non_zero_count_vector_one
+                                           , KEY_TYPE *keys_vector_two
+                                           , VALUE_TYPE *values_vector_two
+                                           , uint64_t non_zero_count_vector_two);
+
+/*
+ * Scalar merge of the keys starting at the given offsets. The data dependent
+ * branch of the classic merge is replaced by advancing both counters with the
+ * result of the comparisons.
+ */
+static ACCUMULATOR_TYPE dot_merge_tail(KEY_TYPE *keys_vector_one
+                                 , VALUE_TYPE *values_vector_one
+                                 , uint64_t non_zero_count_vector_one
+                                 , uint64_t nnz_counter_vector_one
+                                 , KEY_TYPE *keys_vector_two
+                                 , VALUE_TYPE *values_vector_two
+                                 , uint64_t non_zero_count_vector_two
+                                 , uint64_t nnz_counter_vector_two) {
+    ACCUMULATOR_TYPE result;
+    KEY_TYPE key_one, key_two;
+
+    result = 0;
+    while (nnz_counter_vector_one < non_zero_count_vector_one
+           && nnz_counter_vector_two < non_zero_count_vector_two) {
+        key_one = keys_vector_one[nnz_counter_vector_one];
+        key_two = keys_vector_two[nnz_counter_vector_two];
+        if (key_one == key_two) {
+            result += values_vector_one[nnz_counter_vector_one] * values_vector_two[nnz_counter_vector_two];
+        }
+        nnz_counter_vector_one += (key_one <= key_two);
+        nnz_counter_vector_two += (key_two <= key_one);
+    }
+    return result;
+}
+
+static ACCUMULATOR_TYPE dot_scalar(KEY_TYPE *keys_vector_one
+                             , VALUE_TYPE *values_vector_one
+                             , uint64_t non_zero_count_vector_one
+                             , KEY_TYPE *keys_vector_two
+                             , VALUE_TYPE *values_vector_two
+                             , uint64_t non_zero_count_vector_two) {
+    return dot_merge_tail(keys_vector_one, values_vector_one, non_zero_count_vector_one, 0
+                          , keys_vector_two, values_vector_two, non_zero_count_vector_two, 0);
+}
+
+/*
+ * Return the first position >= start in keys with keys[position] >= key.
+ */
+static uint64_t gallop_lower_bound(KEY_TYPE *keys
+                                   , uint64_t start
+                                   , uint64_t non_zero_count
+                                   , KEY_TYPE key) {
+    uint64_t low, high, step, mid;
+
+    low = start;
+    high = start;
+    step = 1;
+
+    /* exponential search for a range [low, high) which contains the key */
+    while (high < non_zero_count && keys[high] < key) {
+        low = high + 1;
+        high += step;
+        step <<= 1;
+    }
+    if (high > non_zero_count) high = non_zero_count;
+
+    /* binary search within this range */
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (keys[mid] < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static ACCUMULATOR_TYPE dot_galloping(KEY_TYPE *keys_vector_short
+                                , VALUE_TYPE *values_vector_short
+                                , uint64_t non_zero_count_vector_short
+                                , KEY_TYPE *keys_vector_long
+                                , VALUE_TYPE *values_vector_long
+                                , uint64_t non_zero_count_vector_long) {
+    ACCUMULATOR_TYPE result;
+    uint64_t i, position;
+
+    result = 0;
+    position = 0;
+    for (i = 0; i < non_zero_count_vector_short; i++) {
+        position = gallop_lower_bound(keys_vector_long, position, non_zero_count_vector_long, keys_vector_short[i]);
+        if (position == non_zero_count_vector_long) break;
+        if (keys_vector_long[position] == keys_vector_short[i]) {
+            result += values_vector_short[i] * values_vector_long[position];
+        }
+    }
+    return result;
+}
+
+#ifdef FCL_DOT_X86_DISPATCH
+
+/*
+ * The SIMD kernels compare a block of keys of vector one against a block of keys
+ * of vector two (all-pairs, by rotating the second block). Every set bit in the
+ * comparison mask of rotation r marks a match between position p of block one
+ * and position (p + r) % block_size of block two. Afterwards the block with the
+ * smaller maximum key is advanced (both if equal). The remaining keys which do not
+ * fill a complete block are handled by the scalar merge.
+ */
+
+__attribute__((target("sse4.2")))
+static ACCUMULATOR_TYPE dot_sse42(KEY_TYPE *keys_vector_one
+                            , VALUE_TYPE *values_vector_one
+                            , uint64_t non_zero_count_vector_one
+                            , KEY_TYPE *keys_vector_two
+                            , VALUE_TYPE *values_vector_two
+                            , uint64_t non_zero_count_vector_two) {
+    ACCUMULATOR_TYPE result;
+    uint64_t i, j, full_blocks_one, full_blocks_two;
+    uint32_t r, mask, p;
+    KEY_TYPE max_one, max_two;
+    __m128i block_one, block_two;
+
+    result = 0;
+    i = 0;
+    j = 0;
+    full_blocks_one = non_zero_count_vector_one & ~((uint64_t) 3);
+    full_blocks_two = non_zero_count_vector_two & ~((uint64_t) 3);
+
+    while (i < full_blocks_one && j < full_blocks_two) {
+        max_one = keys_vector_one[i + 3];
+        max_two = keys_vector_two[j + 3];
+
+        if (max_one >= keys_vector_two[j] && max_two >= keys_vector_one[i]) {
+            block_one = _mm_loadu_si128((const __m128i*) (keys_vector_one + i));
+            block_two = _mm_loadu_si128((const __m128i*) (keys_vector_two + j));
+            for (r = 0; r < 4; r++) {
+                mask = (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block_one, block_two)));
+                while (mask) {
+                    p = (uint32_t) __builtin_ctz(mask);
+                    result += values_vector_one[i + p] * values_vector_two[j + ((p + r) & 3)];
+                    mask &= mask - 1;
+                }
+                block_two = _mm_shuffle_epi32(block_two, _MM_SHUFFLE(0, 3, 2, 1));
+            }
+        }
+
+        if (max_one <= max_two) i += 4;
+        if (max_two <= max_one) j += 4;
+    }
+
+    return result + dot_merge_tail(keys_vector_one, values_vector_one, non_zero_count_vector_one, i
+                                   , keys_vector_two, values_vector_two, non_zero_count_vector_two, j);
+}
+
+__attribute__((target("avx2")))
+static ACCUMULATOR_TYPE dot_avx2(KEY_TYPE *keys_vector_one
+                           , VALUE_TYPE *values_vector_one
+                           , uint64_t non_zero_count_vector_one
+                           , KEY_TYPE *keys_vector_two
+                           , VALUE_TYPE *values_vector_two
+                           , uint64_t non_zero_count_vector_two) {
+    ACCUMULATOR_TYPE result;
+    uint64_t i, j, full_blocks_one, full_blocks_two;
+    uint32_t r, mask, p;
+    KEY_TYPE max_one, max_two;
+    __m256i block_one, block_two, rotate;
+
+    result = 0;
+    i = 0;
+    j = 0;
+    full_blocks_one = non_zero_count_vector_one & ~((uint64_t) 7);
+    full_blocks_two = non_zero_count_vector_two & ~((uint64_t) 7);
+    rotate = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+
+    while (i < full_blocks_one && j < full_blocks_two) {
+        max_one = keys_vector_one[i + 7];
+        max_two = keys_vector_two[j + 7];
+
+        if (max_one >= keys_vector_two[j] && max_two >= keys_vector_one[i]) {
+            block_one = _mm256_loadu_si256((const __m256i*) (keys_vector_one + i));
+            block_two = _mm256_loadu_si256((const __m256i*) (keys_vector_two + j));
+            for (r = 0; r < 8; r++) {
+                mask = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block_one, block_two)));
+                while (mask) {
+                    p = (uint32_t) __builtin_ctz(mask);
+                    result += values_vector_one[i + p] * values_vector_two[j + ((p + r) & 7)];
+                    mask &= mask - 1;
+                }
+                block_two = _mm256_permutevar8x32_epi32(block_two, rotate);
+            }
+        }
+
+        if (max_one <= max_two) i += 8;
+        if (max_two <= max_one) j += 8;
+    }
+
+    return result + dot_merge_tail(keys_vector_one, values_vector_one, non_zero_count_vector_one, i
+                                   , keys_vector_two, values_vector_two, non_zero_count_vector_two, j);
+}
+
+__attribute__((target("avx512f")))
+static ACCUMULATOR_TYPE dot_avx512(KEY_TYPE *keys_vector_one
+                             , VALUE_TYPE *values_vector_one
+                             , uint64_t non_zero_count_vector_one
+                             , KEY_TYPE *keys_vector_two
+                             , VALUE_TYPE *values_vector_two
+                             , uint64_t non_zero_count_vector_two) {
+    ACCUMULATOR_TYPE result;
+    uint64_t i, j, full_blocks_one, full_blocks_two;
+    uint32_t r, mask, p;
+    KEY_TYPE max_one, max_two;
+    __m512i block_one, block_two;
+
+    result = 0;
+    i = 0;
+    j = 0;
+    full_blocks_one = non_zero_count_vector_one & ~((uint64_t) 15);
+    full_blocks_two = non_zero_count_vector_two & ~((uint64_t) 15);
+
+    while (i < full_blocks_one && j < full_blocks_two) {
+        max_one = keys_vector_one[i + 15];
+        max_two = keys_vector_two[j + 15];
+
+        if (max_one >= keys_vector_two[j] && max_two >= keys_vector_one[i]) {
+            block_one = _mm512_loadu_si512((const void*) (keys_vector_one + i));
+            block_two = _mm512_loadu_si512((const void*) (keys_vector_two + j));
+            for (r = 0; r < 16; r++) {
+                mask = (uint32_t) _mm512_cmpeq_epi32_mask(block_one, block_two);
+                while (mask) {
+                    p = (uint32_t) __builtin_ctz(mask);
+                    result += values_vector_one[i + p] * values_vector_two[j + ((p + r) & 15)];
+                    mask &= mask - 1;
+                }
+                block_two = _mm512_alignr_epi32(block_two, block_two, 1);
+            }
+        }
+
+        if (max_one <= max_two) i += 16;
+        if (max_two <= max_one) j += 16;
+    }
+
+    return result + dot_merge_tail(keys_vector_one, values_vector_one, non_zero_count_vector_one, i
+                                   , keys_vector_two, values_vector_two, non_zero_count_vector_two, j);
+}
+
+#endif /* FCL_DOT_X86_DISPATCH */
+
+static dot_kernel_function dot_kernel = NULL;
+
+static dot_kernel_function select_dot_kernel() {
+#ifdef FCL_DOT_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return dot_avx512;
+    if (__builtin_cpu_supports("avx2")) return dot_avx2;
+    if (__builtin_cpu_supports("sse4.2")) return dot_sse42;
+#endif
+    return dot_scalar;
+}
+
+const char* get_dot_kernel_name() {
+    if (dot_kernel == NULL) dot_kernel = select_dot_kernel();
+#ifdef FCL_DOT_X86_DISPATCH
+    if (dot_kernel == dot_avx512) return "avx512";
+    if (dot_kernel == dot_avx2) return "avx2";
+    if (dot_kernel == dot_sse42) return "sse4.2";
+#endif
+    return "scalar";
+}
+
 VALUE_TYPE dot(KEY_TYPE *keys_vector_one
                                 , VALUE_TYPE *values_vector_one
                                 , uint64_t non_zero_count_vector_one
@@ -9,28 +294,23 @@ VALUE_TYPE dot(KEY_TYPE *keys_vector_one
                                 , VALUE_TYPE *values_vector_two
                                 , uint64_t non_zero_count_vector_two) {
 
-    VALUE_TYPE result;
-    uint64_t next_key_vector_two;
-    uint64_t nnz_counter_vector_two;
-    uint64_t nnz_counter_vector_one;
-
-    result = 0;
-    nnz_counter_vector_two = 0;
-    if (non_zero_count_vector_one == 0 || non_zero_count_vector_two == 0) return result;
-    next_key_vector_two = keys_vector_two[nnz_counter_vector_two];
-    for(nnz_counter_vector_one = 0; nnz_counter_vector_one < non_zero_count_vector_one; nnz_counter_vector_one++) {
-        while (nnz_counter_vector_two < (non_zero_count_vector_two - 1)
-               && keys_vector_one[nnz_counter_vector_one] > next_key_vector_two) {
-            nnz_counter_vector_two = nnz_counter_vector_two + 1;
-            next_key_vector_two = keys_vector_two[nnz_counter_vector_two];
-        }
+    if (non_zero_count_vector_one == 0 || non_zero_count_vector_two == 0) return 0;
 
-        if (keys_vector_one[nnz_counter_vector_one] == next_key_vector_two) {
-            result += values_vector_one[nnz_counter_vector_one] * values_vector_two[nnz_counter_vector_two];
-        }
+    if (non_zero_count_vector_one > DOT_GALLOPING_RATIO * non_zero_count_vector_two) {
+        return dot_galloping(keys_vector_two, values_vector_two, non_zero_count_vector_two
+                             , keys_vector_one, values_vector_one, non_zero_count_vector_one);
+    }
 
+    if (non_zero_count_vector_two > DOT_GALLOPING_RATIO * non_zero_count_vector_one) {
+        return dot_galloping(keys_vector_one, values_vector_one, non_zero_count_vector_one
+                             , keys_vector_two, values_vector_two, non_zero_count_vector_two);
     }
-    return result;
+
+    /* the kernel is resolved once, concurrent first calls all store the same pointer */
+    if (dot_kernel == NULL) dot_kernel = select_dot_kernel();
+
+    return dot_kernel(keys_vector_one, values_vector_one, non_zero_count_vector_one
+                      , keys_vector_two, values_vector_two, non_zero_count_vector_two);
 }
 
 VALUE_TYPE dot_binary_search(KEY_TYPE *keys_vector_one
@@ -40,7 +320,7 @@ VALUE_TYPE dot_binary_search(KEY_TYPE *keys_vector_one
                                 , VALUE_TYPE *values_vector_two
                                 , uint64_t non_zero_count_vector_two) {
 
-    VALUE_TYPE result;
+    ACCUMULATOR_TYPE result;
     uint64_t length_left_vec1;
     uint64_t length_right_vec1;
     uint64_t length_left_vec2;
@@ -117,6 +397,104 @@ VALUE_TYPE euclid_vector(KEY_TYPE *keys_vector_one
                  , 0.0 ) ) ;
 }
 
+VALUE_TYPE dot_sparse_dense(KEY_TYPE *keys_vector
+                            , VALUE_TYPE *values_vector
+                            , uint64_t non_zero_count_vector
+                            , VALUE_TYPE *dense_vector) {
+    ACCUMULATOR_TYPE result_0, result_1, result_2, result_3;
+    uint64_t i, unrolled_end;
+
+    /* independent accumulators keep the gathered multiply-adds from
+     * waiting on each other */
+    result_0 = 0;
+    result_1 = 0;
+    result_2 = 0;
+    result_3 = 0;
+    unrolled_end = non_zero_count_vector & ~((uint64_t) 3);
+
+    for (i = 0; i < unrolled_end; i += 4) {
+        result_0 += values_vector[i] * dense_vector[keys_vector[i]];
+        result_1 += values_vector[i + 1] * dense_vector[keys_vector[i + 1]];
+        result_2 += values_vector[i + 2] * dense_vector[keys_vector[i + 2]];
+        result_3 += values_vector[i + 3] * dense_vector[keys_vector[i + 3]];
+    }
+
+    for (; i < non_zero_count_vector; i++) {
+        result_0 += values_vector[i] * dense_vector[keys_vector[i]];
+    }
+
+    return (result_0 + result_1) + (result_2 + result_3);
+}
+
+VALUE_TYPE euclid_vector_sparse_dense(KEY_TYPE *keys_vector
+                                      , VALUE_TYPE *values_vector
+                                      , uint64_t non_zero_count_vector
+                                      , VALUE_TYPE *dense_vector
+                                      , VALUE_TYPE vector_one_length_squared
+                                      , VALUE_TYPE vector_two_length_squared) {
+
+    return sqrt( value_type_max( vector_one_length_squared
+                      + vector_two_length_squared
+                      - 2
+                      * dot_sparse_dense(keys_vector
+                                         , values_vector
+                                         , non_zero_count_vector
+                                         , dense_vector)
+                 , 0.0 ) ) ;
+}
+
+uint64_t get_compressed_keys_size(KEY_TYPE* keys, uint64_t nnz) {
+    uint64_t j, size;
+    KEY_TYPE previous_key;
+
+    size = 0;
+    /* previous_key + 1 wraps around to 0 for the first key */
+    previous_key = KEY_TYPE_MAX;
+    for (j = 0; j < nnz; j++) {
+        size += 1;
+        if (keys[j] - previous_key - 1 >= COMPRESSED_KEY_ESCAPE) size += sizeof(KEY_TYPE);
+        previous_key = keys[j];
+    }
+    return size;
+}
+
+void compress_keys(KEY_TYPE* keys, uint64_t nnz, uint8_t* key_stream) {
+    uint64_t j;
+    KEY_TYPE previous_key, gap;
+
+    previous_key = KEY_TYPE_MAX;
+    for (j = 0; j < nnz; j++) {
+        gap = keys[j] - previous_key - 1;
+        if (gap < COMPRESSED_KEY_ESCAPE) {
+            *key_stream = (uint8_t) gap;
+            key_stream += 1;
+        } else {
+            *key_stream = COMPRESSED_KEY_ESCAPE;
+            memcpy(key_stream + 1, keys + j, sizeof(KEY_TYPE));
+            key_stream += 1 + sizeof(KEY_TYPE);
+        }
+        previous_key = keys[j];
+    }
+}
+
+void decompress_keys(uint8_t* key_stream, uint64_t nnz, KEY_TYPE* keys) {
+    uint64_t j;
+    KEY_TYPE key;
+
+    /* key + 1 wraps around to 0 for the first key */
+    key = KEY_TYPE_MAX;
+    for (j = 0; j < nnz; j++) {
+        if (*key_stream != COMPRESSED_KEY_ESCAPE) {
+            key = key + 1 + *key_stream;
+            key_stream += 1;
+        } else {
+            memcpy(&key, key_stream + 1, sizeof(KEY_TYPE));
+            key_stream += 1 + sizeof(KEY_TYPE);
+        }
+        keys[j] = key;
+    }
+}
+
 uint64_t get_blockvector_nnz(KEY_TYPE* keys, VALUE_TYPE* values, uint64_t nnz, uint64_t keys_per_block) {
     uint64_t nnz_bv, j;
     uint64_t current_chunk, new_chunk, initialized;
@@ -127,7 +505,7 @@ uint64_t get_blockvector_nnz(KEY_TYPE* keys, VALUE_TYPE* values, uint64_t nnz, u
     initialized = 0;
 
     for (j = 0; j < nnz; j++) {
-        current_val = pow(values[j], 2.0);
+        current_val = values[j] * values[j];
         new_chunk = keys[j] / keys_per_block;
         if (current_val > 0) {
             if (initialized == 0) {
@@ -156,21 +534,22 @@ void fill_blockvector(KEY_TYPE* keys
 
     initialized = 0;
     current_chunk = 0;
+    *bv_nnz = 0;
 
     for (j = 0; j < nnz; j++) {
-        current_val = pow(values[j], 2.0);
+        current_val = values[j] * values[j];
         new_chunk = keys[j] / keys_per_block;
         if (current_val > 0) {
-            if (initialized == 0) {
+            if (initialized == 0 || current_chunk != new_chunk) {
+                /* start a new block. the output buffers do not need to be zeroed */
                 initialized = 1;
-                *bv_nnz = 1;
+                (*bv_nnz)++;
+                current_chunk = new_chunk;
+                blockvector_keys[*bv_nnz - 1] = current_chunk;
+                blockvector_values[*bv_nnz - 1] = current_val;
             } else {
-                if (current_chunk != new_chunk) (*bv_nnz)++;
+                blockvector_values[*bv_nnz - 1] += current_val;
             }
-            current_chunk = new_chunk;
-
-            blockvector_keys[*bv_nnz - 1] = current_chunk;
-            blockvector_values[*bv_nnz - 1] += current_val;
         }
     }
 
@@ -10,9 +10,10 @@
  * @param[in] values values of the sparse vector
  * @param[in] nnz Length of keys/values
  * @param[in] keys_per_block Is the number of keys to combine to one block.
- * @param blockvector_keys of the block vector
- * @param blockvector_values of the block vector
- * @param bv_nnz Length of blockvector_keys/blockvector_values
+ * @param[out] blockvector_keys of the block vector (needs space for at least nnz keys)
+ * @param[out] blockvector_values of the block vector (needs space for at least nnz values,
+ *             does not need to be zeroed)
+ * @param[out] bv_nnz Length of blockvector_keys/blockvector_values
  */
 void fill_blockvector(KEY_TYPE* keys
                       , VALUE_TYPE* values
@@ -41,6 +42,11 @@ uint64_t get_blockvector_nnz(KEY_TYPE* keys
 /**
  * @brief Calculate dot product between two sparse vectors.
  *
+ *        The intersection of the keys is done with an AVX-512/AVX2/SSE4.2 kernel
+ *        (selected at runtime depending on the cpu, compile with -DFCL_NO_SIMD to
+ *        always use the scalar merge). If one vector is much shorter than the other
+ *        the keys of the short vector are searched with a galloping search instead.
+ *
  * @param[in] keys_vector_one Array of keys first vector.
  * @param[in] values_vector_one Array of keys first vector.
  * @param[in] non_zero_count_vector_one Number of non zero values first vector.
@@ -78,5 +84,79 @@ VALUE_TYPE euclid_vector(KEY_TYPE *keys_vector_one
                         , VALUE_TYPE vector_one_length_squared
                         , VALUE_TYPE vector_two_length_squared);
 
+/**
+ * @brief Calculate dot product between a sparse vector and a dense vector.
+ *
+ * @param[in] keys_vector Array of keys of the sparse vector.
+ * @param[in] values_vector Array of values of the sparse vector.
+ * @param[in] non_zero_count_vector Number of non zero values of the sparse vector.
+ * @param[in] dense_vector Dense vector which has at least max(keys_vector) + 1 elements.
+ * @return Result of the dot product.
+ */
+VALUE_TYPE dot_sparse_dense(KEY_TYPE *keys_vector
+                            , VALUE_TYPE *values_vector
+                            , uint64_t non_zero_count_vector
+                            , VALUE_TYPE *dense_vector);
+
+/**
+ * @brief Calculate euclidean distance between a sparse and a dense vector.
+ *
+ * @param[in] keys_vector Array of keys of the sparse vector.
+ * @param[in] values_vector Array of values of the sparse vector.
+ * @param[in] non_zero_count_vector Number of non zero values of the sparse vector.
+ * @param[in] dense_vector Dense vector which has at least max(keys_vector) + 1 elements.
+ * @param[in] vector_one_length_squared Length of sparse vector squared.
+ * @param[in] vector_two_length_squared Length of dense vector squared.
+ * @return Result of euclidean distance calculation.
+ */
+VALUE_TYPE euclid_vector_sparse_dense(KEY_TYPE *keys_vector
+                                      , VALUE_TYPE *values_vector
+                                      , uint64_t non_zero_count_vector
+                                      , VALUE_TYPE *dense_vector
+                                      , VALUE_TYPE vector_one_length_squared
+                                      , VALUE_TYPE vector_two_length_squared);
+
+/*
+ * Compressed keys: The keys of a sparse vector are stored as a byte stream of gaps
+ * (key - previous_key - 1, the first key is stored as is). A gap smaller than
+ * COMPRESSED_KEY_ESCAPE is stored in a single byte. Otherwise the escape byte is
+ * followed by the complete key (sizeof(KEY_TYPE) bytes, native byte order).
+ */
+#define COMPRESSED_KEY_ESCAPE 255
+
+/**
+ * @brief Number of bytes needed to store the keys of a sparse vector compressed.
+ *
+ * @param[in] keys of the sparse vector
+ * @param[in] nnz Length of keys
+ * @return Number of bytes written by compress_keys.
+ */
+uint64_t get_compressed_keys_size(KEY_TYPE* keys, uint64_t nnz);
+
+/**
+ * @brief Compress the keys of a sparse vector.
+ *
+ * @param[in] keys of the sparse vector
+ * @param[in] nnz Length of keys
+ * @param[out] key_stream Needs to hold get_compressed_keys_size(keys, nnz) bytes.
+ */
+void compress_keys(KEY_TYPE* keys, uint64_t nnz, uint8_t* key_stream);
+
+/**
+ * @brief Decode the compressed keys of a sparse vector. The decoded keys can be
+ *        used with every kernel for uncompressed sparse vectors (e.g. dot).
+ *
+ * @param[in] key_stream Compressed keys of the sparse vector (see compress_keys).
+ * @param[in] nnz Number of keys of the sparse vector.
+ * @param[out] keys Needs to hold nnz keys.
+ */
+void decompress_keys(uint8_t* key_stream, uint64_t nnz, KEY_TYPE* keys);
+
+/**
+ * @brief Get the name of the kernel used by dot() on this cpu.
+ *
+ * @return One of "avx512", "avx2", "sse4.2" or "scalar".
+ */
+const char* get_dot_kernel_name();
 
 #endif /* SPARSE_VECTOR_MATH_H */